@@ -61,6 +61,8 @@
 #ifdef CFG_PRINTF_USBCDC
   #include "core/usbcdc/cdcuser.h"
   static char usbcdcBuf [32];
+  static int usbcdcBufLen = 0;
+  static int usbcdcBufPos = 0;
 #endif
 
 #if CFG_INTERFACE_ENABLEIRQ == 1
@@ -70,16 +72,62 @@
 static uint8_t msg[CFG_INTERFACE_MAXMSGSIZE];
 static uint8_t *msg_ptr;
 
+// Resumable commands currently being executed.  Tasks can be nested
+// (a script running a command that is itself resumable, for example),
+// in which case only the most recently started task is called.
+static cmdTask_t cmdTask[CMD_TASK_MAXDEPTH];
+static void *cmdTaskCtx[CMD_TASK_MAXDEPTH];
+static uint8_t cmdTaskDepth = 0;
+
+static void cmdMenu();
+
 /**************************************************************************/
 /*! 
     @brief  Polls the relevant incoming message queue to see if anything
             is waiting to be processed.
+
+            If a resumable command is currently executing (see
+            cmdTaskStart), it is given one time slice instead and any
+            incoming data is left in the UART or USB CDC buffer, meaning
+            that new commands are queued until the running command has
+            finished.
 */
 /**************************************************************************/
 void cmdPoll()
 {
+  // Give the current task a time slice if one is executing
+  if (cmdTaskDepth)
+  {
+    uint8_t t = cmdTaskDepth - 1;
+    if (cmdTask[t](cmdTaskCtx[t]) == CMD_TASK_CONTINUE)
+    {
+      return;
+    }
+
+    // Remove the task from the stack, resuming the parent task (if any)
+    // on the next pass.  Note that the task may have started a child
+    // task before returning, in which case that child sits above it.
+    if (t < cmdTaskDepth - 1)
+    {
+      cmdTask[t] = cmdTask[t + 1];
+      cmdTaskCtx[t] = cmdTaskCtx[t + 1];
+    }
+    cmdTaskDepth--;
+    if (cmdTaskDepth)
+    {
+      return;
+    }
+
+    #if CFG_INTERFACE_ENABLEIRQ != 0
+    // Set the IRQ pin low to signal the end of a command
+    gpioSetValue(CFG_INTERFACE_IRQPORT, CFG_INTERFACE_IRQPIN, 0);
+    #endif
+    // Refresh the command prompt
+    cmdMenu();
+  }
+
   #if defined CFG_PRINTF_UART
-  while (uartRxBufferDataPending())
+  while (!cmdTaskDepth && uartRxBufferDataPending())
   {
     uint8_t c = uartRxBufferRead();
     cmdRx(c);
@@ -87,22 +135,102 @@ void cmdPoll()
   #endif
 
   #if defined CFG_PRINTF_USBCDC
-    int  numBytesToRead, numBytesRead, numAvailByte;
+    int  numBytesToRead, numAvailByte;
   
-    CDC_OutBufAvailChar (&numAvailByte);
-    if (numAvailByte > 0) 
+    // Only read a new block once the previous one has been consumed
+    if (usbcdcBufPos == usbcdcBufLen)
     {
-      numBytesToRead = numAvailByte > 32 ? 32 : numAvailByte; 
-      numBytesRead = CDC_RdOutBuf (&usbcdcBuf[0], &numBytesToRead);
-      int i;
-      for (i = 0; i < numBytesRead; i++) 
-      {  
-        cmdRx(usbcdcBuf[i]);   
+      usbcdcBufPos = usbcdcBufLen = 0;
+      CDC_OutBufAvailChar (&numAvailByte);
+      if (numAvailByte > 0) 
+      {
+        numBytesToRead = numAvailByte > 32 ? 32 : numAvailByte; 
+        usbcdcBufLen = CDC_RdOutBuf (&usbcdcBuf[0], &numBytesToRead);
       }
     }
+
+    // Stop as soon as a command starts a task, leaving any remaining
+    // characters for when the task has finished
+    while (!cmdTaskDepth && (usbcdcBufPos < usbcdcBufLen))
+    {
+      cmdRx(usbcdcBuf[usbcdcBufPos++]);
+    }
   #endif
 }
 
+/**************************************************************************/
+/*! 
+    @brief  Starts a resumable command.  This should be called from
+            inside a command handler that would otherwise block for a
+            long time (waiting on a touch event, a radio transmission,
+            etc.).  The handler sets up any state it needs, calls
+            cmdTaskStart and returns right away.  'task' will then be
+            called once per call to cmdPoll() until it returns
+            CMD_TASK_DONE, after which the command prompt is displayed.
+
+            While the task is executing, incoming data keeps buffering
+            in the UART or USB CDC RX buffer and will be handled once
+            the task has finished.
+
+            A task may itself call cmdParse, and the command it runs may
+            start another task.  The new task then runs to completion
+            before the parent task is resumed.  Up to CMD_TASK_MAXDEPTH
+            tasks can be nested this way.
+
+    @param[in]  task
+                The function to call on every pass through cmdPoll()
+    @param[in]  ctx
+                Pointer that will be passed back to 'task' (can be NULL)
+
+    @return     CMD_ERROR_NONE if the task was started, or CMD_ERROR_BUSY
+                if CMD_TASK_MAXDEPTH tasks are already executing
+
+    @section Example
+
+    @code
+    static cmdTaskStatus_t cmd_example_task(void *ctx)
+    {
+      if (systickGetTicks() < _exampleEndTick)
+      {
+        // Not done yet ... let the main loop do something else
+        return CMD_TASK_CONTINUE;
+      }
+      printf("Done%s", CFG_PRINTF_NEWLINE);
+      return CMD_TASK_DONE;
+    }
+
+    void cmd_example(uint8_t argc, char **argv)
+    {
+      _exampleEndTick = systickGetTicks() + 1000;
+      cmdTaskStart(cmd_example_task, NULL);
+    }
+    @endcode
+*/
+/**************************************************************************/
+cmdError_t cmdTaskStart(cmdTask_t task, void *ctx)
+{
+  if (cmdTaskDepth >= CMD_TASK_MAXDEPTH)
+  {
+    return CMD_ERROR_BUSY;
+  }
+
+  cmdTask[cmdTaskDepth] = task;
+  cmdTaskCtx[cmdTaskDepth] = ctx;
+  cmdTaskDepth++;
+
+  return CMD_ERROR_NONE;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Returns true if a resumable command is currently executing
+*/
+/**************************************************************************/
+bool cmdIsBusy(void)
+{
+  return cmdTaskDepth != 0;
+}
+
 /**************************************************************************/
 /*! 
     @brief  Handles a single incoming character.  If a new line is 
@@ -185,12 +313,23 @@ static void cmdMenu()
 
     @param[in]  cmd
                 The entire command string to be parsed
+
+    @return     CMD_ERROR_NONE if the command was found and dispatched,
+                otherwise the reason it was rejected.  Note that errors
+                reported by the command handlers themselves (invalid
+                values, etc.) are not reflected here.
+
+    @note       When called while a resumable command is executing (from
+                a script, for example) the IRQ pin and the command prompt
+                are left alone, since they belong to the outer command.
 */
 /**************************************************************************/
-void cmdParse(char *cmd)
+cmdError_t cmdParse(char *cmd)
 {
   size_t argc, i = 0;
   char *argv[30];
+  cmdError_t err = CMD_ERROR_NONE;
+  bool nested = cmdIsBusy();
 
   argv[i] = strtok(cmd, " ");
   do
@@ -199,6 +338,14 @@ void cmdParse(char *cmd)
   } while ((i < 30) && (argv[i] != NULL));
   
   argc = i;
+
+  // Ignore empty lines
+  if (argv[0] == NULL)
+  {
+    if (!nested) cmdMenu();
+    return CMD_ERROR_NONE;
+  }
+
   for (i=0; i < CMD_COUNT; i++)
   {
       if (!strcmp(argv[0], cmd_tbl[i].command))
@@ -218,6 +365,7 @@ void cmdParse(char *cmd)
           printf ("Too few arguments (%d expected)%s", cmd_tbl[i].minArgs, CFG_PRINTF_NEWLINE);
           printf ("%sType '%s ?' for more information%s%s", CFG_PRINTF_NEWLINE, cmd_tbl[i].command, CFG_PRINTF_NEWLINE, CFG_PRINTF_NEWLINE);
           #endif
+          err = CMD_ERROR_TOOFEWARGS;
         }
         else if ((argc - 1) > cmd_tbl[i].maxArgs)
         {
@@ -228,15 +376,21 @@ void cmdParse(char *cmd)
           printf ("Too many arguments (%d maximum)%s", cmd_tbl[i].maxArgs, CFG_PRINTF_NEWLINE);
           printf ("%sType '%s ?' for more information%s%s", CFG_PRINTF_NEWLINE, cmd_tbl[i].command, CFG_PRINTF_NEWLINE, CFG_PRINTF_NEWLINE);
           #endif
+          err = CMD_ERROR_TOOMANYARGS;
         }
         else
         {
           #if CFG_INTERFACE_ENABLEIRQ != 0
           // Set the IRQ pin high at start of a command
-          gpioSetValue(CFG_INTERFACE_IRQPORT, CFG_INTERFACE_IRQPIN, 1);
+          if (!nested) gpioSetValue(CFG_INTERFACE_IRQPORT, CFG_INTERFACE_IRQPIN, 1);
           #endif
           // Dispatch command to the appropriate function
           cmd_tbl[i].func(argc - 1, &argv [1]);
+          // If the command started a task, cmdPoll will finish it off
+          if (cmdIsBusy())
+          {
+            return CMD_ERROR_NONE;
+          }
           #if CFG_INTERFACE_ENABLEIRQ  != 0
           // Set the IRQ pin low to signal the end of a command
           gpioSetValue(CFG_INTERFACE_IRQPORT, CFG_INTERFACE_IRQPIN, 0);
@@ -244,8 +398,8 @@ void cmdParse(char *cmd)
         }
 
         // Refresh the command prompt
-        cmdMenu();
-        return;
+        if (!nested) cmdMenu();
+        return err;
       }
   }
   // Command not recognized
@@ -258,7 +412,8 @@ void cmdParse(char *cmd)
   #endif
   #endif
 
-  cmdMenu();
+  if (!nested) cmdMenu();
+  return CMD_ERROR_UNKNOWNCOMMAND;
 }
 
 /**************************************************************************/
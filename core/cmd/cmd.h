@@ -52,9 +52,39 @@ typedef struct
   const char *parameters;
 } cmd_t;
 
+// Maximum number of nested resumable commands (a script running a
+// resumable command, for example)
+#define CMD_TASK_MAXDEPTH   (2)
+
+typedef enum
+{
+  CMD_ERROR_NONE            = 0,
+  CMD_ERROR_UNKNOWNCOMMAND  = 1,
+  CMD_ERROR_TOOFEWARGS      = 2,
+  CMD_ERROR_TOOMANYARGS     = 3,
+  CMD_ERROR_BUSY            = 4
+} cmdError_t;
+
+/**************************************************************************/
+/*!
+    Return codes for resumable (non-blocking) command tasks.  A task
+    returns CMD_TASK_CONTINUE to be called again on the next pass
+    through cmdPoll(), or CMD_TASK_DONE once it has finished.
+*/
+/**************************************************************************/
+typedef enum
+{
+  CMD_TASK_DONE       = 0,
+  CMD_TASK_CONTINUE   = 1
+} cmdTaskStatus_t;
+
+typedef cmdTaskStatus_t (*cmdTask_t)(void *ctx);
+
 void cmdPoll();
 void cmdRx(uint8_t c);
-void cmdParse(char *cmd);
+cmdError_t cmdParse(char *cmd);
 void cmdInit();
+cmdError_t cmdTaskStart(cmdTask_t task, void *ctx);
+bool cmdIsBusy(void);
 
 #endif
\ No newline at end of file
@@ -49,42 +49,88 @@
 //struct _reent r = {0, (FILE*) 0, (FILE*) 1, (FILE*) 0};
 //struct _reent *_impure_ptr = &r;
 
+//------------------------------------------------------------------------------
+//         Local Types
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Output sink used by the formatting engine.  Every character produced by
+// vformat is handed to 'put', so the same engine can write into a string
+// (sprintf, snprintf) or straight to the printf output (UART or USB CDC)
+// without an intermediate buffer.
+//------------------------------------------------------------------------------
+typedef struct _printf_sink_t
+{
+    void        (*put)(struct _printf_sink_t *pSink, char c);
+    char        *pStr;      // Next free location (string sinks only)
+    size_t      length;     // Space left, including the final '\0'
+    signed int  num;        // Number of characters written so far
+} printf_sink_t;
+
+// Implemented in sysinit.c
+void __putchar(const char c);
+void __putflush(void);
+
 //------------------------------------------------------------------------------
 //         Local Functions
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-// Writes a character inside the given string. Returns 1.
-// \param pStr  Storage string.
+// String sink.  Stores the character if there is still room for it and the
+// terminating '\0', otherwise the character is dropped.
+//------------------------------------------------------------------------------
+static void StringSink(printf_sink_t *pSink, char c)
+{
+    if (pSink->length > 1) {
+
+        *pSink->pStr++ = c;
+        pSink->length--;
+        pSink->num++;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Output sink.  Sends the character to the printf output (see __putchar).
+//------------------------------------------------------------------------------
+static void OutputSink(printf_sink_t *pSink, char c)
+{
+    __putchar(c);
+    pSink->num++;
+}
+
+//------------------------------------------------------------------------------
+// Writes a character to the given sink. Returns 1.
+// \param pSink  Output sink.
 // \param c  Character to write.
 //------------------------------------------------------------------------------
-signed int append_char(char *pStr, char c)
+static signed int append_char(printf_sink_t *pSink, char c)
 {
-    *pStr = c;
+    pSink->put(pSink, c);
     return 1;
 }
 
 //------------------------------------------------------------------------------
-// Writes a string inside the given string.
-// Returns the size of the written
-// string.
-// \param pStr  Storage string.
+// Writes a string to the given sink.
+// Returns the size of the written string.
+// \param pSink  Output sink.
+// \param fill  Fill character.
+// \param width  Minimum string width.
 // \param pSource  Source string.
 //------------------------------------------------------------------------------
-signed int PutString(char *pStr, char fill, signed int width, const char *pSource)
+static signed int PutString(printf_sink_t *pSink, char fill, signed int width, const char *pSource)
 {
     signed int num = 0;
 
     while (*pSource != 0) {
 
-        *pStr++ = *pSource++;
+        append_char(pSink, *pSource++);
         num++;
     }
 
 	width -= num;
 	while (width > 0) {
 
-        *pStr++ = fill;
+        append_char(pSink, fill);
 		num++;
 		width--;
 	}
@@ -93,16 +139,16 @@ signed int PutString(char *pStr, char fill, signed int width, const char *pSourc
 }
 
 //------------------------------------------------------------------------------
-// Writes an unsigned int inside the given string, using the provided fill &
+// Writes an unsigned int to the given sink, using the provided fill &
 // width parameters.
 // Returns the size in characters of the written integer.
-// \param pStr  Storage string.
+// \param pSink  Output sink.
 // \param fill  Fill character.
 // \param width  Minimum integer width.
 // \param value  Integer value.
 //------------------------------------------------------------------------------
-signed int PutUnsignedInt(
-    char *pStr,
+static signed int PutUnsignedInt(
+    printf_sink_t *pSink,
     char fill,
     signed int width,
     unsigned int value)
@@ -115,38 +161,35 @@ signed int PutUnsignedInt(
     // Recursively write upper digits
     if ((value / 10) > 0) {
 
-        num = PutUnsignedInt(pStr, fill, width, value / 10);
-        pStr += num;
+        num = PutUnsignedInt(pSink, fill, width, value / 10);
     }
     // Write filler characters
     else {
 
         while (width > 0) {
 
-            append_char(pStr, fill);
-            pStr++;
-            num++;
+            num += append_char(pSink, fill);
             width--;
         }
     }
 
     // Write lower digit
-    num += append_char(pStr, (value % 10) + '0');
+    num += append_char(pSink, (value % 10) + '0');
 
     return num;
 }
 
 //------------------------------------------------------------------------------
-// Writes a signed int inside the given string, using the provided fill & width
+// Writes a signed int to the given sink, using the provided fill & width
 // parameters.
 // Returns the size of the written integer.
-// \param pStr  Storage string.
+// \param pSink  Output sink.
 // \param fill  Fill character.
 // \param width  Minimum integer width.
 // \param value  Signed integer value.
 //------------------------------------------------------------------------------
-signed int PutSignedInt(
-    char *pStr,
+static signed int PutSignedInt(
+    printf_sink_t *pSink,
     char fill,
     signed int width,
     signed int value)
@@ -172,13 +215,12 @@ signed int PutSignedInt(
 
         if (value < 0) {
         
-            num = PutSignedInt(pStr, fill, width, -(absolute / 10));
+            num = PutSignedInt(pSink, fill, width, -(absolute / 10));
         }
         else {
 
-            num = PutSignedInt(pStr, fill, width, absolute / 10);
+            num = PutSignedInt(pSink, fill, width, absolute / 10);
         }
-        pStr += num;
     }
     else {
 
@@ -191,38 +233,35 @@ signed int PutSignedInt(
         // Write filler characters
         while (width > 0) {
 
-            append_char(pStr, fill);
-            pStr++;
-            num++;
+            num += append_char(pSink, fill);
             width--;
         }
 
         // Write sign
         if (value < 0) {
 
-            num += append_char(pStr, '-');
-            pStr++;
+            num += append_char(pSink, '-');
         }
     }
 
     // Write lower digit
-    num += append_char(pStr, (absolute % 10) + '0');
+    num += append_char(pSink, (absolute % 10) + '0');
 
     return num;
 }
 
 //------------------------------------------------------------------------------
-// Writes an hexadecimal value into a string, using the given fill, width &
+// Writes an hexadecimal value to the given sink, using the given fill, width &
 // capital parameters.
 // Returns the number of char written.
-// \param pStr  Storage string.
+// \param pSink  Output sink.
 // \param fill  Fill character.
 // \param width  Minimum integer width.
 // \param maj  Indicates if the letters must be printed in lower- or upper-case.
 // \param value  Hexadecimal value.
 //------------------------------------------------------------------------------
-signed int PutHexa(
-    char *pStr,
+static signed int PutHexa(
+    printf_sink_t *pSink,
     char fill,
     signed int width,
     unsigned char maj,
@@ -236,17 +275,14 @@ signed int PutHexa(
     // Recursively output upper digits
     if ((value >> 4) > 0) {
 
-        num += PutHexa(pStr, fill, width, maj, value >> 4);
-        pStr += num;
+        num += PutHexa(pSink, fill, width, maj, value >> 4);
     }
     // Write filler chars
     else {
 
         while (width > 0) {
 
-            append_char(pStr, fill);
-            pStr++;
-            num++;
+            num += append_char(pSink, fill);
             width--;
         }
     }
@@ -254,15 +290,15 @@ signed int PutHexa(
     // Write current digit
     if ((value & 0xF) < 10) {
 
-        append_char(pStr, (value & 0xF) + '0');
+        append_char(pSink, (value & 0xF) + '0');
     }
     else if (maj) {
 
-        append_char(pStr, (value & 0xF) - 10 + 'A');
+        append_char(pSink, (value & 0xF) - 10 + 'A');
     }
     else {
 
-        append_char(pStr, (value & 0xF) - 10 + 'a');
+        append_char(pSink, (value & 0xF) - 10 + 'a');
     }
     num++;
 
@@ -270,46 +306,32 @@ signed int PutHexa(
 }
 
 //------------------------------------------------------------------------------
-//         Global Functions
-//------------------------------------------------------------------------------
-
-//------------------------------------------------------------------------------
-/// Stores the result of a formatted string into another string. Format
-/// arguments are given in a va_list instance.
-/// Return the number of characters written.
-/// \param pStr    Destination string.
-/// \param length  Length of Destination string.
-/// \param pFormat Format string.
-/// \param ap      Argument list.
+// Formatting engine shared by all the printf variants.  Parses the format
+// string and hands every resulting character to the given sink.
+// Returns the number of characters accepted by the sink, or EOF if an
+// unsupported conversion was found.
+// \param pSink    Output sink.
+// \param pFormat  Format string.
+// \param ap       Argument list.
 //------------------------------------------------------------------------------
-signed int vsnprintf(char *pStr, size_t length, const char *pFormat, va_list ap)
+static signed int vformat(printf_sink_t *pSink, const char *pFormat, va_list ap)
 {
     char          fill;
     unsigned char width;
-    signed int    num = 0;
-    signed int    size = 0;
-
-    // Clear the string
-    if (pStr) {
-
-        *pStr = 0;
-    }
 
     // Phase string
-    while (*pFormat != 0 && size < length) {
+    while (*pFormat != 0) {
 
         // Normal character
         if (*pFormat != '%') {
 
-            *pStr++ = *pFormat++;
-            size++;
+            append_char(pSink, *pFormat++);
         }
         // Escaped '%'
         else if (*(pFormat+1) == '%') {
 
-            *pStr++ = '%';
+            append_char(pSink, '%');
             pFormat += 2;
-            size++;
         }
         // Token delimiter
         else {
@@ -337,42 +359,54 @@ signed int vsnprintf(char *pStr, size_t length, const char *pFormat, va_list ap)
                 pFormat++;
             }
 
-            // Check if there is enough space
-            if (size + width > length) {
-
-                width = length - size;
-            }
-        
             // Parse type
             switch (*pFormat) {
             case 'd': 
-            case 'i': num = PutSignedInt(pStr, fill, width, va_arg(ap, signed int)); break;
-            case 'u': num = PutUnsignedInt(pStr, fill, width, va_arg(ap, unsigned int)); break;
-            case 'x': num = PutHexa(pStr, fill, width, 0, va_arg(ap, unsigned int)); break;
-            case 'X': num = PutHexa(pStr, fill, width, 1, va_arg(ap, unsigned int)); break;
-            case 's': num = PutString(pStr, fill, width, va_arg(ap, char *)); break;
-            case 'c': num = append_char(pStr, va_arg(ap, unsigned int)); break;
+            case 'i': PutSignedInt(pSink, fill, width, va_arg(ap, signed int)); break;
+            case 'u': PutUnsignedInt(pSink, fill, width, va_arg(ap, unsigned int)); break;
+            case 'x': PutHexa(pSink, fill, width, 0, va_arg(ap, unsigned int)); break;
+            case 'X': PutHexa(pSink, fill, width, 1, va_arg(ap, unsigned int)); break;
+            case 's': PutString(pSink, fill, width, va_arg(ap, char *)); break;
+            case 'c': append_char(pSink, va_arg(ap, unsigned int)); break;
             default:
                 return EOF;
             }
 
             pFormat++;
-            pStr += num;
-            size += num;
         }
     }
 
-    // NULL-terminated (final \0 is not counted)
-    if (size < length) {
+    return pSink->num;
+}
 
-        *pStr = 0;
-    }
-    else {
+//------------------------------------------------------------------------------
+//         Global Functions
+//------------------------------------------------------------------------------
 
-        *(--pStr) = 0;
-        size--;
+//------------------------------------------------------------------------------
+/// Stores the result of a formatted string into another string. Format
+/// arguments are given in a va_list instance.
+/// Return the number of characters written.
+/// \param pStr    Destination string.
+/// \param length  Length of Destination string.
+/// \param pFormat Format string.
+/// \param ap      Argument list.
+//------------------------------------------------------------------------------
+signed int vsnprintf(char *pStr, size_t length, const char *pFormat, va_list ap)
+{
+    printf_sink_t sink = { StringSink, pStr, length, 0 };
+    signed int    size;
+
+    if (!pStr || !length) {
+
+        return 0;
     }
 
+    size = vformat(&sink, pFormat, ap);
+
+    // NULL-terminated (final \0 is not counted)
+    *sink.pStr = 0;
+
     return size;
 }
 
@@ -399,7 +433,8 @@ signed int snprintf(char *pString, size_t length, const char *pFormat, ...)
 
 //------------------------------------------------------------------------------
 /// Stores the result of a formatted string into another string. Format
-/// arguments are given in a va_list instance.
+/// arguments are given in a va_list instance.  The output is limited to
+/// CFG_PRINTF_MAXSTRINGSIZE characters (including the final '\0').
 /// Return the number of characters written.
 /// \param pString  Destination string.
 /// \param pFormat  Format string.
@@ -412,24 +447,21 @@ signed int vsprintf(char *pString, const char *pFormat, va_list ap)
 
 //------------------------------------------------------------------------------
 /// Outputs a formatted string on the DBGU stream. Format arguments are given
-/// in a va_list instance.
+/// in a va_list instance.  Characters are passed to __putchar as they are
+/// generated, so the output isn't limited in size and no intermediate
+/// buffer is required.
 /// \param pFormat  Format string
 /// \param ap  Argument list.
 //------------------------------------------------------------------------------
 signed int vprintf(const char *pFormat, va_list ap)
 {
-  char pStr[CFG_PRINTF_MAXSTRINGSIZE];
-  char pError[] = "stdio.c: increase CFG_PRINTF_MAXSTRINGSIZE\r\n";
-  
-  // Write formatted string in buffer
-  if (vsprintf(pStr, pFormat, ap) >= CFG_PRINTF_MAXSTRINGSIZE) {
-    
-    puts(pError);
-    while (1); // Increase CFG_PRINTF_MAXSTRINGSIZE
-  }
-  
-  // Display string
-  return puts(pStr);
+    printf_sink_t sink = { OutputSink, 0, 0, 0 };
+    signed int    result;
+
+    result = vformat(&sink, pFormat, ap);
+    __putflush();
+
+    return result;
 }
 
 //------------------------------------------------------------------------------
@@ -38,43 +38,196 @@
 #include <string.h>
 
 //------------------------------------------------------------------------------
-//         Global Functions
+//         Local Definitions
 //------------------------------------------------------------------------------
 
+// Word types used by the optimised routines below.  may_alias keeps GCC from
+// making type-based aliasing assumptions about the byte buffers we access
+// a word at a time.  uword_t is used for word loads from addresses that
+// aren't 4-byte aligned, which the Cortex-M3 handles in hardware for
+// LDR/STR (but not for LDM/STM).
+typedef unsigned int __attribute__((__may_alias__)) word_t;
+typedef struct { word_t w; } __attribute__((__packed__, __may_alias__)) uword_t;
+
+// Below this size the alignment fix-up costs more than it saves
+#define STRING_WORDCOPY_MIN     (8)
+
+#define WORD_ALIGNED(p)         ((((size_t)(p)) & 0x3) == 0)
+
+// Non-zero if any of the four bytes in w is zero
+#define WORD_HASZERO(w)         (((w) - 0x01010101UL) & ~(w) & 0x80808080UL)
+
 //------------------------------------------------------------------------------
-/// Copies data from a source buffer into a destination buffer. The two buffers
-/// must NOT overlap. Returns the destination buffer.
-/// \param pDestination  Destination buffer.
-/// \param pSource  Source buffer.
-/// \param num  Number of bytes to copy.
+//         Local Functions
 //------------------------------------------------------------------------------
-void * memcpy(void *pDestination, const void *pSource, size_t num)
+
+//------------------------------------------------------------------------------
+// Copies num bytes from pSource to pDestination, starting with the lowest
+// address.  The buffers may overlap as long as pDestination < pSource.
+// The destination is first brought to a word boundary, then data is moved
+// in 16 byte LDM/STM blocks (if the source is also aligned) or with
+// unaligned word loads (if it isn't), and the tail is copied bytewise.
+//------------------------------------------------------------------------------
+static void CopyForward(unsigned char *pDestination, const unsigned char *pSource, size_t num)
 {
-    unsigned char *pByteDestination;
-    unsigned char *pByteSource;
-    unsigned int *pAlignedSource = (unsigned int *) pSource;
-    unsigned int *pAlignedDestination = (unsigned int *) pDestination;
+    if (num >= STRING_WORDCOPY_MIN) {
 
-    // If num is more than 4 bytes, and both dest. and source are aligned,
-    // then copy dwords
-    if ((((unsigned int) pAlignedDestination & 0x3) == 0)
-        && (((unsigned int) pAlignedSource & 0x3) == 0)
-        && (num >= 4)) {
+        // Align destination
+        while (!WORD_ALIGNED(pDestination)) {
 
-        while (num >= 4) {
+            *pDestination++ = *pSource++;
+            num--;
+        }
 
-            *pAlignedDestination++ = *pAlignedSource++;
-            num -= 4;
+        if (WORD_ALIGNED(pSource)) {
+
+            word_t       *pWordDestination = (word_t *) pDestination;
+            const word_t *pWordSource = (const word_t *) pSource;
+
+            // Copy 16 byte blocks
+            while (num >= 16) {
+
+#if defined(__thumb2__)
+                __asm volatile ("ldmia %1!, {r3-r6}\n\t"
+                                "stmia %0!, {r3-r6}"
+                                : "+r" (pWordDestination), "+r" (pWordSource)
+                                :
+                                : "r3", "r4", "r5", "r6", "memory");
+#else
+                pWordDestination[0] = pWordSource[0];
+                pWordDestination[1] = pWordSource[1];
+                pWordDestination[2] = pWordSource[2];
+                pWordDestination[3] = pWordSource[3];
+                pWordDestination += 4;
+                pWordSource += 4;
+#endif
+                num -= 16;
+            }
+
+            // Copy remaining words
+            while (num >= 4) {
+
+                *pWordDestination++ = *pWordSource++;
+                num -= 4;
+            }
+
+            pDestination = (unsigned char *) pWordDestination;
+            pSource = (const unsigned char *) pWordSource;
+        }
+        else {
+
+            word_t *pWordDestination = (word_t *) pDestination;
+
+            // Unaligned loads, aligned stores
+            while (num >= 4) {
+
+                *pWordDestination++ = ((const uword_t *) pSource)->w;
+                pSource += 4;
+                num -= 4;
+            }
+
+            pDestination = (unsigned char *) pWordDestination;
         }
     }
 
     // Copy remaining bytes
-    pByteDestination = (unsigned char *) pAlignedDestination;
-    pByteSource = (unsigned char *) pAlignedSource;
     while (num--) {
 
-        *pByteDestination++ = *pByteSource++;
+        *pDestination++ = *pSource++;
     }
+}
+
+//------------------------------------------------------------------------------
+// Copies num bytes from pSource to pDestination, starting with the highest
+// address.  Used by memmove when the buffers overlap and
+// pDestination > pSource.
+//------------------------------------------------------------------------------
+static void CopyBackward(unsigned char *pDestination, const unsigned char *pSource, size_t num)
+{
+    pDestination += num;
+    pSource += num;
+
+    if (num >= STRING_WORDCOPY_MIN) {
+
+        // Align destination
+        while (!WORD_ALIGNED(pDestination)) {
+
+            *--pDestination = *--pSource;
+            num--;
+        }
+
+        if (WORD_ALIGNED(pSource)) {
+
+            word_t       *pWordDestination = (word_t *) pDestination;
+            const word_t *pWordSource = (const word_t *) pSource;
+
+            // Copy 16 byte blocks
+            while (num >= 16) {
+
+#if defined(__thumb2__)
+                __asm volatile ("ldmdb %1!, {r3-r6}\n\t"
+                                "stmdb %0!, {r3-r6}"
+                                : "+r" (pWordDestination), "+r" (pWordSource)
+                                :
+                                : "r3", "r4", "r5", "r6", "memory");
+#else
+                pWordDestination -= 4;
+                pWordSource -= 4;
+                pWordDestination[3] = pWordSource[3];
+                pWordDestination[2] = pWordSource[2];
+                pWordDestination[1] = pWordSource[1];
+                pWordDestination[0] = pWordSource[0];
+#endif
+                num -= 16;
+            }
+
+            // Copy remaining words
+            while (num >= 4) {
+
+                *--pWordDestination = *--pWordSource;
+                num -= 4;
+            }
+
+            pDestination = (unsigned char *) pWordDestination;
+            pSource = (const unsigned char *) pWordSource;
+        }
+        else {
+
+            word_t *pWordDestination = (word_t *) pDestination;
+
+            // Unaligned loads, aligned stores
+            while (num >= 4) {
+
+                pSource -= 4;
+                *--pWordDestination = ((const uword_t *) pSource)->w;
+                num -= 4;
+            }
+
+            pDestination = (unsigned char *) pWordDestination;
+        }
+    }
+
+    // Copy remaining bytes
+    while (num--) {
+
+        *--pDestination = *--pSource;
+    }
+}
+
+//------------------------------------------------------------------------------
+//         Global Functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// Copies data from a source buffer into a destination buffer. The two buffers
+/// must NOT overlap. Returns the destination buffer.
+/// \param pDestination  Destination buffer.
+/// \param pSource  Source buffer.
+/// \param num  Number of bytes to copy.
+//------------------------------------------------------------------------------
+void * memcpy(void *pDestination, const void *pSource, size_t num)
+{
+    CopyForward((unsigned char *) pDestination, (const unsigned char *) pSource, num);
 
     return pDestination;
 }
@@ -88,62 +241,131 @@ void * memcpy(void *pDestination, const void *pSource, size_t num)
 //------------------------------------------------------------------------------
 void * memset(void *pBuffer, int value, size_t num)
 {
-    unsigned char *pByteDestination;
-    unsigned int  *pAlignedDestination = (unsigned int *) pBuffer;
-    unsigned int  alignedValue = (value << 24) | (value << 16) | (value << 8) | value;
+    unsigned char *pByteDestination = (unsigned char *) pBuffer;
+    unsigned int  alignedValue;
+
+    value &= 0xFF;
+
+    if (num >= STRING_WORDCOPY_MIN) {
 
-    // Set words if possible
-    if ((((unsigned int) pAlignedDestination & 0x3) == 0) && (num >= 4)) {
+        word_t *pAlignedDestination;
+
+        // Unsigned, value << 24 overflows an int for value >= 0x80
+        alignedValue = (unsigned int) value * 0x01010101u;
+
+        // Set bytes up to the first word boundary
+        while (!WORD_ALIGNED(pByteDestination)) {
+
+            *pByteDestination++ = value;
+            num--;
+        }
+
+        // Set words
+        pAlignedDestination = (word_t *) pByteDestination;
+        while (num >= 16) {
+
+            pAlignedDestination[0] = alignedValue;
+            pAlignedDestination[1] = alignedValue;
+            pAlignedDestination[2] = alignedValue;
+            pAlignedDestination[3] = alignedValue;
+            pAlignedDestination += 4;
+            num -= 16;
+        }
         while (num >= 4) {
+
             *pAlignedDestination++ = alignedValue;
             num -= 4;
         }
+        pByteDestination = (unsigned char *) pAlignedDestination;
     }
+
     // Set remaining bytes
-    pByteDestination = (unsigned char *) pAlignedDestination;
     while (num--) {
         *pByteDestination++ = value;
     }
     return pBuffer;
 }
 
+//------------------------------------------------------------------------------
+/// Copies data from a source buffer into a destination buffer. The two buffers
+/// may overlap. Returns the destination buffer.
+/// \param s1  Destination buffer.
+/// \param s2  Source buffer.
+/// \param n   Number of bytes to copy.
+//------------------------------------------------------------------------------
 void* memmove(void *s1, const void *s2, size_t n)
 {
-  char *s=(char*)s2, *d=(char*)s1;
-  
-  if(d > s){
-    s+=n-1;
-    d+=n-1;
-    while(n){
-      *d--=*s--;
-      n--;
-    }
-  }else if(d < s)
-    while(n){
-      *d++=*s++;
-      n--;
-    }
+  unsigned char *d = (unsigned char *) s1;
+  const unsigned char *s = (const unsigned char *) s2;
+
+  if (d < s || d >= s + n)
+    CopyForward(d, s, n);
+  else if (d > s)
+    CopyBackward(d, s, n);
+
   return s1;
 }
 
+//------------------------------------------------------------------------------
+/// Compares the first len bytes of two buffers.
+/// Return 0 if equal, otherwise the difference between the first two
+/// bytes that don't match.
+/// \param av   Pointer to the 1st buffer.
+/// \param bv   Pointer to the 2nd buffer.
+/// \param len  Number of bytes to compare.
+//------------------------------------------------------------------------------
 int memcmp(const void *av, const void *bv, size_t len)
 {
   const unsigned char *a = av;
   const unsigned char *b = bv;
-  size_t i;
 
-  for (i=0; i<len; i++) 
+  if (len >= STRING_WORDCOPY_MIN)
   {
-    if (a[i] != b[i]) 
+    // Compare bytes until a is word aligned
+    while (!WORD_ALIGNED(a))
     {
-      return (int)(a[i] - b[i]);
+      if (*a != *b)
+      {
+        return (int)(*a - *b);
+      }
+      a++;
+      b++;
+      len--;
+    }
+
+    // Skip over matching words.  A mismatch is resolved bytewise below.
+    if (WORD_ALIGNED(b))
+    {
+      while ((len >= 4) && (*(const word_t *)a == *(const word_t *)b))
+      {
+        a += 4;
+        b += 4;
+        len -= 4;
+      }
+    }
+    else
+    {
+      while ((len >= 4) && (*(const word_t *)a == ((const uword_t *)b)->w))
+      {
+        a += 4;
+        b += 4;
+        len -= 4;
+      }
     }
   }
+
+  while (len--)
+  {
+    if (*a != *b)
+    {
+      return (int)(*a - *b);
+    }
+    a++;
+    b++;
+  }
   return 0;
 }
 
-
-
 //-----------------------------------------------------------------------------
 /// Search a character in the given string.
 /// Returns a pointer to the character location.
@@ -170,12 +392,30 @@ char * strchr(const char *pString, int character)
 //-----------------------------------------------------------------------------
 size_t strlen(const char *pString)
 {
-    unsigned int length = 0;
+    const char   *p = pString;
+    const word_t *pWord;
 
-    while(*pString++ != 0) {
-        length++;
+    // Check bytes up to the first word boundary
+    while (!WORD_ALIGNED(p)) {
+        if (*p == 0) {
+            return p - pString;
+        }
+        p++;
+    }
+
+    // Check a word at a time.  An aligned word never crosses the end of a
+    // memory region, so reading past the terminator is harmless.
+    pWord = (const word_t *) p;
+    while (!WORD_HASZERO(*pWord)) {
+        pWord++;
+    }
+
+    // Locate the terminator within the last word
+    p = (const char *) pWord;
+    while (*p != 0) {
+        p++;
     }
-    return length;
+    return p - pString;
 }
 
 
@@ -268,6 +508,27 @@ char * strncpy(char *pDestination, const char *pSource, size_t count)
 
 int strcmp(const char *s1, const char *s2)
 {
+  // If both strings share the same alignment, skip over equal words that
+  // don't contain the terminator and finish off bytewise
+  if (((size_t)s1 & 0x3) == ((size_t)s2 & 0x3))
+  {
+    while (!WORD_ALIGNED(s1))
+    {
+      if (*s1 != *s2)
+        return (*(unsigned char *)s1 - *(unsigned char *)s2);
+      if (*s1 == 0)
+        return (0);
+      s1++;
+      s2++;
+    }
+    while ((*(const word_t *)s1 == *(const word_t *)s2) &&
+           !WORD_HASZERO(*(const word_t *)s1))
+    {
+      s1 += 4;
+      s2 += 4;
+    }
+  }
+
   while (*s1 == *s2++)
     if (*s1++ == 0)
       return (0);
@@ -56,6 +56,7 @@
 
 void pmuSetupHW(void);
 void pmuRestoreHW(void);
+static void pmuDeepSleepTicks(uint32_t sleepCtrl, uint32_t wakeupTicks);
 
 
 /**************************************************************************/
@@ -217,6 +218,48 @@ void pmuSleep()
 */
 /**************************************************************************/
 void pmuDeepSleep(uint32_t sleepCtrl, uint32_t wakeupSeconds)
+{
+  pmuDeepSleepTicks(sleepCtrl, PMU_WDTCLOCKSPEED_HZ * wakeupSeconds);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Same as pmuDeepSleep, but the wakeup delay is given in
+            milliseconds.
+
+    The delay is timed by the WDT oscillator, which is only accurate to
+    about +/-40%, and the systick timer doesn't run in deep-sleep mode,
+    so the caller has to account for the time spent asleep itself
+    (see drivers/rf/chibi/chb_lpl.c for an example).
+
+    @param[in]  sleepCtrl  
+                The bits to set in the SCB_PDSLEEPCFG register
+    @param[in]  wakeupMs
+                The number of milliseconds to wait until the device will
+                wakeup (in steps of one WDT clock period, 0.128ms), or 0
+                to wait for an external wakeup event
+*/
+/**************************************************************************/
+void pmuDeepSleepMs(uint32_t sleepCtrl, uint32_t wakeupMs)
+{
+  uint32_t ticks = (PMU_WDTCLOCKSPEED_HZ * wakeupMs) / 1000;
+
+  // don't turn a short delay into no timed wakeup at all
+  if ((wakeupMs > 0) && (ticks == 0))
+  {
+    ticks = 1;
+  }
+  pmuDeepSleepTicks(sleepCtrl, ticks);
+}
+
+/**************************************************************************/
+/*! 
+    Enters deep-sleep mode, waking up after wakeupTicks periods of the
+    WDT oscillator (PMU_WDTCLOCKSPEED_HZ), or only on an external wakeup
+    event if wakeupTicks is 0
+*/
+/**************************************************************************/
+static void pmuDeepSleepTicks(uint32_t sleepCtrl, uint32_t wakeupTicks)
 {
   // Setup the board for deep sleep mode, shutting down certain
   // peripherals and remapping pins for lower power
@@ -227,7 +270,7 @@ void pmuDeepSleep(uint32_t sleepCtrl, uint32_t wakeupSeconds)
   SCB_SCR |= SCB_SCR_SLEEPDEEP;
 
   /* Configure system to run from WDT and set TMR32B0 for wakeup          */
-  if (wakeupSeconds > 0)
+  if (wakeupTicks > 0)
   {
     // Make sure WDTOSC isn't disabled in PDSLEEPCFG
     SCB_PDSLEEPCFG &= ~(SCB_PDSLEEPCFG_WDTOSC_PD);
@@ -246,7 +289,7 @@ void pmuDeepSleep(uint32_t sleepCtrl, uint32_t wakeupSeconds)
     IOCON_PIO0_1 |= IOCON_PIO0_1_FUNC_CT32B0_MAT2;
 
     /* Set appropriate timer delay */
-    TMR_TMR32B0MR0 = PMU_WDTCLOCKSPEED_HZ * wakeupSeconds;
+    TMR_TMR32B0MR0 = wakeupTicks;
   
     /* Configure match control register to raise an interrupt and reset on MR0 */
     TMR_TMR32B0MCR |= (TMR_TMR32B0MCR_MR0_INT_ENABLED | TMR_TMR32B0MCR_MR0_RESET_ENABLED);
@@ -45,6 +45,7 @@ void WAKEUP_IRQHandler( void );
 void pmuInit( void );
 void pmuSleep( void );
 void pmuDeepSleep(uint32_t sleepCtrl, uint32_t wakeupSeconds);
+void pmuDeepSleepMs(uint32_t sleepCtrl, uint32_t wakeupMs);
 void pmuPowerDown( void );
 
 #endif
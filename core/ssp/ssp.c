@@ -33,6 +33,27 @@
     // Print the results
     debug_printf("Ox%x ", response[0]);
     @endcode
+
+    sspTransfer, sspFill and sspDrain keep the 8-entry TX FIFO full
+    rather than waiting for every byte, which is what the SD card, SPI
+    flash and Chibi drivers use for block transfers.  sspSetDataSize
+    and sspTransfer16 move 16-bit frames, e.g. pixels to a TFT:
+
+    @code
+    uint8_t cmd[4] = { 0x03, 0x00, 0x10, 0x00 };
+    uint8_t page[256];
+
+    ssp0Select();
+    // Command and address, then read 256 bytes clocking out 0xFF
+    sspTransfer(0, cmd, NULL, sizeof(cmd));
+    sspDrain(0, page, sizeof(page), 0xFF);
+    ssp0Deselect();
+
+    // Paint 320x240 pixels red over a 16-bit SPI display interface
+    sspSetDataSize(0, 16);
+    sspFill(0, 0xF800, 320 * 240);
+    sspSetDataSize(0, 8);
+    @endcode
 	
     @section LICENSE
 
@@ -224,6 +245,91 @@ void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phas
   return;
 }
 
+/**************************************************************************/
+/*! 
+    @brief Changes the number of bits per frame
+
+    sspInit sets up 8-bit frames.  With more than 8 bits per frame use
+    sspTransfer16 or sspFill, which move a whole frame per FIFO entry
+    (e.g. one 16-bit pixel per write to an SPI display).  Any frame still
+    being sent goes out at the old size first.
+
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[in]  bits
+                Bits per frame (4..16)
+*/
+/**************************************************************************/
+void sspSetDataSize (uint8_t portNum, uint8_t bits)
+{
+  if ((portNum == 0) && (bits >= 4) && (bits <= 16))
+  {
+    while (SSP_SSP0SR & SSP_SSP0SR_BSY_BUSY);
+    SSP_SSP0CR0 = (SSP_SSP0CR0 & ~SSP_SSP0CR0_DSS_MASK) | (bits - 1);
+  }
+
+  return;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Moves length frames through SSP0, keeping the TX FIFO topped
+           up and emptying the RX FIFO as frames arrive
+
+    The SSP receives a frame for every frame it sends, so the frames sent
+    and not yet read back are what is in flight.  Never letting more than
+    SSP_FIFOSIZE be in flight means neither FIFO can overflow, whatever
+    the SPI clock rate, without having to wait for BSY between frames.
+
+    Every frame goes through DR as a uint16_t, which holds any frame
+    size (see sspSetDataSize): with smaller frames the bits above the
+    frame size are ignored on the way out and read back as 0.  size is
+    the number of bytes per frame in txBuf and rxBuf (1 or 2).  A NULL
+    txBuf sends fill for every frame and a NULL rxBuf throws away what
+    comes back.  All the public transfer functions go through here.
+*/
+/**************************************************************************/
+static void sspPipe (const void *txBuf, void *rxBuf, uint32_t length, uint16_t fill, uint8_t size)
+{
+  const uint8_t *tx = txBuf;
+  uint8_t *rx = rxBuf;
+  uint32_t txLeft = length;
+  uint32_t rxLeft = length;
+  uint16_t data;
+
+  while (rxLeft)
+  {
+    while (txLeft && (rxLeft - txLeft < SSP_FIFOSIZE))
+    {
+      data = fill;
+      if (tx)
+      {
+        data = (size == 2) ? *(const uint16_t *)tx : *tx;
+        tx += size;
+      }
+      SSP_SSP0DR = data;
+      txLeft--;
+    }
+    while (SSP_SSP0SR & SSP_SSP0SR_RNE_NOTEMPTY)
+    {
+      data = SSP_SSP0DR;
+      if (rx)
+      {
+        if (size == 2)
+        {
+          *(uint16_t *)rx = data;
+        }
+        else
+        {
+          *rx = data;
+        }
+        rx += size;
+      }
+      rxLeft--;
+    }
+  }
+}
+
 /**************************************************************************/
 /*! 
     @brief Sends a block of data to the SSP0 port
@@ -238,24 +344,9 @@ void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phas
 /**************************************************************************/
 void sspSend (uint8_t portNum, uint8_t *buf, uint32_t length)
 {
-  uint32_t i;
-  uint8_t Dummy = Dummy;
-
   if (portNum == 0)
   {
-    for (i = 0; i < length; i++)
-    {
-      /* Move on only if NOT busy and TX FIFO not full. */
-      while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_NOTFULL | SSP_SSP0SR_BSY_BUSY)) != SSP_SSP0SR_TNF_NOTFULL);
-      SSP_SSP0DR = *buf;
-      buf++;
-  
-      while ( (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY );
-      /* Whenever a byte is written, MISO FIFO counter increments, Clear FIFO 
-      on MISO. Otherwise, when SSP0Receive() is called, previous data byte
-      is left in the FIFO. */
-      Dummy = SSP_SSP0DR;
-    }
+    sspPipe(buf, NULL, length, 0, 1);
   }
 
   return; 
@@ -263,7 +354,8 @@ void sspSend (uint8_t portNum, uint8_t *buf, uint32_t length)
 
 /**************************************************************************/
 /*! 
-    @brief Receives a block of data from the SSP0 port
+    @brief Receives a block of data from the SSP0 port, sending 0xFF for
+           every byte received
 
     @param[in]  portNum
                 The SPI port to use (0..1)
@@ -275,23 +367,115 @@ void sspSend (uint8_t portNum, uint8_t *buf, uint32_t length)
 /**************************************************************************/
 void sspReceive(uint8_t portNum, uint8_t *buf, uint32_t length)
 {
-  uint32_t i;
-
   if (portNum == 0)
   {
-    for ( i = 0; i < length; i++ )
-    {
-      /* As long as the receive FIFO is not empty, data can be received. */
-      SSP_SSP0DR = 0xFF;
-  
-      /* Wait until the Busy bit is cleared */
-      while ( (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY );
-      
-      *buf = SSP_SSP0DR;
-      buf++;
-    }
+    sspPipe(NULL, buf, length, 0xFF, 1);
   }
 
   return; 
 }
 
+/**************************************************************************/
+/*! 
+    @brief Sends and receives a block of 8-bit frames at the same time
+
+    Up to SSP_FIFOSIZE frames are kept in flight, so the bus doesn't sit
+    idle between bytes while the CPU waits for each one to complete.
+
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[in]  txBuf
+                Data to send, or NULL to send 0xFF
+    @param[out] rxBuf
+                Where to put the data received (may be the same buffer
+                as txBuf), or NULL to discard it
+    @param[in]  length
+                Number of bytes to transfer
+*/
+/**************************************************************************/
+void sspTransfer (uint8_t portNum, const uint8_t *txBuf, uint8_t *rxBuf, uint32_t length)
+{
+  if (portNum == 0)
+  {
+    sspPipe(txBuf, rxBuf, length, 0xFF, 1);
+  }
+
+  return;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Same as sspTransfer for frames of more than 8 bits (see
+           sspSetDataSize)
+
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[in]  txBuf
+                Frames to send, or NULL to send 0xFFFF
+    @param[out] rxBuf
+                Where to put the frames received, or NULL to discard them
+    @param[in]  length
+                Number of frames (not bytes) to transfer
+*/
+/**************************************************************************/
+void sspTransfer16 (uint8_t portNum, const uint16_t *txBuf, uint16_t *rxBuf, uint32_t length)
+{
+  if (portNum == 0)
+  {
+    sspPipe(txBuf, rxBuf, length, 0xFFFF, 2);
+  }
+
+  return;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Sends the same frame length times, discarding what comes back
+
+    Used for dummy clocks (e.g. 0xFF to an SD card) and for filling an
+    area of an SPI display with one colour in 16-bit mode.
+
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[in]  value
+                The frame to send (only the low 8 bits in 8-bit mode)
+    @param[in]  length
+                Number of frames to send
+*/
+/**************************************************************************/
+void sspFill (uint8_t portNum, uint16_t value, uint32_t length)
+{
+  if (portNum == 0)
+  {
+    sspPipe(NULL, NULL, length, value, 2);
+  }
+
+  return;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Reads a block of 8-bit frames, sending fill for each one
+
+    Some devices care about the value clocked out while reading (an SD
+    card wants 0xFF), others ignore it.
+
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[out] buf
+                Where to put the data received, or NULL to discard it
+    @param[in]  length
+                Number of bytes to read
+    @param[in]  fill
+                The byte sent for every byte read
+*/
+/**************************************************************************/
+void sspDrain (uint8_t portNum, uint8_t *buf, uint32_t length, uint8_t fill)
+{
+  if (portNum == 0)
+  {
+    sspPipe(NULL, buf, length, fill, 1);
+  }
+
+  return;
+}
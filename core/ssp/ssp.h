@@ -79,7 +79,12 @@ sspClockPhase_t;
 
 extern void SSP_IRQHandler (void);
 void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phase);
+void sspSetDataSize (uint8_t portNum, uint8_t bits);
 void sspSend (uint8_t portNum, uint8_t *buf, uint32_t length);
 void sspReceive (uint8_t portNum, uint8_t *buf, uint32_t length);
+void sspTransfer (uint8_t portNum, const uint8_t *txBuf, uint8_t *rxBuf, uint32_t length);
+void sspTransfer16 (uint8_t portNum, const uint16_t *txBuf, uint16_t *rxBuf, uint32_t length);
+void sspFill (uint8_t portNum, uint16_t value, uint32_t length);
+void sspDrain (uint8_t portNum, uint8_t *buf, uint32_t length, uint8_t fill);
 
 #endif
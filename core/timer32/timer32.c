@@ -348,6 +348,63 @@ void timer32Init(uint8_t timerNum, uint32_t timerInterval)
   return;
 }
 
+/**************************************************************************/
+/*! 
+    @brief  Initialises the specified 32-bit timer as a free-running
+            counter.  The counter increments once every 'prescale' clock
+            ticks and wraps around at 0xFFFFFFFF.  No interrupt is used
+            and the timer is started straight away.
+
+    @param[in]  timerNum
+                The 32-bit timer to initiliase (0..1)
+    @param[in]  prescale
+                The number of clock 'ticks' per count (ex. TIMER32_CCLK_1US
+                for a microsecond counter that wraps every ~71 minutes)
+*/
+/**************************************************************************/
+void timer32InitFreeRunning(uint8_t timerNum, uint32_t prescale)
+{
+  if (prescale < 1)
+  {
+    prescale = 1;
+  }
+
+  if ( timerNum == 0 )
+  {
+    SCB_SYSAHBCLKCTRL |= (SCB_SYSAHBCLKCTRL_CT32B0);
+    TMR_TMR32B0TCR = TMR_TMR32B0TCR_COUNTERRESET_ENABLED;
+    TMR_TMR32B0MCR = 0;
+    TMR_TMR32B0PR = prescale - 1;
+    TMR_TMR32B0TCR = TMR_TMR32B0TCR_COUNTERENABLE_ENABLED;
+  }
+  else if ( timerNum == 1 )
+  {
+    SCB_SYSAHBCLKCTRL |= (SCB_SYSAHBCLKCTRL_CT32B1);
+    TMR_TMR32B1TCR = TMR_TMR32B1TCR_COUNTERRESET_ENABLED;
+    TMR_TMR32B1MCR = 0;
+    TMR_TMR32B1PR = prescale - 1;
+    TMR_TMR32B1TCR = TMR_TMR32B1TCR_COUNTERENABLE_ENABLED;
+  }
+  return;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Returns the current value of the timer's hardware counter (TC)
+*/
+/**************************************************************************/
+uint32_t timer32GetTimerValue(uint8_t timerNum)
+{
+    if (0 == timerNum)
+    {
+        return TMR_TMR32B0TC;
+    }
+    else
+    {
+        return TMR_TMR32B1TC;
+    }
+}
+
 /**************************************************************************/
 /*! 
     @brief Sets the optional callback function for 32-bit timer 0
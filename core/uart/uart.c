@@ -8,7 +8,10 @@
     @section DESCRIPTION
 
     Generic code for UART-based communication.  Incoming text is stored
-    in a FIFO Queue for safer processing.
+    in a FIFO Queue for safer processing.  Outgoing data is queued in a
+    TX FIFO that is emptied by the THRE interrupt, 16 bytes (the size of
+    the hardware FIFO) at a time, so uartSend only has to wait when the
+    TX FIFO is full (see uartSetTxPolicy).
 
     @section Example: Sending text via UART
 
@@ -108,6 +111,69 @@
 /**************************************************************************/
 static uart_pcb_t pcb;
 
+// Size of the UART's hardware TX FIFO
+#define UART_HWFIFO_SIZE    (16)
+
+// Number of bytes in the hardware RX FIFO before an RDA interrupt is
+// raised.  Anything less is picked up by the character timeout interrupt.
+#define UART_RXTRIGGER      (UART_U0FCR_Rx_Trigger_Level_Select_8Char)
+
+/**************************************************************************/
+/*!
+    Moves everything in the hardware RX FIFO into the UART buffer.
+*/
+/**************************************************************************/
+static void uartRxDrain(void)
+{
+  while (UART_U0LSR & UART_U0LSR_RDR_DATA)
+  {
+    uartRxBufferWrite(UART_U0RBR);
+  }
+}
+
+/**************************************************************************/
+/*!
+    Moves up to UART_HWFIFO_SIZE bytes from the TX FIFO into the UART.
+    This must only be called when THR is empty, either from the THRE
+    interrupt or with the UART interrupt disabled.
+*/
+/**************************************************************************/
+static void uartTxFill(void)
+{
+  uint32_t count = 0;
+  uint16_t tail = pcb.txfifo.tail;
+
+  while ((tail != pcb.txfifo.head) && (count < UART_HWFIFO_SIZE))
+  {
+    UART_U0THR = pcb.txfifo.buf[tail & (CFG_UART_TXBUFSIZE - 1)];
+    tail++;
+    count++;
+  }
+  pcb.txfifo.tail = tail;
+
+  // If nothing was written there won't be another THRE interrupt, and the
+  // next call to uartWrite needs to restart transmission itself
+  pcb.pending_tx_data = count ? 1 : 0;
+}
+
+/**************************************************************************/
+/*!
+    Starts transmission if the UART is idle.  Since this doesn't depend on
+    the THRE interrupt being serviced, it is also used to make progress
+    when waiting for room in the TX FIFO (in case the caller is running
+    with interrupts disabled or from a higher priority ISR).
+*/
+/**************************************************************************/
+static void uartTxKick(void)
+{
+  NVIC_DisableIRQ(UART_IRQn);
+  if (UART_U0LSR & UART_U0LSR_THRE)
+  {
+    uartTxFill();
+  }
+  NVIC_EnableIRQ(UART_IRQn);
+}
+
 /**************************************************************************/
 /*!
     IRQ to handle incoming data, etc.
@@ -125,52 +191,37 @@ void UART_IRQHandler(void)
   // 1.) Check receiver line status
   if (IIRValue == UART_U0IIR_IntId_RLS)
   {
+    /* Read LSR will clear the interrupt */
     LSRValue = UART_U0LSR;
-    // Check for errors
-    if (LSRValue & (UART_U0LSR_OE | UART_U0LSR_PE | UART_U0LSR_FE | UART_U0LSR_RXFE | UART_U0LSR_BI))
+    pcb.status = LSRValue;
+    if (LSRValue & UART_U0LSR_OE)
     {
-      /* There are errors or break interrupt */
-      /* Read LSR will clear the interrupt */
-      pcb.status = LSRValue;
-      Dummy = UART_U0RBR;	/* Dummy read on RX to clear interrupt, then bail out */
-      return;
+      // Data was lost in the UART itself (the FIFO contents are still valid)
+      pcb.rxoverrun++;
     }
-    // No error and receive data is ready
-    if (LSRValue & UART_U0LSR_RDR_DATA)
+    if (LSRValue & (UART_U0LSR_PE | UART_U0LSR_FE | UART_U0LSR_BI))
     {
-      /* If no error on RLS, normal ready, save into the data buffer. */
-      /* Note: read RBR will clear the interrupt */
-      uartRxBufferWrite(UART_U0RBR);
+      // The character at the top of the FIFO is bad, so discard it
+      pcb.rxerrors++;
+      Dummy = UART_U0RBR;
     }
+    // Move any remaining data into the RX FIFO
+    uartRxDrain();
   }
 
-  // 2.) Check receive data available
-  else if (IIRValue == UART_U0IIR_IntId_RDA)
-  {
-    // Add incoming text to UART buffer
-    uartRxBufferWrite(UART_U0RBR);
-  }
-
-  // 3.) Check character timeout indicator
-  else if (IIRValue == UART_U0IIR_IntId_CTI)
+  // 2.) Check receive data available/character timeout indicator
+  else if ((IIRValue == UART_U0IIR_IntId_RDA) || (IIRValue == UART_U0IIR_IntId_CTI))
   {
-    /* Bit 9 as the CTI error */
-    pcb.status |= 0x100;
+    // Empty the hardware FIFO into the UART buffer (CTI is raised when
+    // fewer than UART_RXTRIGGER bytes are waiting and the line goes idle)
+    uartRxDrain();
   }
 
   // 4.) Check THRE (transmit holding register empty)
   else if (IIRValue == UART_U0IIR_IntId_THRE)
   {
-    /* Check status in the LSR to see if valid data in U0THR or not */
-    LSRValue = UART_U0LSR;
-    if (LSRValue & UART_U0LSR_THRE)
-    {
-      pcb.pending_tx_data = 0;
-    }
-    else
-    {
-      pcb.pending_tx_data= 1;
-    }
+    // Refill the hardware FIFO from the TX FIFO
+    uartTxFill();
   }
   return;
 }
@@ -199,6 +250,85 @@ uart_pcb_t *uartGetPCB()
     return &pcb;
 }
 
+/**************************************************************************/
+/*! 
+    @brief Finds the divisor latch and fractional divider settings that
+           give the closest match to the requested baud rate.
+
+    The UART baud rate is PCLK / (16 * DL * (1 + DIVADDVAL/MULVAL)), with
+    1 <= MULVAL <= 15 and 0 <= DIVADDVAL < MULVAL.  PCLK is the main clock
+    divided by the value in SCB_UARTCLKDIV.  Every MULVAL/DIVADDVAL pair is
+    tried with the nearest DL, and the pair with the smallest error wins
+    (without the fractional divider if it isn't any better).
+
+    @param[in]  baudrate
+                The requested baud rate
+    @param[out] divisor
+                The value for DLM/DLL (can be NULL)
+    @param[out] fdr
+                The value for U0FDR (can be NULL)
+
+    @returns    The baud rate these settings actually produce
+
+    @section Example
+
+    @code 
+    // Check how close we can get to 921600 baud
+    uint32_t actual = uartCalcDivisor(921600, NULL, NULL);
+    @endcode
+*/
+/**************************************************************************/
+uint32_t uartCalcDivisor(uint32_t baudrate, uint32_t *divisor, uint32_t *fdr)
+{
+  uint32_t clkdiv = SCB_UARTCLKDIV & SCB_UARTCLKDIV_MASK;
+  uint32_t pclk, mulval, divaddval, dl, actual, error;
+  uint32_t bestDl = 1, bestFdr = 0x10, bestRate = 0, bestError = 0xFFFFFFFF;
+
+  if (baudrate == 0)
+  {
+    baudrate = CFG_UART_BAUDRATE;
+  }
+
+  // The UART clock is the main clock divided by UARTCLKDIV.  Until the
+  // clock is enabled (0), assume the divide by 1 that uartInit sets up
+  if (clkdiv == 0)
+  {
+    clkdiv = SCB_UARTCLKDIV_DIV1;
+  }
+  pclk = (CFG_CPU_CCLK * SCB_SYSAHBCLKDIV) / clkdiv;
+
+  for (mulval = 1; mulval <= 15; mulval++)
+  {
+    for (divaddval = 0; divaddval < mulval; divaddval++)
+    {
+      // DL = PCLK * MULVAL / (16 * baud * (MULVAL + DIVADDVAL)), rounded
+      uint32_t den = 16 * baudrate * (mulval + divaddval);
+      dl = (pclk * mulval + den / 2) / den;
+
+      // DL must be at least 3 when the fractional divider is used
+      if ((dl < (divaddval ? 3 : 1)) || (dl > 0xFFFF))
+      {
+        continue;
+      }
+
+      actual = (pclk * mulval) / (16 * dl * (mulval + divaddval));
+      error = (actual > baudrate) ? actual - baudrate : baudrate - actual;
+      if (error < bestError)
+      {
+        bestError = error;
+        bestRate = actual;
+        bestDl = dl;
+        bestFdr = (mulval << 4) | divaddval;
+      }
+    }
+  }
+
+  if (divisor) *divisor = bestDl;
+  if (fdr) *fdr = bestFdr;
+
+  return bestRate;
+}
+
 /**************************************************************************/
 /*! 
     @brief Initialises UART at the specified baud rate.
@@ -209,14 +339,22 @@ uart_pcb_t *uartGetPCB()
 /**************************************************************************/
 void uartInit(uint32_t baudrate)
 {
-  uint32_t fDiv;
-  uint32_t regVal;
+  uint32_t fDiv, fdr;
+  uint32_t regVal = regVal;
+  uartTxPolicy_t txpolicy = pcb.txpolicy;
+
+  // Send anything still queued at the old baud rate
+  if (pcb.initialised)
+  {
+    uartFlush();
+  }
 
   NVIC_DisableIRQ(UART_IRQn);
 
   // Clear protocol control blocks
   memset(&pcb, 0, sizeof(uart_pcb_t));
   pcb.pending_tx_data = 0;
+  pcb.txpolicy = txpolicy;
   uartRxBufferInit();
 
   /* Set 1.6 UART RXD */
@@ -229,7 +367,10 @@ void uartInit(uint32_t baudrate)
 
   /* Enable UART clock */
   SCB_SYSAHBCLKCTRL |= (SCB_SYSAHBCLKCTRL_UART);
-  SCB_UARTCLKDIV = SCB_UARTCLKDIV_DIV1;     /* divided by 1 */
+  if ((SCB_UARTCLKDIV & SCB_UARTCLKDIV_MASK) == 0)
+  {
+    SCB_UARTCLKDIV = SCB_UARTCLKDIV_DIV1;   /* divided by 1 unless already set */
+  }
 
   /* 8 bits, no Parity, 1 Stop bit */
   UART_U0LCR = (UART_U0LCR_Word_Length_Select_8Chars |
@@ -239,12 +380,12 @@ void uartInit(uint32_t baudrate)
                 UART_U0LCR_Break_Control_Disabled |
                 UART_U0LCR_Divisor_Latch_Access_Enabled);
 
-  /* Baud rate */
-  regVal = SCB_UARTCLKDIV;
-  fDiv = (((CFG_CPU_CCLK * SCB_SYSAHBCLKDIV)/regVal)/16)/baudrate;
+  /* Baud rate (integer divisor plus fractional divider) */
+  pcb.baudactual = uartCalcDivisor(baudrate, &fDiv, &fdr);
 
   UART_U0DLM = fDiv / 256;
   UART_U0DLL = fDiv % 256;
+  UART_U0FDR = fdr;
   
   /* Set DLAB back to 0 */
   UART_U0LCR = (UART_U0LCR_Word_Length_Select_8Chars |
@@ -257,7 +398,8 @@ void uartInit(uint32_t baudrate)
   /* Enable and reset TX and RX FIFO. */
   UART_U0FCR = (UART_U0FCR_FIFO_Enabled | 
                 UART_U0FCR_Rx_FIFO_Reset | 
-                UART_U0FCR_Tx_FIFO_Reset); 
+                UART_U0FCR_Tx_FIFO_Reset |
+                UART_RXTRIGGER); 
 
   /* Read to clear the line status. */
   regVal = UART_U0LSR;
@@ -276,11 +418,129 @@ void uartInit(uint32_t baudrate)
 
   /* Enable the UART Interrupt */
   NVIC_EnableIRQ(UART_IRQn);
-  UART_U0IER = UART_U0IER_RBR_Interrupt_Enabled | UART_U0IER_RLS_Interrupt_Enabled;
+  UART_U0IER = UART_U0IER_RBR_Interrupt_Enabled | UART_U0IER_THRE_Interrupt_Enabled | UART_U0IER_RLS_Interrupt_Enabled;
 
   return;
 }
 
+/**************************************************************************/
+/*! 
+    @brief Queues as much of the supplied buffer as fits in the TX FIFO
+           and returns immediately.
+
+    @param[in]  buffer
+                Pointer to the data to send
+    @param[in]  length
+                The number of bytes to send
+
+    @returns    The number of bytes accepted.  With UART_TXPOLICY_OVERWRITE
+                this is always 'length' since older data is discarded to
+                make room.
+
+    @section Example
+
+    @code 
+    // Send as much of the telemetry frame as possible without waiting
+    uint32_t sent = uartWrite(frame, sizeof(frame));
+    @endcode
+
+*/
+/**************************************************************************/
+uint32_t uartWrite(const uint8_t *buffer, uint32_t length)
+{
+  uint32_t written = 0;
+  uint16_t head = pcb.txfifo.head;
+
+  if ((pcb.txpolicy == UART_TXPOLICY_OVERWRITE) &&
+      (length > CFG_UART_TXBUFSIZE - (uint16_t)(head - pcb.txfifo.tail)))
+  {
+    uint32_t free;
+
+    // Only the last CFG_UART_TXBUFSIZE bytes can be kept
+    if (length > CFG_UART_TXBUFSIZE)
+    {
+      pcb.txdropped += length - CFG_UART_TXBUFSIZE;
+      buffer += length - CFG_UART_TXBUFSIZE;
+      written = length - CFG_UART_TXBUFSIZE;
+      length = CFG_UART_TXBUFSIZE;
+    }
+
+    // Discard the oldest data (tail belongs to the ISR, so keep it out)
+    NVIC_DisableIRQ(UART_IRQn);
+    free = CFG_UART_TXBUFSIZE - (uint16_t)(head - pcb.txfifo.tail);
+    if (length > free)
+    {
+      pcb.txfifo.tail += length - free;
+      pcb.txdropped += length - free;
+    }
+    NVIC_EnableIRQ(UART_IRQn);
+
+    length += written;
+  }
+
+  while ((written < length) && ((uint16_t)(head - pcb.txfifo.tail) < CFG_UART_TXBUFSIZE))
+  {
+    pcb.txfifo.buf[head & (CFG_UART_TXBUFSIZE - 1)] = *buffer++;
+    head++;
+    written++;
+  }
+  pcb.txfifo.head = head;
+
+  if ((written < length) && (pcb.txpolicy == UART_TXPOLICY_DROP))
+  {
+    pcb.txdropped += length - written;
+  }
+
+  // Restart transmission if the THRE interrupt has stopped
+  if (!pcb.pending_tx_data)
+  {
+    uartTxKick();
+  }
+
+  return written;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Waits until everything in the TX FIFO has been sent.
+*/
+/**************************************************************************/
+void uartFlush(void)
+{
+  while (pcb.txfifo.head != pcb.txfifo.tail)
+  {
+    uartTxKick();
+  }
+
+  // Wait for the last byte to leave the shift register
+  while (!(UART_U0LSR & UART_U0LSR_TEMT));
+}
+
+/**************************************************************************/
+/*! 
+    @brief Selects what uartSend and uartWrite do when the TX FIFO is
+           full.
+
+    @param[in]  policy
+                UART_TXPOLICY_BLOCK waits for room (default),
+                UART_TXPOLICY_DROP discards the new data and
+                UART_TXPOLICY_OVERWRITE discards the oldest queued data.
+                Discarded bytes are counted in the PCB's txdropped field.
+
+    @section Example
+
+    @code 
+    // Never stall the main loop for telemetry output
+    uartSetTxPolicy(UART_TXPOLICY_DROP);
+    @endcode
+
+*/
+/**************************************************************************/
+void uartSetTxPolicy(uartTxPolicy_t policy)
+{
+  pcb.txpolicy = policy;
+}
+
 /**************************************************************************/
 /*! 
     @brief Sends the contents of supplied text buffer over UART.
@@ -290,6 +550,10 @@ void uartInit(uint32_t baudrate)
     @param[in]  bufferPtr
                 The size of the text buffer
 
+    @note       The data is queued in the TX FIFO and sent in the
+                background.  If the FIFO is full this will wait, drop
+                or overwrite data depending on uartSetTxPolicy.
+
     @section Example
 
     @code 
@@ -303,14 +567,23 @@ void uartInit(uint32_t baudrate)
 /**************************************************************************/
 void uartSend (uint8_t *bufferPtr, uint32_t length)
 {
+  uint32_t written;
+
   while (length != 0)
   {
-    /* THRE status, contain valid data */
-    while ( !(UART_U0LSR & UART_U0LSR_THRE) );
-    UART_U0THR = *bufferPtr;
+    written = uartWrite(bufferPtr, length);
+    if (pcb.txpolicy != UART_TXPOLICY_BLOCK)
+    {
+      break;
+    }
 
-    bufferPtr++;
-    length--;
+    bufferPtr += written;
+    length -= written;
+    if (length)
+    {
+      // Wait for room in the TX FIFO
+      uartTxKick();
+    }
   }
 
   return;
@@ -336,12 +609,7 @@ void uartSend (uint8_t *bufferPtr, uint32_t length)
 /**************************************************************************/
 void uartSendByte (uint8_t byte)
 {
-  /* THRE status, contain valid data */
-  while ( !(UART_U0LSR & UART_U0LSR_THRE) );
-  UART_U0THR = byte;
+  uartSend(&byte, 1);
 
   return;
 }
-
-
-
@@ -41,31 +41,67 @@
 
 #include "projectconfig.h"
 
-// Buffer used for circular fifo
+// Highest baud rate accepted by uartInit and the 'U' command.  Rates
+// above 115200 rely on the fractional divider (see uartCalcDivisor), so
+// check the achieved rate before using them.
+#define UART_MAXBAUDRATE      (3000000)
+
+// Receive FIFO (single producer/single consumer).  head is only written
+// by the UART ISR and tail only by the reader, so no locking is needed.
+// Both are free-running and wrap at 16 bits, so CFG_UART_BUFSIZE must be
+// a power of two.
 typedef struct _uart_buffer_t
 {
-  uint8_t ep_dir;
-  volatile uint8_t len;
-  volatile uint8_t wr_ptr;
-  volatile uint8_t rd_ptr;
+  volatile uint16_t head;
+  volatile uint16_t tail;
   uint8_t buf[CFG_UART_BUFSIZE];
 } uart_buffer_t;
 
+// Transmit FIFO (single producer/single consumer, emptied by the THRE
+// interrupt).  head and tail are free-running and wrap at 16 bits, so
+// CFG_UART_TXBUFSIZE must be a power of two.
+typedef struct _uart_txbuffer_t
+{
+  volatile uint16_t head;
+  volatile uint16_t tail;
+  uint8_t buf[CFG_UART_TXBUFSIZE];
+} uart_txbuffer_t;
+
+// What uartSend/uartWrite should do when the TX FIFO is full
+typedef enum
+{
+  UART_TXPOLICY_BLOCK = 0,      // Wait until there is room (default)
+  UART_TXPOLICY_DROP = 1,       // Discard the new data
+  UART_TXPOLICY_OVERWRITE = 2   // Discard the oldest queued data
+} uartTxPolicy_t;
+
 // UART Protocol control block
 typedef struct _uart_pcb_t
 {
   BOOL initialised;
   uint32_t baudrate;
+  uint32_t baudactual;  // Baud rate actually produced by the divider
   uint32_t status;
-  uint32_t pending_tx_data;
+  volatile uint32_t pending_tx_data;  // Set by the THRE ISR while it has more to send
+  uartTxPolicy_t txpolicy;
+  uint32_t txdropped;
+  uint32_t rxbytes;     // Bytes received
+  uint32_t rxoverflow;  // Bytes lost because the RX FIFO was full
+  uint32_t rxoverrun;   // Hardware FIFO overruns (bytes lost in the UART)
+  uint32_t rxerrors;    // Bytes discarded with parity/framing/break errors
   uart_buffer_t rxfifo;
+  uart_txbuffer_t txfifo;
 } uart_pcb_t;
 
 void UART_IRQHandler(void);
 uart_pcb_t *uartGetPCB();
 void uartInit(uint32_t Baudrate);
+uint32_t uartCalcDivisor(uint32_t baudrate, uint32_t *divisor, uint32_t *fdr);
 void uartSend(uint8_t *BufferPtr, uint32_t Length);
 void uartSendByte (uint8_t byte);
+uint32_t uartWrite(const uint8_t *buffer, uint32_t length);
+void uartFlush(void);
+void uartSetTxPolicy(uartTxPolicy_t policy);
 
 // Rx Buffer access control
 void uartRxBufferInit();
@@ -73,6 +109,8 @@ uint8_t uartRxBufferRead();
 void uartRxBufferWrite(uint8_t data);
 void uartRxBufferClearFIFO();
 uint8_t uartRxBufferDataPending();
+uint16_t uartRxBufferCount();
 bool uartRxBufferReadArray(byte_t* rx, size_t* len);
+uint32_t uartRead(uint8_t *buffer, uint32_t length);
 
 #endif
@@ -50,6 +50,8 @@
 
 #include "uart.h"
 
+#define UART_RXMASK   (CFG_UART_BUFSIZE - 1)
+
 /**************************************************************************/
 /*!
   Initialises the RX FIFO buffer
@@ -58,28 +60,58 @@
 void uartRxBufferInit()
 {
   uart_pcb_t *pcb = uartGetPCB();
-  pcb->rxfifo.len = 0;
+  pcb->rxfifo.head = 0;
+  pcb->rxfifo.tail = 0;
 }
 
 /**************************************************************************/
 /*!
   Read one byte out of the RX buffer. This function will return the byte
-  located at the array index of the read pointer, and then increment the
-  read pointer index.  If the read pointer exceeds the maximum buffer
-  size, it will roll over to zero.
+  located at the tail of the buffer, and then advance the tail.  The
+  caller should make sure that data is available first (see
+  uartRxBufferDataPending).
 */
 /**************************************************************************/
 uint8_t uartRxBufferRead()
 {
   uart_pcb_t *pcb = uartGetPCB();
+  uint16_t tail = pcb->rxfifo.tail;
   uint8_t data;
 
-  data = pcb->rxfifo.buf[pcb->rxfifo.rd_ptr];
-  pcb->rxfifo.rd_ptr = (pcb->rxfifo.rd_ptr + 1) % CFG_UART_BUFSIZE;
-  pcb->rxfifo.len--;
+  data = pcb->rxfifo.buf[tail & UART_RXMASK];
+  pcb->rxfifo.tail = tail + 1;
   return data;
 }
 
+/**************************************************************************/
+/*!
+  Reads up to 'length' bytes out of the RX buffer, and returns the number
+  of bytes actually copied to 'buffer'.
+*/
+/**************************************************************************/
+uint32_t uartRead(uint8_t *buffer, uint32_t length)
+{
+  uart_pcb_t *pcb = uartGetPCB();
+  uint16_t tail = pcb->rxfifo.tail;
+  uint16_t count = pcb->rxfifo.head - tail;
+  uint32_t i;
+
+  if (length > count)
+  {
+    length = count;
+  }
+
+  for (i = 0; i < length; i++)
+  {
+    buffer[i] = pcb->rxfifo.buf[tail & UART_RXMASK];
+    tail++;
+  }
+
+  // Release the space to the ISR in one go
+  pcb->rxfifo.tail = tail;
+  return length;
+}
+
 /**************************************************************************/
 /*!
   Read byte array from uart
@@ -87,14 +119,11 @@ uint8_t uartRxBufferRead()
 /**************************************************************************/
 bool uartRxBufferReadArray(byte_t* rx, size_t* len)
 {
-  uart_pcb_t *pcb = uartGetPCB();
   *len = 0;
-  
-  while(pcb->rxfifo.len != 0)
+
+  while(uartRxBufferDataPending())
   {
-    (*rx) = uartRxBufferRead();
-    (*len)++;
-    rx++;
+    *len += uartRead(rx + *len, CFG_UART_BUFSIZE);
   }
   
   return (*len != 0);
@@ -102,33 +131,39 @@ bool uartRxBufferReadArray(byte_t* rx, size_t* len)
 
 /**************************************************************************/
 /*!
-  Write one byte into the RX buffer. This function will write one
-  byte into the array index specified by the write pointer and increment
-  the write index. If the write index exceeds the max buffer size, then it
-  will roll over to zero.
+  Write one byte into the RX buffer. This function is called from the
+  UART ISR, and will write one byte at the head of the buffer and advance
+  the head.  If the buffer is full the byte is discarded and counted in
+  the PCB's rxoverflow field.
 */
 /**************************************************************************/
 void uartRxBufferWrite(uint8_t data)
 {
   uart_pcb_t *pcb = uartGetPCB();
+  uint16_t head = pcb->rxfifo.head;
+
+  pcb->rxbytes++;
+  if ((uint16_t)(head - pcb->rxfifo.tail) >= CFG_UART_BUFSIZE)
+  {
+    pcb->rxoverflow++;
+    return;
+  }
 
-  pcb->rxfifo.buf[pcb->rxfifo.wr_ptr] = data;
-  pcb->rxfifo.wr_ptr = (pcb->rxfifo.wr_ptr + 1) % CFG_UART_BUFSIZE;
-  pcb->rxfifo.len++;
+  pcb->rxfifo.buf[head & UART_RXMASK] = data;
+  pcb->rxfifo.head = head + 1;
 }
 
 /**************************************************************************/
 /*!
-    Clear the fifo read and write pointers and set the length to zero.
+    Discard everything in the RX buffer.
 */
 /**************************************************************************/
 void uartRxBufferClearFIFO()
 {
   uart_pcb_t *pcb = uartGetPCB();
 
-  pcb->rxfifo.rd_ptr = 0;
-  pcb->rxfifo.wr_ptr = 0;
-  pcb->rxfifo.len = 0;
+  // Only the reader's index is touched so this is safe against the ISR
+  pcb->rxfifo.tail = pcb->rxfifo.head;
 }
 
 /**************************************************************************/
@@ -140,10 +175,22 @@ uint8_t uartRxBufferDataPending()
 {
   uart_pcb_t *pcb = uartGetPCB();
 
-  if (pcb->rxfifo.len != 0)
+  if (pcb->rxfifo.head != pcb->rxfifo.tail)
   {
     return 1;
   }
 
   return 0;
 }
+
+/**************************************************************************/
+/*!
+    Returns the number of bytes waiting in the RX buffer.
+*/
+/**************************************************************************/
+uint16_t uartRxBufferCount()
+{
+  uart_pcb_t *pcb = uartGetPCB();
+
+  return (uint16_t)(pcb->rxfifo.head - pcb->rxfifo.tail);
+}
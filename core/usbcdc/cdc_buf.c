@@ -62,100 +62,152 @@ cdc_buffer_t *cdcGetBuffer()
   return &cdcfifo;
 }
 
+#define CDC_BUFMASK   (CFG_USBCDC_BUFFERSIZE - 1)
+
 /**************************************************************************/
 /*!
-  Initialises the RX FIFO buffer
+  Initialises the FIFO buffer
 */
 /**************************************************************************/
 void cdcBufferInit()
 {
-  cdcfifo.len = 0;
+  cdcfifo.head = 0;
+  cdcfifo.tail = 0;
 }
 
 /**************************************************************************/
 /*!
-  Read one byte out of the RX buffer. This function will return the byte
-  located at the array index of the read pointer, and then increment the
-  read pointer index.  If the read pointer exceeds the maximum buffer
-  size, it will roll over to zero.
+  Read one byte out of the buffer. This function will return the byte
+  located at the tail of the buffer and then advance the tail.  The
+  caller should make sure that data is available first.
 */
 /**************************************************************************/
 uint8_t cdcBufferRead()
 {
+  uint16_t tail = cdcfifo.tail;
   uint8_t data;
 
-  data = cdcfifo.buf[cdcfifo.rd_ptr];
-  cdcfifo.rd_ptr = (cdcfifo.rd_ptr + 1) % CFG_USBCDC_BUFFERSIZE;
-  cdcfifo.len--;
+  data = cdcfifo.buf[tail & CDC_BUFMASK];
+  cdcfifo.tail = tail + 1;
   return data;
 }
 
 /**************************************************************************/
 /*!
-  Reads x bytes from cdc buffer
+  Reads up to len bytes from the cdc buffer, and returns the number of
+  bytes actually read
  */
 /**************************************************************************/
 uint32_t cdcBufferReadLen(uint8_t* buf, uint32_t len)
 {
-  uint32_t counter, actual;
-  counter = actual = 0;
+  uint16_t tail = cdcfifo.tail;
+  uint16_t count = cdcfifo.head - tail;
+  uint32_t i;
 
-  while(counter != len)
+  if (len > count)
   {
-    // Make sure we don't exceed buffer limits
-    if (cdcfifo.len > 0)
-    {
-      buf[counter] = cdcBufferRead();
-      actual++;
-      counter++;
-    }
-    else
-    {
-      return actual;
-    }
+    len = count;
   }
 
-  return actual;
+  for (i = 0; i < len; i++)
+  {
+    buf[i] = cdcfifo.buf[tail & CDC_BUFMASK];
+    tail++;
+  }
+
+  cdcfifo.tail = tail;
+  return len;
 }
 
 /**************************************************************************/
 /*!
-  Write one byte into the RX buffer. This function will write one
-  byte into the array index specified by the write pointer and increment
-  the write index. If the write index exceeds the max buffer size, then it
-  will roll over to zero.
+  Write one byte into the buffer. This function will write one byte at
+  the head of the buffer and advance the head.  The caller should make
+  sure that the buffer isn't full first (see cdcBufferFull).
 */
 /**************************************************************************/
 void cdcBufferWrite(uint8_t data)
 {
-  cdcfifo.buf[cdcfifo.wr_ptr] = data;
-  cdcfifo.wr_ptr = (cdcfifo.wr_ptr + 1) % CFG_USBCDC_BUFFERSIZE;
-  cdcfifo.len++;
+  uint16_t head = cdcfifo.head;
+
+  cdcfifo.buf[head & CDC_BUFMASK] = data;
+  cdcfifo.head = head + 1;
+}
+
+/**************************************************************************/
+/*!
+  Writes up to len bytes into the buffer, and returns the number of
+  bytes that fit
+ */
+/**************************************************************************/
+uint32_t cdcBufferWriteLen(const uint8_t* buf, uint32_t len)
+{
+  uint16_t head = cdcfifo.head;
+  uint16_t space = CFG_USBCDC_BUFFERSIZE - (uint16_t)(head - cdcfifo.tail);
+  uint32_t i;
+
+  if (len > space)
+  {
+    len = space;
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    cdcfifo.buf[head & CDC_BUFMASK] = buf[i];
+    head++;
+  }
+
+  cdcfifo.head = head;
+  return len;
 }
 
 /**************************************************************************/
 /*!
-    Clear the fifo read and write pointers and set the length to zero.
+    Discard everything in the buffer.  This must be called by the
+    consumer (or with the consumer stopped).
 */
 /**************************************************************************/
 void cdcBufferClearFIFO()
 {
-  cdcfifo.rd_ptr = 0;
-  cdcfifo.wr_ptr = 0;
-  cdcfifo.len = 0;
+  cdcfifo.tail = cdcfifo.head;
 }
 
 /**************************************************************************/
 /*!
-    Check whether there is any data pending on the RX buffer.
+    Check whether there is any data pending in the buffer.
 */
 /**************************************************************************/
 uint8_t cdcBufferDataPending()
 {
-  if (cdcfifo.len != 0)
+  if (cdcfifo.head != cdcfifo.tail)
   {
     return 1;
   }
 
   return 0;
 }
+
+/**************************************************************************/
+/*!
+    Check whether the buffer is full.
+*/
+/**************************************************************************/
+uint8_t cdcBufferFull()
+{
+  if ((uint16_t)(cdcfifo.head - cdcfifo.tail) >= CFG_USBCDC_BUFFERSIZE)
+  {
+    return 1;
+  }
+
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    Returns the number of bytes waiting in the buffer.
+*/
+/**************************************************************************/
+uint16_t cdcBufferCount()
+{
+  return (uint16_t)(cdcfifo.head - cdcfifo.tail);
+}
@@ -9,12 +9,15 @@
 
 #include "projectconfig.h"
 
-// Buffer used for circular fifo
+// Buffer used for circular fifo.  This is a single producer/single
+// consumer ring: head is only written by the producer and tail only by
+// the consumer (the USB ISR for outgoing data), so no locking is needed.
+// Both indices are free-running, so CFG_USBCDC_BUFFERSIZE must be a
+// power of two.
 typedef struct _cdc_buffer_t
 {
-  volatile uint8_t len;
-  volatile uint8_t wr_ptr;
-  volatile uint8_t rd_ptr;
+  volatile uint16_t head;
+  volatile uint16_t tail;
   uint8_t buf[CFG_USBCDC_BUFFERSIZE];
 } cdc_buffer_t;
 
@@ -23,7 +26,10 @@ void           cdcBufferInit();
 uint8_t        cdcBufferRead();
 uint32_t       cdcBufferReadLen(uint8_t* buf, uint32_t len);
 void           cdcBufferWrite(uint8_t data);
+uint32_t       cdcBufferWriteLen(const uint8_t* buf, uint32_t len);
 void           cdcBufferClearFIFO();
 uint8_t        cdcBufferDataPending();
+uint8_t        cdcBufferFull();
+uint16_t       cdcBufferCount();
 
 #endif
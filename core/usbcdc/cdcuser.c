@@ -16,15 +16,19 @@
  * Copyright (c) 2009 Keil - An ARM Company. All rights reserved.
  *---------------------------------------------------------------------------*/
 
+#include <string.h>
+
 #include "projectconfig.h"
 
 #include "usb.h"
 #include "usbhw.h"
+#include "usbreg.h"
 #include "usbcfg.h"
 #include "usbcore.h"
 #include "cdc.h"
 #include "cdcuser.h"
 #include "cdc_buf.h"
+#include "core/systick/systick.h"
 
 unsigned char BulkBufIn  [64];            // Buffer to store USB IN  packet
 unsigned char BulkBufOut [64];            // Buffer to store USB OUT packet
@@ -33,13 +37,15 @@ unsigned char NotificationBuf [10];
 CDC_LINE_CODING CDC_LineCoding  = {CFG_USBCDC_BAUDRATE, 0, 0, 8};
 unsigned short  CDC_SerialState = 0x0000;
 unsigned short  CDC_DepInEmpty  = 1;                   // Data IN EP is empty
+static volatile unsigned char CDC_DepInZLP     = 0;    // Last IN packet was full size
+static volatile unsigned char CDC_DepInStalled = 0;    // Host isn't collecting IN data
 
 /*----------------------------------------------------------------------------
   We need a buffer for incomming data on USB port because USB receives
   much faster than  UART transmits
  *---------------------------------------------------------------------------*/
 /* Buffer masks */
-#define CDC_BUF_SIZE               (64)               // Output buffer in bytes (power 2)
+#define CDC_BUF_SIZE               (CFG_USBCDC_RXBUFFERSIZE) // Output buffer in bytes (power 2)
                                                        // large enough for file transfer
 #define CDC_BUF_MASK               (CDC_BUF_SIZE-1ul)
 
@@ -48,8 +54,9 @@ unsigned short  CDC_DepInEmpty  = 1;                   // Data IN EP is empty
 #define CDC_BUF_WR(cdcBuf, dataIn) (cdcBuf.data[CDC_BUF_MASK & cdcBuf.wrIdx++] = (dataIn))
 #define CDC_BUF_RD(cdcBuf)         (cdcBuf.data[CDC_BUF_MASK & cdcBuf.rdIdx++])   
 #define CDC_BUF_EMPTY(cdcBuf)      (cdcBuf.rdIdx == cdcBuf.wrIdx)
-#define CDC_BUF_FULL(cdcBuf)       (cdcBuf.rdIdx == cdcBuf.wrIdx+1)
-#define CDC_BUF_COUNT(cdcBuf)      (CDC_BUF_MASK & (cdcBuf.wrIdx - cdcBuf.rdIdx))
+#define CDC_BUF_COUNT(cdcBuf)      (cdcBuf.wrIdx - cdcBuf.rdIdx)
+#define CDC_BUF_FREE(cdcBuf)       (CDC_BUF_SIZE - CDC_BUF_COUNT(cdcBuf))
+#define CDC_BUF_FULL(cdcBuf)       (CDC_BUF_COUNT(cdcBuf) == CDC_BUF_SIZE)
 
 
 // CDC output buffer
@@ -61,45 +68,67 @@ typedef struct __CDC_BUF_T {
 
 CDC_BUF_T  CDC_OutBuf;                                 // buffer for all CDC Out data
 
+// Set when an OUT packet has been left in the endpoint because there was
+// no room for it in CDC_OutBuf.  The host gets NAKs until it is read.
+static volatile unsigned char CDC_DepOutNAK = 0;
+
+static void CDC_BulkOutResume (void);
+
 /*----------------------------------------------------------------------------
-  read data from CDC_OutBuf
+  read up to length bytes from CDC_OutBuf
+  Return Value: number of bytes actually read
  *---------------------------------------------------------------------------*/
-int CDC_RdOutBuf (char *buffer, const int *length) {
-  int bytesToRead, bytesRead;
-  
-  /* Read *length bytes, block if *bytes are not avaialable	*/
-  bytesToRead = *length;
-  bytesToRead = (bytesToRead < (*length)) ? bytesToRead : (*length);
-  bytesRead = bytesToRead;
-
+uint32_t CDC_RdOutBufLen (uint8_t *buffer, uint32_t length) {
+  unsigned int rdIdx = CDC_OutBuf.rdIdx;
+  uint32_t available = CDC_OutBuf.wrIdx - rdIdx;
+  uint32_t offset, chunk;
 
-  // ... add code to check for underrun
+  if (length > available) {
+    length = available;
+  }
 
-  while (bytesToRead--) {
-    *buffer++ = CDC_BUF_RD(CDC_OutBuf);
+  // Copy in (at most) two parts, up to the end of the ring and from the start
+  offset = rdIdx & CDC_BUF_MASK;
+  chunk = CDC_BUF_SIZE - offset;
+  if (chunk > length) {
+    chunk = length;
   }
-  return (bytesRead);  
+  memcpy(buffer, &CDC_OutBuf.data[offset], chunk);
+  memcpy(buffer + chunk, &CDC_OutBuf.data[0], length - chunk);
+  CDC_OutBuf.rdIdx = rdIdx + length;
+
+  // Accept any packet that was held back while the buffer was full
+  CDC_BulkOutResume();
+
+  return (length);
 }
 
 /*----------------------------------------------------------------------------
-  write data to CDC_OutBuf
+  read data from CDC_OutBuf
  *---------------------------------------------------------------------------*/
-int CDC_WrOutBuf (const char *buffer, int *length) {
-  int bytesToWrite, bytesWritten;
-
-  // Write *length bytes
-  bytesToWrite = *length;
-  bytesWritten = bytesToWrite;
+int CDC_RdOutBuf (char *buffer, const int *length) {
 
+  return ((int)CDC_RdOutBufLen((uint8_t *)buffer, (uint32_t)*length));
+}
 
-  // ... add code to check for overwrite
+/*----------------------------------------------------------------------------
+  write data to CDC_OutBuf
+  The caller must make sure there is room (see CDC_BulkOut)
+ *---------------------------------------------------------------------------*/
+int CDC_WrOutBuf (const char *buffer, int *length) {
+  unsigned int wrIdx = CDC_OutBuf.wrIdx;
+  uint32_t offset, chunk;
 
-  while (bytesToWrite) {
-      CDC_BUF_WR(CDC_OutBuf, *buffer++);           // Copy Data to buffer  
-      bytesToWrite--;
-  }     
+  offset = wrIdx & CDC_BUF_MASK;
+  chunk = CDC_BUF_SIZE - offset;
+  if (chunk > (uint32_t)*length) {
+    chunk = *length;
+  }
+  memcpy(&CDC_OutBuf.data[offset], buffer, chunk);
+  memcpy(&CDC_OutBuf.data[0], buffer + chunk, *length - chunk);
+  CDC_OutBuf.wrIdx = wrIdx + *length;
 
-  return (bytesWritten); 
+  return (*length); 
 }
 
 /*----------------------------------------------------------------------------
@@ -133,10 +162,10 @@ void CDC_Init (void) {
 
   CDC_BUF_RESET(CDC_OutBuf);
 
-  // Initialise the CDC buffer.   This is required to buffer outgoing
-  // data (MCU to PC) since data can only be sent 64 bytes per frame
-  // with at least 1ms between frames.  To see how the buffer is used,
-  // see 'puts' in systeminit.c
+  // Initialise the CDC buffer.   This is used to queue outgoing data
+  // (MCU to PC), which is moved into the bulk IN endpoint one packet at
+  // a time by CDC_BulkIn each time the previous packet has been sent.
+  // To see how the buffer is used, see '__putchar' in sysinit.c
   cdcBufferInit();
 }
 
@@ -281,41 +310,116 @@ uint32_t CDC_SendBreak (unsigned short wDurationOfBreak) {
 
 /*----------------------------------------------------------------------------
   CDC_BulkIn call on DataIn Request
+  Called from the USB ISR each time the previous IN packet has been sent,
+  this loads the next packet (of up to 64 bytes) from the CDC buffer.  A
+  zero length packet is sent after a full size packet when the buffer
+  runs dry, so that the host sees the end of the transfer.
   Parameters:   none
   Return Value: none
  *---------------------------------------------------------------------------*/
 void CDC_BulkIn(void) {
-  //int numBytesRead, numBytesAvail;
-
-//  uint8_t frame[64];
-//  uint32_t bytesRead = 0;
-//  if (cdcBufferDataPending())
-//  {
-//    // Read up to 64 bytes
-//    bytesRead = cdcBufferReadLen(frame, 64);
-//    if (bytesRead > 0)
-//    {
-//      USB_WriteEP (CDC_DEP_IN, frame, bytesRead);
-//    }
-//  }
-
-
-//  ser_AvailChar (&numBytesAvail);
-//
-//  // ... add code to check for overwrite
-//
-//  numBytesRead = ser_Read ((char *)&BulkBufIn[0], &numBytesAvail);
-//
-//  // send over USB
-//  if (numBytesRead > 0) {
-//	USB_WriteEP (CDC_DEP_IN, &BulkBufIn[0], numBytesRead);
-//  }
-//  else {
-//    CDC_DepInEmpty = 1;
-//  }
+  uint32_t numBytesRead;
+
+  // The host is collecting data again
+  CDC_DepInStalled = 0;
+
+  numBytesRead = cdcBufferReadLen(&BulkBufIn[0], CDC_DEP_MAXPACKET);
+  if (numBytesRead > 0) {
+    USB_WriteEP (CDC_DEP_IN, &BulkBufIn[0], numBytesRead);
+    CDC_DepInZLP = (numBytesRead == CDC_DEP_MAXPACKET);
+    CDC_DepInEmpty = 0;
+  }
+  else if (CDC_DepInZLP) {
+    USB_WriteEP (CDC_DEP_IN, &BulkBufIn[0], 0);
+    CDC_DepInZLP = 0;
+    CDC_DepInEmpty = 0;
+  }
+  else {
+    CDC_DepInEmpty = 1;
+  }
 } 
 
 
+/*----------------------------------------------------------------------------
+  Starts sending the contents of the CDC buffer if the bulk IN endpoint
+  is idle.  Once started, CDC_BulkIn keeps the endpoint busy from the
+  USB ISR until the buffer is empty.
+  Parameters:   none
+  Return Value: none
+ *---------------------------------------------------------------------------*/
+void CDC_BulkInStart(void) {
+
+  if (CDC_DepInEmpty && USB_Configuration) {
+    // The endpoint registers are shared with the ISR
+    NVIC_DisableIRQ(USB_IRQn);
+    if (CDC_DepInEmpty) {
+      CDC_BulkIn();
+    }
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+}
+
+
+/*----------------------------------------------------------------------------
+  Resets the bulk IN/OUT state (the endpoint buffers are cleared whenever
+  the device is reset or (re)configured by the host)
+ *---------------------------------------------------------------------------*/
+void CDC_BulkReset(void) {
+
+  CDC_DepInEmpty   = 1;
+  CDC_DepInZLP     = 0;
+  CDC_DepInStalled = 0;
+  CDC_DepOutNAK    = 0;
+}
+
+
+/*----------------------------------------------------------------------------
+  Queue data for the bulk IN endpoint (MCU to PC)
+  If the CDC buffer is full this waits up to CDC_TXTIMEOUT ms for the host
+  to collect data.  If the host doesn't (no terminal open, etc.), the
+  remaining data is dropped and further writes are dropped immediately
+  until the host starts reading again, so the caller is never held up
+  for long.
+  Before the host has configured the device the data is only buffered
+  (whatever doesn't fit is dropped without waiting), and it is sent as
+  soon as the device is configured (see USB_Configure_Event).
+  Parameters:   buffer  data to send
+                length  number of bytes
+  Return Value: number of bytes queued
+ *---------------------------------------------------------------------------*/
+uint32_t CDC_WrInBuf (const uint8_t *buffer, uint32_t length) {
+  uint32_t bytesWritten = 0;
+  uint32_t startTick = systickGetTicks();
+
+  if (!USB_Configuration) {
+    return cdcBufferWriteLen(buffer, length);
+  }
+
+  while (bytesWritten < length) {
+    bytesWritten += cdcBufferWriteLen(buffer + bytesWritten, length - bytesWritten);
+
+    // Keep the endpoint busy once a full packet is waiting
+    if (cdcBufferCount() >= CDC_DEP_MAXPACKET) {
+      CDC_BulkInStart();
+    }
+
+    // Buffer full: wait for the ISR to make room, unless we already know
+    // that the host isn't reading
+    if (bytesWritten < length) {
+      if (CDC_DepInStalled) {
+        break;
+      }
+      if (systickGetTicks() - startTick > CDC_TXTIMEOUT) {
+        CDC_DepInStalled = 1;
+        break;
+      }
+    }
+  }
+
+  return (bytesWritten);
+}
+
+
 /*----------------------------------------------------------------------------
   CDC_BulkOut call on DataOut Request
   Parameters:   none
@@ -324,17 +428,46 @@ void CDC_BulkIn(void) {
 void CDC_BulkOut(void) {
   int numBytesRead;
 
+  // If there's no room for a full packet, leave it in the endpoint.  The
+  // host will get NAKs until CDC_BulkOutResume reads it.
+  if (CDC_BUF_FREE(CDC_OutBuf) < CDC_DEP_MAXPACKET) {
+    CDC_DepOutNAK = 1;
+    return;
+  }
+
+  // Nothing to read (already picked up by CDC_BulkOutResume)
+  if (!(USB_SelectEP(CDC_DEP_OUT) & EP_SEL_F)) {
+    return;
+  }
+
   // get data from USB into intermediate buffer
   numBytesRead = USB_ReadEP(CDC_DEP_OUT, &BulkBufOut[0]);
 
-  // ... add code to check for overwrite
-
   // store data in a buffer to transmit it over serial interface
   CDC_WrOutBuf ((char *)&BulkBufOut[0], &numBytesRead);
 
 }
 
 
+/*----------------------------------------------------------------------------
+  Reads any OUT packets that were held back by CDC_BulkOut, once the
+  application has made enough room in CDC_OutBuf
+ *---------------------------------------------------------------------------*/
+static void CDC_BulkOutResume (void) {
+
+  if (CDC_DepOutNAK && (CDC_BUF_FREE(CDC_OutBuf) >= CDC_DEP_MAXPACKET)) {
+    // The endpoint registers are shared with the ISR
+    NVIC_DisableIRQ(USB_IRQn);
+    CDC_DepOutNAK = 0;
+    // The endpoint may be double buffered, so keep going while it has data
+    while (!CDC_DepOutNAK && (USB_SelectEP(CDC_DEP_OUT) & EP_SEL_F)) {
+      CDC_BulkOut();
+    }
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+}
+
+
 /*----------------------------------------------------------------------------
   Get the SERIAL_STATE as defined in usbcdc11.pdf, 6.3.5, Table 69.
   Parameters:   none
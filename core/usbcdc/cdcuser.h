@@ -21,14 +21,23 @@
 
 /* CDC buffer handling */
 extern int CDC_RdOutBuf        (char *buffer, const int *length);
+extern uint32_t CDC_RdOutBufLen(uint8_t *buffer, uint32_t length);
 extern int CDC_WrOutBuf        (const char *buffer, int *length);
 extern int CDC_OutBufAvailChar (int *availChar);
+extern uint32_t CDC_WrInBuf    (const uint8_t *buffer, uint32_t length);
+
+/* Time (in ms) CDC_WrInBuf waits for the host to collect data before
+   dropping output */
+#define CDC_TXTIMEOUT    (100)
 
 
 /* CDC Data In/Out Endpoint Address */
 #define CDC_DEP_IN       0x83
 #define CDC_DEP_OUT      0x03
 
+/* CDC Data Endpoint max. packet size (see usbdesc.c) */
+#define CDC_DEP_MAXPACKET  (64)
+
 /* CDC Communication In Endpoint Address */
 #define CDC_CEP_IN       0x81
 
@@ -46,6 +55,8 @@ extern uint32_t CDC_SendBreak                (unsigned short wDurationOfBreak);
 /* CDC Bulk Callback Functions */
 extern void CDC_BulkIn                   (void);
 extern void CDC_BulkOut                  (void);
+extern void CDC_BulkInStart              (void);
+extern void CDC_BulkReset              (void);
 
 /* CDC Notification Callback Function */
 extern void CDC_NotificationIn           (void);
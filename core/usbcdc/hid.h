@@ -0,0 +1,74 @@
+/*----------------------------------------------------------------------------
+ *      Name:    hid.h
+ *      Purpose: USB HID (Human Interface Device) definitions
+ *      Version: V1.00
+ *---------------------------------------------------------------------------*/
+
+#ifndef __HID_H__
+#define __HID_H__
+
+#include "projectconfig.h"
+
+/* HID Subclass Codes */
+#define HID_SUBCLASS_NONE               0x00
+#define HID_SUBCLASS_BOOT               0x01
+
+/* HID Protocol Codes */
+#define HID_PROTOCOL_NONE               0x00
+#define HID_PROTOCOL_KEYBOARD           0x01
+#define HID_PROTOCOL_MOUSE              0x02
+
+/* HID Descriptor Types */
+#define HID_HID_DESCRIPTOR_TYPE         0x21
+#define HID_REPORT_DESCRIPTOR_TYPE      0x22
+#define HID_PHYSICAL_DESCRIPTOR_TYPE    0x23
+
+/* HID Descriptor */
+typedef struct _HID_DESCRIPTOR {
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint16_t bcdHID;
+  uint8_t  bCountryCode;
+  uint8_t  bNumDescriptors;
+  /* Array of one or more descriptors */
+  struct _HID_DESCRIPTOR_LIST {
+    uint8_t  bDescriptorType;
+    uint16_t wDescriptorLength;
+  } __attribute__((packed)) DescriptorList[1];
+} __attribute__((packed)) HID_DESCRIPTOR;
+
+/* HID Request Codes */
+#define HID_REQUEST_GET_REPORT          0x01
+#define HID_REQUEST_GET_IDLE            0x02
+#define HID_REQUEST_GET_PROTOCOL        0x03
+#define HID_REQUEST_SET_REPORT          0x09
+#define HID_REQUEST_SET_IDLE            0x0A
+#define HID_REQUEST_SET_PROTOCOL        0x0B
+
+/* HID Report Types (high byte of wValue in Get/Set Report) */
+#define HID_REPORT_INPUT                0x01
+#define HID_REPORT_OUTPUT               0x02
+#define HID_REPORT_FEATURE              0x03
+
+/* Short report descriptor items (tag | type | size) */
+#define HID_UsagePage(x)                0x05, (x)
+#define HID_UsagePageVendor(x)          0x06, (x), 0xFF
+#define HID_Usage(x)                    0x09, (x)
+#define HID_Collection(x)               0xA1, (x)
+#define HID_EndCollection               0xC0
+#define HID_LogicalMin(x)               0x15, (x)
+#define HID_LogicalMaxS(x)              0x26, ((x) & 0xFF), (((x) >> 8) & 0xFF)
+#define HID_ReportSize(x)               0x75, (x)
+#define HID_ReportCount(x)              0x95, (x)
+#define HID_Input(x)                    0x81, (x)
+#define HID_Output(x)                   0x91, (x)
+
+/* Collection Types */
+#define HID_Application                 0x01
+
+/* Main item data bits */
+#define HID_Data                        (0 << 0)
+#define HID_Variable                    (1 << 1)
+#define HID_Absolute                    (0 << 2)
+
+#endif  /* __HID_H__ */
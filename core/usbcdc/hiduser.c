@@ -0,0 +1,223 @@
+/*----------------------------------------------------------------------------
+ *      Name:    hiduser.c
+ *      Purpose: HID interface of the composite (CDC + HID) device
+ *      Version: V1.00
+ *----------------------------------------------------------------------------
+ *      Input reports are queued by the application with HID_QueueReport and
+ *      handed to the interrupt IN endpoint one per poll.  With a 1ms
+ *      bInterval a report queued while the endpoint is idle is written
+ *      straight into the endpoint buffer and goes out on the next frame;
+ *      reports queued while one is in flight are sent from the USB ISR as
+ *      soon as the host has collected the previous one.  The touchscreen
+ *      and joystick drivers queue their events with HID_QueueEvent.
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "projectconfig.h"
+
+#ifdef CFG_USBCDC_HID
+
+#include "usb.h"
+#include "usbhw.h"
+#include "usbcfg.h"
+#include "usbcore.h"
+#include "hid.h"
+#include "hiduser.h"
+
+#define HID_QUEUE_SIZE   (CFG_USBCDC_HIDQUEUESIZE)     // Reports (power of 2)
+#define HID_QUEUE_MASK   (HID_QUEUE_SIZE - 1)
+
+/* Input report queue.  head is only written by the application and tail
+   only by the USB ISR, and both are free-running. */
+static uint8_t HID_Queue[HID_QUEUE_SIZE][HID_IN_REPORT_SIZE];
+static volatile uint8_t HID_QueueHead = 0;
+static volatile uint8_t HID_QueueTail = 0;
+static volatile uint8_t HID_EpBusy    = 0;    // A report is in the IN endpoint
+
+static uint8_t HID_InReportLast [HID_IN_REPORT_SIZE];   // For GET_REPORT
+static uint8_t HID_OutReportBuf [HID_OUT_REPORT_SIZE];
+static volatile uint8_t HID_OutReportNew = 0;
+
+static uint8_t HID_Protocol = 1;                // Report protocol
+static uint8_t HID_IdleTime = 0;                // Only send on change
+
+/*----------------------------------------------------------------------------
+  HID Get Report Request Callback
+  Called automatically on HID Get Report Request
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_GetReport (void) {
+
+  if (SetupPacket.wValue.WB.H != HID_REPORT_INPUT) {
+    return (FALSE);
+  }
+  memcpy(EP0Buf, HID_InReportLast, HID_IN_REPORT_SIZE);
+  if (EP0Data.Count > HID_IN_REPORT_SIZE) {
+    EP0Data.Count = HID_IN_REPORT_SIZE;
+  }
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Set Report Request Callback
+  Called automatically on HID Set Report Request
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_SetReport (void) {
+
+  if (SetupPacket.wValue.WB.H != HID_REPORT_OUTPUT) {
+    return (FALSE);
+  }
+  memcpy(HID_OutReportBuf, EP0Buf, HID_OUT_REPORT_SIZE);
+  HID_OutReportNew = 1;
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Get Idle Request Callback
+  Called automatically on HID Get Idle Request
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_GetIdle (void) {
+
+  EP0Buf[0] = HID_IdleTime;
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Set Idle Request Callback
+  Called automatically on HID Set Idle Request
+  Reports are only ever sent when they are queued, so the idle rate is
+  stored for GET_IDLE but not otherwise used
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_SetIdle (void) {
+
+  HID_IdleTime = SetupPacket.wValue.WB.H;
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Get Protocol Request Callback
+  Called automatically on HID Get Protocol Request
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_GetProtocol (void) {
+
+  EP0Buf[0] = HID_Protocol;
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Set Protocol Request Callback
+  Called automatically on HID Set Protocol Request
+  Return Value: TRUE - Success, FALSE - Error
+ *---------------------------------------------------------------------------*/
+uint32_t HID_SetProtocol (void) {
+
+  HID_Protocol = SetupPacket.wValue.WB.L;
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  HID Interrupt In Callback
+  Called from the USB ISR once the host has collected the last report:
+  send the next queued one, if any
+ *---------------------------------------------------------------------------*/
+void HID_InReport (void) {
+  uint8_t tail = HID_QueueTail;
+
+  if (tail == HID_QueueHead) {
+    HID_EpBusy = 0;
+    return;
+  }
+  memcpy(HID_InReportLast, HID_Queue[tail & HID_QUEUE_MASK], HID_IN_REPORT_SIZE);
+  USB_WriteEP(HID_EP_IN, HID_InReportLast, HID_IN_REPORT_SIZE);
+  HID_QueueTail = tail + 1;
+  HID_EpBusy = 1;
+}
+
+/*----------------------------------------------------------------------------
+  HID Reset
+  Called on bus reset and SET_CONFIGURATION: the endpoint is empty again
+  and anything still queued belongs to the previous session
+ *---------------------------------------------------------------------------*/
+void HID_Reset (void) {
+
+  HID_QueueTail = HID_QueueHead;
+  HID_EpBusy = 0;
+  HID_Protocol = 1;
+  HID_IdleTime = 0;
+}
+
+/*----------------------------------------------------------------------------
+  Queue an input report (HID_IN_REPORT_SIZE bytes) for the host
+  If the endpoint is idle the report is written to it immediately
+  Return Value: TRUE - queued, FALSE - not configured or queue full
+ *---------------------------------------------------------------------------*/
+uint32_t HID_QueueReport (const uint8_t *report) {
+  uint8_t head = HID_QueueHead;
+
+  if (!USB_Configuration) {
+    return (FALSE);
+  }
+  if ((uint8_t)(head - HID_QueueTail) >= HID_QUEUE_SIZE) {
+    return (FALSE);
+  }
+  memcpy(HID_Queue[head & HID_QUEUE_MASK], report, HID_IN_REPORT_SIZE);
+  HID_QueueHead = head + 1;
+
+  if (!HID_EpBusy) {
+    // The endpoint registers are shared with the ISR
+    NVIC_DisableIRQ(USB_IRQn);
+    if (!HID_EpBusy) {
+      HID_InReport();
+    }
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+  return (TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  Queue an input event (see HID_EVENT_TOUCH etc. in hiduser.h) as a report:
+  the type byte followed by len bytes of data, zero padded
+  Return Value: TRUE - queued, FALSE - not configured or queue full
+ *---------------------------------------------------------------------------*/
+uint32_t HID_QueueEvent (uint8_t type, const uint8_t *data, uint32_t len) {
+  uint8_t report[HID_IN_REPORT_SIZE];
+
+  if (len > HID_IN_REPORT_SIZE - 1) {
+    len = HID_IN_REPORT_SIZE - 1;
+  }
+  memset(report, 0, HID_IN_REPORT_SIZE);
+  report[0] = type;
+  memcpy(&report[1], data, len);
+  return (HID_QueueReport(report));
+}
+
+/*----------------------------------------------------------------------------
+  Number of reports that can be queued without HID_QueueReport failing
+ *---------------------------------------------------------------------------*/
+uint32_t HID_QueueFree (void) {
+
+  return (HID_QUEUE_SIZE - (uint8_t)(HID_QueueHead - HID_QueueTail));
+}
+
+/*----------------------------------------------------------------------------
+  Copy the last output report sent by the host (HID_OUT_REPORT_SIZE bytes)
+  Return Value: TRUE - a new report was received since the last call
+ *---------------------------------------------------------------------------*/
+uint32_t HID_GetOutReport (uint8_t *report) {
+
+  if (!HID_OutReportNew) {
+    return (FALSE);
+  }
+  NVIC_DisableIRQ(USB_IRQn);
+  memcpy(report, HID_OutReportBuf, HID_OUT_REPORT_SIZE);
+  HID_OutReportNew = 0;
+  NVIC_EnableIRQ(USB_IRQn);
+  return (TRUE);
+}
+
+#endif
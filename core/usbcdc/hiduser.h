@@ -0,0 +1,47 @@
+/*----------------------------------------------------------------------------
+ *      Name:    hiduser.h
+ *      Purpose: HID interface of the composite (CDC + HID) device
+ *      Version: V1.00
+ *---------------------------------------------------------------------------*/
+
+#ifndef __HIDUSER_H__
+#define __HIDUSER_H__
+
+#include "projectconfig.h"
+
+/* HID Interrupt In Endpoint (see usbdesc.c) */
+#define HID_EP_IN           0x82
+
+/* Size in bytes of every input report (see HID_ReportDescriptor) */
+#define HID_IN_REPORT_SIZE  (CFG_USBCDC_HIDREPORTSIZE)
+#define HID_OUT_REPORT_SIZE (1)
+
+/* Input events queued by the drivers with HID_QueueEvent.  Byte 0 of the
+   report is the event type, followed by the event data (little endian)
+   and zero padding:
+     HID_EVENT_TOUCH     X (2 bytes), Y (2 bytes) in LCD co-ordinates
+     HID_EVENT_JOYSTICK  horizontal (2 bytes), vertical (2 bytes) raw ADC
+                         values, select button (1 byte)
+   Event data that doesn't fit in HID_IN_REPORT_SIZE bytes is cut off. */
+#define HID_EVENT_TOUCH     0x01
+#define HID_EVENT_JOYSTICK  0x02
+
+/* HID Requests Callback Functions */
+extern uint32_t HID_GetReport   (void);
+extern uint32_t HID_SetReport   (void);
+extern uint32_t HID_GetIdle     (void);
+extern uint32_t HID_SetIdle     (void);
+extern uint32_t HID_GetProtocol (void);
+extern uint32_t HID_SetProtocol (void);
+
+/* HID Endpoint Callback Functions */
+extern void HID_InReport (void);
+extern void HID_Reset    (void);
+
+/* Application interface */
+extern uint32_t HID_QueueReport  (const uint8_t *report);
+extern uint32_t HID_QueueEvent   (uint8_t type, const uint8_t *data, uint32_t len);
+extern uint32_t HID_QueueFree    (void);
+extern uint32_t HID_GetOutReport (uint8_t *report);
+
+#endif  /* __HIDUSER_H__ */
@@ -23,6 +23,8 @@
 #ifndef __USBCFG_H__
 #define __USBCFG_H__
 
+#include "projectconfig.h"
+
 
 //*** <<< Use Configuration Wizard in Context Menu >>> ***
 
@@ -54,7 +56,11 @@
 */
 
 #define USB_POWER           0
+#ifdef CFG_USBCDC_HID
+#define USB_IF_NUM          3
+#else
 #define USB_IF_NUM          1
+#endif
 #define USB_LOGIC_EP_NUM    5
 #define USB_EP_NUM          10
 #define USB_MAX_PACKET0     64
@@ -103,7 +109,13 @@
 #define USB_WAKEUP_EVENT    0
 #define USB_SOF_EVENT       0
 #define USB_ERROR_EVENT     0
-#define USB_EP_EVENT        0x000B
+#if defined CFG_USBMSC
+#define USB_EP_EVENT        0x0009    /* EP0 + EP3 (MSC bulk) */
+#elif defined CFG_USBCDC_HID
+#define USB_EP_EVENT        0x000F    /* EP0 + EP1 (CDC notify) + EP2 (HID in) + EP3 (CDC bulk) */
+#else
+#define USB_EP_EVENT        0x000B    /* EP0 + EP1 (CDC notify) + EP3 (CDC bulk) */
+#endif
 #define USB_CONFIGURE_EVENT 1
 #define USB_INTERFACE_EVENT 0
 #define USB_FEATURE_EVENT   0
@@ -133,15 +145,27 @@
 */
 
 #define USB_CLASS           1
+#ifdef CFG_USBCDC_HID
+#define USB_HID             1
+#else
 #define USB_HID             0
-#define USB_HID_IF_NUM      0
+#endif
+#define USB_HID_IF_NUM      2
+#ifdef CFG_USBMSC
+#define USB_MSC             1
+#else
 #define USB_MSC             0
+#endif
 #define USB_MSC_IF_NUM      0
 #define USB_AUDIO           0
 #define USB_ADC_CIF_NUM     0
 #define USB_ADC_SIF1_NUM    1
 #define USB_ADC_SIF2_NUM    2
+#ifdef CFG_USBCDC
 #define USB_CDC  	        1
+#else
+#define USB_CDC  	        0
+#endif
 #define USB_CDC_CIF_NUM     0
 #define USB_CDC_DIF_NUM     1
 #define USB_CDC_BUFSIZE     CFG_USBCDC_BUFSIZE
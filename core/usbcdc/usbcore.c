@@ -43,8 +43,8 @@
 #endif
 
 #if (USB_MSC)
-#include "msc.h"
-#include "mscuser.h"
+#include "core/usbmsc/msc.h"
+#include "core/usbmsc/mscuser.h"
 extern MSC_CSW CSW;
 #endif
 
@@ -853,7 +853,9 @@ void USB_EndPoint0 (uint32_t event) {
             default:
               goto stall_i;
           }
+#if (USB_HID || USB_MSC || USB_AUDIO || USB_CDC)
 setup_class_ok:                                                          /* request finished successfully */
+#endif
           break;  /* end case REQUEST_CLASS */
 #endif  /* USB_CLASS */
 
@@ -995,7 +997,9 @@ stall_i:  USB_SetStallEP(0x80);
                   default:
                     goto stall_i;
                 }
+#if (USB_HID || USB_AUDIO || USB_CDC)
 out_class_ok:                                                            /* request finished successfully */
+#endif
                 break; /* end case REQUEST_CLASS */
 #endif  /* USB_CLASS */
 
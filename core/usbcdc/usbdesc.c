@@ -26,6 +26,15 @@
 #include "usbcfg.h"
 #include "usbdesc.h"
 #include "config.h"
+#if (USB_HID)
+#include "hid.h"
+#include "hiduser.h"
+#endif
+
+#if (USB_MSC)
+#include "core/usbmsc/msc.h"
+#include "core/usbmsc/mscuser.h"
+#endif
 
  
 /* USB Standard Device Descriptor */
@@ -33,9 +42,19 @@ const uint8_t USB_DeviceDescriptor[] = {
   USB_DEVICE_DESC_SIZE,              /* bLength */
   USB_DEVICE_DESCRIPTOR_TYPE,        /* bDescriptorType */
   WBVAL(0x0200), /* 2.0 */           /* bcdUSB */
+#if (USB_MSC)
+  0x00,                              /* bDeviceClass: defined at interface level */
+  0x00,                              /* bDeviceSubClass */
+  0x00,                              /* bDeviceProtocol */
+#elif (USB_HID)
+  USB_DEVICE_CLASS_MISCELLANEOUS,    /* bDeviceClass: functions use IADs */
+  0x02,                              /* bDeviceSubClass: Common Class */
+  0x01,                              /* bDeviceProtocol: Interface Association Descriptor */
+#else
   USB_DEVICE_CLASS_COMMUNICATIONS,   /* bDeviceClass CDC*/
   0x00,                              /* bDeviceSubClass */
   0x00,                              /* bDeviceProtocol */
+#endif
   USB_MAX_PACKET0,                   /* bMaxPacketSize0 */
   WBVAL(USB_VENDOR_ID),                     /* idVendor */
   WBVAL(USB_PROD_ID),                     /* idProduct */
@@ -46,26 +65,116 @@ const uint8_t USB_DeviceDescriptor[] = {
   0x01                               /* bNumConfigurations: one possible configuration*/
 };
 
+#if (USB_HID)
+/* HID Report Descriptor: a vendor defined collection with one input report
+   of CFG_USBCDC_HIDREPORTSIZE bytes and a one byte output report */
+const uint8_t HID_ReportDescriptor[] = {
+  HID_UsagePageVendor(0x00),
+  HID_Usage(0x01),
+  HID_Collection(HID_Application),
+    HID_LogicalMin(0),
+    HID_LogicalMaxS(0xFF),
+    HID_ReportSize(8),
+    HID_ReportCount(HID_IN_REPORT_SIZE),
+    HID_Usage(0x01),
+    HID_Input(HID_Data | HID_Variable | HID_Absolute),
+    HID_ReportCount(HID_OUT_REPORT_SIZE),
+    HID_Usage(0x01),
+    HID_Output(HID_Data | HID_Variable | HID_Absolute),
+  HID_EndCollection,
+};
+const uint16_t HID_ReportDescSize = sizeof(HID_ReportDescriptor);
+#endif
+
 /* USB Configuration Descriptor */
 /*   All Descriptors (Configuration, Interface, Endpoint, Class, Vendor */
+#if (USB_MSC)
 const uint8_t USB_ConfigDescriptor[] = {
 /* Configuration 1 */
   USB_CONFIGUARTION_DESC_SIZE,       /* bLength */
   USB_CONFIGURATION_DESCRIPTOR_TYPE, /* bDescriptorType */
   WBVAL(                             /* wTotalLength */
     1*USB_CONFIGUARTION_DESC_SIZE +
+    1*USB_INTERFACE_DESC_SIZE     +  /* mass storage interface */
+    2*USB_ENDPOINT_DESC_SIZE         /* bulk endpoints */
+      ),
+  0x01,                              /* bNumInterfaces */
+  0x01,                              /* bConfigurationValue: 0x01 is used to select this configuration */
+  0x00,                              /* iConfiguration: no string to describe this configuration */
+  USB_CONFIG_BUS_POWERED /*|*/       /* bmAttributes */
+/*USB_CONFIG_REMOTE_WAKEUP*/,
+  USB_CONFIG_POWER_MA(100),          /* bMaxPower, device power consumption is 100 mA */
+/* Interface 0, Alternate Setting 0, Mass Storage class interface descriptor */
+  USB_INTERFACE_DESC_SIZE,           /* bLength */
+  USB_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+  USB_MSC_IF_NUM,                    /* bInterfaceNumber: Number of Interface */
+  0x00,                              /* bAlternateSetting: Alternate setting */
+  0x02,                              /* bNumEndpoints: two endpoints used */
+  USB_DEVICE_CLASS_STORAGE,          /* bInterfaceClass: Mass Storage */
+  MSC_SUBCLASS_SCSI,                 /* bInterfaceSubClass: SCSI transparent command set */
+  MSC_PROTOCOL_BULK_ONLY,            /* bInterfaceProtocol: Bulk-Only Transport */
+  0x00,                              /* iInterface: */
+/* Endpoint, EP3 Bulk Out (double buffered) */
+  USB_ENDPOINT_DESC_SIZE,            /* bLength */
+  USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
+  USB_ENDPOINT_OUT(3),               /* bEndpointAddress */
+  USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
+  WBVAL(MSC_MAX_PACKET),             /* wMaxPacketSize */
+  0x00,                              /* bInterval: ignore for Bulk transfer */
+/* Endpoint, EP3 Bulk In (double buffered) */
+  USB_ENDPOINT_DESC_SIZE,            /* bLength */
+  USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
+  USB_ENDPOINT_IN(3),                /* bEndpointAddress */
+  USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
+  WBVAL(MSC_MAX_PACKET),             /* wMaxPacketSize */
+  0x00,                              /* bInterval: ignore for Bulk transfer */
+/* Terminator */
+  0                                  /* bLength */
+};
+#else
+const uint8_t USB_ConfigDescriptor[] = {
+/* Configuration 1 */
+  USB_CONFIGUARTION_DESC_SIZE,       /* bLength */
+  USB_CONFIGURATION_DESCRIPTOR_TYPE, /* bDescriptorType */
+  WBVAL(                             /* wTotalLength */
+    1*USB_CONFIGUARTION_DESC_SIZE +
+#if (USB_HID)
+    1*USB_IAD_DESC_SIZE           +  /* CDC interface association */
+#endif
     1*USB_INTERFACE_DESC_SIZE     +  /* communication interface */
     0x0013                        +  /* CDC functions */
     1*USB_ENDPOINT_DESC_SIZE      +  /* interrupt endpoint */
     1*USB_INTERFACE_DESC_SIZE     +  /* data interface */
+#if (USB_HID)
+    2*USB_ENDPOINT_DESC_SIZE      +  /* bulk endpoints */
+    1*USB_INTERFACE_DESC_SIZE     +  /* HID interface */
+    HID_DESC_SIZE                 +  /* HID descriptor */
+    1*USB_ENDPOINT_DESC_SIZE         /* HID interrupt endpoint */
+#else
     2*USB_ENDPOINT_DESC_SIZE         /* bulk endpoints */
+#endif
       ),
+#if (USB_HID)
+  0x03,                              /* bNumInterfaces */
+#else
   0x02,                              /* bNumInterfaces */
+#endif
   0x01,                              /* bConfigurationValue: 0x01 is used to select this configuration */
   0x00,                              /* iConfiguration: no string to describe this configuration */
   USB_CONFIG_BUS_POWERED /*|*/       /* bmAttributes */
 /*USB_CONFIG_REMOTE_WAKEUP*/,
   USB_CONFIG_POWER_MA(100),          /* bMaxPower, device power consumption is 100 mA */
+#if (USB_HID)
+/* Interface Association Descriptor: groups the two CDC interfaces */
+  USB_IAD_DESC_SIZE,                 /* bLength */
+  USB_INTERFACE_ASSOCIATION_DESCRIPTOR_TYPE, /* bDescriptorType */
+  USB_CDC_CIF_NUM,                   /* bFirstInterface */
+  0x02,                              /* bInterfaceCount */
+  CDC_COMMUNICATION_INTERFACE_CLASS, /* bFunctionClass */
+  CDC_ABSTRACT_CONTROL_MODEL,        /* bFunctionSubClass */
+  0x01,                              /* bFunctionProtocol */
+  0x04,                              /* iFunction: "VCOM" */
+#endif
 /* Interface 0, Alternate Setting 0, Communication class interface descriptor */
   USB_INTERFACE_DESC_SIZE,           /* bLength */
   USB_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
@@ -129,9 +238,37 @@ const uint8_t USB_ConfigDescriptor[] = {
   USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
   WBVAL(64),                         /* wMaxPacketSize */
   0x00,                              /* bInterval: ignore for Bulk transfer */
+#if (USB_HID)
+/* Interface 2, Alternate Setting 0, HID class interface descriptor */
+  USB_INTERFACE_DESC_SIZE,           /* bLength */
+  USB_INTERFACE_DESCRIPTOR_TYPE,     /* bDescriptorType */
+  USB_HID_IF_NUM,                    /* bInterfaceNumber: Number of Interface */
+  0x00,                              /* bAlternateSetting: Alternate setting */
+  0x01,                              /* bNumEndpoints: One endpoint used */
+  USB_DEVICE_CLASS_HUMAN_INTERFACE,  /* bInterfaceClass: HID */
+  HID_SUBCLASS_NONE,                 /* bInterfaceSubClass: no boot interface */
+  HID_PROTOCOL_NONE,                 /* bInterfaceProtocol: none */
+  0x00,                              /* iInterface: */
+/* HID Class Descriptor (HID_DESC_OFFSET) */
+  HID_DESC_SIZE,                     /* bLength */
+  HID_HID_DESCRIPTOR_TYPE,           /* bDescriptorType */
+  WBVAL(0x0111), /* 1.11 */          /* bcdHID */
+  0x00,                              /* bCountryCode */
+  0x01,                              /* bNumDescriptors */
+  HID_REPORT_DESCRIPTOR_TYPE,        /* bDescriptorType */
+  WBVAL(HID_REPORT_DESC_SIZE),       /* wDescriptorLength */
+/* Endpoint, EP2 Interrupt In */
+  USB_ENDPOINT_DESC_SIZE,            /* bLength */
+  USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
+  USB_ENDPOINT_IN(2),                /* bEndpointAddress */
+  USB_ENDPOINT_TYPE_INTERRUPT,       /* bmAttributes */
+  WBVAL(HID_IN_REPORT_SIZE),         /* wMaxPacketSize */
+  CFG_USBCDC_HIDINTERVAL,            /* bInterval: in ms */
+#endif
 /* Terminator */
   0                                  /* bLength */
 };
+#endif
 
 
 
@@ -173,10 +310,17 @@ const uint8_t USB_StringDescriptor[] = {
   'x',0,
   'x',0,
   ' ',0,
+#if (USB_MSC)
+  'D',0,
+  'I',0,
+  'S',0,
+  'K',0,
+#else
   'V',0,
   'C',0,
   'O',0,
   'M',0,
+#endif
   ' ',0,
 /* Index 0x03: Serial Number */
   (12*2 + 2),                        /* bLength (12 Char + Type + lenght) */
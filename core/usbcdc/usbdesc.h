@@ -26,6 +26,19 @@
 #define USB_CONFIGUARTION_DESC_SIZE (sizeof(USB_CONFIGURATION_DESCRIPTOR))
 #define USB_INTERFACE_DESC_SIZE     (sizeof(USB_INTERFACE_DESCRIPTOR))
 #define USB_ENDPOINT_DESC_SIZE      (sizeof(USB_ENDPOINT_DESCRIPTOR))
+#define USB_IAD_DESC_SIZE           0x08
+
+#if (USB_HID)
+/* The HID descriptor follows the CDC function and the HID interface */
+#define HID_DESC_OFFSET             (USB_CONFIGUARTION_DESC_SIZE + USB_IAD_DESC_SIZE + \
+                                     3*USB_INTERFACE_DESC_SIZE + 0x0013 +             \
+                                     3*USB_ENDPOINT_DESC_SIZE)
+#define HID_DESC_SIZE               (sizeof(HID_DESCRIPTOR))
+#define HID_REPORT_DESC_SIZE        (sizeof(HID_ReportDescriptor))
+
+extern const uint8_t HID_ReportDescriptor[];
+extern const uint16_t HID_ReportDescSize;
+#endif
 
 extern const uint8_t USB_DeviceDescriptor[];
 extern const uint8_t USB_ConfigDescriptor[];
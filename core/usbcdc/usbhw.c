@@ -396,6 +396,21 @@ void USB_ClearEPBuf (uint32_t EPNum) {
 }
 
 
+/*
+ *  Select USB Endpoint and read its status (without clearing the
+ *  endpoint interrupt)
+ *    Parameters:      EPNum: Endpoint Number
+ *                       EPNum.0..3: Address
+ *                       EPNum.7:    Dir
+ *    Return Value:    Endpoint status (EP_SEL_F, EP_SEL_ST, ...)
+ */
+
+uint32_t USB_SelectEP (uint32_t EPNum) {
+  WrCmd(CMD_SEL_EP(EPAdr(EPNum)));
+  return (RdCmdDat(DAT_SEL_EP(EPAdr(EPNum))));
+}
+
+
 /*
  *  Read USB Endpoint Data
  *    Parameters:      EPNum: Endpoint Number
@@ -483,7 +498,7 @@ uint32_t USB_GetFrame (void) {
  *  USB Interrupt Service Routine
  */
 
-#ifdef CFG_USBCDC
+#if defined CFG_USBCDC || defined CFG_USBMSC
 void USB_IRQHandler (void)
 {
   uint32_t disr, val, n, m;
@@ -22,7 +22,52 @@
 #include "usbhw.h"
 #include "usbcore.h"
 #include "usbuser.h"
+
+#if (USB_CDC)
 #include "cdcuser.h"
+#endif
+
+#if (USB_MSC)
+#include "core/usbmsc/mscuser.h"
+#endif
+#if (USB_HID)
+#include "hiduser.h"
+#endif
+
+
+/* Application callback for configuration changes (see USB_SetConfigCallback) */
+static void (*USB_ConfigCallback) (uint32_t configured) = NULL;
+static uint8_t USB_ConfigLast = 0;
+
+
+/*
+ *  Calls the application callback if the device went from unconfigured to
+ *  configured or back since the last call
+ */
+
+static void USB_ConfigNotify (void) {
+  uint8_t configured = USB_Configuration ? 1 : 0;
+
+  if (configured != USB_ConfigLast) {
+    USB_ConfigLast = configured;
+    if (USB_ConfigCallback) {
+      USB_ConfigCallback(configured);
+    }
+  }
+}
+
+
+/*
+ *  Register a function to be called when the host configures the device
+ *  (configured = 1) or it stops being configured after a bus reset or
+ *  SET_CONFIGURATION 0 (configured = 0).  The callback runs in the USB
+ *  ISR, so it should only set flags or queue work for the main loop.
+ *    Parameter:       callback: function to call, or NULL
+ */
+
+void USB_SetConfigCallback (void (*callback) (uint32_t configured)) {
+  USB_ConfigCallback = callback;
+}
 
 
 /*
@@ -45,6 +90,16 @@ void USB_Power_Event (uint32_t  power) {
 #if USB_RESET_EVENT
 void USB_Reset_Event (void) {
   USB_ResetCore();
+#if (USB_CDC)
+  CDC_BulkReset();
+#endif
+#if (USB_HID)
+  HID_Reset();
+#endif
+#if (USB_MSC)
+  MSC_Reset();
+#endif
+  USB_ConfigNotify();
 }
 #endif
 
@@ -114,8 +169,18 @@ void USB_Error_Event (uint32_t error) {
 void USB_Configure_Event (void) {
 
   if (USB_Configuration) {                  /* Check if USB is configured */
-    /* add your code here */
+#if (USB_CDC)
+    CDC_BulkReset();                        /* Endpoint buffers are empty */
+    CDC_BulkIn();                           /* Send output queued before enumeration */
+#endif
+#if (USB_HID)
+    HID_Reset();                            /* Nothing in the report endpoint */
+#endif
+#if (USB_MSC)
+    MSC_Reset();                            /* Wait for a new CBW */
+#endif
   }
+  USB_ConfigNotify();
 }
 #endif
 
@@ -161,6 +226,7 @@ void (* const USB_P_EP[USB_LOGIC_EP_NUM]) (uint32_t event) = {
  */
 
 void USB_EndPoint1 (uint32_t event) {
+#if (USB_CDC)
   uint16_t temp;
   static uint16_t serialState;
 
@@ -173,6 +239,9 @@ void USB_EndPoint1 (uint32_t event) {
       }
       break;
   }
+#else
+  event = event;
+#endif
 }
 
 
@@ -183,7 +252,15 @@ void USB_EndPoint1 (uint32_t event) {
  */
 
 void USB_EndPoint2 (uint32_t event) {
+#if (USB_HID)
+  switch (event) {
+    case USB_EVT_IN:
+      HID_InReport ();               /* send the next queued report */
+      break;
+  }
+#else
   event = event;
+#endif
 }
 
 
@@ -195,12 +272,21 @@ void USB_EndPoint2 (uint32_t event) {
 
 void USB_EndPoint3 (uint32_t event) {
   switch (event) {
+#if (USB_MSC)
+    case USB_EVT_OUT:
+      MSC_BulkOut ();                /* CBW or WRITE(10) data from Host */
+      break;
+    case USB_EVT_IN:
+      MSC_BulkIn ();                 /* data or CSW sent to Host */
+      break;
+#elif (USB_CDC)
     case USB_EVT_OUT:
       CDC_BulkOut ();                /* data received from Host */
       break;
     case USB_EVT_IN:
       CDC_BulkIn ();                 /* data expected from Host */
       break;
+#endif
   }
 }
 
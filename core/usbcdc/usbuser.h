@@ -48,6 +48,9 @@ extern void USB_EndPoint2  (uint32_t event);
 extern void USB_EndPoint3  (uint32_t event);
 extern void USB_EndPoint4  (uint32_t event);
 
+/* Application callback for configuration changes */
+extern void USB_SetConfigCallback (void (*callback) (uint32_t configured));
+
 /* USB Core Events Callback Functions */
 extern void USB_Configure_Event (void);
 extern void USB_Interface_Event (void);
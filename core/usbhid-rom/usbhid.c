@@ -60,17 +60,63 @@ typedef struct usbhid_out_s
   uint16_t adc1;
   uint16_t adc2;
   uint16_t adc3;
-  uint32_t systicks;
-  uint32_t rollovers;
 } usbhid_out_t;
 
+// Queued report.  head is only advanced by the application and tail only
+// by the USB ISR (both free-running), so pushing a new event needs no
+// locking.  Coalescing rewrites the newest entry, which the ISR may be
+// about to send, so that is done with the USB IRQ disabled.
+typedef struct usbhid_event_s
+{
+  uint32_t timestamp;
+  uint8_t  type;
+  uint8_t  count;
+  uint8_t  len;
+  uint8_t  data[USBHID_PAYLOADSIZE];
+} usbhid_event_t;
+
+#define USBHID_QUEUEMASK  (CFG_USBHID_QUEUESIZE - 1)
+
+static usbhid_event_t usbhidQueue[CFG_USBHID_QUEUESIZE];
+static volatile uint8_t usbhidQueueHead = 0;
+static volatile uint8_t usbhidQueueTail = 0;
+static volatile uint8_t usbhidDropped = 0;
+static volatile uint8_t usbhidEcho = 0;
+static uint8_t usbhidSeq = 0;
+
 /**************************************************************************/
 /*! 
-    @brief Gets the HID In Report (the report going from the LPC1343 to
-    the USB host)
+    @brief Writes the report header common to all report types
 */
 /**************************************************************************/
-void usbHIDGetInReport (uint8_t src[], uint32_t length)
+static void usbHIDWriteHeader (uint8_t src[], uint8_t type, uint8_t count,
+                               uint32_t timestamp, uint8_t len)
+{
+  uint32_t age = systickGetTicks() - timestamp;
+
+  if (age > 0xFFFF) age = 0xFFFF;
+
+  src[0] = type;
+  src[1] = usbhidSeq++;
+  src[2] = count;
+  src[3] = usbhidDropped;
+  usbhidDropped = 0;
+  src[4] = timestamp & 0xFF;
+  src[5] = (timestamp >> 8) & 0xFF;
+  src[6] = (timestamp >> 16) & 0xFF;
+  src[7] = (timestamp >> 24) & 0xFF;
+  src[8] = age & 0xFF;
+  src[9] = (age >> 8) & 0xFF;
+  src[10] = len;
+  src[11] = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Fills the payload with a snapshot of the GPIO and ADC state
+*/
+/**************************************************************************/
+static uint8_t usbHIDGetStatus (uint8_t dst[])
 {
   usbhid_out_t out;
 
@@ -84,34 +130,48 @@ void usbHIDGetInReport (uint8_t src[], uint32_t length)
   out.adc1 = adcRead(1);
   out.adc2 = adcRead(2);
   out.adc3 = adcRead(3);
-  out.systicks = systickGetTicks();
-  out.rollovers = systickGetRollovers();
-
-  size_t i = 0;
-  memcpy(&src[i], &out.gpio1Dir, sizeof out.gpio1Dir);
-  i += sizeof out.gpio1Dir;
-  memcpy(&src[i], &out.gpio1Data, sizeof out.gpio1Data);
-  i += sizeof out.gpio1Data;
-  memcpy(&src[i], &out.gpio2Dir, sizeof out.gpio2Dir);
-  i += sizeof out.gpio2Dir;
-  memcpy(&src[i], &out.gpio2Data, sizeof out.gpio2Data);
-  i += sizeof out.gpio2Data;
-  memcpy(&src[i], &out.gpio3Dir, sizeof out.gpio3Dir);
-  i += sizeof out.gpio3Dir;
-  memcpy(&src[i], &out.gpio3Data, sizeof out.gpio3Data);
-  i += sizeof out.gpio3Data;
-  memcpy(&src[i], &out.adc0, sizeof out.adc0);
-  i += sizeof out.adc0;
-  memcpy(&src[i], &out.adc1, sizeof out.adc1);
-  i += sizeof out.adc1;
-  memcpy(&src[i], &out.adc2, sizeof out.adc2);
-  i += sizeof out.adc2;
-  memcpy(&src[i], &out.adc3, sizeof out.adc3);
-  i += sizeof out.adc3;
-  memcpy(&src[i], &out.systicks, sizeof out.systicks);
-  i += sizeof out.systicks;
-  memcpy(&src[i], &out.rollovers, sizeof out.rollovers);
-  i += sizeof out.rollovers;
+
+  // Both sides are little endian and the struct has no padding
+  memcpy(dst, &out, sizeof out);
+  return sizeof out;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Gets the HID In Report (the report going from the LPC1343 to
+    the USB host)
+
+    This is called by the ROM driver from the USB ISR every time the host
+    polls the interrupt endpoint (every CFG_USBHID_INTERVAL ms).  A
+    pending echo request is answered first, then the oldest queued event
+    is sent.  When nothing is queued a live status report is sent instead.
+*/
+/**************************************************************************/
+void usbHIDGetInReport (uint8_t src[], uint32_t length)
+{
+  uint8_t tail = usbhidQueueTail;
+  usbhid_event_t *ev;
+
+  memset(src, 0, length);
+
+  if (usbhidEcho)
+  {
+    usbHIDWriteHeader(src, usbhidReportType_Echo, 1, systickGetTicks(), 1);
+    src[USBHID_HEADERSIZE] = usbhidEcho;
+    usbhidEcho = 0;
+  }
+  else if (tail != usbhidQueueHead)
+  {
+    ev = &usbhidQueue[tail & USBHID_QUEUEMASK];
+    usbHIDWriteHeader(src, ev->type, ev->count, ev->timestamp, ev->len);
+    memcpy(&src[USBHID_HEADERSIZE], ev->data, ev->len);
+    usbhidQueueTail = tail + 1;
+  }
+  else
+  {
+    usbHIDWriteHeader(src, usbhidReportType_Status, 1, systickGetTicks(), 0);
+    src[10] = usbHIDGetStatus(&src[USBHID_HEADERSIZE]);
+  }
 }
 
 /**************************************************************************/
@@ -135,6 +195,86 @@ void usbHIDSetOutReport (uint8_t dst[], uint32_t length)
     // Disable LED (set high)
     gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, 1);
   }
+
+  // Echo request: answered on the next poll, ahead of any queued event
+  if (length > 1 && dst[1])
+  {
+    usbhidEcho = dst[1];
+  }
+}
+
+/**************************************************************************/
+/*! 
+    @brief Queues an event to be sent to the host in its own report
+
+    @param[in]  type
+                Report type (usbhidReportType_User or higher)
+    @param[in]  data
+                Payload, copied into the queue
+    @param[in]  len
+                Payload length, truncated to USBHID_PAYLOADSIZE
+    @param[in]  coalesce
+                If true and the newest event still waiting to be sent has
+                the same type, that event is updated with the new payload
+                and timestamp instead of queueing another one (use this
+                for state like a joystick position where only the latest
+                value matters, so a burst of moves doesn't fill the
+                queue).
+
+    @return     false if the event was dropped because the queue was full
+*/
+/**************************************************************************/
+bool usbHIDQueueReport (uint8_t type, const uint8_t *data, uint32_t len, bool coalesce)
+{
+  uint8_t head = usbhidQueueHead;
+  usbhid_event_t *ev;
+
+  if (len > USBHID_PAYLOADSIZE) len = USBHID_PAYLOADSIZE;
+
+  if (coalesce)
+  {
+    NVIC_DisableIRQ(USB_IRQn);
+    ev = &usbhidQueue[(uint8_t)(head - 1) & USBHID_QUEUEMASK];
+    if (head != usbhidQueueTail && ev->type == type)
+    {
+      ev->timestamp = systickGetTicks();
+      if (ev->count < 0xFF) ev->count++;
+      ev->len = len;
+      memcpy(ev->data, data, len);
+      NVIC_EnableIRQ(USB_IRQn);
+      return true;
+    }
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+
+  if ((uint8_t)(head - usbhidQueueTail) >= CFG_USBHID_QUEUESIZE)
+  {
+    NVIC_DisableIRQ(USB_IRQn);
+    if (usbhidDropped < 0xFF) usbhidDropped++;
+    NVIC_EnableIRQ(USB_IRQn);
+    return false;
+  }
+
+  ev = &usbhidQueue[head & USBHID_QUEUEMASK];
+  ev->timestamp = systickGetTicks();
+  ev->type = type;
+  ev->count = 1;
+  ev->len = len;
+  memcpy(ev->data, data, len);
+  usbhidQueueHead = head + 1;
+
+  return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief Returns the number of events that can be queued before
+    usbHIDQueueReport starts dropping them
+*/
+/**************************************************************************/
+uint32_t usbHIDQueueFree (void)
+{
+  return CFG_USBHID_QUEUESIZE - (uint8_t)(usbhidQueueHead - usbhidQueueTail);
 }
 
 /**************************************************************************/
@@ -185,9 +325,9 @@ void usbHIDInit (void)
   HidDevInfo.idProduct = USB_PROD_ID;
   HidDevInfo.bcdDevice = USB_DEVICE; 
   HidDevInfo.StrDescPtr = (uint32_t)&USB_HIDStringDescriptor[0];
-  HidDevInfo.InReportCount = sizeof(usbhid_out_t);
-  HidDevInfo.OutReportCount = 1;
-  HidDevInfo.SampleInterval = 0x20;
+  HidDevInfo.InReportCount = CFG_USBHID_REPORTSIZE;
+  HidDevInfo.OutReportCount = USBHID_OUTREPORTSIZE;
+  HidDevInfo.SampleInterval = CFG_USBHID_INTERVAL;
   HidDevInfo.InReport = usbHIDGetInReport;
   HidDevInfo.OutReport = usbHIDSetOutReport;
 
@@ -39,8 +39,43 @@
 
 #include "projectconfig.h"
 
-void usbHIDGetInReport (uint8_t src[], uint32_t length);
-void usbHIDSetOutReport (uint8_t dst[], uint32_t length);
-void usbHIDInit (void);
+/*
+   Every IN report is CFG_USBHID_REPORTSIZE bytes long, starting with a
+   12 byte header (all values little endian):
+
+     [0]      Report type (see usbhidReportType_t, or an application
+              defined type >= usbhidReportType_User)
+     [1]      Sequence number, incremented for every report sent, so the
+              host can tell when it missed one
+     [2]      Number of events merged into this report (coalescing)
+     [3]      Events lost since the previous report because the queue
+              was full (saturates at 255)
+     [4..7]   Systick tick count when the event was queued
+     [8..9]   Ticks the event spent in the queue before being handed to
+              the endpoint (saturates at 65535)
+     [10]     Length of the payload in bytes
+     [11]     Reserved (0)
+     [12..]   Payload (USBHID_PAYLOADSIZE bytes)
+
+   The OUT report is USBHID_OUTREPORTSIZE bytes: bit 0 of byte 0 sets
+   the LED, and a non-zero value in byte 1 asks for it to be echoed back
+   in a usbhidReportType_Echo report (see tools/hidtest).
+*/
+#define USBHID_HEADERSIZE     (12)
+#define USBHID_PAYLOADSIZE    (CFG_USBHID_REPORTSIZE - USBHID_HEADERSIZE)
+#define USBHID_OUTREPORTSIZE  (4)
+
+typedef enum
+{
+  usbhidReportType_Status = 0,    // Live GPIO/ADC snapshot, sent when idle
+  usbhidReportType_Echo   = 1,    // Reply to a host echo request
+  usbhidReportType_User   = 16    // First application defined type
+} usbhidReportType_t;
+
+void     usbHIDGetInReport (uint8_t src[], uint32_t length);
+void     usbHIDSetOutReport (uint8_t dst[], uint32_t length);
+void     usbHIDInit (void);
+bool     usbHIDQueueReport (uint8_t type, const uint8_t *data, uint32_t len, bool coalesce);
+uint32_t usbHIDQueueFree (void);
 
 #endif
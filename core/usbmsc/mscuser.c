@@ -0,0 +1,908 @@
+/**************************************************************************/
+/*!
+    @file     mscuser.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    USB Mass Storage Class (Bulk-Only Transport, SCSI
+              transparent command set) for the RAM-based USB stack in
+              core/usbcdc
+
+    The class runs in two halves.  The USB ISR (MSC_BulkIn/MSC_BulkOut)
+    decodes the CBW, answers the small SCSI commands directly, and moves
+    READ(10)/WRITE(10) data between the bulk endpoint and two
+    MSC_CHUNK_SIZE buffers.  MSC_Poll (called from the main loop) moves
+    the same buffers to and from the media, keeping a single multi-block
+    CMD18/CMD25 open for the whole SCSI command.  While the ISR is
+    sending one buffer the other one is being filled from the card (or
+    written to it), and the endpoint itself is double-buffered, so SPI
+    and USB traffic overlap instead of taking turns.
+
+    The host is simply NAKed whenever neither buffer is ready, so slow
+    media (SPI flash erases, SD card busy time) never loses data.
+
+    LUN 0 is the SD card (CFG_SDCARD).  If CFG_USBMSC_SPIFLASH is defined
+    the W25Q16BV is exposed as an additional LUN with 4096 byte logical
+    blocks (one erase sector), so every write covers whole erase sectors
+    and no read-modify-write buffer is required.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2010, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <string.h>
+
+#include "projectconfig.h"
+
+#ifdef CFG_USBMSC
+
+#include "core/usbcdc/usb.h"
+#include "core/usbcdc/usbhw.h"
+#include "core/usbcdc/usbreg.h"
+#include "core/usbcdc/usbcfg.h"
+#include "core/usbcdc/usbcore.h"
+#include "core/systick/systick.h"
+
+#ifdef CFG_SDCARD
+  #include "drivers/fatfs/diskio.h"
+#endif
+
+#ifdef CFG_USBMSC_SPIFLASH
+  #include "drivers/storage/spiflash/spiflash.h"
+#endif
+
+#include "msc.h"
+#include "mscuser.h"
+
+/* Minimum delay (ms) between two attempts to initialise an SD card */
+#define MSC_MEDIA_RETRY     (1000)
+
+typedef enum
+{
+  MSC_MEDIA_SDCARD = 0,
+  MSC_MEDIA_SPIFLASH
+} mscMedia_t;
+
+typedef enum
+{
+  MSC_OP_NONE = 0,
+  MSC_OP_READ,
+  MSC_OP_WRITE
+} mscOp_t;
+
+typedef struct
+{
+  mscMedia_t        media;
+  uint32_t          blockSize;      // Logical block size reported to the host
+  volatile uint32_t blockCount;     // 0 while no medium is present
+  uint8_t           readOnly;
+  volatile uint8_t  changed;        // Report UNIT ATTENTION once
+} mscLun_t;
+
+static mscLun_t MSC_Lun[] =
+{
+#ifdef CFG_SDCARD
+  { MSC_MEDIA_SDCARD, 512, 0, CFG_USBMSC_READONLY, 0 },
+#endif
+#ifdef CFG_USBMSC_SPIFLASH
+  { MSC_MEDIA_SPIFLASH, 0, 0, CFG_USBMSC_READONLY, 0 },
+#endif
+};
+
+#define MSC_LUNCOUNT        (sizeof(MSC_Lun) / sizeof(MSC_Lun[0]))
+
+/* Bulk-only transport state (USB ISR) */
+static MSC_CBW  CBW;
+MSC_CSW         CSW;                       /* Also used by usbcore.c */
+static uint8_t  BulkStage;
+static uint32_t BulkLen;
+static uint8_t  BulkBuf[MSC_MAX_PACKET] __attribute__ ((aligned (4)));
+
+static uint8_t  MSC_SenseKey;
+static uint8_t  MSC_ASC;
+
+/* Double buffer shared by the USB ISR and MSC_Poll.  Head counts chunks
+   produced and tail chunks consumed (free-running, like cdc_buf.c): the
+   media fills them on a READ(10) and the ISR on a WRITE(10). */
+static uint8_t           MSC_Buf[2][MSC_CHUNK_SIZE] __attribute__ ((aligned (4)));
+static volatile uint8_t  MSC_BufHead;
+static volatile uint8_t  MSC_BufTail;
+static uint32_t          MSC_BufOffset;    /* ISR position inside the current chunk */
+static volatile uint32_t MSC_Length;       /* Bytes left to move over USB */
+
+/* Media transfer requested by the ISR and carried out by MSC_Poll */
+static volatile uint8_t  MSC_Op;
+static volatile uint8_t  MSC_Abort;        /* Set by MSC_Reset */
+static volatile uint8_t  MSC_Failed;       /* Media error, set by MSC_Poll */
+static uint8_t           MSC_OpLun;
+static uint32_t          MSC_OpBlock;
+static uint32_t          MSC_OpBlocks;
+static uint8_t           MSC_OpStarted;    /* Poll only */
+static uint32_t          MSC_ChunksLeft;   /* Poll only */
+#ifdef CFG_USBMSC_SPIFLASH
+static uint32_t          MSC_FlashAddr;    /* Poll only */
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Returns the number of blocks currently available on a LUN,
+            or 0 if the medium isn't ready
+*/
+/**************************************************************************/
+static uint32_t MSC_LunBlocks (uint8_t lun)
+{
+#ifdef CFG_SDCARD
+  if ((MSC_Lun[lun].media == MSC_MEDIA_SDCARD) && (disk_status(0) & STA_NOINIT))
+  {
+    return 0;
+  }
+#endif
+  return MSC_Lun[lun].blockCount;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Opens a streamed transfer of MSC_OpBlocks blocks starting at
+            MSC_OpBlock on MSC_OpLun (main loop context)
+*/
+/**************************************************************************/
+static bool MSC_MediaStart (uint8_t op)
+{
+  switch (MSC_Lun[MSC_OpLun].media)
+  {
+#ifdef CFG_SDCARD
+    case MSC_MEDIA_SDCARD:
+      if (op == MSC_OP_READ)
+        return disk_readstart(0, MSC_OpBlock) == RES_OK;
+      return disk_writestart(0, MSC_OpBlock, MSC_OpBlocks) == RES_OK;
+#endif
+#ifdef CFG_USBMSC_SPIFLASH
+    case MSC_MEDIA_SPIFLASH:
+      MSC_FlashAddr = MSC_OpBlock * MSC_Lun[MSC_OpLun].blockSize;
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Moves the next MSC_CHUNK_SIZE bytes of an open transfer
+            between the media and buf (main loop context)
+*/
+/**************************************************************************/
+static bool MSC_MediaXfer (uint8_t op, uint8_t *buf)
+{
+  switch (MSC_Lun[MSC_OpLun].media)
+  {
+#ifdef CFG_SDCARD
+    case MSC_MEDIA_SDCARD:
+      if (op == MSC_OP_READ)
+        return disk_readblock(0, buf) == RES_OK;
+      return disk_writeblock(0, buf) == RES_OK;
+#endif
+#ifdef CFG_USBMSC_SPIFLASH
+    case MSC_MEDIA_SPIFLASH:
+    {
+      spiflashSizeInfo_t size = spiflashGetSizeInfo();
+      uint32_t n;
+
+      if (op == MSC_OP_READ)
+      {
+        if (spiflashReadBuffer(MSC_FlashAddr, buf, MSC_CHUNK_SIZE))
+          return false;
+      }
+      else
+      {
+        // Logical blocks are erase sectors, so the host always rewrites
+        // a sector in full and it can be erased as soon as it starts
+        if (((MSC_FlashAddr % size.sectorSize) == 0) &&
+            spiflashEraseSector(MSC_FlashAddr / size.sectorSize))
+          return false;
+        for (n = 0; n < MSC_CHUNK_SIZE; n += size.pageSize)
+        {
+          if (spiflashWritePage(MSC_FlashAddr + n, buf + n, size.pageSize))
+            return false;
+        }
+      }
+      MSC_FlashAddr += MSC_CHUNK_SIZE;
+      return true;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Closes an open transfer (main loop context)
+*/
+/**************************************************************************/
+static bool MSC_MediaStop (uint8_t op)
+{
+  switch (MSC_Lun[MSC_OpLun].media)
+  {
+#ifdef CFG_SDCARD
+    case MSC_MEDIA_SDCARD:
+      if (op == MSC_OP_READ)
+        return disk_readstop(0) == RES_OK;
+      return disk_writestop(0) == RES_OK;
+#endif
+    default:
+      return true;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stalls an endpoint and marks it as halted so that usbcore.c
+            resends the CSW once the host clears the halt
+*/
+/**************************************************************************/
+static void MSC_SetStallEP (uint32_t EPNum)
+{
+  USB_SetStallEP(EPNum);
+  USB_EndPointHalt |= (EPNum & 0x80) ? ((1 << 16) << (EPNum & 0x0F)) : (1 << EPNum);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends the Command Status Wrapper
+*/
+/**************************************************************************/
+static void MSC_SetCSW (void)
+{
+  CSW.dSignature = MSC_CSW_Signature;
+  USB_WriteEP(MSC_EP_IN, (uint8_t *)&CSW, sizeof(CSW));
+  BulkStage = MSC_BS_CSW;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Fails the current command with the supplied sense data.  Any
+            data phase the host expects is cut short with a STALL, as
+            required by the Bulk-Only Transport spec.
+*/
+/**************************************************************************/
+static void MSC_CmdFail (uint8_t senseKey, uint8_t asc)
+{
+  MSC_SenseKey = senseKey;
+  MSC_ASC = asc;
+  CSW.bStatus = CSW_CMD_FAILED;
+
+  if (CSW.dDataResidue)
+  {
+    if (CBW.bmFlags & 0x80)
+    {
+      // CSW is sent by usbcore.c when the host clears the halt
+      CSW.dSignature = MSC_CSW_Signature;
+      MSC_SetStallEP(MSC_EP_IN);
+      BulkStage = MSC_BS_CSW;
+      return;
+    }
+    MSC_SetStallEP(MSC_EP_OUT);
+  }
+  MSC_SetCSW();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends BulkLen bytes from BulkBuf as the data phase
+*/
+/**************************************************************************/
+static void MSC_DataInTransfer (void)
+{
+  if (BulkLen > CBW.dDataLength)
+  {
+    BulkLen = CBW.dDataLength;
+  }
+
+  USB_WriteEP(MSC_EP_IN, BulkBuf, BulkLen);
+  CSW.dDataResidue -= BulkLen;
+  CSW.bStatus = CSW_CMD_PASSED;
+
+  // The host expects more than we have: end with a STALL unless the
+  // short packet already terminated the transfer
+  if (CSW.dDataResidue && ((BulkLen % MSC_MAX_PACKET) == 0))
+    BulkStage = MSC_BS_DATA_IN_LAST_STALL;
+  else
+    BulkStage = MSC_BS_DATA_IN_LAST;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks that the addressed LUN can accept a media command.
+            Fails the command and returns false otherwise.
+*/
+/**************************************************************************/
+static bool MSC_CheckReady (void)
+{
+  if (!MSC_LunBlocks(CBW.bLUN))
+  {
+    MSC_CmdFail(SCSI_SENSE_NOT_READY, SCSI_ASC_MEDIUM_NOT_PRESENT);
+    return false;
+  }
+  if (MSC_Lun[CBW.bLUN].changed)
+  {
+    MSC_Lun[CBW.bLUN].changed = 0;
+    MSC_CmdFail(SCSI_SENSE_UNIT_ATTENTION, SCSI_ASC_MEDIUM_CHANGED);
+    return false;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Validates a READ(10)/WRITE(10) and hands the media side of
+            the transfer to MSC_Poll
+*/
+/**************************************************************************/
+static void MSC_RWSetup (uint8_t op)
+{
+  mscLun_t *lun = &MSC_Lun[CBW.bLUN];
+  uint32_t block, blocks;
+
+  if (!MSC_CheckReady()) return;
+
+  block  = ((uint32_t)CBW.CB[2] << 24) | ((uint32_t)CBW.CB[3] << 16) |
+           ((uint32_t)CBW.CB[4] << 8)  |  (uint32_t)CBW.CB[5];
+  blocks = ((uint32_t)CBW.CB[7] << 8)  |  (uint32_t)CBW.CB[8];
+
+  if ((op == MSC_OP_READ) != ((CBW.bmFlags & 0x80) != 0) ||
+      (CBW.dDataLength != blocks * lun->blockSize))
+  {
+    MSC_CmdFail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_FIELD_IN_CDB);
+    return;
+  }
+  if ((block >= lun->blockCount) || (blocks > lun->blockCount - block))
+  {
+    MSC_CmdFail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_LBA_OUT_OF_RANGE);
+    return;
+  }
+  if ((op == MSC_OP_WRITE) && lun->readOnly)
+  {
+    MSC_CmdFail(SCSI_SENSE_DATA_PROTECT, SCSI_ASC_WRITE_PROTECTED);
+    return;
+  }
+  if (blocks == 0)
+  {
+    MSC_SetCSW();
+    return;
+  }
+
+  MSC_BufHead = MSC_BufTail = 0;
+  MSC_BufOffset = 0;
+  MSC_Length = CBW.dDataLength;
+  MSC_Failed = 0;
+  MSC_Abort = 0;                          /* Any earlier abort has completed */
+  MSC_OpLun = CBW.bLUN;
+  MSC_OpBlock = block;
+  MSC_OpBlocks = blocks;
+  BulkStage = (op == MSC_OP_READ) ? MSC_BS_STREAM_IN : MSC_BS_STREAM_OUT;
+  MSC_Op = op;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the SCSI command in the CBW
+*/
+/**************************************************************************/
+static void MSC_CBWDecode (void)
+{
+  mscLun_t *lun = &MSC_Lun[CBW.bLUN];
+  uint32_t n;
+
+  memset(BulkBuf, 0, sizeof(BulkBuf));
+
+  switch (CBW.CB[0])
+  {
+    case SCSI_TEST_UNIT_READY:
+      if (MSC_CheckReady()) MSC_SetCSW();
+      break;
+
+    case SCSI_REQUEST_SENSE:
+      BulkBuf[0]  = 0x70;                 /* Current error, fixed format */
+      BulkBuf[2]  = MSC_SenseKey;
+      BulkBuf[7]  = 10;                   /* Additional length */
+      BulkBuf[12] = MSC_ASC;
+      MSC_SenseKey = SCSI_SENSE_NONE;
+      MSC_ASC = SCSI_ASC_NONE;
+      BulkLen = CBW.CB[4] < 18 ? CBW.CB[4] : 18;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_INQUIRY:
+      BulkBuf[1] = 0x80;                  /* Removable medium */
+      BulkBuf[2] = 0x02;                  /* SCSI-2 */
+      BulkBuf[3] = 0x02;                  /* Response data format */
+      BulkBuf[4] = 36 - 5;                /* Additional length */
+      memcpy(&BulkBuf[8], "microBld", 8);
+      memcpy(&BulkBuf[16], lun->media == MSC_MEDIA_SDCARD ?
+             "LPC1343 SD Card " : "LPC1343 SPIFlash", 16);
+      memcpy(&BulkBuf[32], "1.0 ", 4);
+      n = ((uint32_t)CBW.CB[3] << 8) | CBW.CB[4];
+      BulkLen = n < 36 ? n : 36;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_MODE_SENSE6:
+      BulkBuf[0] = 3;                     /* Mode data length */
+      BulkBuf[2] = lun->readOnly ? 0x80 : 0x00;
+      BulkLen = CBW.CB[4] < 4 ? CBW.CB[4] : 4;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_MODE_SENSE10:
+      BulkBuf[1] = 6;                     /* Mode data length */
+      BulkBuf[3] = lun->readOnly ? 0x80 : 0x00;
+      n = ((uint32_t)CBW.CB[7] << 8) | CBW.CB[8];
+      BulkLen = n < 8 ? n : 8;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_START_STOP_UNIT:
+    case SCSI_MEDIA_REMOVAL:
+    case SCSI_SYNC_CACHE10:               /* Writes complete before the CSW */
+      MSC_SetCSW();
+      break;
+
+    case SCSI_VERIFY10:
+      if (CBW.CB[1] & 0x02)               /* BYTCHK is not supported */
+      {
+        MSC_CmdFail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_FIELD_IN_CDB);
+        break;
+      }
+      if (MSC_CheckReady()) MSC_SetCSW();
+      break;
+
+    case SCSI_READ_FORMAT_CAPACITIES:
+      if (!MSC_CheckReady()) break;
+      n = lun->blockCount;
+      BulkBuf[3]  = 8;                    /* Capacity list length */
+      BulkBuf[4]  = n >> 24;
+      BulkBuf[5]  = n >> 16;
+      BulkBuf[6]  = n >> 8;
+      BulkBuf[7]  = n;
+      BulkBuf[8]  = 0x02;                 /* Formatted media */
+      BulkBuf[9]  = lun->blockSize >> 16;
+      BulkBuf[10] = lun->blockSize >> 8;
+      BulkBuf[11] = lun->blockSize;
+      n = ((uint32_t)CBW.CB[7] << 8) | CBW.CB[8];
+      BulkLen = n < 12 ? n : 12;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_READ_CAPACITY:
+      if (!MSC_CheckReady()) break;
+      n = lun->blockCount - 1;            /* Last logical block */
+      BulkBuf[0] = n >> 24;
+      BulkBuf[1] = n >> 16;
+      BulkBuf[2] = n >> 8;
+      BulkBuf[3] = n;
+      BulkBuf[4] = lun->blockSize >> 24;
+      BulkBuf[5] = lun->blockSize >> 16;
+      BulkBuf[6] = lun->blockSize >> 8;
+      BulkBuf[7] = lun->blockSize;
+      BulkLen = 8;
+      MSC_DataInTransfer();
+      break;
+
+    case SCSI_READ10:
+      MSC_RWSetup(MSC_OP_READ);
+      break;
+
+    case SCSI_WRITE10:
+      MSC_RWSetup(MSC_OP_WRITE);
+      break;
+
+    default:
+      MSC_CmdFail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_COMMAND);
+      break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads and checks a new Command Block Wrapper
+*/
+/**************************************************************************/
+static void MSC_GetCBW (void)
+{
+  uint32_t n;
+
+  n = USB_ReadEP(MSC_EP_OUT, BulkBuf);
+  memcpy(&CBW, BulkBuf, sizeof(CBW));
+
+  if ((n != sizeof(CBW)) || (CBW.dSignature != MSC_CBW_Signature))
+  {
+    // Invalid CBW: stall both pipes until the host does a reset recovery
+    CSW.dSignature = 0;
+    MSC_SetStallEP(MSC_EP_IN);
+    MSC_SetStallEP(MSC_EP_OUT);
+    BulkStage = MSC_BS_ERROR;
+    return;
+  }
+
+  CSW.dTag = CBW.dTag;
+  CSW.dDataResidue = CBW.dDataLength;
+  CSW.bStatus = CSW_CMD_PASSED;
+
+  if ((CBW.bLUN >= MSC_LUNCOUNT) || (CBW.bCBLength < 1) || (CBW.bCBLength > 16))
+  {
+    MSC_CmdFail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_FIELD_IN_CDB);
+    return;
+  }
+
+  MSC_CBWDecode();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Finishes a streamed transfer once MSC_Poll has closed the
+            media (USB IRQ disabled or ISR context)
+*/
+/**************************************************************************/
+static void MSC_StreamDone (void)
+{
+  CSW.dDataResidue = MSC_Length;
+  if (!MSC_Failed)
+  {
+    MSC_SetCSW();
+    return;
+  }
+
+  MSC_BufTail = MSC_BufHead;
+  MSC_CmdFail(SCSI_SENSE_MEDIUM_ERROR, BulkStage == MSC_BS_STREAM_IN ?
+              SCSI_ASC_UNRECOVERED_READ : SCSI_ASC_WRITE_FAULT);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queues READ(10) data from the chunk buffers while the IN
+            endpoint has room (USB IRQ disabled or ISR context)
+*/
+/**************************************************************************/
+static void MSC_StreamIn (void)
+{
+  uint32_t n;
+
+  while (!(USB_SelectEP(MSC_EP_IN) & EP_SEL_F))
+  {
+    if ((MSC_Length == 0) || MSC_Failed)
+    {
+      if (MSC_Op == MSC_OP_NONE) MSC_StreamDone();
+      return;
+    }
+    if (MSC_BufHead == MSC_BufTail)
+    {
+      return;                             /* Waiting for the media */
+    }
+
+    n = MSC_Length < MSC_MAX_PACKET ? MSC_Length : MSC_MAX_PACKET;
+    USB_WriteEP(MSC_EP_IN, &MSC_Buf[MSC_BufTail & 1][MSC_BufOffset], n);
+    MSC_BufOffset += n;
+    MSC_Length -= n;
+    if ((MSC_BufOffset == MSC_CHUNK_SIZE) || (MSC_Length == 0))
+    {
+      MSC_BufOffset = 0;
+      MSC_BufTail++;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Collects WRITE(10) data into the chunk buffers.  Packets that
+            don't fit stay in the endpoint, so the host is NAKed until
+            MSC_Poll frees a buffer (USB IRQ disabled or ISR context)
+*/
+/**************************************************************************/
+static void MSC_StreamOut (void)
+{
+  uint32_t n;
+
+  while (MSC_Length && !MSC_Failed &&
+         ((uint8_t)(MSC_BufHead - MSC_BufTail) < 2) &&
+         (USB_SelectEP(MSC_EP_OUT) & EP_SEL_F))
+  {
+    n = USB_ReadEP(MSC_EP_OUT, &MSC_Buf[MSC_BufHead & 1][MSC_BufOffset]);
+    MSC_BufOffset += n;
+    MSC_Length = n < MSC_Length ? MSC_Length - n : 0;
+    // USB_ReadEP stores whole words, so a chunk is closed as soon as
+    // another full packet might not fit
+    if ((MSC_BufOffset + MSC_MAX_PACKET > MSC_CHUNK_SIZE) || (MSC_Length == 0))
+    {
+      MSC_BufOffset = 0;
+      MSC_BufHead++;
+    }
+  }
+
+  if ((MSC_Length == 0 || MSC_Failed) && (MSC_Op == MSC_OP_NONE))
+  {
+    MSC_StreamDone();
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Lets the ISR side pick up after MSC_Poll has changed the
+            buffer state.  Runs with the USB IRQ disabled.
+*/
+/**************************************************************************/
+static void MSC_Kick (void)
+{
+  NVIC_DisableIRQ(USB_IRQn);
+  switch (BulkStage)
+  {
+    case MSC_BS_STREAM_IN:
+      MSC_StreamIn();
+      break;
+    case MSC_BS_STREAM_OUT:
+      MSC_StreamOut();
+      break;
+    case MSC_BS_CBW:
+      // A CBW that arrived while the last transfer was being closed
+      if ((MSC_Op == MSC_OP_NONE) && (USB_SelectEP(MSC_EP_OUT) & EP_SEL_F))
+        MSC_GetCBW();
+      break;
+  }
+  NVIC_EnableIRQ(USB_IRQn);
+}
+
+/**************************************************************************/
+/*!
+    @brief  MSC Mass Storage Reset Request Callback.  Called
+            automatically on Mass Storage Reset Request, and on USB
+            bus reset/configuration.
+
+    @return TRUE (success)
+*/
+/**************************************************************************/
+uint32_t MSC_Reset (void)
+{
+  USB_EndPointStall = 0x00000000;         /* EP must stay stalled */
+  CSW.dSignature = 0;                     /* Invalid signature */
+  BulkStage = MSC_BS_CBW;
+  if (MSC_Op != MSC_OP_NONE)
+  {
+    MSC_Abort = 1;                        /* MSC_Poll closes the media */
+  }
+  return (TRUE);
+}
+
+/**************************************************************************/
+/*!
+    @brief  MSC Get Max LUN Request Callback
+
+    @return TRUE (success)
+*/
+/**************************************************************************/
+uint32_t MSC_GetMaxLUN (void)
+{
+  EP0Buf[0] = MSC_LUNCOUNT - 1;
+  return (TRUE);
+}
+
+/**************************************************************************/
+/*!
+    @brief  MSC Bulk In Callback (called from USB_EndPoint3)
+*/
+/**************************************************************************/
+void MSC_BulkIn (void)
+{
+  switch (BulkStage)
+  {
+    case MSC_BS_STREAM_IN:
+      MSC_StreamIn();
+      break;
+    case MSC_BS_DATA_IN_LAST:
+      MSC_SetCSW();
+      break;
+    case MSC_BS_DATA_IN_LAST_STALL:
+      CSW.dSignature = MSC_CSW_Signature;
+      MSC_SetStallEP(MSC_EP_IN);
+      BulkStage = MSC_BS_CSW;
+      break;
+    case MSC_BS_CSW:
+      BulkStage = MSC_BS_CBW;
+      // The next CBW may have been held in the endpoint by MSC_BulkOut
+      // (OUT interrupts are serviced before IN interrupts)
+      if (USB_SelectEP(MSC_EP_OUT) & EP_SEL_F)
+        MSC_BulkOut();
+      break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  MSC Bulk Out Callback (called from USB_EndPoint3)
+*/
+/**************************************************************************/
+void MSC_BulkOut (void)
+{
+  switch (BulkStage)
+  {
+    case MSC_BS_CBW:
+      // Leave the CBW in the endpoint until MSC_Poll has closed the
+      // previous transfer (only happens after a Mass Storage Reset)
+      if (MSC_Op == MSC_OP_NONE)
+        MSC_GetCBW();
+      break;
+    case MSC_BS_STREAM_OUT:
+      MSC_StreamOut();
+      break;
+    case MSC_BS_CSW:
+      break;                              /* Picked up by MSC_BulkIn */
+    default:
+      MSC_SetStallEP(MSC_EP_OUT);
+      CSW.bStatus = CSW_PHASE_ERROR;
+      MSC_SetCSW();
+      break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Initialises the Mass Storage class.  Call before USB_Init.
+*/
+/**************************************************************************/
+void MSC_Init (void)
+{
+  uint8_t i;
+
+  for (i = 0; i < MSC_LUNCOUNT; i++)
+  {
+#ifdef CFG_USBMSC_SPIFLASH
+    if (MSC_Lun[i].media == MSC_MEDIA_SPIFLASH)
+    {
+      spiflashSizeInfo_t size;
+      spiflashInit();
+      size = spiflashGetSizeInfo();
+      MSC_Lun[i].blockSize = size.sectorSize;
+      MSC_Lun[i].blockCount = size.sectorCount;
+    }
+#endif
+  }
+
+  MSC_Op = MSC_OP_NONE;
+  MSC_Abort = 0;
+  MSC_Reset();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Moves at most one chunk of an open READ(10)/WRITE(10)
+            between the media and the double buffer, or checks for
+            media changes when idle.  Call this from the main loop.
+
+    @note   Media access happens here rather than in the USB ISR so that
+            the SPI transfer for one chunk overlaps the USB transfer of
+            the other.  Nothing else may use SSP0 while a transfer is
+            open (the SD card stays selected for the whole command).
+*/
+/**************************************************************************/
+void MSC_Poll (void)
+{
+  uint8_t op = MSC_Op;
+  bool ok = true;
+
+  if (op == MSC_OP_NONE)
+  {
+#ifdef CFG_SDCARD
+    static uint32_t nextTry = 0;
+    uint8_t i;
+    DWORD count;
+
+    for (i = 0; i < MSC_LUNCOUNT; i++)
+    {
+      if (MSC_Lun[i].media != MSC_MEDIA_SDCARD) continue;
+      if (disk_status(0) & STA_NODISK)
+      {
+        MSC_Lun[i].blockCount = 0;
+      }
+      else if ((disk_status(0) & STA_NOINIT) &&
+               ((int32_t)(systickGetTicks() - nextTry) >= 0))
+      {
+        // Card inserted (or swapped): bring it up and tell the host
+        MSC_Lun[i].blockCount = 0;
+        nextTry = systickGetTicks() + MSC_MEDIA_RETRY;
+        if ((disk_initialize(0) == 0) &&
+            (disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK))
+        {
+          MSC_Lun[i].blockCount = count;
+          MSC_Lun[i].changed = 1;
+        }
+      }
+    }
+#endif
+    return;
+  }
+
+  if (MSC_Abort)
+  {
+    if (MSC_OpStarted) MSC_MediaStop(op);
+    MSC_OpStarted = 0;
+    MSC_Abort = 0;
+    MSC_Op = MSC_OP_NONE;
+    MSC_Kick();
+    return;
+  }
+
+  if (!MSC_OpStarted)
+  {
+    MSC_ChunksLeft = MSC_OpBlocks * (MSC_Lun[MSC_OpLun].blockSize / MSC_CHUNK_SIZE);
+    MSC_OpStarted = 1;
+    if (!MSC_MediaStart(op))
+    {
+      MSC_OpStarted = 0;
+      MSC_ChunksLeft = 0;
+      ok = false;
+    }
+  }
+
+  if (op == MSC_OP_READ)
+  {
+    if (ok && MSC_ChunksLeft && ((uint8_t)(MSC_BufHead - MSC_BufTail) < 2))
+    {
+      ok = MSC_MediaXfer(op, MSC_Buf[MSC_BufHead & 1]);
+      if (ok)
+      {
+        MSC_BufHead++;
+        MSC_ChunksLeft--;
+      }
+    }
+  }
+  else
+  {
+    if (ok && MSC_ChunksLeft && (MSC_BufHead != MSC_BufTail))
+    {
+      ok = MSC_MediaXfer(op, MSC_Buf[MSC_BufTail & 1]);
+      if (ok)
+      {
+        MSC_BufTail++;
+        MSC_ChunksLeft--;
+      }
+    }
+  }
+
+  if (!ok || (MSC_ChunksLeft == 0))
+  {
+    // Close the media before the CSW can go out, so that the next
+    // command never finds the card still selected
+    if (MSC_OpStarted && !MSC_MediaStop(op)) ok = false;
+    MSC_OpStarted = 0;
+    if (!ok) MSC_Failed = 1;
+    MSC_Op = MSC_OP_NONE;
+  }
+
+  MSC_Kick();
+}
+
+#endif
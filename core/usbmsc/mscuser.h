@@ -0,0 +1,62 @@
+/**************************************************************************/
+/*!
+    @file     mscuser.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2010, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+#ifndef __MSCUSER_H__
+#define __MSCUSER_H__
+
+#include "projectconfig.h"
+
+/* Mass Storage uses EP3, the double-buffered bulk endpoint */
+#define MSC_EP_IN           0x83
+#define MSC_EP_OUT          0x03
+#define MSC_MAX_PACKET      64
+
+/* Media is moved through two buffers of this size (see MSC_Poll) */
+#define MSC_CHUNK_SIZE      512
+
+/* MSC Requests Callback Functions */
+extern uint32_t MSC_Reset     (void);
+extern uint32_t MSC_GetMaxLUN (void);
+
+/* MSC Bulk Callback Functions */
+extern void MSC_BulkIn  (void);
+extern void MSC_BulkOut (void);
+
+/* Application interface */
+extern void MSC_Init    (void);
+extern void MSC_Poll    (void);
+
+#endif  /* __MSCUSER_H__ */
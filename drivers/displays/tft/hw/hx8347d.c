@@ -168,22 +168,11 @@ void lcd_cmd(uint16_t reg, uint16_t param)
 
 void lcd_clear(uint16_t color)
 {
-  unsigned int i;
-
   lcd_area(0, 0, (hx8347dProperties.width -1), (hx8347dProperties.height-1));
 
   lcd_drawstart();
-  for(i=(hx8347dProperties.width*hx8347dProperties.height/8); i!=0; i--)
-  {
-    lcd_draw(color); //1
-    lcd_draw(color); //2
-    lcd_draw(color); //3
-    lcd_draw(color); //4
-    lcd_draw(color); //5
-    lcd_draw(color); //6
-    lcd_draw(color); //7
-    lcd_draw(color); //8
-  }
+  // One 16-bit frame per pixel, keeping the SSP FIFO full
+  sspFill(0, color, (uint32_t)hx8347dProperties.width * hx8347dProperties.height);
   lcd_drawstop();
 
   return;
@@ -210,8 +199,7 @@ void lcd_drawstop(void)
   LCD_CS_DISABLE();
 
   // init 8Bit SPI Mode
-  SSP_SSP0CR0 &= ~SSP_SSP0CR0_DSS_MASK;
-  SSP_SSP0CR0 |= SSP_SSP0CR0_DSS_8BIT;
+  sspSetDataSize(0, 8);
 
   return;
 }
@@ -231,10 +219,8 @@ void lcd_drawstart(void)
   sspSend(0, b_sec, 1);
 
 
-  // Assign config values to SSP0CR0
   // init 16Bit SPI Mode for fast data transmitting
-  SSP_SSP0CR0 &= ~SSP_SSP0CR0_DSS_MASK;
-  SSP_SSP0CR0 |= SSP_SSP0CR0_DSS_16BIT;
+  sspSetDataSize(0, 16);
 
   return;
 }
@@ -285,8 +271,7 @@ void lcd_data(uint16_t c)
 
 void fillRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color)
 {
-  uint32_t size;
-  uint16_t tmp, i;
+  uint16_t tmp;
 
   if(x0 > x1)
   {
@@ -313,33 +298,7 @@ void fillRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color
   lcd_area(x0, y0, x1, y1);
 
   lcd_drawstart();
-  size = (uint32_t)(1+(x1-x0)) * (uint32_t)(1+(y1-y0));
-  tmp  = size/8;
-  if(tmp != 0)
-  {
-    for(i=tmp; i!=0; i--)
-    {
-    	lcd_draw(color); //1
-    	lcd_draw(color); //2
-    	lcd_draw(color); //3
-    	lcd_draw(color); //4
-    	lcd_draw(color); //5
-    	lcd_draw(color); //6
-    	lcd_draw(color); //7
-    	lcd_draw(color); //8
-    }
-    for(i=size-tmp; i!=0; i--)
-    {
-    	lcd_draw(color);
-    }
-  }
-  else
-  {
-    for(i=size; i!=0; i--)
-    {
-    	lcd_draw(color);
-    }
-  }
+  sspFill(0, color, (uint32_t)(1+(x1-x0)) * (uint32_t)(1+(y1-y0)));
   lcd_drawstop();
 
   return;
@@ -475,13 +434,8 @@ void lcdDrawPixel(uint16_t x, uint16_t y, uint16_t color)
 void lcdDrawPixels(uint16_t x, uint16_t y, uint16_t *data, uint32_t len)
 {
   lcd_area(x, y, x + len, y);
-  int i;
   lcd_drawstart();
-  for(i = 0; i < len; i++)
-  {
-    lcd_draw(*data);
-    data++;
-  }
+  sspTransfer16(0, data, NULL, len);
   lcd_drawstop();
 }
 
@@ -45,6 +45,10 @@
 #include "drivers/displays/tft/drawing.h"
 #include "drivers/displays/tft/controls/labelcentered.h"
 
+#ifdef CFG_USBCDC_HID
+  #include "core/usbcdc/hiduser.h"
+#endif
+
 #define TS_LINE1 "Touch the center of"
 #define TS_LINE2 "the red circle using"
 #define TS_LINE3 "a pen or stylus"
@@ -61,6 +65,26 @@ tsMatrix_t _tsMatrix;
 /*                                                                        */
 /**************************************************************************/
 
+/**************************************************************************/
+/*!
+    @brief  Sends a valid touch event to the host as a HID report
+            (HID_EVENT_TOUCH), if the composite CDC + HID device is
+            used.  Nothing is sent if the HID queue is full.
+*/
+/**************************************************************************/
+static void tsSendEvent(tsTouchData_t* data)
+{
+#ifdef CFG_USBCDC_HID
+  uint8_t event[4];
+
+  event[0] = data->xlcd & 0xFF;
+  event[1] = data->xlcd >> 8;
+  event[2] = data->ylcd & 0xFF;
+  event[3] = data->ylcd >> 8;
+  HID_QueueEvent(HID_EVENT_TOUCH, event, sizeof(event));
+#endif
+}
+
 /**************************************************************************/
 /*!
     @brief  Reads the current Z/pressure level using the ADC
@@ -526,6 +550,7 @@ tsTouchError_t tsWaitForEvent(tsTouchData_t* data, uint32_t timeoutMS)
   // Return the results right away if reading is valid
   if (data->valid)
   {
+    tsSendEvent(data);
     return TS_ERROR_NONE;
   }
 
@@ -571,9 +596,38 @@ tsTouchError_t tsWaitForEvent(tsTouchData_t* data, uint32_t timeoutMS)
   }
 
   // Indicate correct reading
+  tsSendEvent(data);
   return TS_ERROR_NONE;
 }
 
+/**************************************************************************/
+/*!
+    @brief  Non-blocking alternative to tsWaitForEvent.  Takes a single
+            reading and returns right away, with data->valid indicating
+            whether a valid touch event was detected or not.  This is
+            intended for code that can't afford to block the main loop,
+            such as resumable CLI commands.
+
+    @param[in]  data
+                Pointer to a tsTouchData_t object that will be updated
+                with the reading results
+*/
+/**************************************************************************/
+tsTouchError_t tsPollEvent(tsTouchData_t* data)
+{
+  tsTouchError_t error;
+
+  if (!_tsInitialised) tsInit();
+
+  error = tsRead(data, false);
+  if (data->valid)
+  {
+    tsSendEvent(data);
+  }
+
+  return error;
+}
+
 /**************************************************************************/
 /*!
     @brief  Updates the touch screen threshhold level and saves it
@@ -104,6 +104,7 @@ void           tsInit ( void );
 tsTouchError_t tsRead(tsTouchData_t* data, uint8_t calibrating);
 void           tsCalibrate ( void );
 tsTouchError_t tsWaitForEvent(tsTouchData_t* data, uint32_t timeoutMS);
+tsTouchError_t tsPollEvent(tsTouchData_t* data);
 int            tsSetThreshhold(uint8_t value);
 uint8_t        tsGetThreshhold(void);
 
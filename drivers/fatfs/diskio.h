@@ -35,6 +35,16 @@ DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 void	disk_timerproc (void);
 
+/* Streamed multiple block access (one CMD18/CMD25 per transfer) */
+DRESULT disk_readstart (BYTE, DWORD);
+DRESULT disk_readblock (BYTE, BYTE*);
+DRESULT disk_readstop (BYTE);
+#if	_READONLY == 0
+DRESULT disk_writestart (BYTE, DWORD, DWORD);
+DRESULT disk_writeblock (BYTE, const BYTE*);
+DRESULT disk_writestop (BYTE);
+#endif
+
 
 
 
@@ -1,8 +1,8 @@
 /*-----------------------------------------------------------------------*/
 /* MMCv3/SDv1/SDv2 (in SPI mode) control module  (C)ChaN, 2007           */
 /*-----------------------------------------------------------------------*/
-/* Only rcvr_spi(), xmit_spi(), disk_timerproc() and some macros         */
-/* are platform dependent.                                               */
+/* Only rcvr_spi(), xmit_spi(), their _multi versions, disk_timerproc()  */
+/* and some macros are platform dependent.                               */
 /*-----------------------------------------------------------------------*/
 
 
@@ -121,11 +121,13 @@ static void FCLK_FAST()
 /* Transmit a byte to MMC via SPI  (Platform dependent)                  */
 /*-----------------------------------------------------------------------*/
 
+#if _READONLY == 0
 //#define xmit_spi(dat) (SSPSend((uint8_t*)&(dat), 1))
 static void xmit_spi(BYTE dat)
 {
     sspSend(0, (uint8_t*) &dat, 1);
 }
+#endif
 
 
 /*-----------------------------------------------------------------------*/
@@ -142,12 +144,31 @@ BYTE rcvr_spi (void)
     return data;
 }
 
-/* Alternative macro to receive data fast */
+/*-----------------------------------------------------------------------*/
+/* Receive/transmit a block via SPI  (Platform dependent)                */
+/*-----------------------------------------------------------------------*/
+/* The SSP FIFO is kept full for the whole block instead of waiting for  */
+/* every byte to complete.                                               */
 
-#define rcvr_spi_m(dst) \
-    do { \
-        sspReceive(0, (uint8_t*)(dst), 1); \
-    } while(0)
+static
+void rcvr_spi_multi (
+	BYTE *buff,		/* Buffer to store received data */
+	UINT btr		/* Byte count */
+)
+{
+	sspDrain(0, (uint8_t*)buff, btr, 0xFF);
+}
+
+#if _READONLY == 0
+static
+void xmit_spi_multi (
+	const BYTE *buff,	/* Data to be sent */
+	UINT btx			/* Byte count */
+)
+{
+	sspTransfer(0, (const uint8_t*)buff, NULL, btx);
+}
+#endif
 
 
 
@@ -246,14 +267,8 @@ BOOL rcvr_datablock (
 	} while ((token == 0xFF) && Timer1);
 	if(token != 0xFE) return FALSE;	/* If not valid data token, retutn with error */
 
-	do {							/* Receive the data block into buffer */
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-	} while (btr -= 4);
-	rcvr_spi();						/* Discard CRC */
-	rcvr_spi();
+	rcvr_spi_multi(buff, btr);		/* Receive the data block into buffer */
+	sspFill(0, 0xFF, 2);			/* Discard CRC */
 
 	return TRUE;					/* Return with success */
 }
@@ -271,20 +286,15 @@ BOOL xmit_datablock (
 	BYTE token			/* Data/Stop token */
 )
 {
-	BYTE resp, wc;
+	BYTE resp;
 
 
 	if (wait_ready() != 0xFF) return FALSE;
 
 	xmit_spi(token);					/* Xmit data token */
 	if (token != 0xFD) {	/* Is data token */
-		wc = 0;
-		do {							/* Xmit the 512 byte data block to MMC */
-			xmit_spi(*buff++);
-			xmit_spi(*buff++);
-		} while (--wc);
-		xmit_spi(0xFF);					/* CRC (Dummy) */
-		xmit_spi(0xFF);
+		xmit_spi_multi(buff, 512);		/* Xmit the 512 byte data block to MMC */
+		sspFill(0, 0xFF, 2);			/* CRC (Dummy) */
 		resp = rcvr_spi();				/* Reveive data response */
 		if ((resp & 0x1F) != 0x05)		/* If not accepted, return with error */
 			return FALSE;
@@ -306,7 +316,7 @@ BYTE send_cmd (
 	DWORD arg		/* Argument */
 )
 {
-	BYTE n, res;
+	BYTE n, res, buf[6];
 
 
 	if (cmd & 0x80) {	/* ACMD<n> is the command sequense of CMD55-CMD<n> */
@@ -320,15 +330,16 @@ BYTE send_cmd (
 	if (!select()) return 0xFF;
 
 	/* Send command packet */
-	xmit_spi(cmd);						/* Start + Command index */
-	xmit_spi((BYTE)(arg >> 24));		/* Argument[31..24] */
-	xmit_spi((BYTE)(arg >> 16));		/* Argument[23..16] */
-	xmit_spi((BYTE)(arg >> 8));			/* Argument[15..8] */
-	xmit_spi((BYTE)arg);				/* Argument[7..0] */
+	buf[0] = cmd;						/* Start + Command index */
+	buf[1] = (BYTE)(arg >> 24);			/* Argument[31..24] */
+	buf[2] = (BYTE)(arg >> 16);			/* Argument[23..16] */
+	buf[3] = (BYTE)(arg >> 8);			/* Argument[15..8] */
+	buf[4] = (BYTE)arg;					/* Argument[7..0] */
 	n = 0x01;							/* Dummy CRC + Stop */
 	if (cmd == CMD0) n = 0x95;			/* Valid CRC for CMD0(0) */
 	if (cmd == CMD8) n = 0x87;			/* Valid CRC for CMD8(0x1AA) */
-	xmit_spi(n);
+	buf[5] = n;
+	sspTransfer(0, buf, NULL, 6);
 
 	/* Receive command response */
 	if (cmd == CMD12) rcvr_spi();		/* Skip a stuff byte when stop reading */
@@ -374,7 +385,7 @@ DSTATUS disk_initialize (
 
 	power_on();							/* Force socket power on */
 	FCLK_SLOW();
-	for (n = 100; n; n--) rcvr_spi();	/* 80 dummy clocks */
+	sspFill(0, 0xFF, 100);				/* 80 dummy clocks */
 
 	ty = 0;
 	if (send_cmd(CMD0, 0) == 1) {			/* Enter Idle state */
@@ -507,6 +518,110 @@ DRESULT disk_write (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Streamed Multiple Block Read                                          */
+/*-----------------------------------------------------------------------*/
+/* disk_read() needs a buffer for the whole transfer.  These functions   */
+/* keep a single CMD18 open and return one 512 byte block per call, so   */
+/* the caller can double buffer (see core/usbmsc/mscuser.c).  The card   */
+/* stays selected until disk_readstop() is called.                       */
+
+DRESULT disk_readstart (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	DWORD sector		/* Start sector number (LBA) */
+)
+{
+	if (drv) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+
+	if (send_cmd(CMD18, sector) != 0) {	/* READ_MULTIPLE_BLOCK */
+		deselect();
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+DRESULT disk_readblock (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	BYTE *buff			/* Pointer to the 512 byte data buffer */
+)
+{
+	if (drv) return RES_PARERR;
+
+	return rcvr_datablock(buff, 512) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_readstop (
+	BYTE drv			/* Physical drive nmuber (0) */
+)
+{
+	if (drv) return RES_PARERR;
+
+	send_cmd(CMD12, 0);					/* STOP_TRANSMISSION */
+	deselect();
+
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Streamed Multiple Block Write                                         */
+/*-----------------------------------------------------------------------*/
+
+#if _READONLY == 0
+DRESULT disk_writestart (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	DWORD sector,		/* Start sector number (LBA) */
+	DWORD count			/* Number of sectors that will follow (pre-erase hint) */
+)
+{
+	if (drv) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (Stat & STA_PROTECT) return RES_WRPRT;
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+
+	if (CardType & CT_SDC) send_cmd(ACMD23, count);
+	if (send_cmd(CMD25, sector) != 0) {	/* WRITE_MULTIPLE_BLOCK */
+		deselect();
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+DRESULT disk_writeblock (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	const BYTE *buff	/* Pointer to the 512 byte data block */
+)
+{
+	if (drv) return RES_PARERR;
+
+	return xmit_datablock(buff, 0xFC) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_writestop (
+	BYTE drv			/* Physical drive nmuber (0) */
+)
+{
+	DRESULT res;
+
+
+	if (drv) return RES_PARERR;
+
+	res = xmit_datablock(0, 0xFD) ? RES_OK : RES_ERROR;	/* STOP_TRAN token */
+	deselect();
+
+	return res;
+}
+#endif /* _READONLY == 0 */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Miscellaneous Functions                                               */
 /*-----------------------------------------------------------------------*/
@@ -37,11 +37,89 @@
 #include "chb.h"
 #include "chb_drvr.h"
 #include "chb_buf.h"
+#include "chb_eeprom.h"
+#include "chb_lpl.h"
+#include "chb_mesh.h"
+#include "chb_xport.h"
+
+#define CHB_TXQ_SIZE    (CFG_CHIBI_TXQUEUESIZE)
+#define CHB_TXQ_MASK    (CHB_TXQ_SIZE - 1)
+
+// the mesh and the transport take their frames out of the rx pool, also
+// from behind a frame the app hasn't released yet
+#define CHB_RX_AHEAD    ((CFG_CHIBI_MESH == 1) || (CFG_CHIBI_XPORT == 1))
+
+// the tx frame counter is reserved in eeprom this many frames at a time so
+// that it never goes backwards across a reset
+#define CHB_SEC_CNT_RESERVE     256
+
+// CCM* flags bytes for the B0 block (adata, 4 byte MIC, 2 byte len field)
+// and the counter blocks
+#define CHB_CCM_B0_FLAGS        0x49
+#define CHB_CCM_A_FLAGS         0x01
+
+// a frame waiting in the tx queue. writes longer than CHB_MAX_PAYLOAD take
+// one entry per fragment, all sharing the handle of the write.
+typedef struct
+{
+    U8 hdr[CHB_HDR_SZ + 1];
+    U8 data[CHB_MAX_PAYLOAD + CHB_SEC_OVERHEAD];
+    U8 len;
+    U8 handle;
+    bool last;
+    U16 addr;
+} chb_tx_desc_t;
+
+// last sequence number seen from a node, for duplicate rejection
+typedef struct
+{
+    U16 src_addr;
+    U8 seq;
+} chb_dup_t;
+
+// highest frame counter accepted from a node, for replay protection
+typedef struct
+{
+    U16 src_addr;
+    U32 frame_cnt;
+} chb_sec_src_t;
+
+// outcome of a queued write. it stays available until the handle's slot
+// gets reused CHB_TXQ_SIZE writes later.
+typedef struct
+{
+    U8 handle;
+    volatile U8 status;
+} chb_tx_result_t;
 
 static chb_pcb_t pcb;
-// these are for the duplicate checking and rejection
-static U8 prev_seq = 0xFF;
-static U16 prev_src_addr = 0xFFFE;
+// these are for the duplicate checking and rejection. one entry per node
+// heard recently, replaced round robin.
+static chb_dup_t dup_tbl[CHB_DUP_TBL_SZ];
+static U8 dup_next;
+// frame security. the counter tables work like the duplicate table.
+static U8 sec_key[CHB_KEY_LEN];
+static U32 sec_frame_cnt;       // next outgoing frame counter
+#if (CFG_CHIBI_SECURITY == 1)
+static U32 sec_frame_cnt_rsvd;  // reserved in eeprom up to here
+#endif
+static chb_sec_src_t sec_tbl[CHB_DUP_TBL_SZ];
+static U8 sec_next;
+// frame handed out by chb_read_frame and not released yet
+static chb_frame_t *lent = NULL;
+#if CHB_RX_AHEAD
+// frames behind the lent one that have been checked already
+static U8 ahead;
+#endif
+
+// tx queue. head is only written by chb_write_async and tail only by the radio
+// isr. both are free running.
+static chb_tx_desc_t txq[CHB_TXQ_SIZE];
+static chb_tx_result_t txq_result[CHB_TXQ_SIZE];
+static volatile U8 txq_head, txq_tail;
+static volatile bool txq_busy;      // the entry at the tail is on the air
+static U8 txq_handle;
+static chb_tx_cb_t txq_cb;
 /**************************************************************************/
 /*!
 
@@ -49,9 +127,51 @@ static U16 prev_src_addr = 0xFFFE;
 /**************************************************************************/
 void chb_init()
 {
+    U8 i;
+
     memset(&pcb, 0, sizeof(chb_pcb_t));
     pcb.src_addr = chb_get_short_addr();
+    lent = NULL;
+#if CHB_RX_AHEAD
+    ahead = 0;
+#endif
+
+    // 0xFFFE isn't a valid short source address so the table starts empty
+    for (i=0; i<CHB_DUP_TBL_SZ; i++)
+    {
+        dup_tbl[i].src_addr = 0xFFFE;
+        sec_tbl[i].src_addr = 0xFFFE;
+    }
+    dup_next = sec_next = 0;
+
+#if (CFG_CHIBI_SECURITY == 1)
+    // continue from the last reserved frame counter (blank eeprom reads 0xFF)
+    chb_eeprom_read(CFG_EEPROM_CHIBI_FRAMECNT, (U8 *)&sec_frame_cnt_rsvd, sizeof(U32));
+    if (sec_frame_cnt_rsvd == 0xFFFFFFFF)
+    {
+        sec_frame_cnt_rsvd = 0;
+    }
+    sec_frame_cnt = sec_frame_cnt_rsvd;
+#endif
+
+    // empty tx queue. give every result slot a handle that doesn't map to it
+    // so that unused handles read back as invalid.
+    txq_head = txq_tail = 0;
+    txq_busy = false;
+    for (i=0; i<CHB_TXQ_SIZE; i++)
+    {
+        txq_result[i].handle = i + 1;
+    }
     chb_drvr_init();
+#if (CFG_CHIBI_LPL == 1)
+    chb_lpl_init();
+#endif
+#if (CFG_CHIBI_MESH == 1)
+    chb_mesh_init();
+#endif
+#if (CFG_CHIBI_XPORT == 1)
+    chb_xport_init();
+#endif
 }
 
 /**************************************************************************/
@@ -80,7 +200,8 @@ static U8 chb_gen_hdr(U8 *hdr, U16 addr, U8 len)
 
     // use default fcf byte 0 val but test for ack request. we won't request
     // ack if broadcast. all other cases we will.
-    *hdr_ptr++ = CHB_FCF_BYTE_0 | ((addr != 0xFFFF) << CHB_ACK_REQ_POS);
+    *hdr_ptr++ = CHB_FCF_BYTE_0 | ((addr != 0xFFFF) << CHB_ACK_REQ_POS) |
+                 ((CFG_CHIBI_SECURITY == 1) << CHB_SEC_EN_POS);
     *hdr_ptr++ = CHB_FCF_BYTE_1;
 
     *hdr_ptr++ = pcb.seq++;
@@ -99,13 +220,340 @@ static U8 chb_gen_hdr(U8 *hdr, U16 addr, U8 len)
 
 /**************************************************************************/
 /*!
+    Update the tx stats with the outcome of a transmission attempt
+*/
+/**************************************************************************/
+static void chb_tx_stats(U8 status)
+{
+    switch (status)
+    {
+    case CHB_SUCCESS:
+        // fall through
+    case CHB_SUCCESS_DATA_PENDING:
+        pcb.txd_success++;
+        break;
+
+    case CHB_NO_ACK:
+        pcb.txd_noack++;
+        break;
+
+    case CHB_CHANNEL_ACCESS_FAILURE:
+        pcb.txd_channel_fail++;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Load the entry at the tail of the tx queue into the radio and start
+    sending it. Must be called with the radio interrupt processing locked
+    out (or from it) and a non-empty queue.
+*/
+/**************************************************************************/
+static U8 chb_txq_start()
+{
+    chb_tx_desc_t *desc = &txq[txq_tail & CHB_TXQ_MASK];
+
+    txq_busy = true;
+#if (CFG_CHIBI_LPL == 1)
+    chb_lpl_tx_begin(desc->addr);
+#endif
+    return chb_tx_start(desc->hdr, desc->data, desc->len);
+}
+
+/**************************************************************************/
+/*!
+    Returns true while frames from the tx queue are being sent. Used by the
+    isr to tell a queued transmission from a blocking chb_write.
+*/
+/**************************************************************************/
+bool chb_txq_active()
+{
+    return txq_busy;
+}
+
+/**************************************************************************/
+/*!
+    Called from the radio interrupt processing when the frame at the tail of the tx queue is done.
+    Records the status, completes the write if this was its last fragment
+    (or if it failed, in which case its remaining fragments are dropped) and
+    loads the next queued frame. Returns true if a new frame is on its way.
+*/
+/**************************************************************************/
+bool chb_txq_next(U8 status)
+{
+    chb_tx_desc_t *desc;
+    U8 handle;
+    bool ok;
+
+    do
+    {
+        desc = &txq[txq_tail & CHB_TXQ_MASK];
+#if (CFG_CHIBI_LPL == 1)
+        // duty cycled: the frame goes out again until the receiver hears it
+        while (chb_lpl_tx_again(status))
+        {
+            if (chb_tx_start(desc->hdr, desc->data, desc->len) == RADIO_SUCCESS)
+            {
+                return true;
+            }
+            status = CHB_INVALID;
+        }
+#endif
+        handle = desc->handle;
+        ok = (status == CHB_SUCCESS) || (status == CHB_SUCCESS_DATA_PENDING);
+
+        chb_tx_stats(status);
+        txq_tail++;
+
+        if (!desc->last && !ok)
+        {
+            while ((txq_tail != txq_head) && (txq[txq_tail & CHB_TXQ_MASK].handle == handle))
+            {
+                txq_tail++;
+            }
+        }
+
+        if (desc->last || !ok)
+        {
+            txq_result[handle & CHB_TXQ_MASK].status = status;
+#if (CFG_CHIBI_MESH == 1)
+            chb_mesh_tx_done(handle, status);
+#endif
+            if (txq_cb)
+            {
+                txq_cb(handle, status);
+            }
+        }
+
+        if (txq_tail == txq_head)
+        {
+            txq_busy = false;
+            return false;
+        }
+
+        // if the radio refuses the next frame, fail it and move on
+        status = CHB_INVALID;
+    } while (chb_txq_start() != RADIO_SUCCESS);
+
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Set the 128-bit key used to secure frames (see CFG_CHIBI_SECURITY). All
+    nodes of the network have to use the same key.
+*/
+/**************************************************************************/
+void chb_set_key(U8 *key)
+{
+    memcpy(sec_key, key, CHB_KEY_LEN);
+}
+
+/**************************************************************************/
+/*!
+    Hand out the next tx frame counter, reserving a new batch in eeprom
+    when the current one runs out
+*/
+/**************************************************************************/
+static U32 chb_sec_next_cnt()
+{
+#if (CFG_CHIBI_SECURITY == 1)
+    if (sec_frame_cnt == sec_frame_cnt_rsvd)
+    {
+        sec_frame_cnt_rsvd += CHB_SEC_CNT_RESERVE;
+        chb_eeprom_write(CFG_EEPROM_CHIBI_FRAMECNT, (U8 *)&sec_frame_cnt_rsvd, sizeof(U32));
+    }
+#endif
+    return sec_frame_cnt++;
+}
+
+/**************************************************************************/
+/*!
+    Build a CCM* B0 or counter block: flags, 13 byte nonce, then a 16-bit
+    value (the payload len for B0, the block counter otherwise).
+
+    The nonce is normally the 64-bit source address, the frame counter and
+    the security level. Chibi frames only carry short addresses, so the PAN
+    ID and short source address (zero padded) take the place of the long
+    address.
+*/
+/**************************************************************************/
+static void chb_sec_block(U8 *blk, U8 flags, U8 *mhr, U32 frame_cnt, U16 val)
+{
+    blk[0] = flags;
+    memset(&blk[1], 0, 4);
+    blk[5] = mhr[4];                // pan id
+    blk[6] = mhr[3];
+    blk[7] = mhr[8];                // src addr
+    blk[8] = mhr[7];
+    blk[9] = frame_cnt >> 24;
+    blk[10] = frame_cnt >> 16;
+    blk[11] = frame_cnt >> 8;
+    blk[12] = frame_cnt;
+    blk[13] = CHB_SEC_LEVEL;
+    blk[14] = val >> 8;
+    blk[15] = val;
+}
+
+/**************************************************************************/
+/*!
+    CBC-MAC over the header (MHR and aux header) and the plaintext payload,
+    run on the radio's AES engine in CBC mode so that the intermediate
+    results never have to be read back. The first CHB_MIC_LEN bytes of the
+    result are stored in mic.
+*/
+/**************************************************************************/
+static void chb_sec_mac(U8 *mhr, U8 *aux, U32 frame_cnt, U8 *m, U8 len, U8 *mic)
+{
+    U8 blk[CHB_AES_BLOCK_SZ], i, n;
+
+    chb_sec_block(blk, CHB_CCM_B0_FLAGS, mhr, frame_cnt, len);
+    chb_aes_encrypt(CHB_AES_MODE_ECB, blk, NULL);
+
+    // the authenticated header is 14 bytes. with its 2 byte len in front
+    // it fills exactly one block.
+    blk[0] = 0;
+    blk[1] = CHB_HDR_SZ + CHB_AUX_HDR_SZ;
+    memcpy(&blk[2], mhr, CHB_HDR_SZ);
+    memcpy(&blk[2 + CHB_HDR_SZ], aux, CHB_AUX_HDR_SZ);
+    chb_aes_encrypt(CHB_AES_MODE_CBC, blk, (len == 0) ? blk : NULL);
+
+    // payload, zero padded to a whole number of blocks
+    for (i=0; i<len; i+=CHB_AES_BLOCK_SZ)
+    {
+        n = ((len - i) > CHB_AES_BLOCK_SZ) ? CHB_AES_BLOCK_SZ : (len - i);
+        memset(blk, 0, CHB_AES_BLOCK_SZ);
+        memcpy(blk, &m[i], n);
+        chb_aes_encrypt(CHB_AES_MODE_CBC, blk, ((i + n) == len) ? blk : NULL);
+    }
+    memcpy(mic, blk, CHB_MIC_LEN);
+}
+
+/**************************************************************************/
+/*!
+    CCM* counter mode. Encrypts or decrypts (it's the same operation) the
+    payload in place, and the MIC with counter block 0.
+*/
+/**************************************************************************/
+static void chb_sec_ctr(U8 *mhr, U32 frame_cnt, U8 *m, U8 len, U8 *mic)
+{
+    U8 blk[CHB_AES_BLOCK_SZ], i, j, n;
+    U16 ctr = 0;
+
+    chb_sec_block(blk, CHB_CCM_A_FLAGS, mhr, frame_cnt, ctr++);
+    chb_aes_encrypt(CHB_AES_MODE_ECB, blk, blk);
+    for (j=0; j<CHB_MIC_LEN; j++)
+    {
+        mic[j] ^= blk[j];
+    }
+
+    for (i=0; i<len; i+=CHB_AES_BLOCK_SZ)
+    {
+        chb_sec_block(blk, CHB_CCM_A_FLAGS, mhr, frame_cnt, ctr++);
+        chb_aes_encrypt(CHB_AES_MODE_ECB, blk, blk);
+
+        n = ((len - i) > CHB_AES_BLOCK_SZ) ? CHB_AES_BLOCK_SZ : (len - i);
+        for (j=0; j<n; j++)
+        {
+            m[i + j] ^= blk[j];
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Secure a payload of len bytes for the frame whose MAC header (the 9
+    bytes after the len byte) is at mhr. The header must already have the
+    security enabled bit set and be final, since it is authenticated.
+    out receives the aux security header, the encrypted payload and the
+    MIC, ie. len + CHB_AUX_HDR_SZ + CHB_MIC_LEN bytes, which is returned.
+*/
+/**************************************************************************/
+U8 chb_sec_protect(U8 *mhr, U8 *data, U8 len, U8 *out)
+{
+    U8 *aux = out;
+    U8 *m = out + CHB_AUX_HDR_SZ;
+    U32 frame_cnt = chb_sec_next_cnt();
+
+    aux[0] = CHB_SEC_LEVEL;
+    aux[1] = frame_cnt;
+    aux[2] = frame_cnt >> 8;
+    aux[3] = frame_cnt >> 16;
+    aux[4] = frame_cnt >> 24;
+    memcpy(m, data, len);
+
+    // the engine loses the key when the radio sleeps, so always reload it
+    chb_aes_set_key(sec_key);
+    chb_sec_mac(mhr, aux, frame_cnt, m, len, &m[len]);
+    chb_sec_ctr(mhr, frame_cnt, m, len, &m[len]);
+
+    return len + CHB_AUX_HDR_SZ + CHB_MIC_LEN;
+}
+
+/**************************************************************************/
+/*!
+    Undo chb_sec_protect. data points to the aux security header and *len
+    is the secured payload len. On success the payload is decrypted in
+    place (it starts at data + CHB_AUX_HDR_SZ) and *len is set to its len.
+    Returns false if the frame isn't secured the way we do it or the MIC
+    doesn't match. Replay checking is up to the caller.
+*/
+/**************************************************************************/
+bool chb_sec_unprotect(U8 *mhr, U8 *data, U8 *len)
+{
+    U8 *aux = data;
+    U8 *m = data + CHB_AUX_HDR_SZ;
+    U8 mic[CHB_MIC_LEN], i, plen, diff = 0;
+    U32 frame_cnt;
+
+    if ((*len < (CHB_AUX_HDR_SZ + CHB_MIC_LEN)) || (aux[0] != CHB_SEC_LEVEL))
+    {
+        return false;
+    }
+    plen = *len - CHB_AUX_HDR_SZ - CHB_MIC_LEN;
+    frame_cnt = aux[1] | (aux[2] << 8) | ((U32)aux[3] << 16) | ((U32)aux[4] << 24);
+
+    // decrypting also turns the received MIC back into the plain CBC-MAC
+    chb_aes_set_key(sec_key);
+    chb_sec_ctr(mhr, frame_cnt, m, plen, &m[plen]);
+    chb_sec_mac(mhr, aux, frame_cnt, m, plen, mic);
+
+    for (i=0; i<CHB_MIC_LEN; i++)
+    {
+        diff |= mic[i] ^ m[plen + i];
+    }
+    if (diff)
+    {
+        return false;
+    }
+
+    *len = plen;
+    return true;
+}
 
+/**************************************************************************/
+/*!
+    Send data and wait for the outcome. Anything still in the tx queue is
+    sent first.
 */
 /**************************************************************************/
 U8 chb_write(U16 addr, U8 *data, U8 len)
 {
     // U8 status, frm_len, hdr_len, hdr[CHB_HDR_SZ + 1];
-    U8 status, frm_len, hdr[CHB_HDR_SZ + 1];
+    U8 status, frm_len, frm_sz, *frm, hdr[CHB_HDR_SZ + 1];
+#if (CFG_CHIBI_SECURITY == 1)
+    U8 sec[CHB_MAX_PAYLOAD + CHB_SEC_OVERHEAD];
+#endif
+
+    // let the queue drain so that the frames go out in order
+    while (txq_busy)
+    {
+        chb_task();
+    }
     
     while (len > 0)
     {
@@ -115,36 +563,36 @@ U8 chb_write(U16 addr, U8 *data, U8 len)
 
         // gen frame header
         // hdr_len = chb_gen_hdr(hdr, addr, frm_len);
-        chb_gen_hdr(hdr, addr, frm_len);
+        chb_gen_hdr(hdr, addr, frm_len + CHB_SEC_OVERHEAD);
 
-        // send data to chip
-        status = chb_tx(hdr, data, frm_len);
+#if (CFG_CHIBI_SECURITY == 1)
+        frm = sec;
+        frm_sz = chb_sec_protect(&hdr[1], data, frm_len, sec);
+#else
+        frm = data;
+        frm_sz = frm_len;
+#endif
+
+        // send data to chip. duty cycled, the frame is repeated until the
+        // receiver has woken up to it
+#if (CFG_CHIBI_LPL == 1)
+        chb_lpl_tx_begin(addr);
+        do
+        {
+            status = chb_tx(hdr, frm, frm_sz);
+        } while (chb_lpl_tx_again(status));
+#else
+        status = chb_tx(hdr, frm, frm_sz);
+#endif
+        chb_tx_stats(status);
     
-        if (status != CHB_SUCCESS)
+        if ((status != CHB_SUCCESS) && (status != CHB_SUCCESS_DATA_PENDING))
         {
-            switch (status)
-            {
-            case RADIO_SUCCESS:
-                // fall through
-            case CHB_SUCCESS_DATA_PENDING:
-                pcb.txd_success++;
-                break;
-
-            case CHB_NO_ACK:
-                pcb.txd_noack++;
-                break;
-
-            case CHB_CHANNEL_ACCESS_FAILURE:
-                pcb.txd_channel_fail++;
-                break;
-
-            default:
-                break;
-            }
             return status;
         }
 
         // adjust len and restart
+        data += frm_len;
         len = len - frm_len;
     }
     return CHB_SUCCESS;
@@ -152,80 +600,393 @@ U8 chb_write(U16 addr, U8 *data, U8 len)
 
 /**************************************************************************/
 /*!
-    Read data from the buffer. Need to pass in a buffer of at leasts max frame
-    size and two 16-bit containers for the src and dest addresses.
- 
-    The read function will automatically populate the addresses and the data with
-    the frm payload. It will then return the len of the payload.
+    Queue data for transmission and return without waiting for the radio.
+
+    The write is split into CHB_MAX_PAYLOAD sized frames which are all
+    queued, or none of them if there isn't enough room (CHB_TX_QUEUE_FULL).
+    On success the write's handle is stored in *handle. The outcome can be
+    polled with chb_tx_status(handle) or delivered to the callback set with
+    chb_set_tx_cb(). Every frame updates the tx stats in the pcb.
 */
 /**************************************************************************/
-U8 chb_read(chb_rx_data_t *rx)
+U8 chb_write_async(U16 addr, U8 *data, U8 len, U8 *handle)
 {
-    U8 i, len, seq, *data_ptr;
+    U8 frm_len, head;
+    chb_tx_desc_t *desc;
 
-    data_ptr = rx->data;
+    if (len == 0)
+    {
+        return CHB_INVALID;
+    }
 
-    // first byte is always len. check it to make sure 
-    // we have a valid len byte.
-    if ((len = chb_buf_read()) > CHB_MAX_FRAME_LENGTH)
+    if (((len + CHB_MAX_PAYLOAD - 1) / CHB_MAX_PAYLOAD) > chb_tx_queue_free())
     {
-        return 0;
+        return CHB_TX_QUEUE_FULL;
+    }
+
+    *handle = txq_handle;
+    txq_result[txq_handle & CHB_TXQ_MASK].handle = txq_handle;
+    txq_result[txq_handle & CHB_TXQ_MASK].status = CHB_TX_PENDING;
+
+    head = txq_head;
+    while (len > 0)
+    {
+        frm_len = (len > CHB_MAX_PAYLOAD) ? CHB_MAX_PAYLOAD : len;
+        desc = &txq[head & CHB_TXQ_MASK];
+
+        chb_gen_hdr(desc->hdr, addr, frm_len + CHB_SEC_OVERHEAD);
+#if (CFG_CHIBI_SECURITY == 1)
+        desc->len = chb_sec_protect(&desc->hdr[1], data, frm_len, desc->data);
+#else
+        memcpy(desc->data, data, frm_len);
+        desc->len = frm_len;
+#endif
+        desc->handle = txq_handle;
+        desc->addr = addr;
+
+        data += frm_len;
+        len = len - frm_len;
+        desc->last = (len == 0);
+        head++;
+    }
+    txq_handle++;
+
+    // publish all fragments at once, then start sending unless the isr is
+    // already working through the queue
+    chb_irq_lock();
+    txq_head = head;
+    if (!txq_busy && (chb_txq_start() != RADIO_SUCCESS))
+    {
+        chb_txq_next(CHB_INVALID);
     }
-    *data_ptr++ = len;
+    chb_irq_unlock();
+
+    return CHB_SUCCESS;
+}
+
+/**************************************************************************/
+/*!
+    Returns CHB_TX_PENDING while a queued write is in progress, then the
+    status of its last transmission attempt. Handles that are too old to
+    be tracked any more return CHB_INVALID.
+*/
+/**************************************************************************/
+U8 chb_tx_status(U8 handle)
+{
+    chb_tx_result_t *res = &txq_result[handle & CHB_TXQ_MASK];
 
-    // load the rest of the data into buffer
-    for (i=0; i<len; i++)
+    return (res->handle == handle) ? res->status : CHB_INVALID;
+}
+
+/**************************************************************************/
+/*!
+    Number of free entries (CHB_MAX_PAYLOAD sized frames) in the tx queue
+*/
+/**************************************************************************/
+U8 chb_tx_queue_free()
+{
+    return CHB_TXQ_SIZE - (U8)(txq_head - txq_tail);
+}
+
+/**************************************************************************/
+/*!
+    Set the function called when a queued write finishes, or NULL for none.
+    It runs wherever radio interrupts are processed (see CFG_CHIBI_DEFERIRQ).
+*/
+/**************************************************************************/
+void chb_set_tx_cb(chb_tx_cb_t cb)
+{
+    txq_cb = cb;
+}
+
+/**************************************************************************/
+/*!
+    Keep pcb.data_rcv raised while frames are waiting. This is done with
+    interrupts off so that a frame arriving in between isn't missed.
+*/
+/**************************************************************************/
+static void chb_update_rcv_flag()
+{
+    CHB_ENTER_CRIT();
+    pcb.data_rcv = (chb_buf_get_cnt() != 0);
+    CHB_LEAVE_CRIT();
+}
+
+#if (CFG_CHIBI_PROMISCUOUS == 0) && (CFG_CHIBI_SECURITY == 0)
+/**************************************************************************/
+/*!
+    Returns true if seq is the last sequence number received from src_addr,
+    ie. the frame is a retry whose ACK got lost. Otherwise the sequence
+    number is remembered for the next check.
+*/
+/**************************************************************************/
+static bool chb_is_dup(U16 src_addr, U8 seq)
+{
+    U8 i;
+
+    for (i=0; i<CHB_DUP_TBL_SZ; i++)
     {
-        *data_ptr++ = chb_buf_read();
+        if (dup_tbl[i].src_addr == src_addr)
+        {
+            if (dup_tbl[i].seq == seq)
+            {
+                return true;
+            }
+            dup_tbl[i].seq = seq;
+            return false;
+        }
     }
 
-    // we're using the buffer that's fed in as an argument as a temp
-    // buffer as well to save resources.
-    // we'll use it as temp storage to parse the frame. then move the frame
-    // down so that only the payload will be in the buffer.
+    // new node. take over the oldest entry.
+    dup_tbl[dup_next].src_addr = src_addr;
+    dup_tbl[dup_next].seq = seq;
+    dup_next = (dup_next + 1) % CHB_DUP_TBL_SZ;
+    return false;
+}
+#endif
 
-    // extract the sequence number
-    data_ptr = rx->data + 3;    // location of sequence number
-    seq = *data_ptr;
+#if (CFG_CHIBI_SECURITY == 1) && (CFG_CHIBI_PROMISCUOUS == 0)
+/**************************************************************************/
+/*!
+    Replay protection. Returns true if frame_cnt is newer than anything
+    accepted from src_addr so far, and remembers it. Only call this once
+    the frame has been authenticated. A node that drops out of the table
+    (more than CHB_DUP_TBL_SZ nodes heard since) starts over.
 
-    // parse the buffer and extract the dest and src addresses
-    data_ptr = rx->data + 6;                // location of dest addr
-    rx->dest_addr = *(U16 *)data_ptr;
-    data_ptr += sizeof(U16);
-    rx->src_addr = *(U16 *)data_ptr;
-    data_ptr += sizeof(U16);
+    This also finds the duplicates: a retry whose ACK got lost carries the
+    same counter as the frame accepted last, and sets retry. The sequence
+    number can't be used for that, it isn't covered by the MIC.
+*/
+/**************************************************************************/
+static bool chb_sec_fresh(U16 src_addr, U32 frame_cnt, bool *retry)
+{
+    U8 i;
 
-    // if the data in the rx buf is 0, then clear the rx_flag. otherwise, keep it raised
-    if (!chb_buf_get_len())
+    for (i=0; i<CHB_DUP_TBL_SZ; i++)
     {
-        pcb.data_rcv = false;
+        if (sec_tbl[i].src_addr == src_addr)
+        {
+            if (frame_cnt <= sec_tbl[i].frame_cnt)
+            {
+                *retry = (frame_cnt == sec_tbl[i].frame_cnt);
+                return false;
+            }
+            sec_tbl[i].frame_cnt = frame_cnt;
+            return true;
+        }
     }
 
+    sec_tbl[sec_next].src_addr = src_addr;
+    sec_tbl[sec_next].frame_cnt = frame_cnt;
+    sec_next = (sec_next + 1) % CHB_DUP_TBL_SZ;
+    return true;
+}
+#endif
+
+/**************************************************************************/
+/*!
+    Parse and check a frame that came in. Returns true if it's for the app,
+    false if it has been dealt with here and its slot can be freed.
+*/
+/**************************************************************************/
+static bool chb_rx_check(chb_frame_t *frm)
+{
+    U8 len;
+#if (CFG_CHIBI_SECURITY == 1) && (CFG_CHIBI_PROMISCUOUS == 0)
+    U8 *aux;
+    bool retry = false;
+#endif
+
+    // buf holds the len byte followed by the frame, so the header fields
+    // are at the same positions as in the over the air frame + 1
+    len = frm->buf[0];
+    frm->seq = frm->buf[3];
+    frm->dest_addr = frm->buf[6] | (frm->buf[7] << 8);
+    frm->src_addr = frm->buf[8] | (frm->buf[9] << 8);
+
 #if (CFG_CHIBI_PROMISCUOUS == 1)
-    // if we're in promiscuous mode, we don't want to do any duplicate rejection and we don't want to move the payload
-    // to the front of the buffer. We want to capture the full frame so just keep the frame intact and return the length.
-    return len;
+    // in promiscuous mode we want to capture the full frame so don't do any
+    // duplicate rejection and hand over everything after the len byte
+    frm->offset = 1;
+    frm->len = len;
 #else
-    // duplicate frame check (dupe check). we want to remove frames that have been already been received since they 
-    // are just retries. 
-    // note: this dupe check only removes duplicate frames from the previous transfer. if another frame from a different
-    // node comes in between the dupes, then the dupe will show up as a received frame.
-    if ((seq == prev_seq) && (rx->src_addr == prev_src_addr))
-    {
-        // this is a duplicate frame from a retry. the remote node thinks we didn't receive 
-        // it properly. discard.
-        return 0;
+    // toss frames that are too short to hold our header (another protocol or
+    // another addressing mode)
+    if (len < (CHB_HDR_SZ + CHB_FCS_LEN))
+    {
+        return false;
+    }
+
+  #if (CFG_CHIBI_SECURITY == 0)
+    // and duplicates. the last sequence number is kept for up to
+    // CHB_DUP_TBL_SZ nodes, so frames from other nodes in between the dupes
+    // don't hide them.
+    if (chb_is_dup(frm->src_addr, frm->seq))
+    {
+        return false;
+    }
+  #endif
+
+    frm->offset = 1 + CHB_HDR_SZ;
+    frm->len = len - CHB_HDR_SZ - CHB_FCS_LEN;
+
+  #if (CFG_CHIBI_SECURITY == 1)
+    // nothing about the sender is recorded before the MIC checks out, so
+    // forged frames can't be used to lock out the real sender. retries are
+    // found by their frame counter and dropped without counting as a
+    // failure.
+    aux = &frm->buf[frm->offset];
+    if (!(frm->buf[1] & (1 << CHB_SEC_EN_POS)) ||
+        !chb_sec_unprotect(&frm->buf[1], aux, &frm->len) ||
+        !chb_sec_fresh(frm->src_addr, aux[1] | (aux[2] << 8) | ((U32)aux[3] << 16) | ((U32)aux[4] << 24), &retry))
+    {
+        if (!retry)
+        {
+            pcb.sec_fail++;
+        }
+        return false;
+    }
+    frm->offset += CHB_AUX_HDR_SZ;
+  #endif
+#endif
+    frm->data = frm->buf + frm->offset;
+
+#if (CFG_CHIBI_MESH == 1)
+    // frames relayed to the next hop and route control frames stop here
+    if (chb_mesh_rx(frm))
+    {
+        return false;
     }
-    else
+#endif
+#if (CFG_CHIBI_XPORT == 1)
+    // and so do fragments and ACKs of multi-frame messages
+    if (chb_xport_rx(frm))
+    {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Return the oldest received frame, or NULL if there is none. The frame
+    stays in its slot (no copy is made) and belongs to the caller until it
+    is handed back with chb_release_frame(). Calling this again before that
+    returns the same frame.
+
+    The addresses and sequence number are parsed out of the header. Except
+    in promiscuous mode, duplicate frames (retries of the last transfer from
+    the same node) are dropped here and data points to the payload. With
+    CFG_CHIBI_SECURITY the payload has been authenticated and decrypted,
+    and unsecured, forged or replayed frames are dropped as well. With
+    CFG_CHIBI_MESH, frames for other nodes are relayed here and mesh data
+    for this one comes out with the originator as src_addr. With
+    CFG_CHIBI_XPORT, transport frames are handed to chb_xport_rx here and
+    never reach the app. Both go on behind a frame the app hasn't released
+    yet, for as long as the rx pool has room.
+*/
+/**************************************************************************/
+chb_frame_t *chb_read_frame()
+{
+    chb_frame_t *frm;
+
+    if (lent)
     {
-        prev_seq = seq;
-        prev_src_addr = rx->src_addr;
+#if CHB_RX_AHEAD
+        // check the frames behind the lent one as they come in, so frames
+        // for other nodes and transport frames don't wait for the app. their slots can only be
+        // freed in order, so the ones dealt with are marked by clearing the
+        // len byte and tossed once they get to the front.
+        while ((frm = chb_buf_peek_at(ahead + 1)) != NULL)
+        {
+            if (!chb_rx_check(frm))
+            {
+                frm->buf[0] = 0;
+            }
+            ahead++;
+        }
+#endif
+        return lent;
     }
 
-    // move the payload down to the beginning of the data buffer
-    memmove(rx->data, data_ptr, len - CHB_HDR_SZ);
-    // finally, return the len of the payload
-    return len - CHB_HDR_SZ - CHB_FCS_LEN;
+    while ((frm = chb_buf_peek()) != NULL)
+    {
+#if CHB_RX_AHEAD
+        // checked already while the frame in front of it was lent out
+        if (ahead)
+        {
+            ahead--;
+            if (frm->buf[0])
+            {
+                lent = frm;
+                break;
+            }
+            chb_buf_free();
+            continue;
+        }
 #endif
+        if (chb_rx_check(frm))
+        {
+            lent = frm;
+            break;
+        }
+        chb_buf_free();
+    }
+
+    chb_update_rcv_flag();
+    return frm;
 }
 
+/**************************************************************************/
+/*!
+    Give a frame returned by chb_read_frame back to the rx pool
+*/
+/**************************************************************************/
+void chb_release_frame(chb_frame_t *frame)
+{
+    if (frame && (frame == lent))
+    {
+        lent = NULL;
+        chb_buf_free();
+        chb_update_rcv_flag();
+    }
+}
+
+/**************************************************************************/
+/*!
+    Read data from the buffer. Need to pass in a buffer of at leasts max frame
+    size and two 16-bit containers for the src and dest addresses.
+ 
+    The read function will automatically populate the addresses and the data with
+    the frm payload. It will then return the len of the payload.
+
+    This copies the frame out of the rx pool. Use chb_read_frame to work on
+    the frame in place.
+*/
+/**************************************************************************/
+U8 chb_read(chb_rx_data_t *rx)
+{
+    chb_frame_t *frm;
+    U8 len;
+
+    if ((frm = chb_read_frame()) == NULL)
+    {
+        return 0;
+    }
+
+    rx->src_addr = frm->src_addr;
+    rx->dest_addr = frm->dest_addr;
+
+#if (CFG_CHIBI_PROMISCUOUS == 1)
+    // keep the len byte in front of the frame like the raw frame buffer
+    len = frm->len;
+    memcpy(rx->data, frm->buf, len + 1);
+#else
+    len = frm->len;
+    memcpy(rx->data, frm->data, len);
+#endif
+
+    chb_release_frame(frm);
+    return len;
+}
@@ -35,10 +35,13 @@
 #define CHIBI_H
 
 #include "types.h"
+#include "projectconfig.h"
 
 #define CHB_HDR_SZ        9    // FCF + seq + pan_id + dest_addr + src_addr (2 + 1 + 2 + 2 + 2)
 #define CHB_FCS_LEN       2
 #define CHB_MAX_PAYLOAD   100
+#define CHB_BUF_SLOT_SZ   128  // largest 802.15.4 frame (127) + len byte
+#define CHB_DUP_TBL_SZ    8    // nodes tracked for duplicate rejection
 
 
 // frame_type = data
@@ -54,6 +57,20 @@
 #define CHB_FCF_BYTE_1    0x98
 
 #define CHB_ACK_REQ_POS   5
+#define CHB_SEC_EN_POS    3
+
+// frame security (CCM*, 802.15.4 security level 5: encryption + 32-bit MIC).
+// the aux security header is the security control byte and the frame
+// counter. it goes in front of the payload and the MIC after it.
+#define CHB_SEC_LEVEL     5
+#define CHB_AUX_HDR_SZ    5
+#define CHB_MIC_LEN       4
+#define CHB_KEY_LEN       16
+#if (CFG_CHIBI_SECURITY == 1)
+    #define CHB_SEC_OVERHEAD  (CHB_AUX_HDR_SZ + CHB_MIC_LEN)
+#else
+    #define CHB_SEC_OVERHEAD  0
+#endif
 
 enum
 {
@@ -61,9 +78,14 @@ enum
     CHB_SUCCESS_DATA_PENDING    = 1,
     CHB_CHANNEL_ACCESS_FAILURE  = 3,
     CHB_NO_ACK                  = 5,
-    CHB_INVALID                 = 7
+    CHB_INVALID                 = 7,
+    CHB_TX_PENDING              = 8,    // queued write hasn't finished yet
+    CHB_TX_QUEUE_FULL           = 9     // not enough room in the tx queue
 };
 
+// called from radio interrupt processing when a queued write finishes
+typedef void (*chb_tx_cb_t)(U8 handle, U8 status);
+
 // Chibi Protocol control block
 typedef struct
 {
@@ -79,6 +101,7 @@ typedef struct
     U16 txd_channel_fail;
     U16 overflow;
     U16 underrun;
+    U16 sec_fail;       // dropped for a bad MIC or an old frame counter
     U8 battlow;
     U8 ed;
     U8 crc;
@@ -89,12 +112,47 @@ typedef struct
     U8 len;
     U16 src_addr;
     U16 dest_addr;
-    U8 data[CHB_MAX_PAYLOAD];
+    U8 data[CHB_BUF_SLOT_SZ];
 } chb_rx_data_t;
 
+// A received frame. chb_read_frame lends it to the app, which gives it back
+// with chb_release_frame. The metadata belongs to this frame only and isn't
+// overwritten by later frames.
+typedef struct
+{
+    U8 len;             // payload len (full frame in promiscuous mode)
+    U8 offset;          // position of the payload in buf
+    U8 *data;           // points to the payload (buf + offset)
+    U8 ed;              // energy detect level at the end of the frame
+    U8 lqi;             // link quality indicator
+    U8 crc;             // 1 if the fcs is valid (always 1 unless promiscuous)
+    U8 channel;         // channel the frame was received on
+    U8 seq;
+    U16 src_addr;
+    U16 dest_addr;
+    U32 timestamp;      // radio interrupt at the end of the frame, in systick
+                        // ticks (microseconds in promiscuous mode)
+    U8 buf[CHB_BUF_SLOT_SZ + 1];    // len byte, frame incl. fcs, lqi byte
+} chb_frame_t;
+
 void chb_init();
 chb_pcb_t *chb_get_pcb();
 U8 chb_write(U16 addr, U8 *data, U8 len);
+U8 chb_write_async(U16 addr, U8 *data, U8 len, U8 *handle);
+U8 chb_tx_status(U8 handle);
+U8 chb_tx_queue_free();
+void chb_set_tx_cb(chb_tx_cb_t cb);
 U8 chb_read(chb_rx_data_t *rx);
+chb_frame_t *chb_read_frame();
+void chb_release_frame(chb_frame_t *frame);
+
+// frame security
+void chb_set_key(U8 *key);
+U8 chb_sec_protect(U8 *mhr, U8 *data, U8 len, U8 *out);
+bool chb_sec_unprotect(U8 *mhr, U8 *data, U8 *len);
+
+// tx queue hooks for the driver's interrupt processing
+bool chb_txq_active();
+bool chb_txq_next(U8 status);
 
 #endif
@@ -35,9 +35,13 @@
 #include "chb_buf.h"
 #include "projectconfig.h"
 
-static U8 chb_buf[CFG_CHIBI_BUFFERSIZE];
-static volatile U32 rd_ptr, wr_ptr;
-static volatile U32 len;
+#define CHB_BUF_MASK    (CHB_BUF_SLOTS - 1)
+
+// received frames are downloaded by the isr straight into a free slot, and
+// handed to the app in the order they arrived. wr_idx is only moved by the
+// isr and rd_idx only by the reader. both are free running.
+static chb_frame_t chb_buf[CHB_BUF_SLOTS];
+static volatile U8 rd_idx, wr_idx;
 
 /**************************************************************************/
 /*!
@@ -46,9 +50,24 @@ static volatile U32 len;
 /**************************************************************************/
 void chb_buf_init()
 {
-    rd_ptr = 0;
-    wr_ptr = 0;
-    len = 0;
+    rd_idx = 0;
+    wr_idx = 0;
+}
+
+/**************************************************************************/
+/*!
+    Return the slot the next received frame should be written to, or NULL
+    if all slots are taken. The frame only becomes visible to the reader
+    once chb_buf_commit() is called.
+*/
+/**************************************************************************/
+chb_frame_t *chb_buf_alloc()
+{
+    if ((U8)(wr_idx - rd_idx) >= CHB_BUF_SLOTS)
+    {
+        return NULL;
+    }
+    return &chb_buf[wr_idx & CHB_BUF_MASK];
 }
 
 /**************************************************************************/
@@ -56,26 +75,52 @@ void chb_buf_init()
 
 */
 /**************************************************************************/
-void chb_buf_write(U8 data)
+void chb_buf_commit()
 {
-    chb_buf[wr_ptr] = data;
-    wr_ptr = (wr_ptr + 1) % CFG_CHIBI_BUFFERSIZE;
-    len++;
+    wr_idx++;
 }
 
 /**************************************************************************/
 /*!
+    Return the oldest received frame without removing it, or NULL if
+    there is none.
+*/
+/**************************************************************************/
+chb_frame_t *chb_buf_peek()
+{
+    if (rd_idx == wr_idx)
+    {
+        return NULL;
+    }
+    return &chb_buf[rd_idx & CHB_BUF_MASK];
+}
 
+/**************************************************************************/
+/*!
+    Return the frame i places behind the oldest one, or NULL if there is
+    none. chb_buf_peek_at(0) is the same as chb_buf_peek().
 */
 /**************************************************************************/
-U8 chb_buf_read()
+chb_frame_t *chb_buf_peek_at(U8 i)
 {
-    U8 data;
+    if ((U8)(wr_idx - rd_idx) <= i)
+    {
+        return NULL;
+    }
+    return &chb_buf[(U8)(rd_idx + i) & CHB_BUF_MASK];
+}
 
-    data = chb_buf[rd_ptr];
-    rd_ptr = (rd_ptr + 1) % CFG_CHIBI_BUFFERSIZE;
-    len--;
-    return data;
+/**************************************************************************/
+/*!
+    Give the oldest frame's slot back to the pool
+*/
+/**************************************************************************/
+void chb_buf_free()
+{
+    if (rd_idx != wr_idx)
+    {
+        rd_idx++;
+    }
 }
 
 /**************************************************************************/
@@ -83,7 +128,7 @@ U8 chb_buf_read()
 
 */
 /**************************************************************************/
-U32 chb_buf_get_len()
+U8 chb_buf_get_cnt()
 {
-    return len;
+    return wr_idx - rd_idx;
 }
@@ -35,10 +35,18 @@
 #define CHB_BUF_H
 
 #include "types.h"
+#include "chb.h"
+#include "projectconfig.h"
+
+// number of frame slots in the rx pool. each slot holds one complete frame.
+#define CHB_BUF_SLOTS   (CFG_CHIBI_BUFFERSIZE / CHB_BUF_SLOT_SZ)
 
 void chb_buf_init();
-void chb_buf_write(U8 data);
-U8 chb_buf_read();
-U32 chb_buf_get_len();
+chb_frame_t *chb_buf_alloc();
+void chb_buf_commit();
+chb_frame_t *chb_buf_peek();
+chb_frame_t *chb_buf_peek_at(U8 i);
+void chb_buf_free();
+U8 chb_buf_get_cnt();
 
 #endif
@@ -32,6 +32,7 @@
 
 *******************************************************************/
 #include <stdio.h>
+#include <string.h>
 #include "chb.h"
 #include "chb_drvr.h"
 #include "chb_buf.h"
@@ -40,10 +41,42 @@
 
 #include "core/systick/systick.h"
 #include "core/timer16/timer16.h"
+#include "core/timer32/timer32.h"
 
 // store string messages in flash rather than RAM
-const char chb_err_overflow[] = "BUFFER FULL. TOSSING INCOMING DATA\r\n";
 const char chb_err_init[] = "RADIO NOT INITIALIZED PROPERLY\r\n";
+
+// time when the radio last raised its interrupt. frames are stamped with it
+// so that deferred processing doesn't skew the timestamps. a sniffer needs
+// better than 1 ms resolution, so in promiscuous mode 32-bit timer 1 runs
+// as a free-running microsecond counter instead of using the systick count.
+#if (CFG_CHIBI_PROMISCUOUS == 1)
+    #define CHB_TSTAMP_TIMER    1
+    #define CHB_TIMESTAMP()     timer32GetTimerValue(CHB_TSTAMP_TIMER)
+#else
+    #define CHB_TIMESTAMP()     systickGetTicks()
+#endif
+static volatile U32 chb_irq_time;
+
+// channel set by the last call to chb_set_channel
+static U8 chb_channel;
+
+// this file is always linked, so without CFG_CHIBI stick to mode 0 rather
+// than taking over PendSV in every build
+#ifdef CFG_CHIBI
+    #define CHB_DEFERIRQ    CFG_CHIBI_DEFERIRQ
+#else
+    #define CHB_DEFERIRQ    0
+#endif
+
+#if (CHB_DEFERIRQ > 0)
+// set by the top half when the radio raises its interrupt. IRQ_STATUS is read
+// (which also clears the radio's interrupt) by the bottom half.
+static volatile bool chb_irq_pending;
+#endif
+
+// chb_irq_lock() nesting depth
+static volatile U8 chb_irq_locked;
 /**************************************************************************/
 /*!
 
@@ -136,22 +169,22 @@ void chb_reset()
 /**************************************************************************/
 U8 chb_reg_read(U8 addr)
 {
-    U8 val = 0;
+    U8 buf[2];
 
     /* Add the register read command to the register address. */
-    addr |= 0x80;
+    buf[0] = addr | 0x80;
+    buf[1] = 0;
 
     CHB_ENTER_CRIT();
     CHB_SPI_ENABLE();
 
     /*Send Register address and read register content.*/
-    val = chb_xfer_byte(addr);
-    val = chb_xfer_byte(val);
+    chb_xfer_block(buf, buf, 2);
 
     CHB_SPI_DISABLE();
     CHB_LEAVE_CRIT();
 
-    return val;
+    return buf[1];
 }
 
 /**************************************************************************/
@@ -178,19 +211,17 @@ U16 chb_reg_read16(U8 addr)
 /**************************************************************************/
 void chb_reg_write(U8 addr, U8 val)
 {
-    // U8 dummy; 
+    U8 buf[2];
 
     /* Add the Register Write command to the address. */
-    addr |= 0xC0;
+    buf[0] = addr | 0xC0;
+    buf[1] = val;
 
     CHB_ENTER_CRIT();
     CHB_SPI_ENABLE();
 
     /*Send Register address and write register content.*/
-    // dummy = chb_xfer_byte(addr);
-    // dummy = chb_xfer_byte(val);
-    chb_xfer_byte(addr);
-    chb_xfer_byte(val);
+    chb_write_block(buf, 2);
 
     CHB_SPI_DISABLE();
     CHB_LEAVE_CRIT();
@@ -249,9 +280,6 @@ void chb_reg_read_mod_write(U8 addr, U8 val, U8 mask)
 /**************************************************************************/
 void chb_frame_write(U8 *hdr, U8 hdr_len, U8 *data, U8 data_len)
 {
-    //U8 i, dummy;
-    U8 i;
-
     // dont allow transmission longer than max frame size
     if ((hdr_len + data_len) > 127)
     {
@@ -266,19 +294,9 @@ void chb_frame_write(U8 *hdr, U8 hdr_len, U8 *data, U8 data_len)
     // dummy = chb_xfer_byte(CHB_SPI_CMD_FW);
     chb_xfer_byte(CHB_SPI_CMD_FW);
 
-    // write hdr contents to fifo
-    for (i=0; i<hdr_len; i++)
-    {
-        // dummy = chb_xfer_byte(*hdr++);
-        chb_xfer_byte(*hdr++);
-    }
-
-    // write data contents to fifo
-    for (i=0; i<data_len; i++)
-    {
-        // dummy = chb_xfer_byte(*data++);
-        chb_xfer_byte(*data++);
-    }
+    // write hdr and data contents to fifo
+    chb_write_block(hdr, hdr_len);
+    chb_write_block(data, data_len);
 
     // terminate spi transaction
     CHB_SPI_DISABLE(); 
@@ -292,45 +310,42 @@ void chb_frame_write(U8 *hdr, U8 hdr_len, U8 *data, U8 data_len)
 /**************************************************************************/
 static void chb_frame_read()
 {
-    U8 i, len, data;
+    U8 len, buf[2];
+    chb_frame_t *frm;
+    chb_pcb_t *pcb = chb_get_pcb();
 
     // CHB_ENTER_CRIT();
     CHB_SPI_ENABLE();
 
     /*Send frame read command and read the length.*/
-    chb_xfer_byte(CHB_SPI_CMD_FR);
-    len = chb_xfer_byte(0);
+    buf[0] = CHB_SPI_CMD_FR;
+    buf[1] = 0;
+    chb_xfer_block(buf, buf, 2);
+    len = buf[1];
 
     /*Check for correct frame length.*/
     if ((len >= CHB_MIN_FRAME_LENGTH) && (len <= CHB_MAX_FRAME_LENGTH))
     {
-        // check to see if there is room to write the frame in the buffer. if not, then drop it
-        if (len < (CFG_CHIBI_BUFFERSIZE - chb_buf_get_len()))
+        // download the frame and the lqi byte that follows it straight into a
+        // free slot of the rx pool. if there is none, drop the frame
+        if ((frm = chb_buf_alloc()) != NULL)
         {
-            chb_buf_write(len);
-            
-            for (i=0; i<len; i++)
-            {
-                data = chb_xfer_byte(0);
-                chb_buf_write(data);
-            }
+            frm->buf[0] = len;
+            chb_read_block(&frm->buf[1], len + 1);
+            frm->lqi = frm->buf[len + 1];
+            frm->ed = pcb->ed;
+            frm->crc = pcb->crc;
+            frm->channel = chb_channel;
+            frm->timestamp = chb_irq_time;
+            chb_buf_commit();
         }
         else
         {
             // we've overflowed the buffer. toss the data and do some housekeeping
-            chb_pcb_t *pcb = chb_get_pcb();
-
-            // read out the data and throw it away
-            for (i=0; i<len; i++)
-            {
-                data = chb_xfer_byte(0);
-            }
+            chb_read_block(NULL, len + 1);
 
             // Increment the overflow stat
             pcb->overflow++;
-
-            // print the error message
-            printf(chb_err_overflow);
         }
     }
 
@@ -340,28 +355,21 @@ static void chb_frame_read()
 
 /**************************************************************************/
 /*!
-    Read directly from the SRAM on the radio. This is only used for debugging
-    purposes.
+    Read directly from the SRAM on the radio. Besides the frame buffer this
+    is how the AES engine's registers are accessed.
 */
 /**************************************************************************/
-#ifdef CHB_DEBUG
 void chb_sram_read(U8 addr, U8 len, U8 *data)
 {
-    U8 i, dummy;
+    U8 cmd[2] = {CHB_SPI_CMD_SR, addr};
 
     CHB_ENTER_CRIT();
     CHB_SPI_ENABLE();
 
-    /*Send SRAM read command.*/
-    dummy = chb_xfer_byte(CHB_SPI_CMD_SR);
-
-    /*Send address where to start reading.*/
-    dummy = chb_xfer_byte(addr);
+    /*Send SRAM read command and the address where to start reading.*/
+    chb_write_block(cmd, 2);
 
-    for (i=0; i<len; i++)
-    {
-        *data++ = chb_xfer_byte(0);
-    }
+    chb_read_block(data, len);
 
     CHB_SPI_DISABLE();
     CHB_LEAVE_CRIT();
@@ -374,26 +382,71 @@ void chb_sram_read(U8 addr, U8 len, U8 *data)
 /**************************************************************************/
 void chb_sram_write(U8 addr, U8 len, U8 *data)
 {    
-    U8 i, dummy;
+    U8 cmd[2] = {CHB_SPI_CMD_SW, addr};
 
     CHB_ENTER_CRIT();
     CHB_SPI_ENABLE();
 
-    /*Send SRAM write command.*/
-    dummy = chb_xfer_byte(CHB_SPI_CMD_SW);
-
-    /*Send address where to start writing to.*/
-    dummy = chb_xfer_byte(addr);
+    /*Send SRAM write command and the address where to start writing to.*/
+    chb_write_block(cmd, 2);
 
-    for (i=0; i<len; i++)
-    {
-        dummy = chb_xfer_byte(*data++);
-    }
+    chb_write_block(data, len);
 
     CHB_SPI_DISABLE();
     CHB_LEAVE_CRIT();
 }
-#endif
+
+/**************************************************************************/
+/*!
+    Load a 128-bit key into the AES engine. The engine forgets it when the
+    radio goes to sleep.
+*/
+/**************************************************************************/
+void chb_aes_set_key(U8 *key)
+{
+    U8 buf[1 + CHB_AES_BLOCK_SZ];
+
+    // AES_CTRL followed by AES_STATE in one burst
+    buf[0] = CHB_AES_MODE_KEY;
+    memcpy(&buf[1], key, CHB_AES_BLOCK_SZ);
+    chb_sram_write(CHB_AES_CTRL, sizeof(buf), buf);
+}
+
+/**************************************************************************/
+/*!
+    Encrypt one block with the AES engine. mode is CHB_AES_MODE_ECB, or
+    CHB_AES_MODE_CBC to xor the block with the previous result first (for
+    CBC-MAC). The result is copied to out unless it's NULL, in which case
+    it stays in the engine for the next CBC block. in and out can be the
+    same buffer.
+
+    The engine takes ~24 usec per block. AES_STATUS is polled rather than
+    waiting for a fixed delay, since the SPI transfers take most of that
+    time anyway.
+*/
+/**************************************************************************/
+void chb_aes_encrypt(U8 mode, U8 *in, U8 *out)
+{
+    U8 buf[2 + CHB_AES_BLOCK_SZ];
+
+    // AES_CTRL, the block and AES_CTRL_MIRROR in one burst. setting the
+    // request bit in the mirror register at the end starts the operation.
+    buf[0] = mode;
+    memcpy(&buf[1], in, CHB_AES_BLOCK_SZ);
+    buf[1 + CHB_AES_BLOCK_SZ] = mode | CHB_AES_REQUEST;
+    chb_sram_write(CHB_AES_CTRL, sizeof(buf), buf);
+
+    // the state mustn't be accessed until the engine is done
+    do
+    {
+        chb_sram_read(CHB_AES_STATUS, 1, buf);
+    } while (!(buf[0] & CHB_AES_DONE));
+
+    if (out)
+    {
+        chb_sram_read(CHB_AES_STATE, CHB_AES_BLOCK_SZ, out);
+    }
+}
 
 /**************************************************************************/
 /*!
@@ -436,6 +489,8 @@ U8 chb_set_channel(U8 channel)
 {
     U8 state;
     
+    chb_channel = channel;
+
 #if (CHB_CHINA == 1)
 
     // this if for China only which uses a 780 MHz frequency band
@@ -496,6 +551,16 @@ U8 chb_set_channel(U8 channel)
     return ((chb_reg_read(PHY_CC_CCA) & 0x1f) == channel) ? RADIO_SUCCESS : RADIO_TIMED_OUT;
 }
 
+/**************************************************************************/
+/*!
+    Get the channel set by the last call to chb_set_channel
+*/
+/**************************************************************************/
+U8 chb_get_channel()
+{
+    return chb_channel;
+}
+
 /**************************************************************************/
 /*!
     Set the power level
@@ -645,23 +710,28 @@ void chb_set_hgm(U8 enb)
 
 /**************************************************************************/
 /*!
-    Load the data into the fifo, initiate a transmission attempt,
-    and return the status of the transmission attempt.
+    Load the data into the fifo and initiate a transmission attempt
+    without waiting for it to finish. The end of the attempt is signalled
+    by the TRX_END interrupt, after which chb_get_status() holds the result.
 */
 /**************************************************************************/
-U8 chb_tx(U8 *hdr, U8 *data, U8 len)
+U8 chb_tx_start(U8 *hdr, U8 *data, U8 len)
 {
     U8 state = chb_get_state();
-    chb_pcb_t *pcb = chb_get_pcb();
 
     if ((state == BUSY_TX) || (state == BUSY_TX_ARET))
     {
         return RADIO_WRONG_STATE;
     }
 
-    // TODO: check why we need to transition to the off state before we go to tx_aret_on
-    chb_set_state(TRX_OFF);
-    chb_set_state(TX_ARET_ON);
+    // back to back frames from the tx queue find the radio still in TX_ARET_ON
+    // so the trip through TRX_OFF (and the PLL settling time) can be skipped
+    if (state != TX_ARET_ON)
+    {
+        // TODO: check why we need to transition to the off state before we go to tx_aret_on
+        chb_set_state(TRX_OFF);
+        chb_set_state(TX_ARET_ON);
+    }
 
     // TODO: try and start the frame transmission by writing TX_START command instead of toggling
     // sleep pin...i just feel like it's kind of weird...
@@ -671,9 +741,35 @@ U8 chb_tx(U8 *hdr, U8 *data, U8 len)
 
     //Do frame transmission
     chb_reg_read_mod_write(TRX_STATE, CMD_TX_START, 0x1F);
+    return RADIO_SUCCESS;
+}
+
+/**************************************************************************/
+/*!
+    Load the data into the fifo, initiate a transmission attempt,
+    and return the status of the transmission attempt.
+*/
+/**************************************************************************/
+U8 chb_tx(U8 *hdr, U8 *data, U8 len)
+{
+    U8 status;
+    chb_pcb_t *pcb = chb_get_pcb();
+
+    // keep interrupt processing from changing the radio state half way
+    chb_irq_lock();
+    status = chb_tx_start(hdr, data, len);
+    chb_irq_unlock();
+
+    if (status != RADIO_SUCCESS)
+    {
+        return status;
+    }
 
     // wait for the transmission to end, signalled by the TRX END flag
-    while (!pcb->tx_end);
+    while (!pcb->tx_end)
+    {
+        chb_task();
+    }
     pcb->tx_end = false;
 
     // check the status of the transmission
@@ -726,6 +822,18 @@ static void chb_radio_init()
     chb_set_pwr(CFG_CHIBI_POWER);       // Defined in projectconfig.h
     chb_set_channel(CFG_CHIBI_CHANNEL); // Defined in projectconfig.h
 
+#if (CHB_DEFERIRQ > 0)
+    // received frames may sit in the radio until the bottom half gets to them.
+    // protect the frame buffer until it's been read instead of letting the
+    // next frame overwrite it
+    chb_reg_read_mod_write(TRX_CTRL_2, 1 << CHB_RX_SAFE_MODE_POS, 1 << CHB_RX_SAFE_MODE_POS);
+#endif
+#if (CHB_DEFERIRQ == 1)
+    // the bottom half runs in PendSV. give it the lowest priority so that
+    // every other interrupt can preempt it
+    SCB_SHPR3 = (SCB_SHPR3 & ~SCB_SHPR3_PRI_14_MASK) | SCB_SHPR3_PRI_14_LOWEST;
+#endif
+
     // set fsm state
     // put trx in rx auto ack mode
     chb_set_state(RX_STATE);
@@ -766,7 +874,7 @@ static void chb_radio_init()
                       CHB_EINTPIN,
                       gpioInterruptSense_Edge,        // Edge-sensitive
                       gpioInterruptEdge_Single,       // Single edge
-                      gpioInterruptEvent_ActiveLow);  // High triggers interrupt
+                      gpioInterruptEvent_ActiveHigh); // High triggers interrupt
 
     // enable interrupt
     gpioIntEnable (CHB_EINTPORT,
@@ -796,6 +904,11 @@ void chb_drvr_init()
     timer16Init(0, 0xFFFF);
     timer16Enable(0);
 
+#if (CFG_CHIBI_PROMISCUOUS == 1)
+    // free-running 1 MHz counter for the frame timestamps
+    timer32InitFreeRunning(CHB_TSTAMP_TIMER, TIMER32_CCLK_1US);
+#endif
+
     // Set sleep and reset as output
     gpioSetDir(CHB_SLPTRPORT, CHB_SLPTRPIN, 1);
     gpioSetDir(CHB_RSTPORT, CHB_RSTPIN, 1);
@@ -841,28 +954,98 @@ void chb_sleep(U8 enb)
     chb_set_state(RX_STATE);
   }
 }
+
 /**************************************************************************/
 /*!
+    Sample the channel for usec microseconds. The radio is woken up if
+    it's asleep and is left listening in RX_STATE, so a frame that starts
+    during the sample is received as usual.
 
+    Returns the highest PHY_RSSI value seen (0..28, in 3dB steps above the
+    receiver sensitivity), or CHB_SAMPLE_FRAME if a frame was coming in.
+    Returns as soon as the RSSI reaches thres.
 */
 /**************************************************************************/
-void chb_ISR_Handler (void)
+U8 chb_sample(U16 usec, U8 thres)
 {
-    // U8 dummy, state, intp_src = 0;
-    U8 state, intp_src = 0;
-    chb_pcb_t *pcb = chb_get_pcb();
+    U8 rssi, max = 0, state;
+    U16 t = 0;
 
-    CHB_ENTER_CRIT();
+    // keep the bottom half from changing the state while we look at it
+    chb_irq_lock();
 
-    /*Read Interrupt source.*/
-    CHB_SPI_ENABLE();   
+    if (gpioGetValue(CHB_SLPTRPORT, CHB_SLPTRPIN))
+    {
+        chb_sleep(false);
+    }
 
-    /*Send Register address and read register content.*/
-    // dummy = chb_xfer_byte(IRQ_STATUS | CHB_SPI_CMD_RR);
-    chb_xfer_byte(IRQ_STATUS | CHB_SPI_CMD_RR);
-    intp_src = chb_xfer_byte(0);
+    for (;;)
+    {
+        state = chb_get_state();
+        if ((state == BUSY_RX) || (state == BUSY_RX_AACK))
+        {
+            max = CHB_SAMPLE_FRAME;
+            break;
+        }
 
-    CHB_SPI_DISABLE();
+        rssi = chb_reg_read(PHY_RSSI) & 0x1f;
+        if (rssi > max)
+        {
+            max = rssi;
+        }
+        if ((max >= thres) || (t >= usec))
+        {
+            break;
+        }
+        chb_delay_us(CHB_SAMPLE_STEP_US);
+        t += CHB_SAMPLE_STEP_US;
+    }
+
+    chb_irq_unlock();
+    return max;
+}
+
+/**************************************************************************/
+/*!
+    Put the radio to sleep, but only if it's just listening. Returns false
+    and leaves it on if it's receiving or sending a frame or has raised an
+    interrupt that hasn't been handled yet.
+*/
+/**************************************************************************/
+bool chb_sleep_idle()
+{
+    bool ok = false;
+
+    chb_irq_lock();
+    if (!gpioGetValue(CHB_SLPTRPORT, CHB_SLPTRPIN) && (chb_get_state() == RX_STATE))
+    {
+        // this waits for a frame that has just started to end
+        chb_set_state(TRX_OFF);
+
+        // if it did, leave the radio on for the bottom half to read it
+        if (gpioGetValue(CHB_EINTPORT, CHB_EINTPIN))
+        {
+            chb_set_state(RX_STATE);
+        }
+        else
+        {
+            CHB_SLPTR_ENABLE();
+            ok = true;
+        }
+    }
+    chb_irq_unlock();
+    return ok;
+}
+/**************************************************************************/
+/*!
+    Handle the radio's interrupt sources (IRQ_STATUS). This is the bottom
+    half: it does all the SPI work, including downloading received frames.
+*/
+/**************************************************************************/
+static void chb_irq_process(U8 intp_src)
+{
+    U8 state;
+    chb_pcb_t *pcb = chb_get_pcb();
 
     while (intp_src)
     {
@@ -883,8 +1066,12 @@ void chb_ISR_Handler (void)
                 // get the crc
                 pcb->crc = (chb_reg_read(PHY_RSSI) & (1<<7)) ? 1 : 0;
 
-                // if the crc is not valid, then do not read the frame and set the rx flag
+                // if the crc is not valid, then do not read the frame and set the rx flag.
+                // a sniffer wants to see corrupted frames too (ex. collisions), so in
+                // promiscuous mode they're read anyway and flagged by frm->crc
+#if (CFG_CHIBI_PROMISCUOUS == 0)
                 if (pcb->crc)
+#endif
                 {
                     // get the data
                     chb_frame_read();
@@ -892,6 +1079,17 @@ void chb_ISR_Handler (void)
                     pcb->data_rcv = true;
                 }
             }
+            else if (chb_txq_active())
+            {
+                // a frame from the tx queue is done. if the next one could be
+                // loaded straight away, stay in TX_ARET_ON rather than going
+                // back to receive
+                if (chb_txq_next(chb_get_status()))
+                {
+                    intp_src &= ~CHB_IRQ_TRX_END_MASK;
+                    continue;
+                }
+            }
             else
             {
                 pcb->tx_end = true;
@@ -921,5 +1119,130 @@ void chb_ISR_Handler (void)
         {
         }
     }
+}
+
+/**************************************************************************/
+/*!
+    Top half, called from the GPIO interrupt when the radio raises its IRQ
+    line. With CFG_CHIBI_DEFERIRQ set to 0 everything is done right here.
+    Otherwise the event is only latched. The bottom half then runs from
+    PendSV at the lowest priority (1) or from chb_task() in the main
+    loop (2).
+*/
+/**************************************************************************/
+void chb_ISR_Handler (void)
+{
+    chb_irq_time = CHB_TIMESTAMP();
+
+#if (CHB_DEFERIRQ == 0)
+    U8 buf[2];
+
+    CHB_ENTER_CRIT();
+
+    /*Read Interrupt source.*/
+    CHB_SPI_ENABLE();   
+
+    /*Send Register address and read register content.*/
+    buf[0] = IRQ_STATUS | CHB_SPI_CMD_RR;
+    buf[1] = 0;
+    chb_xfer_block(buf, buf, 2);
+
+    CHB_SPI_DISABLE();
+
+    chb_irq_process(buf[1]);
     CHB_LEAVE_CRIT();
+#else
+    chb_irq_pending = true;
+  #if (CHB_DEFERIRQ == 1)
+    SCB_ICSR = SCB_ICSR_PENDSVSET;
+  #endif
+#endif
+}
+
+#if (CHB_DEFERIRQ > 0)
+/**************************************************************************/
+/*!
+    Run the bottom half if the radio has raised its interrupt and the app
+    isn't in the middle of a radio operation (chb_irq_lock).
+*/
+/**************************************************************************/
+static void chb_bottom_half()
+{
+    if (!chb_irq_pending || chb_irq_locked)
+    {
+        return;
+    }
+
+    // clear the flag first. if the radio interrupts again while we're busy,
+    // we'll just go round again
+    chb_irq_pending = false;
+    chb_irq_process(chb_reg_read(IRQ_STATUS));
+}
+#endif
+
+#if (CHB_DEFERIRQ == 1)
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void PendSV_Handler (void)
+{
+    chb_bottom_half();
+}
+#endif
+
+/**************************************************************************/
+/*!
+    Process pending radio interrupts. With CFG_CHIBI_DEFERIRQ set to 2 this
+    has to be called regularly from the main loop. Otherwise it does nothing.
+*/
+/**************************************************************************/
+void chb_task()
+{
+#if (CHB_DEFERIRQ == 2)
+    chb_bottom_half();
+#endif
+    CHB_TASK_HOOK();
+}
+
+/**************************************************************************/
+/*!
+    Keep radio interrupt processing out while the app goes through a
+    sequence of radio operations (state changes followed by a frame
+    upload, etc). Calls can be nested, in every CFG_CHIBI_DEFERIRQ mode:
+    processing is only let back in by the outermost chb_irq_unlock().
+*/
+/**************************************************************************/
+void chb_irq_lock()
+{
+#if (CHB_DEFERIRQ == 0)
+    // disable first, so the isr can't run between the two
+    NVIC_DisableIRQ(CHB_EINTIRQ);
+#endif
+    chb_irq_locked++;
+}
+
+/**************************************************************************/
+/*!
+    Undo one chb_irq_lock(). Any interrupt that came in while locked is
+    processed once the outermost lock is released.
+*/
+/**************************************************************************/
+void chb_irq_unlock()
+{
+    if (!chb_irq_locked || (--chb_irq_locked != 0))
+    {
+        return;
+    }
+
+#if (CHB_DEFERIRQ == 0)
+    NVIC_EnableIRQ(CHB_EINTIRQ);
+#elif (CHB_DEFERIRQ == 1)
+    if (chb_irq_pending)
+    {
+        // an interrupt came in while we were locked
+        SCB_ICSR = SCB_ICSR_PENDSVSET;
+    }
+#endif
 }
@@ -64,6 +64,7 @@
 #define CHB_EINTPORT          1
 #define CHB_EINTPIN           8
 #define CHB_EINTPIN_IOCONREG  IOCON_PIO1_8
+#define CHB_EINTIRQ           EINT1_IRQn
 #define CHB_RSTPORT           1
 #define CHB_RSTPIN            9
 #define CHB_RSTPIN_IOCONREG   IOCON_PIO1_9
@@ -85,6 +86,13 @@
     
 #define CHB_ENTER_CRIT()    __disable_irq()
 #define CHB_LEAVE_CRIT()    __enable_irq()
+
+// run at the end of every chb_task() call, i.e. each time round the busy
+// waits for a transmission to end. a build can put a WFI here or, like the
+// host simulator in tools/chibisim, let time pass.
+#ifndef CHB_TASK_HOOK
+    #define CHB_TASK_HOOK()
+#endif
 #define CHB_RST_ENABLE()    do {gpioSetValue(CHB_RSTPORT, CHB_RSTPIN, 0); } while (0)
 #define CHB_RST_DISABLE()   do {gpioSetValue(CHB_RSTPORT, CHB_RSTPIN, 1); } while (0)
 #define CHB_SLPTR_ENABLE()  do {gpioSetValue(CHB_SLPTRPORT, CHB_SLPTRPIN, 1); } while (0)
@@ -98,6 +106,13 @@ enum
     CCA_CARRIER_SENSE_WITH_ED = 3     /**< Use a combination of both energy detection and carrier sense. */
 };
 
+// channel sampling (chb_sample)
+enum
+{
+    CHB_SAMPLE_STEP_US      = 20,       // time between two RSSI reads
+    CHB_SAMPLE_FRAME        = 0xFF      // returned if a frame was coming in
+};
+
 // configuration parameters
 enum
 {
@@ -184,7 +199,30 @@ enum
     CHB_BPSK_TX_OFFSET          = 3,
     CHB_MIN_FRAME_LENGTH        = 3,
     CHB_MAX_FRAME_LENGTH        = 0x7f,
-    CHB_PA_EXT_EN_POS           = 7
+    CHB_PA_EXT_EN_POS           = 7,
+    CHB_RX_SAFE_MODE_POS        = 7
+};
+
+// AES engine. its registers are reached with the SRAM commands.
+enum
+{
+    CHB_AES_STATUS          = 0x82,
+    CHB_AES_CTRL            = 0x83,
+    CHB_AES_STATE           = 0x84,     // 16 bytes, key or data
+    CHB_AES_CTRL_MIRROR     = 0x94,
+    CHB_AES_BLOCK_SZ        = 16
+};
+
+// AES_STATUS and AES_CTRL bits
+enum
+{
+    CHB_AES_DONE            = (1<<0),
+    CHB_AES_ER              = (1<<7),
+    CHB_AES_REQUEST         = (1<<7),
+    CHB_AES_DIR_DECRYPT     = (1<<3),
+    CHB_AES_MODE_ECB        = (0<<4),
+    CHB_AES_MODE_KEY        = (1<<4),
+    CHB_AES_MODE_CBC        = (2<<4)
 };
 
 // transceiver timing
@@ -345,6 +383,7 @@ void chb_frame_write(U8 *hdr, U8 hdr_len, U8 *data, U8 data_len);
 // general configuration
 void chb_set_mode(U8 mode);
 U8 chb_set_channel(U8 channel);
+U8 chb_get_channel();
 void chb_set_pwr(U8 val);
 void chb_set_ieee_addr(U8 *addr);
 void chb_get_ieee_addr(U8 *addr);
@@ -354,21 +393,30 @@ U8 chb_set_state(U8 state);
 
 // Power management
 void chb_sleep(U8 enb);
+U8 chb_sample(U16 usec, U8 thres);
+bool chb_sleep_idle();
 
 // data transmit
+U8 chb_tx_start(U8 *hdr, U8 *data, U8 len);
 U8 chb_tx(U8 *hdr, U8 *data, U8 len);
 
 #if (CHB_CC1190_PRESENT)
     void chb_set_hgm(U8 enb);
 #endif
 
-#ifdef CHB_DEBUG
 // sram access
 void chb_sram_read(U8 addr, U8 len, U8 *data);
 void chb_sram_write(U8 addr, U8 len, U8 *data);
-#endif
 
+// aes engine
+void chb_aes_set_key(U8 *key);
+void chb_aes_encrypt(U8 mode, U8 *in, U8 *out);
+
+// interrupt handling (see CFG_CHIBI_DEFERIRQ)
 void chb_ISR_Handler (void);
+void chb_task();
+void chb_irq_lock();
+void chb_irq_unlock();
 
 #endif
 
@@ -0,0 +1,473 @@
+/**************************************************************************/
+/*! 
+    @file     chb_lpl.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Duty cycled (low power listening) MAC for Chibi
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <string.h>
+
+#include "chb.h"
+#include "chb_drvr.h"
+#include "chb_lpl.h"
+
+#include "core/systick/systick.h"
+#include "core/pmu/pmu.h"
+
+#if (CFG_CHIBI_LPL == 1)
+
+// symbol time and symbols per byte at the configured data rate. the modes
+// are an enum, so they're compared by value here
+#if (CFG_CHIBI_MODE == 0)                   // OQPSK_868MHZ
+    #define CHB_LPL_SYMBOL_US       40
+    #define CHB_LPL_SYMBOLS_PER_BYTE 2
+#elif (CFG_CHIBI_MODE == 3)                 // BPSK40_915MHZ
+    #define CHB_LPL_SYMBOL_US       25
+    #define CHB_LPL_SYMBOLS_PER_BYTE 8
+#elif (CFG_CHIBI_MODE == 4)                 // BPSK20_868MHZ
+    #define CHB_LPL_SYMBOL_US       50
+    #define CHB_LPL_SYMBOLS_PER_BYTE 8
+#else                                       // OQPSK_915MHZ, OQPSK_780MHZ
+    #define CHB_LPL_SYMBOL_US       16
+    #define CHB_LPL_SYMBOLS_PER_BYTE 2
+#endif
+#define CHB_LPL_BYTE_US         (CHB_LPL_SYMBOL_US * CHB_LPL_SYMBOLS_PER_BYTE)
+
+// longest frame on the air (preamble, SFD and PHR + 127 bytes)
+#define CHB_LPL_FRAME_US        ((6 + 127) * CHB_LPL_BYTE_US)
+
+// gap between two copies of a unicast frame: the sender waits for the ACK
+// (macAckWaitDuration) and loads the frame again
+#define CHB_LPL_GAP_US          ((20 + 12 + 11 * CHB_LPL_SYMBOLS_PER_BYTE) * CHB_LPL_SYMBOL_US + 500)
+
+// a sample has to be longer than the gap to be sure to hit a copy
+#define CHB_LPL_SAMPLE_US       (CHB_LPL_GAP_US + 2 * CHB_SAMPLE_STEP_US)
+
+// radio on time of a sample: waking up, PLL settling and the sample itself
+#define CHB_LPL_SAMPLE_COST_US  (TIME_SLEEP_TO_TRX_OFF + TIME_TRX_OFF_RX_ON + CHB_LPL_SAMPLE_US)
+
+// after hearing something, stay on long enough to get a full copy
+#define CHB_LPL_LISTEN_MS       ((2 * CHB_LPL_FRAME_US + CHB_LPL_GAP_US) / 1000 + 1)
+
+// and after a frame, to catch the one that follows it (the rest of a
+// write, a reply)
+#define CHB_LPL_LINGER_MS       CHB_LPL_LISTEN_MS
+
+// a sender keeps repeating its frame for this long on top of the interval,
+// so that a sample falls in and the receiver gets a full copy afterwards
+#define CHB_LPL_STROBE_MS       ((CHB_LPL_SAMPLE_US + 2 * (CHB_LPL_FRAME_US + CHB_LPL_GAP_US)) / 1000 + 1)
+
+// sampling more often than it takes to listen for a frame is pointless
+#define CHB_LPL_MIN_INTERVAL    CHB_LPL_LISTEN_MS
+
+// everything but the WDT oscillator is off in deep sleep
+#define CHB_LPL_PDSLEEPCFG      (SCB_PDSLEEPCFG_IRCOUT_PD | SCB_PDSLEEPCFG_IRC_PD | \
+                                 SCB_PDSLEEPCFG_FLASH_PD | SCB_PDSLEEPCFG_USBPLL_PD | \
+                                 SCB_PDSLEEPCFG_SYSPLL_PD | SCB_PDSLEEPCFG_SYSOSC_PD | \
+                                 SCB_PDSLEEPCFG_ADC_PD | SCB_PDSLEEPCFG_BOD_PD)
+
+static U16 interval;                // ms between samples, 0 = radio always on
+static volatile bool radio_on;
+static bool sampled;                // woken up by a sample rather than to send
+static bool heard;                  // a frame came in since then
+static U16 last_rcvd;
+static U32 next_sample;
+static volatile U32 awake_until;
+static U32 awake_since;
+static U32 slept_ms;                // in deep sleep, where the systick stops
+
+// frame being sent
+static volatile bool tx_busy;
+static U16 tx_addr;
+static U32 tx_start;
+static U16 tx_copies;
+
+static chb_lpl_stats_t stats;
+static U32 stats_since;
+
+/**************************************************************************/
+/*!
+    Milliseconds since startup, including the time spent in deep sleep
+*/
+/**************************************************************************/
+U32 chb_lpl_now()
+{
+    return systickGetTicks() * CFG_SYSTICK_DELAY_IN_MS + slept_ms;
+}
+
+/**************************************************************************/
+/*!
+    Keep the radio on for at least another ms milliseconds. It has to be
+    on already.
+*/
+/**************************************************************************/
+static void chb_lpl_stay(U32 now, U32 ms)
+{
+    if (!radio_on)
+    {
+        radio_on = true;
+        awake_since = now;
+    }
+    if ((S32)(now + ms - awake_until) > 0)
+    {
+        awake_until = now + ms;
+    }
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_lpl_init()
+{
+    radio_on = true;
+    tx_busy = false;
+    slept_ms = 0;
+    awake_since = chb_lpl_now();
+    chb_lpl_reset_stats();
+    chb_lpl_set_interval(CFG_CHIBI_LPL_INTERVAL);
+}
+
+/**************************************************************************/
+/*!
+    Set the time between two channel samples in ms. The longer it is, the
+    less the radio is on and the longer frames take to get through, for
+    this node's frames and for the ones sent to it. All nodes should use
+    the same interval, since a sender's repeats are based on its own.
+    0 keeps the radio on all the time.
+*/
+/**************************************************************************/
+void chb_lpl_set_interval(U16 ms)
+{
+    U32 now = chb_lpl_now();
+
+    interval = ms;
+    if (ms == 0)
+    {
+        // back to always on, with the usual retries
+        if (!radio_on)
+        {
+            chb_sleep(false);
+            chb_lpl_stay(now, 0);
+        }
+        chb_reg_write(XAH_CTRL_0, (CHB_MAX_FRAME_RETRIES << CHB_MAX_FRAME_RETRIES_POS) |
+                                  (CHB_MAX_CSMA_RETRIES << CHB_MAX_CSMA_RETIRES_POS));
+        return;
+    }
+
+    // the task turns the radio off
+    awake_until = now;
+    next_sample = now + ms;
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+U16 chb_lpl_get_interval()
+{
+    return interval;
+}
+
+/**************************************************************************/
+/*!
+    Worst case time in ms for a frame to get through to a node that
+    samples with the current interval
+*/
+/**************************************************************************/
+U16 chb_lpl_max_latency()
+{
+    if (interval == 0)
+    {
+        return (CHB_LPL_FRAME_US + CHB_LPL_GAP_US) / 1000 + 1;
+    }
+    return interval + CHB_LPL_STROBE_MS;
+}
+
+/**************************************************************************/
+/*!
+    Use the longest interval that still gets frames through within ms
+    milliseconds. If the target is too tight for duty cycling, the radio
+    stays on. Returns the interval.
+*/
+/**************************************************************************/
+U16 chb_lpl_set_latency(U16 ms)
+{
+    U16 ival = 0;
+
+    if (ms >= CHB_LPL_STROBE_MS + CHB_LPL_MIN_INTERVAL)
+    {
+        ival = ms - CHB_LPL_STROBE_MS;
+    }
+    chb_lpl_set_interval(ival);
+    return ival;
+}
+
+/**************************************************************************/
+/*!
+    Sample the channel when it's time to and turn the radio off again
+    once there's nothing left to listen for. Call it from the main loop.
+*/
+/**************************************************************************/
+void chb_lpl_task()
+{
+    chb_pcb_t *pcb = chb_get_pcb();
+    U32 now;
+    U8 level;
+
+    if (interval == 0)
+    {
+        return;
+    }
+    now = chb_lpl_now();
+
+    if (radio_on)
+    {
+        // every frame that comes in keeps the radio on a bit longer
+        if (pcb->rcvd_xfers != last_rcvd)
+        {
+            last_rcvd = pcb->rcvd_xfers;
+            heard = true;
+            chb_lpl_stay(now, CHB_LPL_LINGER_MS);
+        }
+
+        if (((S32)(now - awake_until) >= 0) && !tx_busy && !chb_txq_active() && chb_sleep_idle())
+        {
+            radio_on = false;
+            stats.awake_ms += now - awake_since;
+            if (sampled && !heard)
+            {
+                stats.idle_wakeups++;
+            }
+            sampled = false;
+        }
+        return;
+    }
+
+    if ((S32)(now - next_sample) < 0)
+    {
+        return;
+    }
+    next_sample += interval;
+    if ((S32)(now - next_sample) >= 0)
+    {
+        // fell behind, don't try to catch up
+        next_sample = now + interval;
+    }
+
+    stats.samples++;
+    level = chb_sample(CHB_LPL_SAMPLE_US, CHB_LPL_RSSI_THRES);
+
+    // the radio stays on if the sample found something or a frame came in
+    // right at the end of it
+    if ((level >= CHB_LPL_RSSI_THRES) || !chb_sleep_idle())
+    {
+        stats.wakeups++;
+        sampled = true;
+        heard = false;
+        last_rcvd = pcb->rcvd_xfers;
+        chb_lpl_stay(now, CHB_LPL_LISTEN_MS);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Put the MCU to sleep until there's something to do. With the radio off
+    and CFG_CHIBI_LPL_DEEPSLEEP set that's deep sleep until the next
+    sample. Otherwise it's pmuSleep, which the systick ends within a ms.
+*/
+/**************************************************************************/
+void chb_lpl_idle()
+{
+#if (CFG_CHIBI_LPL_DEEPSLEEP == 1)
+    S32 left = (S32)(next_sample - chb_lpl_now());
+
+    if ((interval > 0) && !radio_on && (left > 1))
+    {
+        // the radio is woken up on the way out (pmuRestoreHW). the sample
+        // that's due puts it back to sleep if the channel is quiet
+        pmuDeepSleepMs(CHB_LPL_PDSLEEPCFG, left);
+        slept_ms += left;
+        return;
+    }
+#endif
+    pmuSleep();
+}
+
+/**************************************************************************/
+/*!
+    Called by chb.c before it sends a frame to addr. Wakes up the radio and
+    sets it up for one attempt per copy, with CSMA for the first.
+*/
+/**************************************************************************/
+void chb_lpl_tx_begin(U16 addr)
+{
+    U32 now;
+
+    if (interval == 0)
+    {
+        return;
+    }
+    now = chb_lpl_now();
+
+    if (!radio_on)
+    {
+        chb_sleep(false);
+        chb_lpl_stay(now, 0);
+    }
+
+    tx_busy = true;
+    tx_addr = addr;
+    tx_start = now;
+    tx_copies = 1;
+    chb_reg_write(XAH_CTRL_0, CHB_MAX_CSMA_RETRIES << CHB_MAX_CSMA_RETIRES_POS);
+}
+
+/**************************************************************************/
+/*!
+    Called by chb.c with the status of each copy. Returns true if the frame
+    has to go out again: a unicast until it's ACKed and a broadcast until
+    every node has had the chance to wake up. Otherwise the frame is done
+    and status is its outcome.
+*/
+/**************************************************************************/
+bool chb_lpl_tx_again(U8 status)
+{
+    U32 now, elapsed;
+    bool more;
+
+    if (!tx_busy)
+    {
+        return false;
+    }
+    now = chb_lpl_now();
+    elapsed = now - tx_start;
+
+    if (tx_addr == 0xFFFF)
+    {
+        more = (status == CHB_SUCCESS);
+    }
+    else
+    {
+        more = (status == CHB_NO_ACK);
+    }
+
+    if (more && (elapsed < (U32)interval + CHB_LPL_STROBE_MS))
+    {
+        if (tx_copies == 1)
+        {
+            // the channel is ours now, no need for CSMA on the repeats
+            chb_reg_write(XAH_CTRL_0, 7 << CHB_MAX_CSMA_RETIRES_POS);
+        }
+        tx_copies++;
+        return true;
+    }
+
+    tx_busy = false;
+    stats.frames++;
+    stats.strobes += tx_copies;
+    if ((tx_addr != 0xFFFF) && ((status == CHB_SUCCESS) || (status == CHB_SUCCESS_DATA_PENDING)))
+    {
+        if ((stats.acked == 0) || (elapsed < stats.latency_min))
+        {
+            stats.latency_min = elapsed;
+        }
+        if (elapsed > stats.latency_max)
+        {
+            stats.latency_max = elapsed;
+        }
+        stats.latency_sum += elapsed;
+        stats.acked++;
+    }
+
+    // stay on for an answer
+    chb_lpl_stay(now, CHB_LPL_LINGER_MS);
+    return false;
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_lpl_get_stats(chb_lpl_stats_t *s)
+{
+    U32 now = chb_lpl_now();
+
+    memcpy(s, &stats, sizeof(chb_lpl_stats_t));
+    if (radio_on)
+    {
+        s->awake_ms += now - awake_since;
+    }
+    s->sample_ms = (U32)(((U64)stats.samples * CHB_LPL_SAMPLE_COST_US) / 1000);
+    s->elapsed_ms = now - stats_since;
+}
+
+/**************************************************************************/
+/*!
+    Share of the time the radio was on since the stats were reset, in
+    hundredths of a percent
+*/
+/**************************************************************************/
+U16 chb_lpl_duty_cycle()
+{
+    chb_lpl_stats_t s;
+    U32 on;
+
+    chb_lpl_get_stats(&s);
+    on = s.awake_ms + s.sample_ms;
+    if ((s.elapsed_ms == 0) || (on >= s.elapsed_ms))
+    {
+        return 10000;
+    }
+    return (U16)(((U64)on * 10000) / s.elapsed_ms);
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_lpl_reset_stats()
+{
+    memset(&stats, 0, sizeof(chb_lpl_stats_t));
+    stats_since = chb_lpl_now();
+    if (radio_on)
+    {
+        awake_since = stats_since;
+    }
+}
+
+#endif
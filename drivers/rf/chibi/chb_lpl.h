@@ -0,0 +1,97 @@
+/**************************************************************************/
+/*! 
+    @file     chb_lpl.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Duty cycled (low power listening) MAC for Chibi
+
+    With a wake interval set, the radio sleeps most of the time. Every
+    interval ms it's woken up for a moment to sample the channel (RSSI)
+    and only stays on if it hears something. A sender makes sure it gets
+    heard by repeating its frame for a bit longer than the wake interval:
+    a unicast until the receiver ACKs it, a broadcast for the whole time.
+    The frame itself is the wakeup strobe, so a receiver that wakes up in
+    the middle of one copy just waits for the next and doesn't need a
+    separate preamble.
+
+    Receivers drop the extra copies through the normal duplicate check
+    (same sequence number). The longer the interval, the less time the
+    radio is on and the longer a frame takes to get through. Worst case,
+    a frame needs chb_lpl_max_latency() ms.
+
+    In between, chb_lpl_idle() puts the MCU to sleep as well, with
+    pmuSleep or, if CFG_CHIBI_LPL_DEEPSLEEP is set, pmuDeepSleepMs until
+    the next sample.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef CHB_LPL_H
+#define CHB_LPL_H
+
+#include "types.h"
+#include "projectconfig.h"
+
+// RSSI (3dB steps above the sensitivity) that counts as activity
+#define CHB_LPL_RSSI_THRES      3
+
+typedef struct
+{
+    U32 samples;        // times the channel was sampled
+    U32 wakeups;        // samples that found the channel busy
+    U32 idle_wakeups;   // wakeups that didn't bring in a frame for us
+    U32 frames;         // frames sent
+    U32 strobes;        // copies sent for them
+    U32 acked;          // unicast frames that got through
+    U32 latency_min;    // ms from the first copy to the ACK
+    U32 latency_max;
+    U32 latency_sum;
+    U32 awake_ms;       // radio on, not counting the samples
+    U32 sample_ms;      // radio on for the samples
+    U32 elapsed_ms;     // since the stats were reset
+} chb_lpl_stats_t;
+
+void chb_lpl_init();
+void chb_lpl_task();
+void chb_lpl_idle();
+U32 chb_lpl_now();
+void chb_lpl_set_interval(U16 ms);
+U16 chb_lpl_get_interval();
+U16 chb_lpl_set_latency(U16 ms);
+U16 chb_lpl_max_latency();
+void chb_lpl_get_stats(chb_lpl_stats_t *stats);
+U16 chb_lpl_duty_cycle();
+void chb_lpl_reset_stats();
+
+// hooks for the tx paths in chb.c
+void chb_lpl_tx_begin(U16 addr);
+bool chb_lpl_tx_again(U8 status);
+
+#endif
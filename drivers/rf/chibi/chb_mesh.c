@@ -0,0 +1,862 @@
+/**************************************************************************/
+/*! 
+    @file     chb_mesh.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Multi-hop forwarding and route discovery (see chb_mesh.h)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <string.h>
+
+#include "chb.h"
+#include "chb_drvr.h"
+#include "chb_lpl.h"
+#include "chb_mesh.h"
+
+#include "core/systick/systick.h"
+
+#if (CFG_CHIBI_MESH == 1)
+
+// positions of the header fields in the payload
+#define CHB_MESH_TYPE           1
+#define CHB_MESH_HOPS           2
+#define CHB_MESH_ORIG           3
+#define CHB_MESH_DEST           5
+
+// not a valid short address, marks unused entries
+#define CHB_MESH_NONE           0xFFFE
+
+#define CHB_MESH_TRACK_SZ       (CFG_CHIBI_TXQUEUESIZE)
+#define CHB_MESH_TRACK_MASK     (CHB_MESH_TRACK_SZ - 1)
+#define CHB_MESH_SEEN_SZ        8
+
+// a unicast data frame in the tx queue, originated or relayed here. the
+// slot is picked by the write's handle.
+typedef struct
+{
+    U8 handle;
+    bool busy;
+    bool relay;
+    U16 orig;
+    U16 dest;
+    U16 next_hop;
+    U32 rx_time;        // chb_mesh_now() when a relayed frame came in
+} chb_mesh_track_t;
+
+// outcome of a queued write, filled in from the radio interrupt processing
+typedef struct
+{
+    U8 handle;
+    U8 status;
+    U32 time;
+    volatile bool valid;
+} chb_mesh_done_t;
+
+// route requests already handled, so that each one is passed on once
+typedef struct
+{
+    U16 orig;
+    U8 id;
+} chb_mesh_seen_t;
+
+static chb_mesh_route_t routes[CHB_MESH_ROUTES];
+static chb_mesh_track_t track[CHB_MESH_TRACK_SZ];
+static chb_mesh_done_t done[CHB_MESH_TRACK_SZ];
+static chb_mesh_seen_t seen[CHB_MESH_SEEN_SZ];
+static U8 seen_next;
+static U8 relays;                   // relayed frames being tracked
+static U16 sweep_age;
+static chb_mesh_stats_t stats;
+
+// route discovery in progress and the frame waiting for it
+static U16 disc_target;
+static U8 disc_tries;
+static U32 disc_time;
+static U8 rreq_id;
+static U8 pend[CHB_MESH_MAX_PAYLOAD];
+static U8 pend_len;
+
+// a route request waiting to be passed on, or a reply waiting to go out
+static U8 held_len;
+static U16 held_addr;
+static U32 held_time;
+static U8 held_frm[CHB_MESH_HDR_SZ + 1];
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+static U16 chb_mesh_get16(U8 *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void chb_mesh_put16(U8 *p, U16 val)
+{
+    p[0] = val;
+    p[1] = val >> 8;
+}
+
+/**************************************************************************/
+/*!
+    Fill in a mesh header at the start of frm
+*/
+/**************************************************************************/
+static void chb_mesh_hdr(U8 *frm, U8 type, U16 orig, U16 dest)
+{
+    frm[0] = CHB_MESH_DISPATCH;
+    frm[CHB_MESH_TYPE] = type;
+    frm[CHB_MESH_HOPS] = 0;
+    chb_mesh_put16(&frm[CHB_MESH_ORIG], orig);
+    chb_mesh_put16(&frm[CHB_MESH_DEST], dest);
+}
+
+/**************************************************************************/
+/*!
+    Queue a frame built or relayed by the mesh. This runs in the rx path,
+    so it doesn't wait for room in the tx queue: a frame that doesn't fit
+    is dropped and counted. A dropped relay is lost (the previous hop has
+    had its ACK), a dropped route request or reply is made up for by the
+    discovery retries.
+*/
+/**************************************************************************/
+static U8 chb_mesh_queue(U16 addr, U8 *frm, U8 len, U8 *handle)
+{
+    U8 status;
+
+    status = chb_write_async(addr, frm, len, handle);
+    if (status == CHB_TX_QUEUE_FULL)
+    {
+        stats.queue_drops++;
+    }
+    return status;
+}
+
+/**************************************************************************/
+/*!
+    Time in ms for everything the mesh times: route ages, discovery
+    timeouts, the request jitter and the hop latency. The systick stops
+    while the MCU is in deep sleep, so with low power listening this is
+    chb_lpl_now(), which adds the time slept.
+*/
+/**************************************************************************/
+static U32 chb_mesh_now()
+{
+#if (CFG_CHIBI_LPL == 1)
+    return chb_lpl_now();
+#else
+    return systickGetTicks() * CFG_SYSTICK_DELAY_IN_MS;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    Route table. The ages are kept in 16 bits to keep the entries small,
+    so the task also clears out expired routes before their age wraps.
+*/
+/**************************************************************************/
+static U16 chb_mesh_age()
+{
+    return chb_mesh_now() / CHB_MESH_AGE_MS;
+}
+
+static chb_mesh_route_t *chb_mesh_find(U16 dest)
+{
+    U16 now = chb_mesh_age();
+    U8 i;
+
+    for (i=0; i<CHB_MESH_ROUTES; i++)
+    {
+        if (routes[i].dest == dest)
+        {
+            if ((U16)(now - routes[i].used) > (CHB_MESH_ROUTE_TIMEOUT / CHB_MESH_AGE_MS))
+            {
+                routes[i].dest = CHB_MESH_NONE;
+                return NULL;
+            }
+            return &routes[i];
+        }
+    }
+    return NULL;
+}
+
+/**************************************************************************/
+/*!
+    Record that dest can be reached in hops hops through next_hop. A route
+    that is already known is only replaced by one that's as short, unless
+    this is news about the one in use.
+*/
+/**************************************************************************/
+static void chb_mesh_learn(U16 dest, U16 next_hop, U8 hops)
+{
+    chb_mesh_route_t *r;
+    U8 i;
+
+    if ((dest == CHB_MESH_NONE) || (dest == 0xFFFF) || (dest == chb_get_pcb()->src_addr))
+    {
+        return;
+    }
+
+    if ((r = chb_mesh_find(dest)) != NULL)
+    {
+        if ((hops > r->hops) && (next_hop != r->next_hop))
+        {
+            return;
+        }
+    }
+    else
+    {
+        // a free entry, else the one unused for the longest
+        r = &routes[0];
+        for (i=0; i<CHB_MESH_ROUTES; i++)
+        {
+            if (routes[i].dest == CHB_MESH_NONE)
+            {
+                r = &routes[i];
+                break;
+            }
+            if ((S16)(routes[i].used - r->used) < 0)
+            {
+                r = &routes[i];
+            }
+        }
+    }
+
+    if ((r->dest != dest) || (r->next_hop != next_hop))
+    {
+        r->fails = 0;
+    }
+    r->dest = dest;
+    r->next_hop = next_hop;
+    r->hops = hops;
+    r->used = chb_mesh_age();
+}
+
+/**************************************************************************/
+/*!
+    Keep count of the frames in a row that next_hop didn't ACK. Once it
+    has missed CHB_MESH_LINK_FAILS, every route through it is forgotten
+    and true is returned. A busy channel doesn't count: the neighbour is
+    still there, it just couldn't be reached this time.
+*/
+/**************************************************************************/
+static bool chb_mesh_link(U16 next_hop, bool acked)
+{
+    bool broken = false;
+    U8 i;
+
+    for (i=0; i<CHB_MESH_ROUTES; i++)
+    {
+        if ((routes[i].dest != CHB_MESH_NONE) && (routes[i].next_hop == next_hop))
+        {
+            routes[i].fails = acked ? 0 : routes[i].fails + 1;
+            broken |= (routes[i].fails >= CHB_MESH_LINK_FAILS);
+        }
+    }
+    if (broken)
+    {
+        for (i=0; i<CHB_MESH_ROUTES; i++)
+        {
+            if (routes[i].next_hop == next_hop)
+            {
+                routes[i].dest = CHB_MESH_NONE;
+            }
+        }
+    }
+    return broken;
+}
+
+/**************************************************************************/
+/*!
+    Returns true if this route request was handled already, otherwise
+    remembers it
+*/
+/**************************************************************************/
+static bool chb_mesh_seen(U16 orig, U8 id)
+{
+    U8 i;
+
+    for (i=0; i<CHB_MESH_SEEN_SZ; i++)
+    {
+        if ((seen[i].orig == orig) && (seen[i].id == id))
+        {
+            return true;
+        }
+    }
+    seen[seen_next].orig = orig;
+    seen[seen_next].id = id;
+    seen_next = (seen_next + 1) % CHB_MESH_SEEN_SZ;
+    return false;
+}
+
+/**************************************************************************/
+/*!
+    Flood a request for a route to target
+*/
+/**************************************************************************/
+static void chb_mesh_send_rreq(U16 target)
+{
+    U8 frm[CHB_MESH_HDR_SZ + 1], handle;
+
+    chb_mesh_hdr(frm, CHB_MESH_RREQ, chb_get_pcb()->src_addr, target);
+    frm[CHB_MESH_HDR_SZ] = ++rreq_id;
+    chb_mesh_queue(0xFFFF, frm, sizeof(frm), &handle);
+    stats.rreq_sent++;
+    disc_time = chb_mesh_now();
+}
+
+/**************************************************************************/
+/*!
+    Tell orig that its frames for dest can't get through from here
+*/
+/**************************************************************************/
+static void chb_mesh_send_rerr(U16 orig, U16 dest)
+{
+    chb_mesh_route_t *r;
+    U8 frm[CHB_MESH_HDR_SZ + 2], handle;
+
+    if ((r = chb_mesh_find(orig)) == NULL)
+    {
+        return;
+    }
+    chb_mesh_hdr(frm, CHB_MESH_RERR, chb_get_pcb()->src_addr, orig);
+    chb_mesh_put16(&frm[CHB_MESH_HDR_SZ], dest);
+    chb_mesh_queue(r->next_hop, frm, sizeof(frm), &handle);
+    stats.rerr_sent++;
+}
+
+/**************************************************************************/
+/*!
+    Hold a frame back for ms before it's queued. Only one frame is held, an
+    older one goes out straight away.
+
+    With low power listening the neighbour a request came from keeps
+    repeating it for a whole wakeup interval. Anything sent to it or
+    passed on before that's over only fails CSMA, so the wait is
+    stretched by the longest strobe.
+*/
+/**************************************************************************/
+static void chb_mesh_hold(U16 addr, U8 *frm, U8 len, U32 ms)
+{
+    U8 handle;
+
+    if (held_len)
+    {
+        chb_mesh_queue(held_addr, held_frm, held_len, &handle);
+    }
+#if (CFG_CHIBI_LPL == 1)
+    if (chb_lpl_get_interval())
+    {
+        ms += chb_lpl_max_latency();
+    }
+#endif
+    memcpy(held_frm, frm, len);
+    held_len = len;
+    held_addr = addr;
+    held_time = chb_mesh_now() + ms;
+}
+
+/**************************************************************************/
+/*!
+    Keep track of a queued data frame to find out if the next hop got it
+*/
+/**************************************************************************/
+static void chb_mesh_track(U8 handle, bool relay, U16 orig, U16 dest, U16 next_hop, U32 rx_time)
+{
+    chb_mesh_track_t *t = &track[handle & CHB_MESH_TRACK_MASK];
+
+    if (t->busy && t->relay)
+    {
+        relays--;
+    }
+    t->handle = handle;
+    t->busy = true;
+    t->relay = relay;
+    t->orig = orig;
+    t->dest = dest;
+    t->next_hop = next_hop;
+    t->rx_time = rx_time;
+
+    if (relay && (++relays > stats.queue_max))
+    {
+        stats.queue_max = relays;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Go through the tracked frames that are done. A next hop that keeps
+    missing ACKs is taken out of the route table, and the originator of a
+    relayed frame is told.
+*/
+/**************************************************************************/
+static void chb_mesh_poll()
+{
+    chb_mesh_track_t *t;
+    chb_mesh_done_t *d;
+    U32 ms;
+    U8 i;
+    bool ok, broken;
+
+    for (i=0; i<CHB_MESH_TRACK_SZ; i++)
+    {
+        t = &track[i];
+        d = &done[i];
+        if (!t->busy || !d->valid || (d->handle != t->handle))
+        {
+            continue;
+        }
+        t->busy = false;
+        d->valid = false;
+        ok = (d->status == CHB_SUCCESS) || (d->status == CHB_SUCCESS_DATA_PENDING);
+        broken = false;
+        if (ok || (d->status == CHB_NO_ACK))
+        {
+            broken = chb_mesh_link(t->next_hop, ok);
+        }
+
+        if (!t->relay)
+        {
+            if (!ok)
+            {
+                stats.send_fail++;
+            }
+            continue;
+        }
+
+        relays--;
+        if (ok)
+        {
+            ms = d->time - t->rx_time;
+            if ((stats.forwarded == 0) || (ms < stats.hop_min))
+            {
+                stats.hop_min = ms;
+            }
+            if (ms > stats.hop_max)
+            {
+                stats.hop_max = ms;
+            }
+            stats.hop_sum += ms;
+            stats.forwarded++;
+        }
+        else
+        {
+            stats.fwd_fail++;
+            if (broken)
+            {
+                chb_mesh_send_rerr(t->orig, t->dest);
+            }
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Queue a data frame of ours along route r
+*/
+/**************************************************************************/
+static U8 chb_mesh_send_data(chb_mesh_route_t *r, U16 dest, U8 *data, U8 len)
+{
+    U8 frm[CHB_MAX_PAYLOAD], handle, status;
+
+    chb_mesh_hdr(frm, CHB_MESH_DATA, chb_get_pcb()->src_addr, dest);
+    memcpy(&frm[CHB_MESH_HDR_SZ], data, len);
+
+    status = chb_write_async(r->next_hop, frm, CHB_MESH_HDR_SZ + len, &handle);
+    if (status == CHB_SUCCESS)
+    {
+        r->used = chb_mesh_age();
+        stats.sent++;
+        chb_mesh_track(handle, false, 0, dest, r->next_hop, 0);
+    }
+    return status;
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_mesh_init()
+{
+    U8 i;
+
+    for (i=0; i<CHB_MESH_ROUTES; i++)
+    {
+        routes[i].dest = CHB_MESH_NONE;
+    }
+    for (i=0; i<CHB_MESH_SEEN_SZ; i++)
+    {
+        seen[i].orig = CHB_MESH_NONE;
+    }
+    memset(track, 0, sizeof(track));
+    memset(done, 0, sizeof(done));
+    seen_next = relays = 0;
+    disc_target = CHB_MESH_NONE;
+    pend_len = 0;
+    held_len = 0;
+    memset(&stats, 0, sizeof(chb_mesh_stats_t));
+}
+
+/**************************************************************************/
+/*!
+    Send len bytes (up to CHB_MESH_MAX_PAYLOAD) to addr, over as many hops
+    as it takes. The frame is queued like chb_write_async and the outcome
+    of the first hop shows in the stats.
+
+    Returns CHB_SUCCESS once the frame is queued, or CHB_TX_PENDING if the
+    route has to be found first, in which case chb_mesh_task() sends it
+    when the reply comes in. Only one frame can wait for a route at a
+    time: CHB_TX_QUEUE_FULL means try again later. Broadcasts don't go
+    through the mesh (CHB_INVALID).
+*/
+/**************************************************************************/
+U8 chb_mesh_write(U16 addr, U8 *data, U8 len)
+{
+    chb_mesh_route_t *r;
+
+    if ((addr == 0xFFFF) || (addr == CHB_MESH_NONE) || (addr == chb_get_pcb()->src_addr) ||
+        (len == 0) || (len > CHB_MESH_MAX_PAYLOAD))
+    {
+        return CHB_INVALID;
+    }
+
+    chb_mesh_poll();
+    if ((r = chb_mesh_find(addr)) != NULL)
+    {
+        return chb_mesh_send_data(r, addr, data, len);
+    }
+
+    if (pend_len)
+    {
+        return CHB_TX_QUEUE_FULL;
+    }
+    memcpy(pend, data, len);
+    pend_len = len;
+    disc_target = addr;
+    disc_tries = 0;
+    chb_mesh_send_rreq(addr);
+    return CHB_TX_PENDING;
+}
+
+/**************************************************************************/
+/*!
+    Take a mesh frame that came in out of the rx pipeline (called by
+    chb_read_frame once the frame has been checked). Data for this node
+    is handed on to the app with the mesh header stripped and the
+    originator and final destination as its addresses: the function
+    returns false. Everything else is dealt with here and true is
+    returned, so the frame is freed without the app ever seeing it.
+    Frames that aren't mesh frames are left alone (false).
+*/
+/**************************************************************************/
+bool chb_mesh_rx(chb_frame_t *frm)
+{
+    chb_mesh_route_t *r;
+    U8 *p = frm->data;
+    U8 reply[CHB_MESH_HDR_SZ], type, hops, handle;
+    U16 orig, dest, prev, me = chb_get_pcb()->src_addr;
+
+    if ((frm->len < CHB_MESH_HDR_SZ) || (p[0] != CHB_MESH_DISPATCH))
+    {
+        return false;
+    }
+    type = p[CHB_MESH_TYPE];
+    hops = p[CHB_MESH_HOPS] + 1;
+    orig = chb_mesh_get16(&p[CHB_MESH_ORIG]);
+    dest = chb_mesh_get16(&p[CHB_MESH_DEST]);
+    prev = frm->src_addr;
+
+    if (orig == me)
+    {
+        // our own route request coming back
+        return true;
+    }
+
+    // whoever sent it is a neighbour, and the way back to the originator
+    chb_mesh_learn(prev, prev, 1);
+    chb_mesh_learn(orig, prev, hops);
+
+    switch (type)
+    {
+    case CHB_MESH_DATA:
+        if (dest == me)
+        {
+            stats.delivered++;
+            frm->src_addr = orig;
+            frm->dest_addr = dest;
+            frm->offset += CHB_MESH_HDR_SZ;
+            frm->data += CHB_MESH_HDR_SZ;
+            frm->len -= CHB_MESH_HDR_SZ;
+            return false;
+        }
+        if (hops >= CHB_MESH_MAX_HOPS)
+        {
+            stats.ttl_drop++;
+            break;
+        }
+        if ((r = chb_mesh_find(dest)) == NULL)
+        {
+            stats.no_route++;
+            chb_mesh_send_rerr(orig, dest);
+            break;
+        }
+
+        // fast path: straight from the rx slot into the tx queue
+        p[CHB_MESH_HOPS] = hops;
+        r->used = chb_mesh_age();
+        if (chb_mesh_queue(r->next_hop, p, frm->len, &handle) == CHB_SUCCESS)
+        {
+            // the frame is stamped in systick ticks when it came in. how
+            // long ago that was is taken off the mesh's own clock.
+            chb_mesh_track(handle, true, orig, dest, r->next_hop, chb_mesh_now() -
+                           (systickGetTicks() - frm->timestamp) * CFG_SYSTICK_DELAY_IN_MS);
+        }
+        break;
+
+    case CHB_MESH_RREQ:
+        if ((frm->len < CHB_MESH_HDR_SZ + 1) || chb_mesh_seen(orig, p[CHB_MESH_HDR_SZ]))
+        {
+            break;
+        }
+        if (dest == me)
+        {
+            // answer along the way the request came
+            chb_mesh_hdr(reply, CHB_MESH_RREP, me, orig);
+            chb_mesh_hold(prev, reply, sizeof(reply), 0);
+            stats.rrep_sent++;
+            break;
+        }
+        if (hops < CHB_MESH_MAX_HOPS)
+        {
+            // neighbours that heard the same request would all pass it on at
+            // the same moment. hold it back a bit, by a different time on
+            // each node.
+            p[CHB_MESH_HOPS] = hops;
+            chb_mesh_hold(0xFFFF, p, CHB_MESH_HDR_SZ + 1, CFG_SYSTICK_DELAY_IN_MS +
+                          ((me * 7) + (p[CHB_MESH_HDR_SZ] * 3)) % CHB_MESH_RREQ_JITTER);
+        }
+        break;
+
+    case CHB_MESH_RREP:
+        // orig is the node that was looked for and dest the one looking. the
+        // route to orig is in the table now, the task sends the frame
+        // waiting for it.
+        if ((dest != me) && (hops < CHB_MESH_MAX_HOPS) && ((r = chb_mesh_find(dest)) != NULL))
+        {
+            p[CHB_MESH_HOPS] = hops;
+            chb_mesh_queue(r->next_hop, p, frm->len, &handle);
+        }
+        break;
+
+    case CHB_MESH_RERR:
+        if (frm->len < CHB_MESH_HDR_SZ + 2)
+        {
+            break;
+        }
+        if (((r = chb_mesh_find(chb_mesh_get16(&p[CHB_MESH_HDR_SZ]))) != NULL) && (r->next_hop == prev))
+        {
+            r->dest = CHB_MESH_NONE;
+        }
+        if ((dest != me) && (hops < CHB_MESH_MAX_HOPS) && ((r = chb_mesh_find(dest)) != NULL))
+        {
+            p[CHB_MESH_HOPS] = hops;
+            chb_mesh_queue(r->next_hop, p, frm->len, &handle);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Called by chb.c from the radio interrupt processing when a queued
+    write is done
+*/
+/**************************************************************************/
+void chb_mesh_tx_done(U8 handle, U8 status)
+{
+    chb_mesh_done_t *d = &done[handle & CHB_MESH_TRACK_MASK];
+
+    d->handle = handle;
+    d->status = status;
+    d->time = chb_mesh_now();
+    d->valid = true;
+}
+
+/**************************************************************************/
+/*!
+    Relay what came in, pass on route requests, look after the discovery
+    in progress and find out how the frames sent went. Call it from the
+    main loop.
+
+    Relaying happens as frames are taken out of the rx buffer, so this
+    calls chb_read_frame. A frame for the app is left lent out and the
+    app's next chb_read_frame returns it. The frames behind it are still
+    relayed, but their slots are only freed once the app has released
+    it, so an app that leaves its frames unread fills up the rx pool.
+*/
+/**************************************************************************/
+void chb_mesh_task()
+{
+    chb_mesh_route_t *r;
+    U32 now, timeout;
+    U8 handle, i;
+
+    chb_read_frame();
+    chb_mesh_poll();
+    now = chb_mesh_now();
+
+    if (chb_mesh_age() != sweep_age)
+    {
+        sweep_age = chb_mesh_age();
+        for (i=0; i<CHB_MESH_ROUTES; i++)
+        {
+            if (routes[i].dest != CHB_MESH_NONE)
+            {
+                chb_mesh_find(routes[i].dest);
+            }
+        }
+    }
+
+    if (held_len && ((S32)(now - held_time) >= 0))
+    {
+        chb_mesh_queue(held_addr, held_frm, held_len, &handle);
+        held_len = 0;
+    }
+
+    if (pend_len == 0)
+    {
+        return;
+    }
+
+    if ((r = chb_mesh_find(disc_target)) != NULL)
+    {
+        if (chb_mesh_send_data(r, disc_target, pend, pend_len) != CHB_TX_QUEUE_FULL)
+        {
+            stats.disc_ok++;
+            pend_len = 0;
+        }
+        return;
+    }
+
+    // every hop the request and the reply take can cost a whole wake
+    // interval when the radios are duty cycled
+    timeout = CHB_MESH_RREQ_TIMEOUT;
+#if (CFG_CHIBI_LPL == 1)
+    timeout += 2 * CHB_MESH_MAX_HOPS * chb_lpl_max_latency();
+#endif
+    if ((now - disc_time) >= timeout)
+    {
+        if (disc_tries < CHB_MESH_RREQ_RETRIES)
+        {
+            disc_tries++;
+            chb_mesh_send_rreq(disc_target);
+        }
+        else
+        {
+            stats.disc_fail++;
+            pend_len = 0;
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Next hop towards addr, or 0xFFFE if there's no route to it
+*/
+/**************************************************************************/
+U16 chb_mesh_next_hop(U16 addr)
+{
+    chb_mesh_route_t *r = chb_mesh_find(addr);
+
+    return r ? r->next_hop : CHB_MESH_NONE;
+}
+
+/**************************************************************************/
+/*!
+    Copy entry i of the route table (0..CHB_MESH_ROUTES-1). Returns false if
+    it's unused.
+*/
+/**************************************************************************/
+bool chb_mesh_get_route(U8 i, chb_mesh_route_t *route)
+{
+    if ((i >= CHB_MESH_ROUTES) || (routes[i].dest == CHB_MESH_NONE) ||
+        (chb_mesh_find(routes[i].dest) == NULL))
+    {
+        return false;
+    }
+    memcpy(route, &routes[i], sizeof(chb_mesh_route_t));
+    return true;
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_mesh_clear_routes()
+{
+    U8 i;
+
+    for (i=0; i<CHB_MESH_ROUTES; i++)
+    {
+        routes[i].dest = CHB_MESH_NONE;
+    }
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_mesh_get_stats(chb_mesh_stats_t *s)
+{
+    memcpy(s, &stats, sizeof(chb_mesh_stats_t));
+    s->queue_now = relays;
+}
+
+/**************************************************************************/
+/*!
+
+*/
+/**************************************************************************/
+void chb_mesh_reset_stats()
+{
+    memset(&stats, 0, sizeof(chb_mesh_stats_t));
+}
+
+#endif
@@ -0,0 +1,142 @@
+/**************************************************************************/
+/*! 
+    @file     chb_mesh.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Multi-hop forwarding for Chibi, with on demand route
+              discovery and a small next-hop route table.
+
+    A mesh frame is an ordinary Chibi frame whose payload starts with a
+    mesh header: the originator and final destination, and the number
+    of hops so far.  Each node keeps the next hop for up to
+    CFG_CHIBI_MESH_ROUTES destinations.  Routes are learned from the
+    frames that go through (the way back to the originator) and found on
+    demand: the first chb_mesh_write to an unknown node floods a route
+    request, the destination answers along the reverse path, and the
+    frame goes out once the reply is in.
+
+    Relaying is done in chb_read_frame, as part of taking frames out of
+    the rx buffer: a data frame for another node is sent on to the next
+    hop straight from its rx slot, and route control frames are handled
+    there too, so neither reaches the app.  chb_mesh_task() keeps this
+    going when the app doesn't read, and looks after route discovery and
+    broken links.  A relay whose next hop misses CHB_MESH_LINK_FAILS
+    ACKs in a row drops the routes through it and reports back to the
+    originator with a route error, so the next write finds a new route.
+
+    Relaying doesn't stop at a frame for the app: chb_read_frame checks
+    the frames behind the one lent out and relays them, but the rx pool
+    frees slots in order, so theirs are only given back once the app
+    releases its frame.  An app that holds on to a frame for long, or
+    doesn't read at all, fills the pool and the radio drops what comes
+    in after that.  Relays don't wait for room in the tx queue either
+    (this happens in the rx path): when it's full the frame is dropped
+    and counted in queue_drops.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef CHB_MESH_H
+#define CHB_MESH_H
+
+#include "types.h"
+#include "chb.h"
+#include "projectconfig.h"
+
+// first payload byte of every mesh frame. frames sent with chb_write must
+// not start with this value when the mesh is in use.
+#define CHB_MESH_DISPATCH       0xC6
+
+#define CHB_MESH_HDR_SZ         7    // dispatch + type + hops + originator + destination
+#define CHB_MESH_MAX_PAYLOAD    (CHB_MAX_PAYLOAD - CHB_MESH_HDR_SZ)
+#define CHB_MESH_MAX_HOPS       8    // frames are dropped after this many hops
+
+#define CHB_MESH_ROUTES         (CFG_CHIBI_MESH_ROUTES)
+#define CHB_MESH_ROUTE_TIMEOUT  60000   // ms a route is kept without being used
+#define CHB_MESH_AGE_MS         250     // resolution of the route ages
+#define CHB_MESH_RREQ_TIMEOUT   250     // ms to wait for a route reply
+#define CHB_MESH_RREQ_RETRIES   2       // route requests sent again before giving up
+#define CHB_MESH_LINK_FAILS     2       // missed ACKs in a row before a link counts as broken
+#define CHB_MESH_RREQ_JITTER    8       // ms, spreads out the rebroadcasts of a request
+
+// mesh frame types
+enum
+{
+    CHB_MESH_DATA = 0,
+    CHB_MESH_RREQ,          // route request (flooded)
+    CHB_MESH_RREP,          // route reply (back along the reverse path)
+    CHB_MESH_RERR           // route error (back to the originator)
+};
+
+typedef struct
+{
+    U16 dest;
+    U16 next_hop;
+    U8 hops;
+    U8 fails;           // frames in a row the next hop didn't ACK
+    U16 used;           // when the route was last used, in CHB_MESH_AGE_MS units
+} chb_mesh_route_t;
+
+typedef struct
+{
+    U32 sent;           // data frames this node originated
+    U32 send_fail;      // of those, not ACKed by the first hop
+    U32 delivered;      // data frames for this node
+    U32 forwarded;      // relayed and ACKed by the next hop
+    U32 fwd_fail;       // relayed but not ACKed by the next hop
+    U32 no_route;       // dropped for lack of a route
+    U32 ttl_drop;       // dropped after CHB_MESH_MAX_HOPS hops
+    U32 queue_drops;    // relayed or route frames dropped, tx queue full
+    U8 queue_now;       // relayed frames in the tx queue right now
+    U8 queue_max;       // and the most there were at once
+    U32 hop_min;        // ms from receiving a relayed frame to the next
+    U32 hop_max;        // hop's ACK
+    U32 hop_sum;
+    U16 rreq_sent;
+    U16 rrep_sent;
+    U16 rerr_sent;
+    U16 disc_ok;        // route discoveries that got a reply
+    U16 disc_fail;      // and that gave up (the frame waiting is dropped)
+} chb_mesh_stats_t;
+
+void chb_mesh_init();
+void chb_mesh_task();
+U8 chb_mesh_write(U16 addr, U8 *data, U8 len);
+U16 chb_mesh_next_hop(U16 addr);
+bool chb_mesh_get_route(U8 i, chb_mesh_route_t *route);
+void chb_mesh_clear_routes();
+void chb_mesh_get_stats(chb_mesh_stats_t *stats);
+void chb_mesh_reset_stats();
+
+// hooks for chb.c
+bool chb_mesh_rx(chb_frame_t *frame);
+void chb_mesh_tx_done(U8 handle, U8 status);
+
+#endif
@@ -0,0 +1,185 @@
+/**************************************************************************/
+/*! 
+    @file     chb_sniff.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Sniffer records and channel hopping for promiscuous mode.
+              See chb_sniff.h for the record format.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include "chb.h"
+#include "chb_drvr.h"
+#include "chb_sniff.h"
+
+#include "core/systick/systick.h"
+
+// air time of one byte and the received power for an ED level of 0 at the
+// configured data rate (see the RSSI section of the at86rf212 datasheet).
+// the modes are an enum, so they're compared by value here
+#if (CFG_CHIBI_MODE == 0)                   // OQPSK_868MHZ
+    #define CHB_SNIFF_US_PER_BYTE   80      // 100 kbps
+    #define CHB_SNIFF_RSSI_BASE     (-98)
+#elif (CFG_CHIBI_MODE == 3)                 // BPSK40_915MHZ
+    #define CHB_SNIFF_US_PER_BYTE   200     // 40 kbps
+    #define CHB_SNIFF_RSSI_BASE     (-99)
+#elif (CFG_CHIBI_MODE == 4)                 // BPSK20_868MHZ
+    #define CHB_SNIFF_US_PER_BYTE   400     // 20 kbps
+    #define CHB_SNIFF_RSSI_BASE     (-100)
+#else                                       // OQPSK_915MHZ, OQPSK_780MHZ
+    #define CHB_SNIFF_US_PER_BYTE   32      // 250 kbps
+    #define CHB_SNIFF_RSSI_BASE     (-97)
+#endif
+
+// preamble, SFD and PHR that go on the air before the frame itself
+#define CHB_SNIFF_SHR_PHR_SZ    6
+
+#define CHB_SNIFF_TICKS(ms)     (((ms) + CFG_SYSTICK_DELAY_IN_MS - 1) / CFG_SYSTICK_DELAY_IN_MS)
+
+static U8 first_chan, last_chan;
+static U16 dwell_ticks;
+static U32 hop_time;
+static U16 last_overflow;
+
+/**************************************************************************/
+/*!
+    Set up the channels to capture on. The sniffer stays dwell ms on each
+    channel from first_channel to last_channel and then starts over. With
+    first_channel == last_channel or dwell == 0 it stays on first_channel.
+*/
+/**************************************************************************/
+void chb_sniff_init(U8 first_channel, U8 last_channel, U16 dwell)
+{
+    first_chan = first_channel;
+    last_chan = (last_channel < first_channel) ? first_channel : last_channel;
+    dwell_ticks = CHB_SNIFF_TICKS(dwell);
+    last_overflow = chb_get_pcb()->overflow;
+
+    chb_set_channel(first_chan);
+    hop_time = systickGetTicks();
+}
+
+/**************************************************************************/
+/*!
+    Move to the next channel once the dwell time is up. Call it from the
+    main loop after the received frames have been handled, so that frames
+    are stamped with the channel they were received on.
+*/
+/**************************************************************************/
+void chb_sniff_task()
+{
+    U8 chan;
+
+    if ((dwell_ticks == 0) || (first_chan == last_chan))
+    {
+        return;
+    }
+
+    if ((U32)(systickGetTicks() - hop_time) >= dwell_ticks)
+    {
+        chan = chb_get_channel();
+        chan = ((chan >= last_chan) || (chan < first_chan)) ? first_chan : chan + 1;
+        chb_set_channel(chan);
+        hop_time = systickGetTicks();
+    }
+}
+
+/**************************************************************************/
+/*!
+    Append one byte to a SLIP encoded record
+*/
+/**************************************************************************/
+static U8 *chb_sniff_put(U8 *out, U8 byte)
+{
+    if (byte == CHB_SNIFF_END)
+    {
+        *out++ = CHB_SNIFF_ESC;
+        *out++ = CHB_SNIFF_ESC_END;
+    }
+    else if (byte == CHB_SNIFF_ESC)
+    {
+        *out++ = CHB_SNIFF_ESC;
+        *out++ = CHB_SNIFF_ESC_ESC;
+    }
+    else
+    {
+        *out++ = byte;
+    }
+    return out;
+}
+
+/**************************************************************************/
+/*!
+    Build the SLIP encoded record for a frame returned by chb_read_frame.
+    out must hold CHB_SNIFF_REC_MAX bytes. Returns the number of bytes to
+    send.
+*/
+/**************************************************************************/
+U16 chb_sniff_record(chb_frame_t *frm, U8 *out)
+{
+    U8 *p = out;
+    U8 i;
+    U16 dropped;
+    S16 rssi;
+    U32 ts;
+
+    // move the timestamp from the end of the frame to its first bit
+    ts = frm->timestamp - ((U32)(CHB_SNIFF_SHR_PHR_SZ + frm->len) * CHB_SNIFF_US_PER_BYTE);
+
+    // P = RSSI_BASE_VAL + 1.03 * ED
+    rssi = CHB_SNIFF_RSSI_BASE + frm->ed + ((frm->ed * 3) / 100);
+
+    // frames the rx pool had no room for since the last record
+    dropped = chb_get_pcb()->overflow - last_overflow;
+    last_overflow += dropped;
+
+    *p++ = CHB_SNIFF_END;
+    p = chb_sniff_put(p, CHB_SNIFF_REC_FRAME);
+    p = chb_sniff_put(p, CHB_SNIFF_HDR_SZ);
+    p = chb_sniff_put(p, ts & 0xff);
+    p = chb_sniff_put(p, (ts >> 8) & 0xff);
+    p = chb_sniff_put(p, (ts >> 16) & 0xff);
+    p = chb_sniff_put(p, (ts >> 24) & 0xff);
+    p = chb_sniff_put(p, frm->channel);
+    p = chb_sniff_put(p, frm->ed);
+    p = chb_sniff_put(p, (U8)rssi);
+    p = chb_sniff_put(p, frm->lqi);
+    p = chb_sniff_put(p, frm->crc ? CHB_SNIFF_FLAG_CRC_OK : 0);
+    p = chb_sniff_put(p, (dropped > 255) ? 255 : dropped);
+    p = chb_sniff_put(p, frm->len);
+    for (i=0; i<frm->len; i++)
+    {
+        p = chb_sniff_put(p, frm->data[i]);
+    }
+    *p++ = CHB_SNIFF_END;
+
+    return p - out;
+}
@@ -0,0 +1,93 @@
+/**************************************************************************/
+/*! 
+    @file     chb_sniff.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Sniffer records for frames captured in promiscuous mode.
+
+    Each captured frame is sent to the host as one record: a fixed header
+    with the capture metadata followed by the raw frame (incl. the FCS).
+    Records are SLIP framed (RFC 1055) so the host can find the start of
+    the next record after lost or corrupted bytes.
+
+    Record layout (before SLIP encoding, multi-byte fields little endian):
+
+        0   type        CHB_SNIFF_REC_FRAME
+        1   hdr len     offset of the frame (CHB_SNIFF_HDR_SZ).  Fields
+                        added later go before the frame, so the host must
+                        use this rather than a fixed offset
+        2   timestamp   U32, microseconds, start of the frame (first bit
+                        of the preamble).  Wraps around every ~71 minutes
+        6   channel
+        7   ed          raw energy detect level (0..84, ~1 dB steps)
+        8   rssi        S8, received power in dBm derived from ed
+        9   lqi         link quality indicator
+        10  flags       CHB_SNIFF_FLAG_xxx
+        11  dropped     frames lost on the device since the last record
+                        (saturates at 255)
+        12  len         frame length incl. FCS
+        13  frame
+
+    The timestamp is taken in the radio interrupt at the end of the frame
+    and moved back by the air time of the frame at the configured data
+    rate.  Interrupt latency is a few microseconds and constant, so time
+    differences between frames are accurate to well below one symbol.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef CHB_SNIFF_H
+#define CHB_SNIFF_H
+
+#include "types.h"
+#include "chb.h"
+#include "chb_drvr.h"
+
+// SLIP framing
+#define CHB_SNIFF_END           0xC0
+#define CHB_SNIFF_ESC           0xDB
+#define CHB_SNIFF_ESC_END       0xDC
+#define CHB_SNIFF_ESC_ESC       0xDD
+
+#define CHB_SNIFF_REC_FRAME     0x01
+#define CHB_SNIFF_HDR_SZ        13
+
+// record flags
+#define CHB_SNIFF_FLAG_CRC_OK   (1<<0)
+
+// worst case size of an encoded record: every byte escaped plus an END at
+// each side
+#define CHB_SNIFF_REC_MAX       (2 * (CHB_SNIFF_HDR_SZ + CHB_MAX_FRAME_LENGTH) + 2)
+
+void chb_sniff_init(U8 first_channel, U8 last_channel, U16 dwell);
+void chb_sniff_task();
+U16 chb_sniff_record(chb_frame_t *frm, U8 *out);
+
+#endif
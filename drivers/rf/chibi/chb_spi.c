@@ -52,6 +52,10 @@ void chb_spi_init()
     // initialise spi, high between frames and transition on trailing edge
     sspInit(0, sspClockPolarity_High, sspClockPhase_FallingEdge);
 
+    // sspInit runs at 4.0 MHz. the radio accepts up to 8 MHz so speed it up to
+    // (72,000,000 / (2 x [4 + 1])) = 7.2 MHz
+    SSP_SSP0CR0 = (SSP_SSP0CR0 & ~SSP_SSP0CR0_SCR_MASK) | SSP_SSP0CR0_SCR_4;
+
     // set the slave select to idle
     CHB_SPI_DISABLE();
 }
@@ -65,13 +69,38 @@ void chb_spi_init()
 /**************************************************************************/
 U8 chb_xfer_byte(U8 data)
 {
-    /* Move on only if NOT busy and TX FIFO not full */
-    while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_MASK | SSP_SSP0SR_BSY_MASK)) != SSP_SSP0SR_TNF_NOTFULL);
-    SSP_SSP0DR = data;
-  
-    /* Wait until the busy bit is cleared and receive buffer is not empty */
-    while ((SSP_SSP0SR & (SSP_SSP0SR_BSY_MASK | SSP_SSP0SR_RNE_MASK)) != SSP_SSP0SR_RNE_NOTEMPTY);
+    sspTransfer(0, &data, &data, 1);
+    return data;
+}
 
-    // Read the queue
-    return SSP_SSP0DR;
+/**************************************************************************/
+/*!
+    Transfer a block of bytes in both directions, keeping the SSP FIFO full
+    rather than waiting for each byte to complete. A register access is a
+    command and a value, so it goes out as one two byte block.
+*/
+/**************************************************************************/
+void chb_xfer_block(U8 *out, U8 *in, U8 len)
+{
+    sspTransfer(0, out, in, len);
+}
+
+/**************************************************************************/
+/*!
+    Write a block of data, discarding whatever comes back on MISO
+*/
+/**************************************************************************/
+void chb_write_block(U8 *data, U8 len)
+{
+    sspTransfer(0, data, NULL, len);
+}
+
+/**************************************************************************/
+/*!
+    Read a block of data, clocking out dummy bytes
+*/
+/**************************************************************************/
+void chb_read_block(U8 *data, U8 len)
+{
+    sspDrain(0, data, len, 0);
 }
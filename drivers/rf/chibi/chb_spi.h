@@ -58,5 +58,8 @@
 
 void chb_spi_init();
 U8 chb_xfer_byte(U8 data);
+void chb_xfer_block(U8 *out, U8 *in, U8 len);
+void chb_write_block(U8 *data, U8 len);
+void chb_read_block(U8 *data, U8 len);
 
 #endif
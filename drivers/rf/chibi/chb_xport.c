@@ -0,0 +1,610 @@
+/**************************************************************************/
+/*! 
+    @file     chb_xport.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Fragmenting transport with a sliding window and selective
+              ACK on top of the Chibi MAC.  See chb_xport.h.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <string.h>
+
+#include "chb.h"
+#include "chb_xport.h"
+#include "core/systick/systick.h"
+
+#if (CFG_CHIBI_XPORT == 1)
+
+// frame types (second byte of the transport header)
+#define CHB_XPORT_DATA          0x00
+#define CHB_XPORT_ACK           0x01
+#define CHB_XPORT_ACK_REQ       0x80    // flag: receiver should answer with an ACK
+#define CHB_XPORT_TYPE_MASK     0x7F
+
+#define CHB_XPORT_ACK_SZ        5       // dispatch + type + msg id + cum frag + sack
+
+// ask for an ACK once the window is full. asking halfway through keeps
+// the window sliding in theory, but on a half duplex radio the ACK then
+// has to fight the rest of the window for the channel and both sides
+// lose frames to it (see the transport scenarios in tools/chibisim)
+#define CHB_XPORT_ACK_EVERY     (CHB_XPORT_WINDOW)
+
+#define CHB_XPORT_TIMEOUT_TICKS ((CHB_XPORT_TIMEOUT + CFG_SYSTICK_DELAY_IN_MS - 1) / CFG_SYSTICK_DELAY_IN_MS)
+#define CHB_XPORT_NONE          0xFF
+
+// Sender state. Fragments are numbered from 0; base is the first one that
+// hasn't been acknowledged and next is the first one that was never sent.
+// The bitmaps are relative to base (bit i = fragment base + i).
+typedef struct
+{
+    U16 addr;
+    U8 *data;           // the app's buffer, which must stay valid until the end
+    U16 len;
+    U8 msg_id;
+    U8 frag_cnt;
+    U8 base;
+    U8 next;
+    U8 sacked;          // held by the receiver past a gap
+    U8 resend;          // waiting to be sent again
+    U8 rexmit;          // resent since the last timeout
+    U8 fast;            // of resend, the ones a SACK showed were lost
+    U8 retries;
+    U8 state;
+    U32 timer;          // systick count at the last sign of life
+} chb_xport_tx_t;
+
+// Reassembly state for one source. Fragment next is the first one that
+// hasn't been handed to the app. Fragments that arrive early are kept in
+// slot[frag % CHB_XPORT_WINDOW] and flagged in have (bit i = fragment
+// next + i).
+typedef struct
+{
+    U16 src_addr;
+    U8 msg_id;
+    U16 total;
+    U8 frag_cnt;
+    U8 next;
+    U8 have;
+    U32 last_used;
+    U8 slot[CHB_XPORT_WINDOW][CHB_XPORT_FRAG_SZ];
+} chb_xport_rx_t;
+
+static chb_xport_tx_t tx;
+static chb_xport_rx_t rx[CHB_XPORT_SOURCES];
+static chb_xport_rx_cb_t rx_cb;
+static U8 tx_msg_id;
+static chb_xport_stats_t stats;
+
+/**************************************************************************/
+/*!
+    Number of fragments needed for a message of len bytes
+*/
+/**************************************************************************/
+static U8 chb_xport_frag_cnt(U16 len)
+{
+    return (len + CHB_XPORT_FRAG_SZ - 1) / CHB_XPORT_FRAG_SZ;
+}
+
+/**************************************************************************/
+/*!
+    Length of fragment frag of a message of total bytes
+*/
+/**************************************************************************/
+static U8 chb_xport_frag_len(U16 total, U8 frag)
+{
+    U16 left = total - (frag * CHB_XPORT_FRAG_SZ);
+
+    return (left > CHB_XPORT_FRAG_SZ) ? CHB_XPORT_FRAG_SZ : left;
+}
+
+/**************************************************************************/
+/*!
+    Reset the transport. Any transfer in progress is dropped.
+*/
+/**************************************************************************/
+void chb_xport_init()
+{
+    U8 i;
+
+    memset(&tx, 0, sizeof(chb_xport_tx_t));
+    tx.state = CHB_XPORT_IDLE;
+
+    // 0xFFFE isn't a valid short source address, so these are unused
+    for (i=0; i<CHB_XPORT_SOURCES; i++)
+    {
+        rx[i].src_addr = 0xFFFE;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Set the function that receives incoming messages, or NULL for none
+*/
+/**************************************************************************/
+void chb_xport_set_rx_cb(chb_xport_rx_cb_t cb)
+{
+    rx_cb = cb;
+}
+
+/**************************************************************************/
+/*!
+    Start sending len bytes to addr. Only one message can be in flight at
+    a time, and data is sent straight out of the caller's buffer so it must
+    not change until chb_xport_tx_status() returns CHB_XPORT_DONE or
+    CHB_XPORT_FAILED. chb_xport_task() does the actual sending.
+
+    Returns CHB_SUCCESS, or CHB_INVALID if a transfer is already in progress,
+    addr is the broadcast address or len is 0 or over CHB_XPORT_MAX_MSG.
+*/
+/**************************************************************************/
+U8 chb_xport_send(U16 addr, U8 *data, U16 len)
+{
+    if ((tx.state == CHB_XPORT_BUSY) || (addr == 0xFFFF) ||
+        (len == 0) || (len > CHB_XPORT_MAX_MSG))
+    {
+        return CHB_INVALID;
+    }
+
+    tx.addr = addr;
+    tx.data = data;
+    tx.len = len;
+    tx.msg_id = tx_msg_id++;
+    tx.frag_cnt = chb_xport_frag_cnt(len);
+    tx.base = tx.next = 0;
+    tx.sacked = tx.resend = tx.rexmit = tx.fast = 0;
+    tx.retries = 0;
+    tx.timer = systickGetTicks();
+    tx.state = CHB_XPORT_BUSY;
+    return CHB_SUCCESS;
+}
+
+/**************************************************************************/
+/*!
+    Status of the last message passed to chb_xport_send
+*/
+/**************************************************************************/
+U8 chb_xport_tx_status()
+{
+    return tx.state;
+}
+
+/**************************************************************************/
+/*!
+    Pick the fragment to send next: the oldest one waiting to be resent,
+    else a new one if the window has room. Returns CHB_XPORT_NONE if there
+    is nothing to send.
+*/
+/**************************************************************************/
+static U8 chb_xport_pick()
+{
+    U8 i;
+
+    if (tx.resend)
+    {
+        for (i=0; !(tx.resend & (1 << i)); i++);
+        return tx.base + i;
+    }
+
+    if ((tx.next < tx.frag_cnt) && ((U8)(tx.next - tx.base) < CHB_XPORT_WINDOW))
+    {
+        return tx.next;
+    }
+    return CHB_XPORT_NONE;
+}
+
+/**************************************************************************/
+/*!
+    Queue one data fragment with chb_write_async
+*/
+/**************************************************************************/
+static U8 chb_xport_send_frag(U8 frag, bool ack_req)
+{
+    U8 buf[CHB_MAX_PAYLOAD], len, handle;
+    U16 offset = frag * CHB_XPORT_FRAG_SZ;
+
+    len = chb_xport_frag_len(tx.len, frag);
+
+    buf[0] = CHB_XPORT_DISPATCH;
+    buf[1] = CHB_XPORT_DATA | (ack_req ? CHB_XPORT_ACK_REQ : 0);
+    buf[2] = tx.msg_id;
+    buf[3] = offset & 0xff;
+    buf[4] = offset >> 8;
+    buf[5] = tx.len & 0xff;
+    buf[6] = tx.len >> 8;
+    memcpy(&buf[CHB_XPORT_HDR_SZ], tx.data + offset, len);
+
+    return chb_write_async(tx.addr, buf, CHB_XPORT_HDR_SZ + len, &handle);
+}
+
+/**************************************************************************/
+/*!
+    Handle an ACK for the message being sent. cum is the first fragment the
+    receiver is still missing and bit i of sack is set if it already holds
+    fragment cum + 1 + i.
+*/
+/**************************************************************************/
+static void chb_xport_tx_ack(U8 cum, U8 sack)
+{
+    U8 shift, top, lost;
+
+    // stale or bogus
+    if ((cum < tx.base) || (cum > tx.next))
+    {
+        return;
+    }
+
+    tx.timer = systickGetTicks();
+    stats.acks_rcvd++;
+
+    shift = cum - tx.base;
+    if (shift)
+    {
+        tx.base = cum;
+        tx.resend = (shift < 8) ? (tx.resend >> shift) : 0;
+        tx.rexmit = (shift < 8) ? (tx.rexmit >> shift) : 0;
+        tx.fast = (shift < 8) ? (tx.fast >> shift) : 0;
+        tx.retries = 0;
+    }
+
+    if (tx.base == tx.frag_cnt)
+    {
+        tx.state = CHB_XPORT_DONE;
+        stats.msgs_sent++;
+        return;
+    }
+
+    tx.sacked = sack << 1;
+    tx.resend &= ~tx.sacked;
+    tx.fast &= ~tx.sacked;
+
+    // anything below the highest fragment the receiver holds that it's still
+    // missing was lost, so resend it now rather than waiting for the timeout.
+    // don't do it twice for the same fragment though, its retry might still
+    // be on the way.
+    if (tx.sacked)
+    {
+        for (top=7; !(tx.sacked & (1 << top)); top--);
+        lost = ((1 << top) - 1) & ~tx.sacked & ~tx.rexmit;
+        tx.resend |= lost;
+        tx.fast |= lost;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Send what the window allows and deal with timeouts
+*/
+/**************************************************************************/
+static void chb_xport_tx_task()
+{
+    U8 frag, bit;
+    bool ack_req;
+    U32 now = systickGetTicks();
+
+    if (tx.state != CHB_XPORT_BUSY)
+    {
+        return;
+    }
+
+    // the timeout only starts once the radio is done with the queue, as
+    // there's no telling how long the frames ahead of ours take
+    if (chb_txq_active())
+    {
+        tx.timer = now;
+    }
+    else if ((U32)(now - tx.timer) >= CHB_XPORT_TIMEOUT_TICKS)
+    {
+        stats.timeouts++;
+        if (++tx.retries > CHB_XPORT_MAX_RETRIES)
+        {
+            tx.state = CHB_XPORT_FAILED;
+            stats.msgs_failed++;
+            return;
+        }
+
+        // resend everything in the window the receiver hasn't reported
+        tx.resend = ((1 << (tx.next - tx.base)) - 1) & ~tx.sacked;
+        tx.rexmit = 0;
+        tx.fast = 0;
+        tx.timer = now;
+    }
+
+    while ((chb_tx_queue_free() > 0) && ((frag = chb_xport_pick()) != CHB_XPORT_NONE))
+    {
+        if (frag == tx.next)
+        {
+            tx.next++;
+        }
+        else
+        {
+            bit = 1 << (frag - tx.base);
+            if (tx.fast & bit)
+            {
+                stats.fast_resent++;
+            }
+            else
+            {
+                stats.timeout_resent++;
+            }
+            tx.resend &= ~bit;
+            tx.rexmit |= bit;
+            tx.fast &= ~bit;
+        }
+
+        // ask for an ACK at the end of the window and whenever we have to stop
+        ack_req = (chb_xport_pick() == CHB_XPORT_NONE) || (((frag + 1) % CHB_XPORT_ACK_EVERY) == 0);
+        chb_xport_send_frag(frag, ack_req);
+        stats.frags_sent++;
+        tx.timer = now;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Tell src_addr where we are with its message
+*/
+/**************************************************************************/
+static void chb_xport_send_ack(chb_xport_rx_t *ctx)
+{
+    U8 buf[CHB_XPORT_ACK_SZ], handle;
+
+    buf[0] = CHB_XPORT_DISPATCH;
+    buf[1] = CHB_XPORT_ACK;
+    buf[2] = ctx->msg_id;
+    buf[3] = ctx->next;
+    buf[4] = ctx->have >> 1;
+
+    // if the queue is full the sender will time out and ask again
+    if (chb_write_async(ctx->src_addr, buf, CHB_XPORT_ACK_SZ, &handle) == CHB_SUCCESS)
+    {
+        stats.acks_sent++;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Find the reassembly state for src_addr. A new source takes over an
+    unused entry or else the one that has been quiet the longest.
+*/
+/**************************************************************************/
+static chb_xport_rx_t *chb_xport_rx_ctx(U16 src_addr, U8 msg_id, U16 total)
+{
+    chb_xport_rx_t *ctx = &rx[0];
+    U8 i;
+
+    for (i=0; i<CHB_XPORT_SOURCES; i++)
+    {
+        if (rx[i].src_addr == src_addr)
+        {
+            ctx = &rx[i];
+            break;
+        }
+        if ((rx[i].src_addr == 0xFFFE) ||
+            ((ctx->src_addr != 0xFFFE) && ((S32)(rx[i].last_used - ctx->last_used) < 0)))
+        {
+            ctx = &rx[i];
+        }
+    }
+
+    // start over for a new message. the total len is checked as well so
+    // that a sender that restarted and reused a msg id isn't ignored.
+    if ((ctx->src_addr != src_addr) || (ctx->msg_id != msg_id) || (ctx->total != total))
+    {
+        ctx->src_addr = src_addr;
+        ctx->msg_id = msg_id;
+        ctx->total = total;
+        ctx->frag_cnt = chb_xport_frag_cnt(total);
+        ctx->next = 0;
+        ctx->have = 0;
+    }
+    ctx->last_used = systickGetTicks();
+    return ctx;
+}
+
+/**************************************************************************/
+/*!
+    Handle a data fragment. It's passed to the app if it's the next one in
+    order (followed by any stored ones it unblocks), kept if it's further
+    ahead within the window, and dropped otherwise.
+*/
+/**************************************************************************/
+static void chb_xport_rx_data(U16 src_addr, U8 *buf, U8 len)
+{
+    chb_xport_rx_t *ctx;
+    U8 frag, idx, frag_len, msg_id;
+    U16 offset, total;
+    bool ack, gap;
+
+    ack = (buf[1] & CHB_XPORT_ACK_REQ) != 0;
+    msg_id = buf[2];
+    offset = buf[3] | (buf[4] << 8);
+    total = buf[5] | (buf[6] << 8);
+    len -= CHB_XPORT_HDR_SZ;
+    buf += CHB_XPORT_HDR_SZ;
+
+    if ((total == 0) || (total > CHB_XPORT_MAX_MSG) || (offset >= total) ||
+        ((offset % CHB_XPORT_FRAG_SZ) != 0))
+    {
+        return;
+    }
+    frag = offset / CHB_XPORT_FRAG_SZ;
+    if (len != chb_xport_frag_len(total, frag))
+    {
+        return;
+    }
+
+    ctx = chb_xport_rx_ctx(src_addr, msg_id, total);
+    stats.frags_rcvd++;
+    gap = (ctx->have != 0);
+    idx = frag - ctx->next;
+
+    if ((frag < ctx->next) ||
+        ((idx < CHB_XPORT_WINDOW) && (ctx->have & (1 << idx))))
+    {
+        // we have this one already so our ACK must have been lost
+        stats.frags_dup++;
+        ack = true;
+    }
+    else if (idx >= CHB_XPORT_WINDOW)
+    {
+        // the sender never goes past the window, so something is off. just
+        // tell it where we are.
+        stats.frags_outside++;
+        ack = true;
+    }
+    else if (idx == 0)
+    {
+        if (rx_cb)
+        {
+            rx_cb(src_addr, ctx->msg_id, offset, total, buf, len);
+        }
+        stats.bytes_rcvd += len;
+        ctx->next++;
+        ctx->have >>= 1;
+
+        // hand over the fragments this one was holding up
+        while (ctx->have & 1)
+        {
+            offset = ctx->next * CHB_XPORT_FRAG_SZ;
+            frag_len = chb_xport_frag_len(total, ctx->next);
+            if (rx_cb)
+            {
+                rx_cb(src_addr, ctx->msg_id, offset, total, ctx->slot[ctx->next % CHB_XPORT_WINDOW], frag_len);
+            }
+            stats.bytes_rcvd += frag_len;
+            ctx->next++;
+            ctx->have >>= 1;
+        }
+
+        if (ctx->next == ctx->frag_cnt)
+        {
+            stats.msgs_rcvd++;
+            ack = true;
+        }
+    }
+    else
+    {
+        memcpy(ctx->slot[frag % CHB_XPORT_WINDOW], buf, len);
+        ctx->have |= 1 << idx;
+        stats.frags_held++;
+
+        // first sign of a lost fragment. report it straight away so that
+        // the sender can fill the gap without waiting for a timeout.
+        if (!gap)
+        {
+            ack = true;
+        }
+    }
+
+    if (ack)
+    {
+        chb_xport_send_ack(ctx);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Process a received frame if it belongs to the transport (called by
+    chb_read_frame once the frame has been checked). Returns true if it
+    did and the frame's slot can be freed, or false if it's an ordinary
+    frame for the app.
+*/
+/**************************************************************************/
+bool chb_xport_rx(chb_frame_t *frame)
+{
+    U8 *buf = frame->data;
+
+    if ((frame->len < 2) || (buf[0] != CHB_XPORT_DISPATCH))
+    {
+        return false;
+    }
+
+    switch (buf[1] & CHB_XPORT_TYPE_MASK)
+    {
+    case CHB_XPORT_DATA:
+        if (frame->len > CHB_XPORT_HDR_SZ)
+        {
+            chb_xport_rx_data(frame->src_addr, buf, frame->len);
+        }
+        break;
+
+    case CHB_XPORT_ACK:
+        if ((frame->len >= CHB_XPORT_ACK_SZ) && (tx.state == CHB_XPORT_BUSY) &&
+            (frame->src_addr == tx.addr) && (buf[2] == tx.msg_id))
+        {
+            chb_xport_tx_ack(buf[3], buf[4]);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Run the transport. Call this regularly from the main loop while
+    transfers are going on. Transport frames are processed by
+    chb_read_frame() as they are taken out of the rx pool, also when
+    they're behind a frame for the app, so this calls it and leaves any
+    frame for the app lent out for the app's own chb_read_frame(). The
+    slots behind that frame are only freed once the app releases it.
+*/
+/**************************************************************************/
+void chb_xport_task()
+{
+    chb_read_frame();
+    chb_xport_tx_task();
+}
+
+/**************************************************************************/
+/*!
+    Copy the transport counters to s
+*/
+/**************************************************************************/
+void chb_xport_get_stats(chb_xport_stats_t *s)
+{
+    memcpy(s, &stats, sizeof(chb_xport_stats_t));
+}
+
+/**************************************************************************/
+/*!
+    Clear the transport counters
+*/
+/**************************************************************************/
+void chb_xport_reset_stats()
+{
+    memset(&stats, 0, sizeof(chb_xport_stats_t));
+}
+
+#endif
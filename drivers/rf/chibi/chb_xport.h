@@ -0,0 +1,112 @@
+/**************************************************************************/
+/*! 
+    @file     chb_xport.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Fragmentation, reassembly and windowed transfer of messages
+              that don't fit in a single Chibi frame.
+
+    A message is split into fragments of CHB_XPORT_FRAG_SZ bytes, each
+    carrying the message ID, its byte offset and the total message len.
+    Up to CFG_CHIBI_XPORT_WINDOW fragments can be unacknowledged at a
+    time.  The receiver acknowledges cumulatively (the next fragment it
+    expects) plus a selective ACK bitmap of the fragments it already holds
+    past that point, so only the missing ones are sent again.
+
+    Received fragments are handed to the app in order through the rx
+    callback as soon as the gap before them is filled, so a message can
+    be much larger than the RAM set aside for reassembly.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef CHB_XPORT_H
+#define CHB_XPORT_H
+
+#include "types.h"
+#include "chb.h"
+#include "projectconfig.h"
+
+// first payload byte of every transport frame. frames sent with chb_write
+// must not start with this value when the transport is in use.
+#define CHB_XPORT_DISPATCH      0xC5
+
+#define CHB_XPORT_HDR_SZ        7    // dispatch + type + msg id + offset + total len
+#define CHB_XPORT_FRAG_SZ       (CHB_MAX_PAYLOAD - CHB_XPORT_HDR_SZ)
+#define CHB_XPORT_MAX_MSG       (255 * CHB_XPORT_FRAG_SZ)
+
+#define CHB_XPORT_WINDOW        (CFG_CHIBI_XPORT_WINDOW)
+#define CHB_XPORT_SOURCES       (CFG_CHIBI_XPORT_SOURCES)
+#define CHB_XPORT_TIMEOUT       50   // ms without an ACK before resending
+#define CHB_XPORT_MAX_RETRIES   8    // timeouts in a row before giving up
+
+// transfer status
+enum
+{
+    CHB_XPORT_IDLE = 0,
+    CHB_XPORT_BUSY,
+    CHB_XPORT_DONE,
+    CHB_XPORT_FAILED
+};
+
+// called for each in order piece of a message. the message is complete when
+// offset + len == total.
+typedef void (*chb_xport_rx_cb_t)(U16 src_addr, U8 msg_id, U16 offset, U16 total, U8 *data, U8 len);
+
+typedef struct
+{
+    U32 msgs_sent;      // messages the receiver acknowledged in full
+    U32 msgs_failed;    // given up after CHB_XPORT_MAX_RETRIES timeouts
+    U32 frags_sent;     // data frames queued, first copies and resends
+    U32 fast_resent;    // resent because a selective ACK showed a gap
+    U32 timeout_resent; // resent after a timeout
+    U32 timeouts;
+    U32 acks_rcvd;
+    U32 acks_sent;
+    U32 msgs_rcvd;      // messages handed to the app in full
+    U32 bytes_rcvd;     // bytes handed to the app
+    U32 frags_rcvd;     // data frames received
+    U32 frags_held;     // of those, kept until the gap before them filled
+    U32 frags_dup;      // already had (our ACK was lost)
+    U32 frags_outside;  // beyond the window, dropped
+} chb_xport_stats_t;
+
+void chb_xport_init();
+U8 chb_xport_send(U16 addr, U8 *data, U16 len);
+U8 chb_xport_tx_status();
+void chb_xport_set_rx_cb(chb_xport_rx_cb_t cb);
+void chb_xport_task();
+void chb_xport_get_stats(chb_xport_stats_t *s);
+void chb_xport_reset_stats();
+
+// hook for chb.c
+bool chb_xport_rx(chb_frame_t *frame);
+
+#endif
@@ -136,9 +136,8 @@ pn532_error_t pn532_bus_SendCommand(const byte_t * pbtData, const size_t szData)
 
   // Wait for ACK
   byte_t abtRxBuf[6];
-  uart_pcb_t *uart = uartGetPCB();
   systickDelay(10);   // FIXME: How long should we wait for ACK?
-  if (uart->rxfifo.len < 6) 
+  if (uartRxBufferCount() < 6) 
   {
     // Unable to read ACK
     #ifdef PN532_DEBUGMODE
@@ -150,12 +149,7 @@ pn532_error_t pn532_bus_SendCommand(const byte_t * pbtData, const size_t szData)
 
   // Read ACK ... this will also remove it from the buffer
   const byte_t abtAck[6] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
-  abtRxBuf[0] = uartRxBufferRead();
-  abtRxBuf[1] = uartRxBufferRead();
-  abtRxBuf[2] = uartRxBufferRead();
-  abtRxBuf[3] = uartRxBufferRead();
-  abtRxBuf[4] = uartRxBufferRead();
-  abtRxBuf[5] = uartRxBufferRead();
+  uartRead(abtRxBuf, 6);
 
   // Make sure the received ACK matches the prototype
   if (0 != (memcmp (abtRxBuf, abtAck, 6))) 
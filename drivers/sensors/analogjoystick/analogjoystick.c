@@ -46,8 +46,57 @@
 #include "core/adc/adc.h"
 #include "core/gpio/gpio.h"
 
+#ifdef CFG_USBCDC_HID
+  #include "core/usbcdc/hiduser.h"
+#endif
+
 static bool _joystickInitialised = false;
 
+#ifdef CFG_USBCDC_HID
+static uint32_t _joystickLastHorizontal, _joystickLastVertical;
+static bool _joystickLastSelect;
+static bool _joystickEventSent = false;
+
+/**************************************************************************/
+/*! 
+    @brief  Sends the joystick state to the host as a HID report
+            (HID_EVENT_JOYSTICK) when the select button has changed or
+            either axis has moved by more than JOYSTICK_HID_THRESHOLD
+            since the last report, so that ADC noise doesn't fill the
+            HID queue.
+*/
+/**************************************************************************/
+static void joystickSendEvent(uint32_t horizontal, uint32_t vertical, bool select)
+{
+  uint8_t event[5];
+
+  if (_joystickEventSent &&
+      select == _joystickLastSelect &&
+      horizontal + JOYSTICK_HID_THRESHOLD >= _joystickLastHorizontal &&
+      horizontal <= _joystickLastHorizontal + JOYSTICK_HID_THRESHOLD &&
+      vertical + JOYSTICK_HID_THRESHOLD >= _joystickLastVertical &&
+      vertical <= _joystickLastVertical + JOYSTICK_HID_THRESHOLD)
+  {
+    return;
+  }
+
+  event[0] = horizontal & 0xFF;
+  event[1] = horizontal >> 8;
+  event[2] = vertical & 0xFF;
+  event[3] = vertical >> 8;
+  event[4] = select;
+
+  // Only remember the state once it is queued, so a full queue is retried
+  if (HID_QueueEvent(HID_EVENT_JOYSTICK, event, sizeof(event)))
+  {
+    _joystickLastHorizontal = horizontal;
+    _joystickLastVertical = vertical;
+    _joystickLastSelect = select;
+    _joystickEventSent = true;
+  }
+}
+#endif
+
 /**************************************************************************/
 /*! 
     @brief  Initialises the analog joystick, setting the appropriate
@@ -84,6 +133,9 @@ void joystickInit(void)
     @param[out] select
                 pointer to the bool variable that will hold the
                 current state of the digital select button
+
+    When the composite CDC + HID device is used (CFG_USBCDC_HID), the
+    values are also sent to the host as a HID event.
 */
 /**************************************************************************/
 void joystickGetValues(uint32_t *horizontal, uint32_t *vertical, bool *select)
@@ -94,6 +146,10 @@ void joystickGetValues(uint32_t *horizontal, uint32_t *vertical, bool *select)
   *horizontal = adcRead(JOYSTICK_HORIZ_ADCPORT);
   *vertical = adcRead(JOYSTICK_VERT_ADCPORT);
   *select = gpioGetValue(JOYSTICK_SEL_PORT, JOYSTICK_SEL_PIN);
+
+#ifdef CFG_USBCDC_HID
+  joystickSendEvent(*horizontal, *vertical, *select);
+#endif
 }
 
 /**************************************************************************/
@@ -43,6 +43,7 @@
 #define JOYSTICK_HORIZ_ADCPORT    (3)     // ADC3
 #define JOYSTICK_SEL_PORT         (0)     // Use UART CTS for SEL input (P0.7)
 #define JOYSTICK_SEL_PIN          (7)
+#define JOYSTICK_HID_THRESHOLD    (8)     // ADC counts an axis must move before a new HID event is sent
 
 #define JOYSTICK_SEL_FUNC_GPIO  do {IOCON_PIO0_7 &= ~IOCON_PIO0_7_FUNC_MASK; IOCON_PIO0_7 |= IOCON_PIO0_7_FUNC_GPIO;} while (0)
 #define JOYSTICK_VERT_FUNC_ADC  do {IOCON_JTAG_TMS_PIO1_0 &= ~IOCON_JTAG_TMS_PIO1_0_FUNC_MASK; IOCON_JTAG_TMS_PIO1_0 |= IOCON_JTAG_TMS_PIO1_0_FUNC_AD1;} while (0)
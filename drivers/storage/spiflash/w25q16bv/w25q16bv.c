@@ -68,15 +68,25 @@ static bool _w25q16bvInitialised = false;
 /**************************************************************************/
 uint8_t w25q16bv_TransferByte(uint8_t data)
 {
-    /* Move on only if NOT busy and TX FIFO not full */
-    while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_MASK | SSP_SSP0SR_BSY_MASK)) != SSP_SSP0SR_TNF_NOTFULL);
-    SSP_SSP0DR = data;
-  
-    /* Wait until the busy bit is cleared and receive buffer is not empty */
-    while ((SSP_SSP0SR & (SSP_SSP0SR_BSY_MASK | SSP_SSP0SR_RNE_MASK)) != SSP_SSP0SR_RNE_NOTEMPTY);
+    sspTransfer(0, &data, &data, 1);
+    return data;
+}
+
+/**************************************************************************/
+/*!
+    Sends a command followed by a 24-bit address in one burst (the chip
+    must already be selected)
+*/
+/**************************************************************************/
+static void w25q16bv_SendAddress(uint8_t cmd, uint32_t address)
+{
+    uint8_t buf[4];
 
-    // Read the queue
-    return SSP_SSP0DR;
+    buf[0] = cmd;
+    buf[1] = (address >> 16) & 0xFF;      // address upper 8
+    buf[2] = (address >> 8) & 0xFF;       // address mid 8
+    buf[3] = address & 0xFF;              // address lower 8
+    sspTransfer(0, buf, NULL, sizeof(buf));
 }
 
 /**************************************************************************/
@@ -144,19 +154,11 @@ spiflashError_e w25q16bvWaitForReady()
 /**************************************************************************/
 void w25q16bvGetUniqueID(uint8_t *buffer)
 {
-  uint8_t i;
-
   W25Q16BV_SELECT();
   w25q16bv_TransferByte(W25Q16BV_CMD_READUNIQUEID); // Unique ID cmd
-  w25q16bv_TransferByte(0xFF);                      // Dummy write
-  w25q16bv_TransferByte(0xFF);                      // Dummy write
-  w25q16bv_TransferByte(0xFF);                      // Dummy write
-  w25q16bv_TransferByte(0xFF);                      // Dummy write
+  sspFill(0, 0xFF, 4);                              // Dummy writes
   // Read 8 bytes worth of data
-  for (i = 0; i < 8; i++)
-  {
-    buffer[i] = w25q16bv_TransferByte(0xFF);
-  }
+  sspDrain(0, buffer, 8, 0xFF);
   W25Q16BV_DESELECT();
 }
 
@@ -218,14 +220,14 @@ void spiflashGetManufacturerInfo (uint8_t *manufID, uint8_t *deviceID)
   // W25Q16BV_CMD_MANUFDEVID (0x90) provides both the JEDEC manufacturer
   // ID and the device ID
 
+  uint8_t id[2];
+
   W25Q16BV_SELECT();
-  w25q16bv_TransferByte(W25Q16BV_CMD_MANUFDEVID); 
-  w25q16bv_TransferByte(0x00);            // Dummy write
-  w25q16bv_TransferByte(0x00);            // Dummy write
-  w25q16bv_TransferByte(0x00);            // Dummy write
-  *manufID = w25q16bv_TransferByte(0xFF);
-  *deviceID = w25q16bv_TransferByte(0xFF);
+  w25q16bv_SendAddress(W25Q16BV_CMD_MANUFDEVID, 0); // Address 0 = manuf. ID first
+  sspDrain(0, id, 2, 0xFF);
   W25Q16BV_DESELECT();
+  *manufID = id[0];
+  *deviceID = id[1];
 }
 
 /**************************************************************************/
@@ -293,8 +295,7 @@ spiflashError_e spiflashReadBuffer (uint32_t address, uint8_t *buffer, uint32_t
 {
   if (!_w25q16bvInitialised) spiflashInit();
 
-  uint32_t a, i;
-  a = i = 0;
+  uint32_t avail;
 
   // Make sure the address is valid
   if (address >= W25Q16BV_MAXADDRESS)
@@ -306,23 +307,19 @@ spiflashError_e spiflashReadBuffer (uint32_t address, uint8_t *buffer, uint32_t
   if (w25q16bvWaitForReady())
     return SPIFLASH_ERROR_TIMEOUT_READY;
 
-  // Send the read data command
+  // Send the read data command (0x03), then fill the response buffer
+  // with whatever fits before the end of the flash memory
+  avail = W25Q16BV_MAXADDRESS + 1 - address;
   W25Q16BV_SELECT();
-  w25q16bv_TransferByte(W25Q16BV_CMD_READDATA);      // 0x03
-  w25q16bv_TransferByte((address >> 16) & 0xFF);     // address upper 8
-  w25q16bv_TransferByte((address >> 8) & 0xFF);      // address mid 8
-  w25q16bv_TransferByte(address & 0xFF);             // address lower 8
-  // Fill response buffer
-  for (a = address; a < address + len; a++, i++)
+  w25q16bv_SendAddress(W25Q16BV_CMD_READDATA, address);
+  sspDrain(0, buffer, len < avail ? len : avail, 0xFF);
+  W25Q16BV_DESELECT();
+
+  if (len > avail)
   {
-    if (a > W25Q16BV_MAXADDRESS)
-    {
-      // Oops ... we're at the end of the flash memory
-      return SPIFLASH_ERROR_ADDROVERFLOW;
-    }
-    buffer[i] = w25q16bv_TransferByte(0xFF);
+    // Oops ... we're at the end of the flash memory
+    return SPIFLASH_ERROR_ADDROVERFLOW;
   }
-  W25Q16BV_DESELECT();
 
   return SPIFLASH_ERROR_OK;
 }
@@ -387,10 +384,7 @@ spiflashError_e spiflashEraseSector (uint32_t sectorNumber)
   // Send the erase sector command
   uint32_t address = sectorNumber * W25Q16BV_SECTORSIZE;
   W25Q16BV_SELECT();
-  w25q16bv_TransferByte(W25Q16BV_CMD_SECTERASE4); 
-  w25q16bv_TransferByte((address >> 16) & 0xFF);     // address upper 8
-  w25q16bv_TransferByte((address >> 8) & 0xFF);      // address mid 8
-  w25q16bv_TransferByte(address & 0xFF);             // address lower 8
+  w25q16bv_SendAddress(W25Q16BV_CMD_SECTERASE4, address);
   W25Q16BV_DESELECT();
 
   // Wait until the busy bit is cleared before exiting
@@ -517,7 +511,6 @@ spiflashError_e spiflashEraseChip (void)
 spiflashError_e spiflashWritePage (uint32_t address, uint8_t *buffer, uint32_t len)
 {
   uint8_t status;
-  uint32_t i;
 
   if (!_w25q16bvInitialised) spiflashInit();
 
@@ -558,24 +551,11 @@ spiflashError_e spiflashWritePage (uint32_t address, uint8_t *buffer, uint32_t l
   }
 
   // Send page write command (0x02) plus 24-bit address
+  // If len = 256 bytes, lower 8 bits must be 0 (see datasheet 11.2.17)
   W25Q16BV_SELECT();
-  w25q16bv_TransferByte(W25Q16BV_CMD_PAGEPROG);      // 0x02
-  w25q16bv_TransferByte((address >> 16) & 0xFF);     // address upper 8
-  w25q16bv_TransferByte((address >> 8) & 0xFF);      // address mid 8
-  if (len == 256)
-  {
-    // If len = 256 bytes, lower 8 bits must be 0 (see datasheet 11.2.17)
-    w25q16bv_TransferByte(0);
-  }
-  else
-  {
-    w25q16bv_TransferByte(address & 0xFF);           // address lower 8
-  }
+  w25q16bv_SendAddress(W25Q16BV_CMD_PAGEPROG, len == 256 ? address & ~0xFF : address);
   // Transfer data
-  for (i = 0; i < len; i++)
-  {
-    w25q16bv_TransferByte(buffer[i]);
-  }
+  sspTransfer(0, buffer, NULL, len);
   // Write only occurs after the CS line is de-asserted
   W25Q16BV_DESELECT();
 
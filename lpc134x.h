@@ -110,6 +110,21 @@
 #define SCB_CPUID_VARIANT_MASK                    ((unsigned int) 0x00F00000) // Variant
 #define SCB_CPUID_IMPLEMENTER_MASK                ((unsigned int) 0xFF000000) // Implementer
 
+/*  Interrupt Control and State Register */
+
+#define SCB_ICSR                                  (*(pREG32 (0xE000ED04)))
+#define SCB_ICSR_PENDSTCLR                        ((unsigned int) 0x02000000) // Clear pending SysTick
+#define SCB_ICSR_PENDSTSET                        ((unsigned int) 0x04000000) // Set pending SysTick
+#define SCB_ICSR_PENDSVCLR                        ((unsigned int) 0x08000000) // Clear pending PendSV
+#define SCB_ICSR_PENDSVSET                        ((unsigned int) 0x10000000) // Set pending PendSV
+
+/*  System Handler Priority Register 3 */
+
+#define SCB_SHPR3                                 (*(pREG32 (0xE000ED20)))
+#define SCB_SHPR3_PRI_14_MASK                     ((unsigned int) 0x00FF0000) // PendSV priority
+#define SCB_SHPR3_PRI_14_LOWEST                   ((unsigned int) 0x00FF0000)
+#define SCB_SHPR3_PRI_15_MASK                     ((unsigned int) 0xFF000000) // SysTick priority
+
 /*  System Control Register */
 
 #define SCB_SCR                                   (*(pREG32 (0xE000ED10)))
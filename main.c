@@ -47,6 +47,17 @@
   #include "core/cmd/cmd.h"
 #endif
 
+#ifdef CFG_USBMSC
+  #include "core/usbmsc/mscuser.h"
+#endif
+
+#ifdef CFG_CHIBI
+  #include "drivers/rf/chibi/chb_drvr.h"
+  #include "drivers/rf/chibi/chb_lpl.h"
+  #include "drivers/rf/chibi/chb_mesh.h"
+  #include "drivers/rf/chibi/chb_xport.h"
+#endif
+
 /**************************************************************************/
 /*! 
     Main program entry point.  After reset, normal code execution will
@@ -75,6 +86,43 @@ int main(void)
     #ifdef CFG_INTERFACE 
       cmdPoll(); 
     #endif
+
+    // Move USB Mass Storage data to/from the SD card or SPI flash
+    #ifdef CFG_USBMSC
+      MSC_Poll();
+    #endif
+
+    // Service the radio if its interrupts are handled from the main loop
+    #if defined CFG_CHIBI && CFG_CHIBI_DEFERIRQ == 2
+      chb_task();
+    #endif
+
+    // Relay frames for other nodes and keep the routes up to date.  Frames
+    // for this node wait for chb_read_frame, and until the app releases
+    // them the rx pool can't reuse the slots behind them (see chb_mesh.h)
+    #if defined CFG_CHIBI && CFG_CHIBI_MESH == 1
+      chb_mesh_task();
+    #endif
+
+    // Move multi-frame messages along (see the 'K' command).  Transport
+    // frames are taken out of the rx pool, anything else is left for
+    // chb_read_frame
+    #if defined CFG_CHIBI && CFG_CHIBI_XPORT == 1
+      chb_xport_task();
+    #endif
+
+    // Nothing in this firmware reads plain Chibi frames.  Give them back
+    // straight away, or a stray frame from another node would hold up the
+    // relaying and transport frames behind it in the rx pool
+    #if defined CFG_CHIBI && (CFG_CHIBI_MESH == 1 || CFG_CHIBI_XPORT == 1)
+      chb_release_frame(chb_read_frame());
+    #endif
+
+    // Duty cycle the radio and sleep until there's something to do
+    #if defined CFG_CHIBI && CFG_CHIBI_LPL == 1
+      chb_lpl_task();
+      chb_lpl_idle();
+    #endif
   }
 
   return 0;
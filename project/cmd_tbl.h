@@ -77,6 +77,15 @@ void cmd_bmp(uint8_t argc, char **argv);
 #ifdef CFG_CHIBI
 void cmd_chibi_addr(uint8_t argc, char **argv);
 void cmd_chibi_tx(uint8_t argc, char **argv);
+#if CFG_CHIBI_LPL == 1
+void cmd_chibi_lpl(uint8_t argc, char **argv);
+#endif
+#if CFG_CHIBI_MESH == 1
+void cmd_chibi_mesh(uint8_t argc, char **argv);
+#endif
+#if CFG_CHIBI_XPORT == 1
+void cmd_chibi_xport(uint8_t argc, char **argv);
+#endif
 #endif
 
 #ifdef CFG_I2CEEPROM
@@ -91,6 +100,7 @@ void cmd_lm75b_gettemp(uint8_t argc, char **argv);
 
 #ifdef CFG_SDCARD
 void cmd_sd_dir(uint8_t argc, char **argv);
+void cmd_sd_script(uint8_t argc, char **argv);
 #endif
 
 #ifdef CFG_PWM
@@ -148,6 +158,15 @@ cmd_t cmd_tbl[] =
   #ifdef CFG_CHIBI
   { "A",    0,  1,  0, cmd_chibi_addr        , "Get/Set Node Address"           , "'A [<0x0..0xFFFE>]'" },
   { "S",    2, 99,  0, cmd_chibi_tx          , "Send Message"                   , "'S <destaddr> <msg>'" },
+  #if CFG_CHIBI_LPL == 1
+  { "D",    0,  2,  0, cmd_chibi_lpl         , "Radio Duty Cycle"               , "'D [<interval ms> | L <max latency ms> | R]'" },
+  #endif
+  #if CFG_CHIBI_MESH == 1
+  { "N",    0,  1,  0, cmd_chibi_mesh        , "Mesh Routes"                    , "'N [C | R]'" },
+  #endif
+  #if CFG_CHIBI_XPORT == 1
+  { "K",    0,  2,  0, cmd_chibi_xport       , "Send Large Message"             , "'K [<destaddr> <bytes> | R]'" },
+  #endif
   #endif
 
   #ifdef CFG_LM75B
@@ -156,6 +175,7 @@ cmd_t cmd_tbl[] =
 
   #ifdef CFG_SDCARD
   { "d",    0,  1,  0,  cmd_sd_dir           , "Dir (SD Card)"                  , "'d [<path>]'" },
+  { "X",    1,  1,  0,  cmd_sd_script        , "Run Script (SD Card)"           , "'X <file>'" },
   #endif
 
   #ifdef CFG_PWM
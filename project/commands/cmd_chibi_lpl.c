@@ -0,0 +1,131 @@
+/**************************************************************************/
+/*! 
+    @file     cmd_chibi_lpl.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Code to execute for cmd_chibi_lpl in the 'core/cmd'
+              command-line interpretter.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "core/cmd/cmd.h"
+#include "project/commands.h"       // Generic helper functions
+
+#if defined CFG_CHIBI && CFG_CHIBI_LPL == 1
+  #include "drivers/rf/chibi/chb.h"
+  #include "drivers/rf/chibi/chb_lpl.h"
+
+/**************************************************************************/
+/*! 
+    Gets or sets the radio's wake interval and shows what it costs and
+    buys: the share of the time the radio was on, how often it woke up
+    for nothing, and how long frames took to get through.
+
+    'D <ms>' sets the wake interval (0 = radio always on), 'D L <ms>'
+    picks the longest interval that meets a latency target and 'D R'
+    resets the stats.
+*/
+/**************************************************************************/
+void cmd_chibi_lpl(uint8_t argc, char **argv)
+{
+  chb_lpl_stats_t stats;
+  int32_t ms;
+  uint16_t duty;
+
+  if (argc > 0)
+  {
+    if (!strcmp(argv[0], "R") || !strcmp(argv[0], "r"))
+    {
+      chb_lpl_reset_stats();
+      return;
+    }
+
+    if (!strcmp(argv[0], "L") || !strcmp(argv[0], "l"))
+    {
+      if (argc < 2)
+      {
+        printf("Latency target required: 'D L <ms>'%s", CFG_PRINTF_NEWLINE);
+        return;
+      }
+      getNumber (argv[1], &ms);
+      if (ms <= 0 || ms > 0xFFFF)
+      {
+        printf("Invalid Latency: 1-65535 ms required.%s", CFG_PRINTF_NEWLINE);
+        return;
+      }
+      if (chb_lpl_set_latency((uint16_t)ms) == 0)
+      {
+        printf("Target too tight for duty cycling, the radio stays on.%s", CFG_PRINTF_NEWLINE);
+      }
+    }
+    else
+    {
+      getNumber (argv[0], &ms);
+      if (ms < 0 || ms > 0xFFFF)
+      {
+        printf("Invalid Interval: 0-65535 ms required.%s", CFG_PRINTF_NEWLINE);
+        return;
+      }
+      chb_lpl_set_interval((uint16_t)ms);
+    }
+    chb_lpl_reset_stats();
+  }
+
+  chb_lpl_get_stats(&stats);
+  duty = chb_lpl_duty_cycle();
+
+  if (chb_lpl_get_interval())
+  {
+    printf("%-25s : %u ms %s", "Wake Interval", chb_lpl_get_interval(), CFG_PRINTF_NEWLINE);
+  }
+  else
+  {
+    printf("%-25s : Always On %s", "Wake Interval", CFG_PRINTF_NEWLINE);
+  }
+  printf("%-25s : %u ms %s", "Max Latency", chb_lpl_max_latency(), CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u.%02u %% of %u s %s", "Radio On", duty / 100, duty % 100,
+         (unsigned int)(stats.elapsed_ms / 1000), CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u (%u woke up, %u for nothing) %s", "Channel Samples", (unsigned int)stats.samples,
+         (unsigned int)stats.wakeups, (unsigned int)stats.idle_wakeups, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u (%u copies) %s", "Frames Sent", (unsigned int)stats.frames,
+         (unsigned int)stats.strobes, CFG_PRINTF_NEWLINE);
+  if (stats.acked)
+  {
+    printf("%-25s : %u / %u / %u ms %s", "Latency (min/avg/max)", (unsigned int)stats.latency_min,
+           (unsigned int)(stats.latency_sum / stats.acked), (unsigned int)stats.latency_max, CFG_PRINTF_NEWLINE);
+  }
+}
+
+#endif
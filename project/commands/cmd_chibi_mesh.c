@@ -0,0 +1,116 @@
+/**************************************************************************/
+/*! 
+    @file     cmd_chibi_mesh.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Code to execute for cmd_chibi_mesh in the 'core/cmd'
+              command-line interpretter.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "core/cmd/cmd.h"
+#include "project/commands.h"       // Generic helper functions
+
+#if defined CFG_CHIBI && CFG_CHIBI_MESH == 1
+  #include "drivers/rf/chibi/chb.h"
+  #include "drivers/rf/chibi/chb_mesh.h"
+
+/**************************************************************************/
+/*! 
+    Shows the mesh route table and what this node did for the mesh: the
+    frames it sent, received and relayed, how long relayed frames spent
+    here before the next hop had them, and how busy the tx queue was.
+
+    'N C' clears the route table and 'N R' resets the stats.
+*/
+/**************************************************************************/
+void cmd_chibi_mesh(uint8_t argc, char **argv)
+{
+  chb_mesh_stats_t stats;
+  chb_mesh_route_t route;
+  uint8_t i, cnt = 0;
+
+  if (argc > 0)
+  {
+    if (!strcmp(argv[0], "C") || !strcmp(argv[0], "c"))
+    {
+      chb_mesh_clear_routes();
+    }
+    else if (!strcmp(argv[0], "R") || !strcmp(argv[0], "r"))
+    {
+      chb_mesh_reset_stats();
+    }
+    else
+    {
+      printf("Invalid Argument: 'N [C | R]'%s", CFG_PRINTF_NEWLINE);
+    }
+    return;
+  }
+
+  for (i=0; i<CHB_MESH_ROUTES; i++)
+  {
+    if (chb_mesh_get_route(i, &route))
+    {
+      printf("0x%04X via 0x%04X, %u hop(s) %s", route.dest, route.next_hop, route.hops, CFG_PRINTF_NEWLINE);
+      cnt++;
+    }
+  }
+  if (cnt == 0)
+  {
+    printf("No Routes%s", CFG_PRINTF_NEWLINE);
+  }
+
+  chb_mesh_get_stats(&stats);
+  printf("%-25s : %u (%u not ACKed) %s", "Frames Sent", (unsigned int)stats.sent,
+         (unsigned int)stats.send_fail, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u %s", "Frames Received", (unsigned int)stats.delivered, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u (%u not ACKed) %s", "Frames Relayed", (unsigned int)(stats.forwarded + stats.fwd_fail),
+         (unsigned int)stats.fwd_fail, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u no route, %u too many hops %s", "Frames Dropped", (unsigned int)stats.no_route,
+         (unsigned int)stats.ttl_drop, CFG_PRINTF_NEWLINE);
+  if (stats.forwarded)
+  {
+    printf("%-25s : %u / %u / %u ms %s", "Hop Latency (min/avg/max)", (unsigned int)stats.hop_min,
+           (unsigned int)(stats.hop_sum / stats.forwarded), (unsigned int)stats.hop_max, CFG_PRINTF_NEWLINE);
+  }
+  printf("%-25s : %u now, %u max, %u dropped %s", "Relay Queue", stats.queue_now, stats.queue_max,
+         (unsigned int)stats.queue_drops, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u requests, %u found, %u failed %s", "Route Discovery", stats.rreq_sent,
+         stats.disc_ok, stats.disc_fail, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u replies, %u errors %s", "Route Control Sent", stats.rrep_sent,
+         stats.rerr_sent, CFG_PRINTF_NEWLINE);
+}
+
+#endif
@@ -46,11 +46,12 @@
 #ifdef CFG_CHIBI
   #include "drivers/rf/chibi/chb.h"
   #include "drivers/rf/chibi/chb_drvr.h"
+  #include "drivers/rf/chibi/chb_mesh.h"
 
 /**************************************************************************/
 /*! 
-    Sends text or data via Chibi
-    
+    Sends text or data via Chibi. With CFG_CHIBI_MESH, messages to a
+    single node go through the mesh and can take several hops.
 */
 /**************************************************************************/
 void cmd_chibi_tx(uint8_t argc, char **argv)
@@ -84,6 +85,16 @@ void cmd_chibi_tx(uint8_t argc, char **argv)
   *data_ptr++ = '\0';
 
   // Send message
+  #if CFG_CHIBI_MESH == 1
+  if (addr != 0xFFFF)
+  {
+    if (chb_mesh_write(addr, data, data_ptr - data) == CHB_TX_QUEUE_FULL)
+    {
+      printf("Busy finding a route, try again.%s", CFG_PRINTF_NEWLINE);
+    }
+    return;
+  }
+  #endif
   chb_write(addr, data, data_ptr - data);
 }
 
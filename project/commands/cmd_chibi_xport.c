@@ -0,0 +1,176 @@
+/**************************************************************************/
+/*! 
+    @file     cmd_chibi_xport.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Code to execute for cmd_chibi_xport in the 'core/cmd'
+              command-line interpretter.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "core/cmd/cmd.h"
+#include "core/systick/systick.h"
+#include "project/commands.h"       // Generic helper functions
+
+#if defined CFG_CHIBI && CFG_CHIBI_XPORT == 1
+  #include "drivers/rf/chibi/chb.h"
+  #include "drivers/rf/chibi/chb_drvr.h"
+  #include "drivers/rf/chibi/chb_xport.h"
+
+// The test message is the firmware image, starting at the vector table,
+// so it doesn't take any RAM
+extern const void *vectors[];
+
+static uint32_t _xportStart;
+static uint16_t _xportLen;
+
+/**************************************************************************/
+/*! 
+    Waits for the message started by cmd_chibi_xport to be acknowledged
+    or given up on and prints how long it took.  The transport itself is
+    run from the main loop.
+*/
+/**************************************************************************/
+static cmdTaskStatus_t cmd_chibi_xport_task(void *ctx)
+{
+  uint32_t ms;
+
+  switch (chb_xport_tx_status())
+  {
+    case CHB_XPORT_BUSY:
+      return CMD_TASK_CONTINUE;
+
+    case CHB_XPORT_DONE:
+      ms = (systickGetTicks() - _xportStart) * CFG_SYSTICK_DELAY_IN_MS;
+      if (ms == 0)
+      {
+        ms = 1;
+      }
+      printf("%u bytes sent in %u ms (%u bytes/s)%s", _xportLen, (unsigned int)ms,
+             (unsigned int)(((uint32_t)_xportLen * 1000) / ms), CFG_PRINTF_NEWLINE);
+      break;
+
+    default:
+      printf("Send failed (no ACK)%s", CFG_PRINTF_NEWLINE);
+      break;
+  }
+  return CMD_TASK_DONE;
+}
+
+/**************************************************************************/
+/*! 
+    Sends a message that doesn't fit in a single frame with the
+    fragmenting transport (chb_xport).  'K <destaddr> <bytes>' sends the
+    first <bytes> of the firmware image and reports the time it took.
+
+    Without arguments it shows what the transport did in both directions:
+    messages and fragments sent, how many fragments had to be resent
+    (straight away because a selective ACK showed a gap, or after a
+    timeout) and what was received.  'K R' resets the stats.
+*/
+/**************************************************************************/
+void cmd_chibi_xport(uint8_t argc, char **argv)
+{
+  chb_xport_stats_t stats;
+  int32_t addr32, len32;
+
+  if (argc == 1)
+  {
+    if (!strcmp(argv[0], "R") || !strcmp(argv[0], "r"))
+    {
+      chb_xport_reset_stats();
+    }
+    else
+    {
+      printf("Invalid Argument: 'K [<destaddr> <bytes> | R]'%s", CFG_PRINTF_NEWLINE);
+    }
+    return;
+  }
+
+  if (argc == 2)
+  {
+    // Check for invalid values (getNumber may complain about this as well)
+    getNumber (argv[0], &addr32);
+    if (addr32 <= 0 || addr32 > 0xFFFE)
+    {
+      printf("Invalid Address: 1-65534 or 0x0001-0xFFFE required.%s", CFG_PRINTF_NEWLINE);
+      return;
+    }
+    getNumber (argv[1], &len32);
+    if (len32 <= 0 || len32 > CHB_XPORT_MAX_MSG)
+    {
+      printf("Invalid Length: 1-%u bytes required.%s", (unsigned int)CHB_XPORT_MAX_MSG, CFG_PRINTF_NEWLINE);
+      return;
+    }
+
+    if (chb_xport_send((uint16_t)addr32, (uint8_t *)vectors, (uint16_t)len32) != CHB_SUCCESS)
+    {
+      printf("A message is already being sent%s", CFG_PRINTF_NEWLINE);
+      return;
+    }
+    _xportStart = systickGetTicks();
+    _xportLen = (uint16_t)len32;
+
+    if (cmdTaskStart(cmd_chibi_xport_task, NULL) != CMD_ERROR_NONE)
+    {
+      // Too many nested tasks ... run the transport here instead
+      do
+      {
+        #if CFG_CHIBI_DEFERIRQ == 2
+          chb_task();
+        #endif
+        chb_xport_task();
+      } while (cmd_chibi_xport_task(NULL) == CMD_TASK_CONTINUE);
+    }
+    return;
+  }
+
+  chb_xport_get_stats(&stats);
+  printf("%-25s : %u (%u failed) %s", "Messages Sent", (unsigned int)stats.msgs_sent,
+         (unsigned int)stats.msgs_failed, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u %s", "Fragments Sent", (unsigned int)stats.frags_sent, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u on SACK, %u on timeout (%u timeouts) %s", "Fragments Resent",
+         (unsigned int)stats.fast_resent, (unsigned int)stats.timeout_resent,
+         (unsigned int)stats.timeouts, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u received, %u sent %s", "ACKs", (unsigned int)stats.acks_rcvd,
+         (unsigned int)stats.acks_sent, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u (%u bytes) %s", "Messages Received", (unsigned int)stats.msgs_rcvd,
+         (unsigned int)stats.bytes_rcvd, CFG_PRINTF_NEWLINE);
+  printf("%-25s : %u (%u held, %u duplicate, %u outside window) %s", "Fragments Received",
+         (unsigned int)stats.frags_rcvd, (unsigned int)stats.frags_held,
+         (unsigned int)stats.frags_dup, (unsigned int)stats.frags_outside, CFG_PRINTF_NEWLINE);
+}
+
+#endif
@@ -0,0 +1,432 @@
+/**************************************************************************/
+/*! 
+    @file     cmd_sd_script.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Code to execute for cmd_sd_script in the 'core/cmd'
+              command-line interpretter.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "core/cmd/cmd.h"
+#include "project/commands.h"           // Generic helper functions
+
+#ifdef CFG_SDCARD
+  #include "core/systick/systick.h"
+  #include "drivers/fatfs/diskio.h"
+  #include "drivers/fatfs/ff.h"
+
+  #define SCRIPT_READBUFSIZE    (64)    // Bytes read from the file at once
+  #define SCRIPT_MAXPATH        (32)    // Max length of the script path
+  #define SCRIPT_MAXLOOPS       (4)     // Max number of nested @loop blocks
+
+  typedef struct
+  {
+    DWORD     offset;                   // File offset of the first line in the loop
+    uint32_t  lineNumber;               // Line number of the '@loop' directive
+    uint32_t  remaining;                // Iterations left after the current one
+  } scriptLoop_t;
+
+  typedef struct
+  {
+    bool          running;
+    bool          abortOnError;
+    char          path[SCRIPT_MAXPATH];
+    FIL           file;
+    BYTE          buf[SCRIPT_READBUFSIZE];
+    UINT          bufLen;
+    UINT          bufPos;
+    DWORD         bufOffset;            // File offset of buf[0]
+    char          line[CFG_INTERFACE_MAXMSGSIZE];
+    uint32_t      lineNumber;
+    uint32_t      delayStart;
+    uint32_t      delayTicks;
+    scriptLoop_t  loops[SCRIPT_MAXLOOPS];
+    uint8_t       loopDepth;
+  } script_t;
+
+  static FATFS _scriptFatfs;
+  static script_t _script;
+
+/**************************************************************************/
+/*! 
+    @brief  Mounts the SD card and opens the script file, placing the
+            file pointer at the specified offset.  This is also used to
+            recover the file handle if another command (such as 'B')
+            remounted or unmounted the card while the script was running.
+*/
+/**************************************************************************/
+static FRESULT scriptOpen(DWORD offset)
+{
+  FRESULT res;
+
+  if (disk_initialize(0) & (STA_NOINIT | STA_NODISK))
+  {
+    return FR_NOT_READY;
+  }
+
+  res = f_mount(0, &_scriptFatfs);
+  if (res == FR_OK)
+  {
+    res = f_open(&_script.file, _script.path, FA_READ | FA_OPEN_EXISTING);
+  }
+  if ((res == FR_OK) && offset)
+  {
+    res = f_lseek(&_script.file, offset);
+  }
+
+  // Discard anything left in the read buffer
+  _script.bufOffset = offset;
+  _script.bufLen = _script.bufPos = 0;
+
+  return res;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Moves the read position to the specified file offset.  If
+            the offset is still in the read buffer (short loops) no
+            file access is required.
+*/
+/**************************************************************************/
+static FRESULT scriptSeek(DWORD offset)
+{
+  FRESULT res;
+
+  if ((offset >= _script.bufOffset) && (offset <= _script.bufOffset + _script.bufLen))
+  {
+    _script.bufPos = offset - _script.bufOffset;
+    return FR_OK;
+  }
+
+  res = f_lseek(&_script.file, offset);
+  if (res == FR_INVALID_OBJECT)
+  {
+    return scriptOpen(offset);
+  }
+  _script.bufOffset = offset;
+  _script.bufLen = _script.bufPos = 0;
+
+  return res;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads the next line from the script into _script.line,
+            refilling the read buffer as required.  '\r' characters are
+            dropped, and lines longer than CFG_INTERFACE_MAXMSGSIZE are
+            truncated.
+
+    @return 1 if a line was read, 0 at the end of the file, or -1 if
+            the file could not be read
+*/
+/**************************************************************************/
+static int scriptReadLine(void)
+{
+  FRESULT res;
+  size_t len = 0;
+  char c;
+
+  for (;;)
+  {
+    // Refill the read buffer
+    if (_script.bufPos == _script.bufLen)
+    {
+      _script.bufOffset += _script.bufLen;
+      _script.bufLen = _script.bufPos = 0;
+      res = f_read(&_script.file, _script.buf, SCRIPT_READBUFSIZE, &_script.bufLen);
+      if (res == FR_INVALID_OBJECT)
+      {
+        // The card was remounted by another command ... reopen the script
+        res = scriptOpen(_script.bufOffset);
+        if (res == FR_OK)
+        {
+          res = f_read(&_script.file, _script.buf, SCRIPT_READBUFSIZE, &_script.bufLen);
+        }
+      }
+      if (res != FR_OK)
+      {
+        return -1;
+      }
+      if (_script.bufLen == 0)
+      {
+        // End of file (the last line may not end with a new line)
+        if (len == 0)
+        {
+          return 0;
+        }
+        break;
+      }
+    }
+
+    c = _script.buf[_script.bufPos++];
+    if (c == '\n')
+    {
+      break;
+    }
+    if ((c != '\r') && (len < sizeof(_script.line) - 1))
+    {
+      _script.line[len++] = c;
+    }
+  }
+
+  _script.line[len] = '\0';
+  _script.lineNumber++;
+
+  return 1;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Closes the script file and unmounts the SD card
+*/
+/**************************************************************************/
+static void scriptClose(void)
+{
+  f_close(&_script.file);
+  f_mount(0, 0);
+  _script.running = false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Handles '@' directives.  Returns false if the directive is
+            invalid or can't be executed.
+*/
+/**************************************************************************/
+static bool scriptDirective(char *line)
+{
+  int32_t value = 0;
+  char *arg = strchr(line, ' ');
+
+  // Split the directive and its argument
+  if (arg)
+  {
+    *arg++ = '\0';
+    while (*arg == ' ') arg++;
+  }
+
+  if (!strcmp(line, "@delay"))
+  {
+    if (!arg || !getNumber(arg, &value) || (value < 0))
+    {
+      return false;
+    }
+    _script.delayStart = systickGetTicks();
+    _script.delayTicks = (uint32_t)value / CFG_SYSTICK_DELAY_IN_MS;
+    return true;
+  }
+
+  if (!strcmp(line, "@loop"))
+  {
+    if (!arg || !getNumber(arg, &value) || (value < 1) || (_script.loopDepth == SCRIPT_MAXLOOPS))
+    {
+      return false;
+    }
+    _script.loops[_script.loopDepth].offset = _script.bufOffset + _script.bufPos;
+    _script.loops[_script.loopDepth].lineNumber = _script.lineNumber;
+    _script.loops[_script.loopDepth].remaining = (uint32_t)value - 1;
+    _script.loopDepth++;
+    return true;
+  }
+
+  if (!strcmp(line, "@end"))
+  {
+    scriptLoop_t *loop;
+
+    if (_script.loopDepth == 0)
+    {
+      return false;
+    }
+    loop = &_script.loops[_script.loopDepth - 1];
+    if (loop->remaining == 0)
+    {
+      // Loop is finished
+      _script.loopDepth--;
+      return true;
+    }
+    loop->remaining--;
+    _script.lineNumber = loop->lineNumber;
+    return scriptSeek(loop->offset) == FR_OK;
+  }
+
+  if (!strcmp(line, "@onerror") && arg)
+  {
+    if (!strcmp(arg, "abort"))
+    {
+      _script.abortOnError = true;
+      return true;
+    }
+    if (!strcmp(arg, "continue"))
+    {
+      _script.abortOnError = false;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Resumable part of cmd_sd_script.  Runs until one command has
+            been executed (or a delay has started), then hands control
+            back to the main loop.
+*/
+/**************************************************************************/
+static cmdTaskStatus_t cmd_sd_script_task(void *ctx)
+{
+  int rc;
+  char *line;
+
+  // Wait for any pending '@delay' to expire
+  if (_script.delayTicks)
+  {
+    if ((systickGetTicks() - _script.delayStart) < _script.delayTicks)
+    {
+      return CMD_TASK_CONTINUE;
+    }
+    _script.delayTicks = 0;
+  }
+
+  while ((rc = scriptReadLine()) > 0)
+  {
+    // Skip leading white space, blank lines and comments
+    line = _script.line;
+    while (*line == ' ' || *line == '\t') line++;
+    if ((*line == '\0') || (*line == '#'))
+    {
+      continue;
+    }
+
+    if (*line == '@')
+    {
+      if (!scriptDirective(line))
+      {
+        printf("Invalid directive on line %u%s", (unsigned int)_script.lineNumber, CFG_PRINTF_NEWLINE);
+        break;
+      }
+      if (_script.delayTicks)
+      {
+        return CMD_TASK_CONTINUE;
+      }
+      continue;
+    }
+
+    // Execute the command without echo or prompt
+    if ((cmdParse(line) != CMD_ERROR_NONE) && _script.abortOnError)
+    {
+      printf("Script aborted on line %u%s", (unsigned int)_script.lineNumber, CFG_PRINTF_NEWLINE);
+      break;
+    }
+
+    return CMD_TASK_CONTINUE;
+  }
+
+  if (rc < 0)
+  {
+    printf("Failed to read '%s'%s", _script.path, CFG_PRINTF_NEWLINE);
+  }
+
+  scriptClose();
+  return CMD_TASK_DONE;
+}
+
+/**************************************************************************/
+/*! 
+    sd 'script' command handler
+
+    Executes a text file containing CLI commands (one per line) from the
+    SD card.  Commands are executed without being echoed, and the file
+    is read through a small buffer rather than line by line.  In
+    addition to regular commands, the following can be used in a script:
+
+    @code
+    # Comment
+    @delay <ms>                 Waits for the specified delay
+    @loop <count>               Repeats everything up to the matching
+    ...                         '@end' <count> times (can be nested up
+    @end                        to SCRIPT_MAXLOOPS deep)
+    @onerror <abort|continue>   Stop the script (default) or continue if
+                                a command is unknown or has the wrong
+                                number of arguments
+    @endcode
+
+    The script runs as a resumable command, so the main loop keeps
+    running and incoming commands are queued until it has finished.
+*/
+/**************************************************************************/
+void cmd_sd_script(uint8_t argc, char **argv)
+{
+  FRESULT res;
+
+  if (_script.running)
+  {
+    printf("A script is already running%s", CFG_PRINTF_NEWLINE);
+    return;
+  }
+
+  if (strlen(argv[0]) >= SCRIPT_MAXPATH)
+  {
+    printf("Path too long%s", CFG_PRINTF_NEWLINE);
+    return;
+  }
+
+  memset(&_script, 0, sizeof(script_t));
+  strcpy(_script.path, argv[0]);
+  _script.abortOnError = true;
+
+  res = scriptOpen(0);
+  if (res == FR_NOT_READY)
+  {
+    printf("SD init failed%s", CFG_PRINTF_NEWLINE);
+    return;
+  }
+  if (res != FR_OK)
+  {
+    printf("Failed to open '%s'%s", _script.path, CFG_PRINTF_NEWLINE);
+    f_mount(0, 0);
+    return;
+  }
+
+  _script.running = true;
+  if (cmdTaskStart(cmd_sd_script_task, NULL) != CMD_ERROR_NONE)
+  {
+    // Too many nested tasks ... run the script here instead
+    while (cmd_sd_script_task(NULL) == CMD_TASK_CONTINUE);
+  }
+}
+
+#endif
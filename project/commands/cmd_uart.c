@@ -46,6 +46,30 @@
   #include "drivers/storage/eeprom/eeprom.h"
   #include "core/uart/uart.h"
 
+// Largest acceptable difference between the requested and actual baud
+// rate, in 1/100ths of a percent
+#define CMD_UART_MAXERROR   (300)
+
+/**************************************************************************/
+/*! 
+    Displays the requested baud rate along with the rate the UART
+    divider actually produces, and returns the error in 1/100ths of a
+    percent.
+*/
+/**************************************************************************/
+static int32_t cmd_uart_print(uint32_t speed)
+{
+  uint32_t actual = uartCalcDivisor(speed, NULL, NULL);
+  int32_t error = (int32_t)(((int64_t)actual - (int64_t)speed) * 10000 / (int64_t)speed);
+  int32_t absError = error < 0 ? -error : error;
+
+  printf("%u (actual %u, error %c%d.%02d%%)%s", (unsigned int)speed,
+         (unsigned int)actual, error < 0 ? '-' : '+', (int)(absError / 100),
+         (int)(absError % 100), CFG_PRINTF_NEWLINE);
+
+  return absError;
+}
+
 /**************************************************************************/
 /*! 
     Gets or sets the UART speed from EEPROM.
@@ -60,14 +84,21 @@ void cmd_uart(uint8_t argc, char **argv)
     getNumber (argv[0], &speed);
     
     // Check for invalid values (getNumber may complain about this as well)
-    if (speed < 9600 || speed  > 115200)
+    if (speed < 9600 || speed  > UART_MAXBAUDRATE)
+    {
+      printf("Invalid baud rate: 9600-%u required.%s", (unsigned int)UART_MAXBAUDRATE, CFG_PRINTF_NEWLINE);
+      return;
+    }
+
+    // Make sure the UART can actually generate something close enough
+    printf("Setting UART to: ");
+    if (cmd_uart_print(speed) > CMD_UART_MAXERROR)
     {
-      printf("Invalid baud rate: 9600-115200 required.%s", CFG_PRINTF_NEWLINE);
+      printf("Baud rate error too large%s", CFG_PRINTF_NEWLINE);
       return;
     }
 
     // Write baud rate to EEPROM and reinitialise UART if using it
-    printf("Setting UART to: %d%s", (int)speed, CFG_PRINTF_NEWLINE);
     eepromWriteU32(CFG_EEPROM_UART_SPEED, speed);
     #ifdef CFG_PRINTF_UART
     uartInit(speed);
@@ -78,17 +109,17 @@ void cmd_uart(uint8_t argc, char **argv)
     // Display the current baud rate
     #ifdef CFG_PRINTF_UART
       uart_pcb_t *pcb = uartGetPCB();
-      printf("%u%s", (unsigned int)(pcb->baudrate), CFG_PRINTF_NEWLINE);
+      cmd_uart_print(pcb->baudrate);
     #else
       // Try to get UART from EEPROM
       uint32_t uartEEPROM = eepromReadU32(CFG_EEPROM_UART_SPEED);
-      if ((uartEEPROM < 9600) || (uartEEPROM > 115200))
+      if ((uartEEPROM < 9600) || (uartEEPROM > UART_MAXBAUDRATE))
       {
         printf("UART not set in EEPROM%s", CFG_PRINTF_NEWLINE);
       }
       else
       {
-        printf("%u%s", (unsigned int)uartEEPROM, CFG_PRINTF_NEWLINE);
+        cmd_uart_print(uartEEPROM);
       }
     #endif
   }
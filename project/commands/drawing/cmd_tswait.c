@@ -45,18 +45,55 @@
 #include "project/commands.h"       // Generic helper functions
 
 #ifdef CFG_TFTLCD    
+  #include "core/systick/systick.h"
   #include "drivers/displays/tft/touchscreen.h"
 
+static uint32_t _tswaitStartTick;
+static uint32_t _tswaitTimeout;
+
+/**************************************************************************/
+/*! 
+    Resumable part of cmd_tswait.  Takes one touch screen reading per
+    pass through the main loop until a valid touch event occurs or the
+    timeout expires.
+*/
+/**************************************************************************/
+static cmdTaskStatus_t cmd_tswait_task(void *ctx)
+{
+  tsTouchData_t data;
+
+  tsPollEvent(&data);
+
+  if (data.valid)
+  {
+    // A valid touch event occurred ... parse data
+    printf("%d,%d%s",(int)data.xlcd, (int)data.ylcd, CFG_PRINTF_NEWLINE);
+    return CMD_TASK_DONE;
+  }
+
+  // Unsigned subtraction also handles systick rollover
+  if (_tswaitTimeout && ((systickGetTicks() - _tswaitStartTick) > _tswaitTimeout))
+  {
+    // Display error code
+    printf("%d%s", (int)TS_ERROR_TIMEOUT, CFG_PRINTF_NEWLINE);
+    return CMD_TASK_DONE;
+  }
+
+  return CMD_TASK_CONTINUE;
+}
+
 /**************************************************************************/
 /*! 
     Waits for a touch screen event and returns the co-ordinates
+
+    This command doesn't block the main loop while waiting: the wait is
+    carried out by cmd_tswait_task, which is called from cmdPoll until
+    a touch event or a timeout occurs.
 */
 /**************************************************************************/
 void cmd_tswait(uint8_t argc, char **argv)
 {
-  tsTouchData_t data;
   int32_t delay;
-  int32_t error = 0;
 
   if (argc == 1)
   {
@@ -74,21 +111,13 @@ void cmd_tswait(uint8_t argc, char **argv)
     return;
   }
 
-  // Blocking delay until a valid touch event occurs
-  error = tsWaitForEvent(&data, delay > 0 ? (uint32_t)delay : 0);
-
-  if (error == TS_ERROR_NONE)
+  _tswaitStartTick = systickGetTicks();
+  _tswaitTimeout = (uint32_t)delay;
+  if (cmdTaskStart(cmd_tswait_task, NULL) != CMD_ERROR_NONE)
   {
-    // A valid touch event occurred ... parse data
-    printf("%d,%d%s",(int)data.xlcd, (int)data.ylcd, CFG_PRINTF_NEWLINE);
+    // Too many nested tasks ... fall back to waiting here
+    while (cmd_tswait_task(NULL) == CMD_TASK_CONTINUE);
   }
-  else
-  {
-    // Display error code
-    printf("%d%s", (int)error, CFG_PRINTF_NEWLINE);
-  }
-
-  return;
 }
 
 #endif
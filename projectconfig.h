@@ -342,47 +342,63 @@
 
     CFG_UART_BAUDRATE         The default UART speed.  This value is used 
                               when initialising UART, and should be a 
-                              standard value like 57600, 9600, etc.  
+                              standard value like 57600, 9600, etc.  Rates
+                              up to UART_MAXBAUDRATE are supported using
+                              the fractional divider (see 'U' command
+                              for the actual rate and error).
                               NOTE: This value may be overridden if
                               another value is stored in EEPROM!
     CFG_UART_BUFSIZE          The length in bytes of the UART RX FIFO. This
                               will determine the maximum number of received
-                              characters to store in memory.
+                              characters to store in memory.  Must be a
+                              power of two (up to 32768).
+    CFG_UART_TXBUFSIZE        The length in bytes of the UART TX FIFO, which
+                              is emptied into the UART by the THRE interrupt
+                              so that uartSend and printf don't have to wait
+                              for every character to go out.  Must be a
+                              power of two.
 
     -----------------------------------------------------------------------*/
     #ifdef CFG_BRD_LPC1343_REFDESIGN
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 
     #ifdef CFG_BRD_LPC1343_REFDESIGN_MINIMAL
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 
     #ifdef CFG_BRD_LPC1343_TFTLCDSTANDALONE_USB
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 
     #ifdef CFG_BRD_LPC1343_TFTLCDSTANDALONE_UART
       #define CFG_UART_BAUDRATE           (57600)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 
     #ifdef CFG_BRD_LPC1343_802154USBSTICK
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 	
     #ifdef CFG_BRD_LPC1343_OLIMEX_P
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 
     #ifdef CFG_BRD_LPC1343_LPCXPRESSO
       #define CFG_UART_BAUDRATE           (115200)
       #define CFG_UART_BUFSIZE            (512)
+      #define CFG_UART_TXBUFSIZE          (128)
     #endif
 /*=========================================================================*/
 
@@ -602,19 +618,81 @@
 
     CFG_USBHID                If this field is defined USB HID support will
                               be included.  Currently uses ROM-based USB HID
+    CFG_USBHID_INTERVAL       HID endpoint polling interval in ms (1..255).
+                              One report is sent per poll: the oldest
+                              queued event (see usbHIDQueueReport), or a
+                              GPIO/ADC status report when nothing is
+                              queued.
+    CFG_USBHID_REPORTSIZE     Size in bytes of every HID input report,
+                              including the 12 byte header described in
+                              usbhid.h.  Between 32 and 64.
+    CFG_USBHID_QUEUESIZE      Number of events that can be waiting to be
+                              sent.  Must be a power of two (up to 128).
     CFG_USBCDC                If this field is defined USB CDC support will
                               be included, with the USB Serial Port speed
                               set to 115200 BPS by default
     CFG_USBCDC_BAUDRATE       The default TX/RX speed.  This value is used 
                               when initialising USBCDC, and should be a 
                               standard value like 57600, 9600, etc.
-    CFG_USBCDC_INITTIMEOUT    The maximum delay in milliseconds to wait for
-                              USB to connect.  Must be a multiple of 10!
+    CFG_USBCDC_INITTIMEOUT    The maximum delay in milliseconds that
+                              systemInit waits for the host to configure
+                              the device.  Must be a multiple of 10!  With
+                              0 startup continues immediately: printf
+                              output is buffered (up to
+                              CFG_USBCDC_BUFFERSIZE bytes) until the
+                              device is configured.  Use
+                              USB_SetConfigCallback to be told when that
+                              happens.
     CFG_USBCDC_BUFFERSIZE     Size of the buffer (in bytes) that stores
                               printf data until it can be sent out in
-                              64 byte frames.  The buffer is required since
-                              only one frame per ms can be sent using USB
-                              CDC (see 'puts' in systeminit.c).
+                              64 byte packets.  The buffer is emptied by
+                              the USB ISR each time the previous packet
+                              has been sent (see CDC_BulkIn in cdcuser.c).
+                              Must be a power of two.
+    CFG_USBCDC_RXBUFFERSIZE   Size of the buffer (in bytes) that stores
+                              incoming data until the application reads
+                              it (see CDC_RdOutBufLen).  When there isn't
+                              room for a full 64 byte packet the host is
+                              held off (NAKed) until data is read, so no
+                              data is lost.  Must be a power of two and at
+                              least 64.
+    CFG_USBCDC_HID            If this field is defined (along with
+                              CFG_USBCDC) a HID interface is added to the
+                              CDC device, which then enumerates as a
+                              composite device (the CDC interfaces are
+                              grouped with an Interface Association
+                              Descriptor).  Input reports are queued with
+                              HID_QueueReport (see hiduser.c) and the last
+                              output report is read with HID_GetOutReport.
+                              Touchscreen and joystick events are sent
+                              automatically (see HID_EVENT_TOUCH in
+                              hiduser.h).
+    CFG_USBCDC_HIDINTERVAL    The HID endpoint polling interval in ms.  A
+                              report queued while the endpoint is idle
+                              reaches the host within this delay.
+    CFG_USBCDC_HIDREPORTSIZE  Size in bytes of the HID input report (1..64)
+    CFG_USBCDC_HIDQUEUESIZE   Number of input reports that can be waiting
+                              to be sent.  Must be a power of two (up to
+                              128).
+    CFG_USBMSC                If this field is defined the device will
+                              enumerate as a USB Mass Storage device
+                              (Bulk-Only Transport, SCSI commands)
+                              exposing the SD card and/or SPI flash to
+                              the host.  The media is accessed from
+                              MSC_Poll, which must be called from the
+                              main loop (see main.c).  Uses the same USB
+                              stack as CFG_USBCDC, so only one of them
+                              can be defined.
+    CFG_USBMSC_READONLY       If this is set to 1 the host can read the
+                              exposed media but not write to it.
+    CFG_USBMSC_SPIFLASH       If this field is defined the W25Q16BV SPI
+                              flash is exposed as an extra LUN (after the
+                              SD card, if CFG_SDCARD is defined) using
+                              4096 byte blocks, one per erase sector.
+                              Note that mmc.c and the W25Q16BV driver both
+                              use P0.2 as CS, so one of them will need to
+                              be moved to another pin if both devices are
+                              fitted on the same board.
 
     -----------------------------------------------------------------------*/
     #define CFG_USB_VID                   (0x239A)
@@ -622,58 +700,135 @@
 	
     #ifdef CFG_BRD_LPC1343_REFDESIGN
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 
     #ifdef CFG_BRD_LPC1343_REFDESIGN_MINIMAL
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       // #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 
     #ifdef CFG_BRD_LPC1343_TFTLCDSTANDALONE_USB
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 
     #ifdef CFG_BRD_LPC1343_TFTLCDSTANDALONE_UART
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       // #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (57600)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 
     #ifdef CFG_BRD_LPC1343_802154USBSTICK
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 	
     #ifdef CFG_BRD_LPC1343_OLIMEX_P
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif	
 
     #ifdef CFG_BRD_LPC1343_LPCXPRESSO
       // #define CFG_USBHID
+      #define CFG_USBHID_INTERVAL         (32)
+      #define CFG_USBHID_REPORTSIZE       (32)
+      #define CFG_USBHID_QUEUESIZE        (8)
       #define CFG_USBCDC
       #define CFG_USBCDC_BAUDRATE         (115200)
-      #define CFG_USBCDC_INITTIMEOUT      (5000)
+      #define CFG_USBCDC_INITTIMEOUT      (0)
       #define CFG_USBCDC_BUFFERSIZE       (256)
+      #define CFG_USBCDC_RXBUFFERSIZE     (256)
+      // #define CFG_USBCDC_HID
+      #define CFG_USBCDC_HIDINTERVAL      (1)
+      #define CFG_USBCDC_HIDREPORTSIZE    (8)
+      #define CFG_USBCDC_HIDQUEUESIZE     (8)
+      // #define CFG_USBMSC
+      #define CFG_USBMSC_READONLY         (0)   // Must be 0 or 1
+      // #define CFG_USBMSC_SPIFLASH
     #endif
 /*=========================================================================*/
 
@@ -682,7 +837,10 @@
     PRINTF REDIRECTION
     -----------------------------------------------------------------------
 
-    CFG_PRINTF_MAXSTRINGSIZE  Maximum size of string buffer for printf
+    CFG_PRINTF_MAXSTRINGSIZE  Maximum size of string buffer for sprintf
+                              and vsprintf.  printf itself formats
+                              directly into the UART or USB CDC output
+                              and isn't limited by this value.
     CFG_PRINTF_UART           Will cause all printf statements to be 
                               redirected to UART
     CFG_PRINTF_USBCDC         Will cause all printf statements to be
@@ -1000,7 +1158,7 @@
           ===============================
           0 1 2 3 4 5 6 7 8 9 A B C D E F
     000x  x x x x x x x x . x x . . . . .   Chibi
-    001x  . . . . . . . . . . . . . . . .   
+    001x  x x x x . . . . . . . . . . . .   Chibi
     002x  x x x x . . . . . . . . . . . .   UART
     003x  x x x x x x x x x x x x x x x x   Touch Screen Calibration
     004x  x x x x x x x x x x x x x x . .   Touch Screen Calibration
@@ -1020,6 +1178,7 @@
     #define CFG_EEPROM_RESERVED                 (0x00FF)              // Protect first 256 bytes of memory
     #define CFG_EEPROM_CHIBI_IEEEADDR           (uint16_t)(0x0000)    // 8
     #define CFG_EEPROM_CHIBI_SHORTADDR          (uint16_t)(0x0009)    // 2
+    #define CFG_EEPROM_CHIBI_FRAMECNT           (uint16_t)(0x0010)    // 4
     #define CFG_EEPROM_UART_SPEED               (uint16_t)(0x0020)    // 4
     #define CFG_EEPROM_TOUCHSCREEN_CALIBRATED   (uint16_t)(0x0030)    // 1
     #define CFG_EEPROM_TOUCHSCREEN_CAL_AN       (uint16_t)(0x0031)    // 4
@@ -1061,8 +1220,76 @@
     CFG_CHIBI_PROMISCUOUS       Set to 1 to enabled promiscuous mode or
                                 0 to disable it.  If promiscuous mode is
                                 enabled be sure to set CFG_CHIBI_BUFFERSIZE
-                                to an appropriately large value (ex. 1024)
-    CFG_CHIBI_BUFFERSIZE        The size of the message buffer in bytes
+                                to an appropriately large value (ex. 1024).
+                                Promiscuous mode uses 32-bit timer 1 as a
+                                microsecond clock for frame timestamps
+    CFG_CHIBI_BUFFERSIZE        The size of the receive buffer in bytes.
+                                Incoming frames are stored in one slot
+                                per 128 bytes, so this must be a power of
+                                two multiple of 128 (ex. 256 = 2 frames).
+                                With the per frame metadata each slot
+                                takes ~150 bytes of RAM
+    CFG_CHIBI_DEFERIRQ          Where radio interrupts are processed.  0 =
+                                entirely inside the GPIO interrupt (lowest
+                                latency, but received frames are read over
+                                SPI with interrupts disabled).  1 = the
+                                GPIO interrupt only latches the event and
+                                the SPI work is done in PendSV at the
+                                lowest priority.  2 = the SPI work is done
+                                by chb_task(), which the application must
+                                call from its main loop
+    CFG_CHIBI_TXQUEUESIZE       The number of frames that can be queued with
+                                chb_write_async (must be a power of 2).
+                                Each entry takes ~112 bytes of RAM, and a
+                                write longer than 100 bytes needs one entry
+                                per 100 byte fragment
+    CFG_CHIBI_XPORT             Set to 1 to build in the fragmenting
+                                transport (chb_xport.c) for messages that
+                                don't fit in a single frame, or 0 to leave
+                                it out.  The main loop then runs it with
+                                chb_xport_task() and the 'K' command can
+                                send test messages with it
+    CFG_CHIBI_XPORT_WINDOW      The number of fragments chb_xport can send
+                                before it has to wait for an ACK (1..8).
+                                Larger windows keep the link busier, but
+                                each one costs 93 bytes of RAM per source
+                                on the receiving side
+    CFG_CHIBI_XPORT_SOURCES     The number of nodes chb_xport can receive
+                                messages from at the same time.  Each one
+                                takes CFG_CHIBI_XPORT_WINDOW x 93 bytes of
+                                RAM (plus ~12 bytes)
+    CFG_CHIBI_SECURITY          Set to 1 to encrypt and authenticate every
+                                frame (CCM* with a 32-bit MIC, using the
+                                AES engine in the AT86RF212) or 0 to send
+                                them in plaintext.  All nodes need the same
+                                setting and the same key (see chb_set_key).
+                                Secured frames carry 9 extra bytes and
+                                unsecured or replayed frames are dropped
+    CFG_CHIBI_LPL               Set to 1 to build in the duty cycled MAC
+                                (chb_lpl.c) or 0 to keep the radio on all
+                                the time.  Not with CFG_CHIBI_PROMISCUOUS
+    CFG_CHIBI_LPL_INTERVAL      Wake interval in ms at startup (0 = radio
+                                always on, can be changed at runtime).  The
+                                radio samples the channel once per interval
+                                and senders repeat their frames for a bit
+                                longer than that, so this trades the time
+                                the radio is on against the time a frame
+                                takes to get through.  All nodes should use
+                                the same interval
+    CFG_CHIBI_LPL_DEEPSLEEP     Set to 1 to put the MCU in deep sleep
+                                between samples (chb_lpl_idle) or 0 to use
+                                pmuSleep.  Deep sleep stops USB and the
+                                systick and uses CT32B0 and pin 0.1 to
+                                wake up, so it's for battery nodes only
+    CFG_CHIBI_MESH              Set to 1 to build in multi-hop forwarding
+                                (chb_mesh.c) or 0 for single hop only.
+                                Nodes relay chb_mesh_write frames for each
+                                other and find routes on demand.  Not with
+                                CFG_CHIBI_PROMISCUOUS
+    CFG_CHIBI_MESH_ROUTES       The number of destinations the route table
+                                holds (8 bytes of RAM each).  When it's
+                                full the route unused for the longest is
+                                replaced
 
     DEPENDENCIES:               Chibi requires the use of SSP0, 16-bit timer
                                 0 and pins 3.1, 3.2, 3.3.  It also requires
@@ -1079,7 +1306,18 @@
       #define CFG_CHIBI_CHANNEL           (0)                 // 868-868.6 MHz
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
-      #define CFG_CHIBI_BUFFERSIZE        (128)
+      #define CFG_CHIBI_BUFFERSIZE        (256)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif
 
     #ifdef CFG_BRD_LPC1343_REFDESIGN_MINIMAL
@@ -1089,7 +1327,18 @@
       #define CFG_CHIBI_CHANNEL           (0)                 // 868-868.6 MHz
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
-      #define CFG_CHIBI_BUFFERSIZE        (128)
+      #define CFG_CHIBI_BUFFERSIZE        (256)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif
 
     #if defined CFG_BRD_LPC1343_TFTLCDSTANDALONE_USB || defined CFG_BRD_LPC1343_TFTLCDSTANDALONE_UART
@@ -1099,7 +1348,18 @@
       #define CFG_CHIBI_CHANNEL           (0)                 // 868-868.6 MHz
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
-      #define CFG_CHIBI_BUFFERSIZE        (128)
+      #define CFG_CHIBI_BUFFERSIZE        (256)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif
 
     #ifdef CFG_BRD_LPC1343_802154USBSTICK
@@ -1110,6 +1370,17 @@
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
       #define CFG_CHIBI_BUFFERSIZE        (1024)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif
 	
     #ifdef CFG_BRD_LPC1343_OLIMEX_P
@@ -1119,7 +1390,18 @@
       #define CFG_CHIBI_CHANNEL           (0)                 // 868-868.6 MHz
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
-      #define CFG_CHIBI_BUFFERSIZE        (128)
+      #define CFG_CHIBI_BUFFERSIZE        (256)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif	
 
     #ifdef CFG_BRD_LPC1343_LPCXPRESSO
@@ -1129,7 +1411,18 @@
       #define CFG_CHIBI_CHANNEL           (0)                 // 868-868.6 MHz
       #define CFG_CHIBI_PANID             (0x1234)
       #define CFG_CHIBI_PROMISCUOUS       (0)
-      #define CFG_CHIBI_BUFFERSIZE        (128)
+      #define CFG_CHIBI_BUFFERSIZE        (256)
+      #define CFG_CHIBI_TXQUEUESIZE       (4)
+      #define CFG_CHIBI_DEFERIRQ          (1)
+      #define CFG_CHIBI_XPORT             (0)
+      #define CFG_CHIBI_XPORT_WINDOW      (4)
+      #define CFG_CHIBI_XPORT_SOURCES     (2)
+      #define CFG_CHIBI_SECURITY          (0)
+      #define CFG_CHIBI_LPL               (0)
+      #define CFG_CHIBI_LPL_INTERVAL      (250)
+      #define CFG_CHIBI_LPL_DEEPSLEEP     (0)
+      #define CFG_CHIBI_MESH              (0)
+      #define CFG_CHIBI_MESH_ROUTES       (8)
     #endif
 /*=========================================================================*/
 
@@ -1296,10 +1589,66 @@
   #error "CFG_PRINTF_CDC requires CFG_USBCDC to be defined as well"
 #endif
 
+#if defined CFG_USBCDC && (CFG_USBCDC_BUFFERSIZE & (CFG_USBCDC_BUFFERSIZE - 1)) != 0
+  #error "CFG_USBCDC_BUFFERSIZE must be a power of two"
+#endif
+
+#if defined CFG_USBCDC && ((CFG_USBCDC_RXBUFFERSIZE & (CFG_USBCDC_RXBUFFERSIZE - 1)) != 0 || CFG_USBCDC_RXBUFFERSIZE < 64)
+  #error "CFG_USBCDC_RXBUFFERSIZE must be a power of two (64 or more)"
+#endif
+
+#ifdef CFG_USBCDC_HID
+  #if !defined CFG_USBCDC
+    #error "CFG_USBCDC_HID requires CFG_USBCDC to be defined as well"
+  #endif
+  #if CFG_USBCDC_HIDINTERVAL < 1 || CFG_USBCDC_HIDINTERVAL > 255
+    #error "CFG_USBCDC_HIDINTERVAL must be between 1 and 255 (ms)"
+  #endif
+  #if CFG_USBCDC_HIDREPORTSIZE < 1 || CFG_USBCDC_HIDREPORTSIZE > 64
+    #error "CFG_USBCDC_HIDREPORTSIZE must be between 1 and 64"
+  #endif
+  #if (CFG_USBCDC_HIDQUEUESIZE & (CFG_USBCDC_HIDQUEUESIZE - 1)) != 0 || CFG_USBCDC_HIDQUEUESIZE > 128
+    #error "CFG_USBCDC_HIDQUEUESIZE must be a power of two (up to 128)"
+  #endif
+#endif
+
+#ifdef CFG_USBHID
+  #if CFG_USBHID_INTERVAL < 1 || CFG_USBHID_INTERVAL > 255
+    #error "CFG_USBHID_INTERVAL must be between 1 and 255 (ms)"
+  #endif
+  #if CFG_USBHID_REPORTSIZE < 32 || CFG_USBHID_REPORTSIZE > 64
+    #error "CFG_USBHID_REPORTSIZE must be between 32 and 64"
+  #endif
+  #if (CFG_USBHID_QUEUESIZE & (CFG_USBHID_QUEUESIZE - 1)) != 0 || CFG_USBHID_QUEUESIZE > 128
+    #error "CFG_USBHID_QUEUESIZE must be a power of two (up to 128)"
+  #endif
+#endif
+
 #if defined CFG_USBCDC && defined CFG_USBHID
   #error "Only one USB class can be defined at a time (CFG_USBCDC or CFG_USBHID)"
 #endif
 
+#if defined CFG_USBMSC && (defined CFG_USBCDC || defined CFG_USBHID)
+  #error "Only one USB class can be defined at a time (CFG_USBCDC, CFG_USBHID or CFG_USBMSC)"
+#endif
+
+#ifdef CFG_USBMSC
+  #if !defined CFG_SDCARD && !defined CFG_USBMSC_SPIFLASH
+    #error "CFG_USBMSC requires CFG_SDCARD and/or CFG_USBMSC_SPIFLASH to be defined"
+  #endif
+  #if CFG_USBMSC_READONLY != 0 && CFG_USBMSC_READONLY != 1
+    #error "CFG_USBMSC_READONLY must be equal to either 1 or 0"
+  #endif
+#endif
+
+#if (CFG_UART_BUFSIZE & (CFG_UART_BUFSIZE - 1)) != 0 || CFG_UART_BUFSIZE > 32768
+  #error "CFG_UART_BUFSIZE must be a power of two (up to 32768)"
+#endif
+
+#if (CFG_UART_TXBUFSIZE & (CFG_UART_TXBUFSIZE - 1)) != 0
+  #error "CFG_UART_TXBUFSIZE must be a power of two"
+#endif
+
 #if defined CFG_SSP0_SCKPIN_2_11 && defined CFG_SSP0_SCKPIN_0_6
   #error "Only one SCK pin can be defined at a time for SSP0"
 #endif
@@ -1324,6 +1673,9 @@
   #ifdef CFG_SDCARD
     #error "CFG_CHIBI and CFG_SDCARD can not be defined at the same time. Only one SPI block is available on the LPC1343."
   #endif
+  #if defined CFG_USBMSC && defined CFG_USBMSC_SPIFLASH
+    #error "CFG_CHIBI and CFG_USBMSC_SPIFLASH can not be defined at the same time. Only one SPI block is available on the LPC1343."
+  #endif
   #ifdef CFG_TFTLCD
     #error "CFG_CHIBI and CFG_TFTLCD can not be defined at the same time since they both use pins 1.8, 1.9 and 1.10."
   #endif
@@ -1336,6 +1688,51 @@
   #if !defined GPIO_ENABLE_IRQ1
     #error "GPIO_ENABLE_IRQ1 must be enabled when using Chibi (Chibi IRQ is on GPIO1.8)"
   #endif
+  #if CFG_CHIBI_BUFFERSIZE < 128 || ((CFG_CHIBI_BUFFERSIZE / 128) & ((CFG_CHIBI_BUFFERSIZE / 128) - 1)) != 0 || CFG_CHIBI_BUFFERSIZE > 16384
+    #error "CFG_CHIBI_BUFFERSIZE must be 128 times a power of two (ex. 256, 512, 1024)"
+  #endif
+  #if CFG_CHIBI_DEFERIRQ < 0 || CFG_CHIBI_DEFERIRQ > 2
+    #error "CFG_CHIBI_DEFERIRQ must be 0, 1 or 2"
+  #endif
+  #if CFG_CHIBI_TXQUEUESIZE < 1 || (CFG_CHIBI_TXQUEUESIZE & (CFG_CHIBI_TXQUEUESIZE - 1)) != 0 || CFG_CHIBI_TXQUEUESIZE > 128
+    #error "CFG_CHIBI_TXQUEUESIZE must be a power of two (up to 128)"
+  #endif
+  #if CFG_CHIBI_XPORT != 0 && CFG_CHIBI_XPORT != 1
+    #error "CFG_CHIBI_XPORT must be equal to either 1 or 0"
+  #endif
+  #if CFG_CHIBI_XPORT_WINDOW < 1 || CFG_CHIBI_XPORT_WINDOW > 8
+    #error "CFG_CHIBI_XPORT_WINDOW must be between 1 and 8"
+  #endif
+  #if CFG_CHIBI_XPORT_SOURCES < 1
+    #error "CFG_CHIBI_XPORT_SOURCES must be at least 1"
+  #endif
+  #if CFG_CHIBI_SECURITY != 0 && CFG_CHIBI_SECURITY != 1
+    #error "CFG_CHIBI_SECURITY must be equal to either 1 or 0"
+  #endif
+  #if CFG_CHIBI_LPL != 0 && CFG_CHIBI_LPL != 1
+    #error "CFG_CHIBI_LPL must be equal to either 1 or 0"
+  #endif
+  #if CFG_CHIBI_LPL == 1 && CFG_CHIBI_PROMISCUOUS == 1
+    #error "CFG_CHIBI_LPL can not be used in promiscuous mode (a sniffer has to listen all the time)"
+  #endif
+  #if CFG_CHIBI_LPL_INTERVAL < 0 || CFG_CHIBI_LPL_INTERVAL > 65535
+    #error "CFG_CHIBI_LPL_INTERVAL must be between 0 and 65535 ms"
+  #endif
+  #if CFG_CHIBI_LPL_DEEPSLEEP != 0 && CFG_CHIBI_LPL_DEEPSLEEP != 1
+    #error "CFG_CHIBI_LPL_DEEPSLEEP must be equal to either 1 or 0"
+  #endif
+  #if CFG_CHIBI_LPL_DEEPSLEEP == 1 && defined CFG_USBCDC
+    #error "CFG_CHIBI_LPL_DEEPSLEEP stops USB, so it can't be used with CFG_USBCDC"
+  #endif
+  #if CFG_CHIBI_MESH != 0 && CFG_CHIBI_MESH != 1
+    #error "CFG_CHIBI_MESH must be equal to either 1 or 0"
+  #endif
+  #if CFG_CHIBI_MESH == 1 && CFG_CHIBI_PROMISCUOUS == 1
+    #error "CFG_CHIBI_MESH can not be used in promiscuous mode"
+  #endif
+  #if CFG_CHIBI_MESH_ROUTES < 1 || CFG_CHIBI_MESH_ROUTES > 255
+    #error "CFG_CHIBI_MESH_ROUTES must be between 1 and 255"
+  #endif
 #endif
 
 #ifdef CFG_TFTLCD
@@ -63,7 +63,6 @@
 #endif
 
 #ifdef CFG_USBCDC
-  volatile unsigned int lastTick;
   #include "core/usbcdc/usb.h"
   #include "core/usbcdc/usbcore.h"
   #include "core/usbcdc/usbhw.h"
@@ -71,6 +70,12 @@
   #include "core/usbcdc/cdc_buf.h"
 #endif
 
+#ifdef CFG_USBMSC
+  #include "core/usbcdc/usb.h"
+  #include "core/usbcdc/usbhw.h"
+  #include "core/usbmsc/mscuser.h"
+#endif
+
 #ifdef CFG_ST7565
   #include "drivers/displays/bitmap/st7565/st7565.h"
   #include "drivers/displays/smallfonts.h"
@@ -153,7 +158,7 @@ void systemInit()
   #ifdef CFG_PRINTF_UART
     #ifdef CFG_I2CEEPROM
       uint32_t uart = eepromReadU32(CFG_EEPROM_UART_SPEED);
-      if ((uart == 0xFFFFFFFF) || (uart > 115200))
+      if ((uart < 9600) || (uart > UART_MAXBAUDRATE))
       {
         uartInit(CFG_UART_BAUDRATE);  // Use default baud rate
       }
@@ -178,18 +183,28 @@ void systemInit()
 
   // Initialise USB CDC
   #ifdef CFG_USBCDC
-    lastTick = systickGetTicks();   // Used to control output/printf timing
     CDC_Init();                     // Initialise VCOM
     USB_Init();                     // USB Initialization
     USB_Connect(TRUE);              // USB Connect
-    // Wait until USB is configured or timeout occurs
-    uint32_t usbTimeout = 0; 
-    while ( usbTimeout < CFG_USBCDC_INITTIMEOUT / 10 )
-    {
-      if (USB_Configuration) break;
-      systickDelay(10);             // Wait 10ms
-      usbTimeout++;
-    }
+    // Enumeration carries on in the USB ISR.  Anything printed before
+    // the host configures the device is kept in the CDC buffer and sent
+    // once it does, so there's normally no need to wait here.
+    #if CFG_USBCDC_INITTIMEOUT > 0
+      uint32_t usbTimeout = 0; 
+      while ( usbTimeout < CFG_USBCDC_INITTIMEOUT / 10 )
+      {
+        if (USB_Configuration) break;
+        systickDelay(10);           // Wait 10ms
+        usbTimeout++;
+      }
+    #endif
+  #endif
+
+  // Initialise USB Mass Storage (media access happens in MSC_Poll)
+  #ifdef CFG_USBMSC
+    MSC_Init();
+    USB_Init();
+    USB_Connect(TRUE);
   #endif
 
   // Printf can now be used with UART or USBCDC
@@ -251,6 +266,11 @@ void systemInit()
 
     @param[in]  byte
                 Byte value to send
+
+    @note When CFG_PRINTF_USBCDC is used the byte is only queued in the
+          CDC buffer, and __putflush should be called once the complete
+          string has been written to make sure that a partial packet
+          is sent.  printf and puts take care of this.
 */
 /**************************************************************************/
 void __putchar(const char c) 
@@ -259,6 +279,25 @@ void __putchar(const char c)
     // Send output to UART
     uartSendByte(c);
   #endif
+
+  #ifdef CFG_PRINTF_USBCDC
+    // Queue for the bulk IN endpoint (sent by the USB ISR)
+    CDC_WrInBuf((const uint8_t *)&c, 1);
+  #endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief Pushes out any output queued by __putchar.  This is called
+           once at the end of every printf/puts call, and returns
+           immediately (the data is sent in the background).
+*/
+/**************************************************************************/
+void __putflush(void)
+{
+  #ifdef CFG_PRINTF_USBCDC
+    CDC_BulkInStart();
+  #endif
 }
 
 /**************************************************************************/
@@ -276,34 +315,9 @@ void __putchar(const char c)
 /**************************************************************************/
 int puts(const char * str)
 {
-  // There must be at least 1ms between USB frames (of up to 64 bytes)
-  // This buffers all data and writes it out from the buffer one frame
-  // and one millisecond at a time
-  #ifdef CFG_PRINTF_USBCDC
-    if (USB_Configuration) 
-    {
-      while(*str)
-        cdcBufferWrite(*str++);
-      // Check if we can flush the buffer now or if we need to wait
-      unsigned int currentTick = systickGetTicks();
-      if (currentTick != lastTick)
-      {
-        uint8_t frame[64];
-        uint32_t bytesRead = 0;
-        while (cdcBufferDataPending())
-        {
-          // Read up to 64 bytes as long as possible
-          bytesRead = cdcBufferReadLen(frame, 64);
-          USB_WriteEP (CDC_DEP_IN, frame, bytesRead);
-          systickDelay(1);
-        }
-        lastTick = currentTick;
-      }
-    }
-  #else
-    // Handle output character by character in __putchar
-    while(*str) __putchar(*str++);
-  #endif
+  // Handle output character by character in __putchar
+  while(*str) __putchar(*str++);
+  __putflush();
 
   return 0;
 }
@@ -0,0 +1,1271 @@
+/**************************************************************************/
+/*! 
+    @file     bench.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Benchmarks for the Chibi stack running on simulated radios
+
+    Each scenario sets up a handful of nodes running the real chb.c and
+    chb_drvr.c on top of the radio model and reports what the app on
+    them saw: frames per second with the blocking and the queued write,
+    end-to-end latency (chb_write to chb_read_frame), what happens to a
+    receiver that doesn't keep up (rx buffer overflows), retries over a
+    lossy link, collisions between hidden terminals, the latency and
+    radio on time of low power listening, and route discovery, per-hop
+    latency, route repair and relaying behind a slow app of the mesh.
+
+    The binary is built once per CFG_CHIBI_BUFFERSIZE (see the Makefile).
+    Usage: chibisim_<bufsize> [seconds of simulated time per scenario]
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "projectconfig.h"
+#include "drivers/rf/chibi/chb.h"
+#include "drivers/rf/chibi/chb_drvr.h"
+#include "drivers/rf/chibi/chb_lpl.h"
+#include "drivers/rf/chibi/chb_mesh.h"
+#include "drivers/rf/chibi/chb_xport.h"
+
+#define BENCH_SEED      0x15D1
+
+// every bench frame starts with a marker, so that it's never taken for a
+// mesh frame, the time it was handed to chibi and a sequence number
+#define BENCH_MAGIC     0xBE
+#define BENCH_HDR_SZ    7
+
+// time given to the queues to drain after the senders stop
+#define BENCH_TAIL      SIM_MS(250)
+
+typedef struct
+{
+    uint32_t cnt;
+    sim_time_t min, max, sum;
+} bench_stat_t;
+
+typedef struct
+{
+    uint16_t dest;
+    bool async;
+    uint8_t len;
+    sim_time_t period;          // time between frames, 0 = back to back
+    sim_time_t start;
+    sim_time_t stop;
+
+    // results
+    uint32_t writes;
+    uint32_t qfull;
+    chb_pcb_t pcb;
+    chb_lpl_stats_t lpl;
+    chb_mesh_stats_t mesh;
+} bench_tx_t;
+
+typedef struct
+{
+    sim_time_t poll;            // app only looks at the radio this often, 0 = always
+    sim_time_t busy;            // and is then busy for this long
+
+    // results
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t lost;              // sequence gaps
+    uint16_t next_seq[SIM_MAX_NODES];
+    bool seen[SIM_MAX_NODES];
+    bench_stat_t latency;
+    sim_time_t first;           // first frame arrived at
+    sim_time_t last;
+    sim_time_t max_gap;         // longest time without a frame after the first
+    chb_pcb_t pcb;
+    chb_lpl_stats_t lpl;
+    chb_mesh_stats_t mesh;
+} bench_rx_t;
+
+typedef struct
+{
+    sim_time_t die;             // drops out of radio range at, 0 = never
+    sim_time_t hold;            // the app keeps its frames this long, 0 = reads them straight away
+    sim_time_t held;            // since when it holds the one it has
+
+    // results
+    uint32_t app_frames;        // frames for this node the app read
+    chb_mesh_stats_t mesh;
+    chb_lpl_stats_t lpl;
+} bench_relay_t;
+
+static sim_time_t bench_len = SIM_MS(2000);
+
+// wake interval the nodes use, 0 = radio always on
+static uint16_t bench_lpl;
+
+// unicast frames go through the mesh layer
+static bool bench_mesh;
+
+/**************************************************************************/
+/*!
+    Statistics
+*/
+/**************************************************************************/
+static void bench_stat_add(bench_stat_t *s, sim_time_t v)
+{
+    if ((s->cnt == 0) || (v < s->min))
+    {
+        s->min = v;
+    }
+    if ((s->cnt == 0) || (v > s->max))
+    {
+        s->max = v;
+    }
+    s->sum += v;
+    s->cnt++;
+}
+
+static void bench_stat_print(const char *name, bench_stat_t *s)
+{
+    if (s->cnt == 0)
+    {
+        printf("    %-20s n/a\n", name);
+        return;
+    }
+    printf("    %-20s min %.2f  avg %.2f  max %.2f ms\n", name,
+           s->min / 1e6, (double)s->sum / s->cnt / 1e6, s->max / 1e6);
+}
+
+/**************************************************************************/
+/*!
+    What the main loop does between two pieces of work with low power
+    listening on: sample the channel when it's due and sleep
+*/
+/**************************************************************************/
+static void bench_lpl_idle()
+{
+#if (CFG_CHIBI_DEFERIRQ == 2)
+    chb_task();
+#endif
+    chb_lpl_task();
+    chb_lpl_idle();
+}
+
+/**************************************************************************/
+/*!
+    Same for a mesh node: relay what came in, throw away anything for the
+    app and wait for the next interrupt (or duty cycle the radio)
+*/
+/**************************************************************************/
+static void bench_mesh_idle()
+{
+    chb_frame_t *frm;
+
+    chb_mesh_task();
+    while ((frm = chb_read_frame()) != NULL)
+    {
+        chb_release_frame(frm);
+    }
+    if (bench_lpl)
+    {
+        bench_lpl_idle();
+    }
+    else
+    {
+        chb_task();
+    }
+}
+
+/**************************************************************************/
+/*!
+    Sender: writes len byte frames to dest from start to stop
+*/
+/**************************************************************************/
+static void bench_tx_node(void *arg)
+{
+    bench_tx_t *tx = arg;
+    chb_pcb_t *pcb;
+    uint8_t data[CHB_MAX_PAYLOAD];
+    uint8_t handle = 0;
+    uint16_t seq = 0;
+    uint32_t usec;
+    sim_time_t next;
+
+    chb_init();
+    chb_lpl_set_interval(bench_lpl);
+    pcb = chb_get_pcb();
+    memset(data, 0xA5, sizeof(data));
+
+    next = tx->start;
+    while (sim_now() < tx->stop)
+    {
+        if (sim_now() < next)
+        {
+            if (bench_mesh)
+            {
+                bench_mesh_idle();
+            }
+            else if (bench_lpl)
+            {
+                bench_lpl_idle();
+            }
+            else
+            {
+                sim_sleep_until(next);
+            }
+            continue;
+        }
+
+        usec = sim_now() / 1000;
+        data[0] = BENCH_MAGIC;
+        memcpy(&data[1], &usec, 4);
+        memcpy(&data[5], &seq, 2);
+        if (bench_mesh)
+        {
+            // CHB_TX_PENDING means it's waiting for a route. while another
+            // frame is waiting this one is skipped.
+            if (chb_mesh_write(tx->dest, data, tx->len) == CHB_TX_QUEUE_FULL)
+            {
+                tx->qfull++;
+                next = tx->period ? next + tx->period : sim_now();
+                bench_mesh_idle();
+                continue;
+            }
+        }
+        else if (tx->async)
+        {
+            if (chb_write_async(tx->dest, data, tx->len, &handle) == CHB_TX_QUEUE_FULL)
+            {
+                tx->qfull++;
+                chb_task();
+                continue;
+            }
+        }
+        else
+        {
+            chb_write(tx->dest, data, tx->len);
+        }
+        tx->writes++;
+        seq++;
+        tx->pcb = *pcb;
+        chb_lpl_get_stats(&tx->lpl);
+        next = tx->period ? next + tx->period : sim_now();
+
+        // a mesh sender skips the frames it missed while a route was found
+        // rather than sending them back to back
+        while (bench_mesh && tx->period && (next < sim_now()))
+        {
+            next += tx->period;
+        }
+    }
+
+    // let the queue drain
+    while (tx->async && tx->writes && (chb_tx_status(handle) == CHB_TX_PENDING))
+    {
+        chb_task();
+    }
+    tx->pcb = *pcb;
+
+    // keep answering route requests until the end
+    while (bench_mesh)
+    {
+        bench_mesh_idle();
+        tx->pcb = *pcb;
+        chb_mesh_get_stats(&tx->mesh);
+        chb_lpl_get_stats(&tx->lpl);
+    }
+
+    // keep the duty cycle going until the end
+    while (bench_lpl)
+    {
+        bench_lpl_idle();
+        chb_lpl_get_stats(&tx->lpl);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Receiver: reads everything that comes in, as often as the app allows
+*/
+/**************************************************************************/
+static void bench_rx_node(void *arg)
+{
+    bench_rx_t *rx = arg;
+    chb_pcb_t *pcb;
+    chb_frame_t *frm;
+    sim_node_t *src;
+    uint32_t usec;
+    uint16_t seq;
+    int id;
+
+    chb_init();
+    chb_lpl_set_interval(bench_lpl);
+    pcb = chb_get_pcb();
+
+    for (;;)
+    {
+        if (bench_mesh)
+        {
+            chb_mesh_task();
+            chb_mesh_get_stats(&rx->mesh);
+        }
+
+        while ((frm = chb_read_frame()) != NULL)
+        {
+            if (rx->frames == 0)
+            {
+                rx->first = sim_now();
+            }
+            else if ((sim_now() - rx->last) > rx->max_gap)
+            {
+                rx->max_gap = sim_now() - rx->last;
+            }
+            rx->last = sim_now();
+            rx->frames++;
+            rx->bytes += frm->len;
+            if (frm->len >= BENCH_HDR_SZ)
+            {
+                memcpy(&usec, &frm->data[1], 4);
+                memcpy(&seq, &frm->data[5], 2);
+                bench_stat_add(&rx->latency, sim_now() - SIM_US(usec));
+
+                // short address n + 1 is node n
+                id = frm->src_addr - 1;
+                if (((src = sim_node_get(id)) != NULL) && (src != sim_node()))
+                {
+                    if (rx->seen[id] && (seq != rx->next_seq[id]))
+                    {
+                        rx->lost += (uint16_t)(seq - rx->next_seq[id]);
+                    }
+                    rx->seen[id] = true;
+                    rx->next_seq[id] = seq + 1;
+                }
+            }
+            chb_release_frame(frm);
+        }
+        rx->pcb = *pcb;
+        chb_lpl_get_stats(&rx->lpl);
+
+        if (rx->poll)
+        {
+            // the app is off doing something else
+            sim_sleep_until(sim_now() + rx->poll);
+            sim_delay_us(rx->busy / 1000);
+        }
+        else if (bench_lpl)
+        {
+            bench_lpl_idle();
+        }
+        else
+        {
+            chb_task();
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    A relay whose app is slow: it keeps each frame for itself lent out
+    for relay->hold before giving it back, while relaying goes on
+*/
+/**************************************************************************/
+static void bench_slow_app_idle(bench_relay_t *relay)
+{
+    chb_frame_t *frm;
+
+    chb_mesh_task();
+    if ((frm = chb_read_frame()) != NULL)
+    {
+        if (relay->held == 0)
+        {
+            relay->held = sim_now();
+        }
+        else if ((sim_now() - relay->held) >= relay->hold)
+        {
+            chb_release_frame(frm);
+            relay->app_frames++;
+            relay->held = 0;
+        }
+    }
+    chb_task();
+}
+
+/**************************************************************************/
+/*!
+    Relay: only forwards frames for the others. Once it's time for it to
+    die it drops out of range of everybody (the radio keeps running, it
+    just can't be heard any more).
+*/
+/**************************************************************************/
+static void bench_relay_node(void *arg)
+{
+    bench_relay_t *relay = arg;
+    bool dead = false;
+    int i;
+
+    chb_init();
+    chb_lpl_set_interval(bench_lpl);
+    for (;;)
+    {
+        if (relay->die && !dead && (sim_now() >= relay->die))
+        {
+            for (i=0; i<SIM_MAX_NODES; i++)
+            {
+                if (sim_node_get(i) && (i != sim_node()->id))
+                {
+                    sim_link(sim_node()->id, i, 100, 0);
+                }
+            }
+            dead = true;
+        }
+        if (relay->hold)
+        {
+            bench_slow_app_idle(relay);
+        }
+        else
+        {
+            bench_mesh_idle();
+        }
+        chb_mesh_get_stats(&relay->mesh);
+        chb_lpl_get_stats(&relay->lpl);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Run the nodes set up for a scenario. Returns the wall clock time taken.
+*/
+/**************************************************************************/
+static double bench_run(sim_time_t until)
+{
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sim_run(until);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static void bench_tx_print(const char *name, bench_tx_t *tx)
+{
+    chb_pcb_t *p = &tx->pcb;
+
+    printf("    %-20s writes %u  ok %u  no ack %u  channel busy %u  queue full %u\n",
+           name, tx->writes, p->txd_success, p->txd_noack, p->txd_channel_fail, tx->qfull);
+}
+
+static void bench_rx_print(const char *name, bench_rx_t *rx, sim_time_t len)
+{
+    printf("    %-20s frames %u (%.1f/s, %.1f kbit/s payload)  lost %u  overflow %u\n",
+           name, rx->frames, rx->frames / (len / 1e9), rx->bytes * 8 / (len / 1e6),
+           rx->lost, rx->pcb.overflow);
+}
+
+static void bench_radio_print(sim_node_t *n)
+{
+    sim_radio_stats_t *s = &n->radio.stats;
+
+    printf("    radio %-14d tx %u  acks %u  cca busy %u  rx ok %u  bad fcs %u  collided %u  missed %u\n",
+           n->id, s->tx_frames, s->tx_acks, s->cca_busy, s->rx_ok, s->rx_bad_fcs,
+           s->rx_collided, s->rx_missed);
+}
+
+/**************************************************************************/
+/*!
+    One sender, one receiver, back to back frames
+*/
+/**************************************************************************/
+static void bench_throughput(bool async, uint8_t len)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    sim_node_t *a, *b;
+    double wall;
+
+    sim_reset(BENCH_SEED);
+    tx.dest = 2;
+    tx.async = async;
+    tx.len = len;
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    a = sim_node_add(1, bench_tx_node, &tx);
+    b = sim_node_add(2, bench_rx_node, &rx);
+    wall = bench_run(tx.stop + BENCH_TAIL);
+
+    printf("throughput, %s, %u byte payload\n", async ? "chb_write_async" : "chb_write", len);
+    bench_tx_print("sender", &tx);
+    bench_rx_print("receiver", &rx, bench_len);
+    bench_stat_print("latency", &rx.latency);
+    bench_radio_print(a);
+    bench_radio_print(b);
+    printf("    %-20s %.3f s (%.0fx real time)\n\n", "wall clock", wall, (bench_len / 1e9) / wall);
+}
+
+/**************************************************************************/
+/*!
+    Latency of single frames on an idle channel
+*/
+/**************************************************************************/
+static void bench_latency(uint8_t len)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+
+    sim_reset(BENCH_SEED);
+    tx.dest = 2;
+    tx.len = len;
+    tx.period = SIM_MS(20);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    sim_node_add(1, bench_tx_node, &tx);
+    sim_node_add(2, bench_rx_node, &rx);
+    bench_run(tx.stop + BENCH_TAIL);
+
+    printf("latency, %u byte payload every 20 ms\n", len);
+    bench_rx_print("receiver", &rx, bench_len);
+    bench_stat_print("latency", &rx.latency);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Several senders bursting at a receiver whose app only drains the rx
+    buffer every poll ms
+*/
+/**************************************************************************/
+static void bench_overflow(int senders, uint32_t poll_ms)
+{
+    bench_tx_t tx[SIM_MAX_NODES - 1];
+    bench_rx_t rx = {0};
+    sim_node_t *r;
+    uint32_t writes = 0, ok = 0;
+    char name[24];
+    int i;
+
+    sim_reset(BENCH_SEED);
+    memset(tx, 0, sizeof(tx));
+    rx.poll = SIM_MS(poll_ms);
+    rx.busy = SIM_MS(1);
+    for (i=0; i<senders; i++)
+    {
+        tx[i].dest = senders + 1;
+        tx[i].async = true;
+        tx[i].len = CHB_MAX_PAYLOAD;
+        tx[i].start = SIM_MS(5);
+        tx[i].stop = tx[i].start + bench_len;
+        sim_node_add(i + 1, bench_tx_node, &tx[i]);
+    }
+    r = sim_node_add(senders + 1, bench_rx_node, &rx);
+    bench_run(SIM_MS(5) + bench_len + BENCH_TAIL);
+
+    for (i=0; i<senders; i++)
+    {
+        writes += tx[i].writes;
+        ok += tx[i].pcb.txd_success;
+    }
+    printf("overflow, %d senders, receiver reads every %u ms\n", senders, poll_ms);
+    snprintf(name, sizeof(name), "senders");
+    printf("    %-20s writes %u  acked %u\n", name, writes, ok);
+    bench_rx_print("receiver", &rx, bench_len);
+    printf("    %-20s %u (acked but dropped by the stack)\n", "not delivered", ok - rx.frames);
+    bench_radio_print(r);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Retries over a link that loses loss_pct of the frames
+*/
+/**************************************************************************/
+static void bench_lossy(int loss_pct)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    sim_node_t *a;
+
+    sim_reset(BENCH_SEED);
+    tx.dest = 2;
+    tx.len = 50;
+    tx.period = SIM_MS(10);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    a = sim_node_add(1, bench_tx_node, &tx);
+    sim_node_add(2, bench_rx_node, &rx);
+    sim_link(0, 1, loss_pct, 0);
+    bench_run(tx.stop + BENCH_TAIL);
+
+    printf("lossy link, %d%% loss, 50 byte payload every 10 ms\n", loss_pct);
+    bench_tx_print("sender", &tx);
+    bench_rx_print("receiver", &rx, bench_len);
+    printf("    %-20s %.2f per write\n", "air time used", (double)a->radio.stats.tx_frames / tx.writes);
+    bench_stat_print("latency", &rx.latency);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Two senders that can't hear each other, both sending to the node in
+    the middle
+*/
+/**************************************************************************/
+static void bench_hidden(bool collisions)
+{
+    bench_tx_t tx[2];
+    bench_rx_t rx = {0};
+    sim_node_t *r;
+    int i;
+
+    sim_reset(BENCH_SEED);
+    memset(tx, 0, sizeof(tx));
+    for (i=0; i<2; i++)
+    {
+        tx[i].dest = 3;
+        tx[i].async = true;
+        tx[i].len = CHB_MAX_PAYLOAD;
+        tx[i].start = SIM_MS(5);
+        tx[i].stop = tx[i].start + bench_len;
+        sim_node_add(i + 1, bench_tx_node, &tx[i]);
+    }
+    r = sim_node_add(3, bench_rx_node, &rx);
+    sim_link(0, 1, 100, 0);
+    sim_collisions(collisions);
+    bench_run(SIM_MS(5) + bench_len + BENCH_TAIL);
+
+    printf("hidden terminals, collisions %s\n", collisions ? "on" : "off");
+    bench_tx_print("sender 1", &tx[0]);
+    bench_tx_print("sender 2", &tx[1]);
+    bench_rx_print("receiver", &rx, bench_len);
+    bench_radio_print(r);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Low power listening: a sensor sending a short frame now and then to a
+    node that samples the channel every ival ms, as does the sensor. The
+    period isn't a multiple of the interval, so the frames fall anywhere
+    between two samples.
+*/
+/**************************************************************************/
+static void bench_lpl_print(const char *name, sim_node_t *n, chb_lpl_stats_t *s, sim_time_t len)
+{
+    double on = s->elapsed_ms ? (s->awake_ms + s->sample_ms) * 100.0 / s->elapsed_ms : 100.0;
+
+    printf("    %-20s radio on %.2f%% (%.2f%% in the model)  samples %u  woke up %u  for nothing %u\n",
+           name, on, radio_on_time(n) * 100.0 / len, s->samples, s->wakeups, s->idle_wakeups);
+}
+
+static void bench_lpl_run(uint16_t ival)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    sim_node_t *a, *b;
+    sim_time_t len = 5 * bench_len;
+
+    sim_reset(BENCH_SEED);
+    bench_lpl = ival;
+    tx.dest = 2;
+    tx.len = 20;
+    tx.period = SIM_MS(443);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + len;
+    a = sim_node_add(1, bench_tx_node, &tx);
+    b = sim_node_add(2, bench_rx_node, &rx);
+    bench_run(tx.stop + BENCH_TAIL + SIM_MS(ival));
+    bench_lpl = 0;
+
+    if (ival)
+    {
+        printf("low power listening, sampling every %u ms, 20 byte payload every 443 ms\n", ival);
+    }
+    else
+    {
+        printf("low power listening off, 20 byte payload every 443 ms\n");
+    }
+    bench_tx_print("sender", &tx);
+    bench_rx_print("receiver", &rx, len);
+    bench_stat_print("latency", &rx.latency);
+    if (tx.lpl.frames)
+    {
+        printf("    %-20s %.1f per frame\n", "copies sent", (double)tx.lpl.strobes / tx.lpl.frames);
+    }
+    bench_lpl_print("sender", a, &tx.lpl, sim_now());
+    bench_lpl_print("receiver", b, &rx.lpl, sim_now());
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Mesh forwarding: nodes in a line, each only in range of its neighbours,
+    the first one sending to the last. The first frame has to wait for a
+    route discovery; after that every frame is relayed hops - 1 times.
+*/
+/**************************************************************************/
+static void bench_mesh_print(const char *name, chb_mesh_stats_t *m)
+{
+    printf("    %-20s forwarded %u  failed %u  no route %u  hop latency ", name,
+           m->forwarded, m->fwd_fail, m->no_route);
+    if (m->forwarded)
+    {
+        printf("min %u  avg %.2f  max %u ms", m->hop_min, (double)m->hop_sum / m->forwarded, m->hop_max);
+    }
+    else
+    {
+        printf("n/a");
+    }
+    printf("  queue max %u  dropped %u  rreq %u  rrep %u  rerr %u\n",
+           m->queue_max, m->queue_drops, m->rreq_sent, m->rrep_sent, m->rerr_sent);
+}
+
+static void bench_mesh_summary(bench_tx_t *tx, bench_rx_t *rx)
+{
+    printf("    %-20s sent %u  not acked %u  routes found %u  discovery failed %u  rreq %u\n",
+           "sender", tx->mesh.sent, tx->mesh.send_fail, tx->mesh.disc_ok, tx->mesh.disc_fail,
+           tx->mesh.rreq_sent);
+    printf("    %-20s delivered %u  lost %u  rrep %u\n", "receiver",
+           rx->mesh.delivered, tx->writes - rx->frames, rx->mesh.rrep_sent);
+    if (rx->frames)
+    {
+        printf("    %-20s %.2f ms after the first write  longest gap %.2f ms\n", "first frame",
+               (rx->first - tx->start) / 1e6, rx->max_gap / 1e6);
+        bench_stat_print("end to end latency", &rx->latency);
+    }
+}
+
+static void bench_mesh_line(int hops, sim_time_t period)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    bench_relay_t relay[SIM_MAX_NODES];
+    char name[32];
+    int i, j;
+
+    sim_reset(BENCH_SEED);
+    memset(relay, 0, sizeof(relay));
+    bench_mesh = true;
+    tx.dest = hops + 1;
+    tx.len = 50;
+    tx.period = period;
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    sim_node_add(1, bench_tx_node, &tx);
+    for (i=1; i<hops; i++)
+    {
+        sim_node_add(i + 1, bench_relay_node, &relay[i]);
+    }
+    sim_node_add(hops + 1, bench_rx_node, &rx);
+    for (i=0; i<=hops; i++)
+    {
+        for (j=i+2; j<=hops; j++)
+        {
+            sim_link(i, j, 100, 0);
+        }
+    }
+    bench_run(tx.stop + BENCH_TAIL);
+    bench_mesh = false;
+
+    printf("mesh, %d hops in a line, 50 byte payload every %u ms\n", hops, (unsigned)(period / SIM_MS(1)));
+    bench_mesh_summary(&tx, &rx);
+    for (i=1; i<hops; i++)
+    {
+        sprintf(name, "relay %d", i + 1);
+        bench_mesh_print(name, &relay[i].mesh);
+    }
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Route repair: the sender reaches the receiver through one relay, or
+    the long way round through two others. Halfway through the short path
+    dies and the sender has to find the long one.
+*/
+/**************************************************************************/
+static void bench_mesh_repair()
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    bench_relay_t relay[3];
+    // node ids: 0 sender, 1 short path, 2 and 3 long path, 4 receiver
+    static const int links[][2] = {{0, 1}, {1, 4}, {0, 2}, {2, 3}, {3, 4}};
+    bool audible;
+    int i, j, k;
+
+    sim_reset(BENCH_SEED);
+    memset(relay, 0, sizeof(relay));
+    bench_mesh = true;
+    tx.dest = 5;
+    tx.len = 50;
+    tx.period = SIM_MS(50);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    relay[0].die = tx.start + bench_len / 2;
+    sim_node_add(1, bench_tx_node, &tx);
+    for (i=0; i<3; i++)
+    {
+        sim_node_add(i + 2, bench_relay_node, &relay[i]);
+    }
+    sim_node_add(5, bench_rx_node, &rx);
+    for (i=0; i<5; i++)
+    {
+        for (j=i+1; j<5; j++)
+        {
+            audible = false;
+            for (k=0; k<5; k++)
+            {
+                audible |= ((links[k][0] == i) && (links[k][1] == j));
+            }
+            if (!audible)
+            {
+                sim_link(i, j, 100, 0);
+            }
+        }
+    }
+    bench_run(tx.stop + BENCH_TAIL);
+    bench_mesh = false;
+
+    printf("mesh route repair, relay on the 2 hop path dies after %.1f s, 50 byte payload every 50 ms\n",
+           bench_len / 2e9);
+    bench_mesh_summary(&tx, &rx);
+    bench_mesh_print("relay 2 (short)", &relay[0].mesh);
+    bench_mesh_print("relay 3 (long)", &relay[1].mesh);
+    bench_mesh_print("relay 4 (long)", &relay[2].mesh);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    A relay that's also a destination, with an app that keeps each of its
+    frames for hold ms before it reads the next. The line carries a 50
+    byte frame every 50 ms past it, and a node only it can hear sends it
+    one every 500 ms.
+*/
+/**************************************************************************/
+static void bench_mesh_slow_app(int hold)
+{
+    bench_tx_t tx = {0}, tx2 = {0};
+    bench_rx_t rx = {0};
+    bench_relay_t relay[2];
+    int i, j;
+
+    sim_reset(BENCH_SEED);
+    memset(relay, 0, sizeof(relay));
+    bench_mesh = true;
+    tx.dest = 4;
+    tx.len = 50;
+    tx.period = SIM_MS(50);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + bench_len;
+    tx2.dest = 2;
+    tx2.len = 20;
+    tx2.period = SIM_MS(500);
+    tx2.start = SIM_MS(7);
+    tx2.stop = tx.stop;
+    relay[0].hold = SIM_MS(hold);
+    // node ids: 0 sender, 1 and 2 relays, 3 receiver, 4 next to 0 and 1 sends to 1
+    sim_node_add(1, bench_tx_node, &tx);
+    sim_node_add(2, bench_relay_node, &relay[0]);
+    sim_node_add(3, bench_relay_node, &relay[1]);
+    sim_node_add(4, bench_rx_node, &rx);
+    sim_node_add(5, bench_tx_node, &tx2);
+    for (i=0; i<5; i++)
+    {
+        for (j=i+1; j<5; j++)
+        {
+            if (!((j == i + 1) && (j < 4)) && !((i < 2) && (j == 4)))
+            {
+                sim_link(i, j, 100, 0);
+            }
+        }
+    }
+    bench_run(tx.stop + BENCH_TAIL);
+    bench_mesh = false;
+
+    printf("mesh, 3 hops in a line, 50 byte payload every 50 ms, relay 2 reads its own frames after %d ms\n",
+           hold);
+    bench_mesh_summary(&tx, &rx);
+    bench_mesh_print("relay 2", &relay[0].mesh);
+    bench_mesh_print("relay 3", &relay[1].mesh);
+    printf("    %-20s sent %u  read %u\n", "frames for relay 2", tx2.mesh.sent, relay[0].app_frames);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Transport: one node sending len byte messages to another with chb_xport,
+    one after the other, over a link that loses loss_pct of the frames.
+    Fragments the MAC gives up on (or that the receiver has no room for)
+    have to be recovered by the transport, either straight away when a
+    selective ACK shows the gap or after a timeout. The receiver checks
+    that every message arrives in order and intact.
+
+    With stray set, a third node sends the receiver an ordinary frame that
+    often, and the receiver's app keeps each one for BENCH_XPORT_HOLD
+    before it gives it back. The transport has to carry on behind it.
+*/
+/**************************************************************************/
+typedef struct
+{
+    uint16_t dest;
+    uint16_t len;
+    sim_time_t start;
+    sim_time_t stop;
+
+    // results
+    uint32_t msgs;
+    uint32_t failed;
+    uint32_t bytes;
+    sim_time_t last;            // last message acknowledged at
+    bench_stat_t msg_time;
+    chb_xport_stats_t stats;
+    chb_pcb_t pcb;
+} bench_xport_tx_t;
+
+typedef struct
+{
+    // results
+    uint32_t msgs;
+    uint32_t bytes;
+    uint32_t order_err;         // piece that didn't start where the last one ended
+    uint32_t data_err;          // messages with the wrong contents
+    uint32_t cut_short;         // messages that stopped before the end
+    uint32_t app_frames;        // ordinary frames the app read
+    bench_stat_t gap;           // time without progress within a message
+    chb_xport_stats_t stats;
+    chb_pcb_t pcb;
+
+    uint8_t msg_id;
+    uint16_t next;              // next offset expected, 0 = between messages
+    bool bad;
+    sim_time_t last;
+    sim_time_t held;            // the app has had a frame since, 0 = none
+} bench_xport_rx_t;
+
+#define BENCH_XPORT_HOLD    SIM_MS(100)
+
+static uint8_t bench_xport_buf[CHB_XPORT_MAX_MSG];
+static bench_xport_rx_t *bench_xport_rx;
+
+static uint8_t bench_xport_byte(uint8_t msg_id, uint16_t pos)
+{
+    return (uint8_t)(msg_id * 13 + pos * 7 + (pos >> 8));
+}
+
+static void bench_xport_tx_node(void *arg)
+{
+    bench_xport_tx_t *x = arg;
+    sim_time_t sent_at = 0;
+    uint8_t msg_id = 0;
+    uint16_t i;
+    bool busy = false;
+
+    chb_init();
+    chb_xport_reset_stats();
+    sim_sleep_until(x->start);
+
+    while (sim_now() < x->stop)
+    {
+        if (busy && (chb_xport_tx_status() != CHB_XPORT_BUSY))
+        {
+            if (chb_xport_tx_status() == CHB_XPORT_DONE)
+            {
+                x->msgs++;
+                x->bytes += x->len;
+                x->last = sim_now();
+                bench_stat_add(&x->msg_time, sim_now() - sent_at);
+            }
+            else
+            {
+                x->failed++;
+            }
+            busy = false;
+        }
+
+        // the transport sends straight out of the buffer, so the next
+        // message only goes in once the last one is done
+        if (!busy)
+        {
+            for (i=0; i<x->len; i++)
+            {
+                bench_xport_buf[i] = bench_xport_byte(msg_id, i);
+            }
+            chb_xport_send(x->dest, bench_xport_buf, x->len);
+            sent_at = sim_now();
+            msg_id++;
+            busy = true;
+        }
+
+        chb_xport_task();
+        chb_xport_get_stats(&x->stats);
+        x->pcb = *chb_get_pcb();
+        chb_task();
+    }
+
+    // keep answering until the end
+    for (;;)
+    {
+        chb_xport_task();
+        chb_task();
+    }
+}
+
+static void bench_xport_rx_cb(U16 src_addr, U8 msg_id, U16 offset, U16 total, U8 *data, U8 len)
+{
+    bench_xport_rx_t *x = bench_xport_rx;
+    U8 i;
+
+    if (offset == 0)
+    {
+        if (x->next)
+        {
+            x->cut_short++;
+        }
+        x->msg_id = msg_id;
+        x->bad = false;
+    }
+    else
+    {
+        if ((offset != x->next) || (msg_id != x->msg_id))
+        {
+            x->order_err++;
+        }
+        bench_stat_add(&x->gap, sim_now() - x->last);
+    }
+
+    for (i=0; i<len; i++)
+    {
+        if (data[i] != bench_xport_byte(msg_id, offset + i))
+        {
+            x->bad = true;
+        }
+    }
+
+    x->bytes += len;
+    x->last = sim_now();
+    x->next = offset + len;
+    if (x->next == total)
+    {
+        x->msgs++;
+        x->data_err += x->bad;
+        x->next = 0;
+    }
+}
+
+static void bench_xport_rx_node(void *arg)
+{
+    bench_xport_rx_t *x = arg;
+    chb_frame_t *frm;
+
+    chb_init();
+    chb_xport_reset_stats();
+    bench_xport_rx = x;
+    chb_xport_set_rx_cb(bench_xport_rx_cb);
+
+    for (;;)
+    {
+        chb_xport_task();
+        if ((frm = chb_read_frame()) != NULL)
+        {
+            if (x->held == 0)
+            {
+                x->held = sim_now();
+            }
+            else if ((sim_now() - x->held) >= BENCH_XPORT_HOLD)
+            {
+                chb_release_frame(frm);
+                x->app_frames++;
+                x->held = 0;
+            }
+        }
+        chb_xport_get_stats(&x->stats);
+        x->pcb = *chb_get_pcb();
+        chb_task();
+    }
+}
+
+static void bench_xport(uint16_t len, int loss_pct, int stray)
+{
+    bench_xport_tx_t tx = {0};
+    bench_xport_rx_t rx = {0};
+    bench_tx_t other = {0};
+    chb_xport_stats_t *s = &tx.stats;
+    sim_node_t *a;
+    double rate, secs;
+
+    sim_reset(BENCH_SEED);
+    tx.dest = 2;
+    tx.len = len;
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + 3 * bench_len;
+    a = sim_node_add(1, bench_xport_tx_node, &tx);
+    sim_node_add(2, bench_xport_rx_node, &rx);
+    sim_link(0, 1, loss_pct, 0);
+    if (stray)
+    {
+        other.dest = 2;
+        other.len = 20;
+        other.period = SIM_MS(stray);
+        other.start = tx.start + other.period / 2;
+        other.stop = tx.stop;
+        sim_node_add(3, bench_tx_node, &other);
+    }
+    bench_run(tx.stop + BENCH_TAIL);
+
+    rate = radio_bit_rate(a) / 1000.0;
+    secs = tx.msgs ? (tx.last - tx.start) / 1e9 : 1;
+    printf("transport, %u byte messages, %d%% loss, window %d", len, loss_pct, CHB_XPORT_WINDOW);
+    if (stray)
+    {
+        printf(", another node's frame every %d ms held by the app for %u ms",
+               stray, (unsigned)(BENCH_XPORT_HOLD / SIM_MS(1)));
+    }
+    printf("\n");
+    printf("    %-20s %u sent  %u failed  goodput %.1f kbit/s (%.1f%% of %.0f kbit/s)\n", "messages",
+           tx.msgs, tx.failed, tx.bytes * 8 / secs / 1000, tx.bytes * 8 / secs / 10 / rate, rate);
+    bench_stat_print("message time", &tx.msg_time);
+    printf("    %-20s %u sent  resent %u on sack, %u on timeout  timeouts %u  acks %u\n", "fragments",
+           s->frags_sent, s->fast_resent, s->timeout_resent, s->timeouts, s->acks_rcvd);
+    printf("    %-20s no ack %u  channel busy %u\n", "mac gave up", tx.pcb.txd_noack, tx.pcb.txd_channel_fail);
+    s = &rx.stats;
+    printf("    %-20s %u received  held %u  duplicate %u  outside window %u  acks %u\n", "receiver",
+           s->frags_rcvd, s->frags_held, s->frags_dup, s->frags_outside, s->acks_sent);
+    printf("    %-20s %u messages  out of order %u  corrupt %u  cut short %u  overflow %u\n", "delivered",
+           rx.msgs, rx.order_err, rx.data_err, rx.cut_short, rx.pcb.overflow);
+    if (stray)
+    {
+        printf("    %-20s %u sent  %u read by the app\n", "other frames", other.writes, rx.app_frames);
+    }
+    bench_stat_print("stall", &rx.gap);
+    bench_radio_print(a);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*!
+    Mesh and low power listening together: a line of duty cycled nodes,
+    the first one sending a short frame to the last now and then. Every
+    hop, and every hop of the route discovery, waits for the next node to
+    wake up.
+*/
+/**************************************************************************/
+static void bench_mesh_lpl(int hops, uint16_t ival)
+{
+    bench_tx_t tx = {0};
+    bench_rx_t rx = {0};
+    bench_relay_t relay[SIM_MAX_NODES];
+    sim_node_t *n[SIM_MAX_NODES];
+    sim_time_t len = 5 * bench_len;
+    char name[32];
+    int i, j;
+
+    sim_reset(BENCH_SEED);
+    memset(relay, 0, sizeof(relay));
+    bench_mesh = true;
+    bench_lpl = ival;
+    tx.dest = hops + 1;
+    tx.len = 20;
+    tx.period = SIM_MS(1009);
+    tx.start = SIM_MS(5);
+    tx.stop = tx.start + len;
+    n[0] = sim_node_add(1, bench_tx_node, &tx);
+    for (i=1; i<hops; i++)
+    {
+        n[i] = sim_node_add(i + 1, bench_relay_node, &relay[i]);
+    }
+    n[hops] = sim_node_add(hops + 1, bench_rx_node, &rx);
+    for (i=0; i<=hops; i++)
+    {
+        for (j=i+2; j<=hops; j++)
+        {
+            sim_link(i, j, 100, 0);
+        }
+    }
+    bench_run(tx.stop + BENCH_TAIL + SIM_MS(hops * ival));
+    bench_mesh = false;
+    bench_lpl = 0;
+
+    printf("mesh with low power listening, %d hops in a line, sampling every %u ms, 20 byte payload every 1009 ms\n",
+           hops, ival);
+    bench_mesh_summary(&tx, &rx);
+    for (i=1; i<hops; i++)
+    {
+        sprintf(name, "relay %d", i + 1);
+        bench_mesh_print(name, &relay[i].mesh);
+    }
+    bench_lpl_print("sender", n[0], &tx.lpl, sim_now());
+    for (i=1; i<hops; i++)
+    {
+        sprintf(name, "relay %d", i + 1);
+        bench_lpl_print(name, n[i], &relay[i].lpl, sim_now());
+    }
+    bench_lpl_print("receiver", n[hops], &rx.lpl, sim_now());
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        bench_len = SIM_MS(atof(argv[1]) * 1000);
+    }
+
+    printf("CFG_CHIBI_BUFFERSIZE %d, CFG_CHIBI_TXQUEUESIZE %d, CFG_CHIBI_DEFERIRQ %d, CFG_CHIBI_MODE %d\n",
+           CFG_CHIBI_BUFFERSIZE, CFG_CHIBI_TXQUEUESIZE, CFG_CHIBI_DEFERIRQ, CFG_CHIBI_MODE);
+    printf("%.1f s of simulated time per scenario\n\n", bench_len / 1e9);
+
+    bench_throughput(false, CHB_MAX_PAYLOAD);
+    bench_throughput(true, CHB_MAX_PAYLOAD);
+    bench_throughput(true, 10);
+    bench_latency(10);
+    bench_latency(CHB_MAX_PAYLOAD);
+    bench_overflow(1, 100);
+    bench_overflow(3, 100);
+    bench_overflow(3, 500);
+    bench_lossy(20);
+    bench_lossy(60);
+    bench_hidden(true);
+    bench_hidden(false);
+    bench_lpl_run(0);
+    bench_lpl_run(50);
+    bench_lpl_run(100);
+    bench_lpl_run(250);
+    bench_lpl_run(500);
+    bench_mesh_line(5, SIM_MS(50));
+    bench_mesh_line(5, SIM_MS(10));
+    bench_mesh_repair();
+    bench_mesh_lpl(3, 100);
+    bench_mesh_slow_app(200);
+    bench_xport(2048, 0, 0);
+    bench_xport(8192, 0, 0);
+    bench_xport(4096, 20, 0);
+    bench_xport(4096, 50, 0);
+    bench_xport(4096, 0, 250);
+    return 0;
+}
@@ -0,0 +1,60 @@
+/**************************************************************************/
+/*! 
+    @file     pmu.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Simulated power management (tools/chibisim)
+
+    pmuSleep waits for the next interrupt or systick. pmuDeepSleepMs
+    puts the radio to sleep like pmuSetupHW does and stops the node's
+    systick for as long as it sleeps.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef _PMU_H_
+#define _PMU_H_
+
+#include "projectconfig.h"
+
+// deep sleep doesn't power anything down in the simulator
+#define SCB_PDSLEEPCFG_IRCOUT_PD    (0)
+#define SCB_PDSLEEPCFG_IRC_PD       (0)
+#define SCB_PDSLEEPCFG_FLASH_PD     (0)
+#define SCB_PDSLEEPCFG_USBPLL_PD    (0)
+#define SCB_PDSLEEPCFG_SYSPLL_PD    (0)
+#define SCB_PDSLEEPCFG_SYSOSC_PD    (0)
+#define SCB_PDSLEEPCFG_ADC_PD       (0)
+#define SCB_PDSLEEPCFG_BOD_PD       (0)
+
+void pmuSleep(void);
+void pmuDeepSleepMs(uint32_t sleepCtrl, uint32_t wakeupMs);
+
+#endif
@@ -0,0 +1,123 @@
+/**************************************************************************/
+/*! 
+    @file     projectconfig.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Simulation config for the Chibi stack (tools/chibisim)
+
+    Takes the place of the project's projectconfig.h when the Chibi
+    sources are built for the host. The Chibi settings can be overridden
+    on the command line (ex. -DCFG_CHIBI_BUFFERSIZE=2048), and the few
+    core registers and intrinsics the driver touches are routed to the
+    simulator.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef _PROJECTCONFIG_H_
+#define _PROJECTCONFIG_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+#define CFG_CPU_CCLK                (72000000)
+#define CFG_SYSTICK_DELAY_IN_MS     (1)
+
+// eeprom layout (see the real projectconfig.h)
+#define CFG_EEPROM_CHIBI_IEEEADDR   (uint16_t)(0x0000)    // 8
+#define CFG_EEPROM_CHIBI_SHORTADDR  (uint16_t)(0x0009)    // 2
+#define CFG_EEPROM_CHIBI_FRAMECNT   (uint16_t)(0x0010)    // 4
+
+#define CFG_CHIBI
+#ifndef CFG_CHIBI_MODE
+  #define CFG_CHIBI_MODE            (0)                 // OQPSK_868MHZ
+#endif
+#define CFG_CHIBI_POWER             (0xE9)              // CHB_PWR_EU2_3DBM
+#ifndef CFG_CHIBI_CHANNEL
+  #define CFG_CHIBI_CHANNEL         (0)                 // 868-868.6 MHz
+#endif
+#define CFG_CHIBI_PANID             (0x1234)
+#ifndef CFG_CHIBI_PROMISCUOUS
+  #define CFG_CHIBI_PROMISCUOUS     (0)
+#endif
+#ifndef CFG_CHIBI_BUFFERSIZE
+  #define CFG_CHIBI_BUFFERSIZE      (1024)
+#endif
+#ifndef CFG_CHIBI_TXQUEUESIZE
+  #define CFG_CHIBI_TXQUEUESIZE     (4)
+#endif
+#ifndef CFG_CHIBI_DEFERIRQ
+  #define CFG_CHIBI_DEFERIRQ        (1)
+#endif
+#define CFG_CHIBI_XPORT             (1)
+#define CFG_CHIBI_XPORT_WINDOW      (4)
+#define CFG_CHIBI_XPORT_SOURCES     (2)
+#define CFG_CHIBI_SECURITY          (0)
+// built in, but off (interval 0) unless a benchmark sets an interval
+#define CFG_CHIBI_LPL               (1)
+#define CFG_CHIBI_LPL_INTERVAL      (0)
+#ifndef CFG_CHIBI_LPL_DEEPSLEEP
+  #define CFG_CHIBI_LPL_DEEPSLEEP   (0)
+#endif
+// only frames sent with chb_mesh_write use the mesh
+#define CFG_CHIBI_MESH              (1)
+#define CFG_CHIBI_MESH_ROUTES       (8)
+
+#define CFG_CHIBI_EEPROM_IEEEADDR   CFG_EEPROM_CHIBI_IEEEADDR
+#define CFG_CHIBI_EEPROM_SHORTADDR  CFG_EEPROM_CHIBI_SHORTADDR
+
+// Cortex-M3 core. Setting PENDSVSET pends PendSV on the node that wrote it.
+#define SCB_SYSAHBCLKDIV            (1)
+#define SCB_ICSR                    (*sim_icsr())
+#define SCB_ICSR_PENDSVSET          ((unsigned int) 0x10000000)
+#define SCB_SHPR3                   (*sim_shpr3())
+#define SCB_SHPR3_PRI_14_MASK       ((unsigned int) 0x00FF0000)
+#define SCB_SHPR3_PRI_14_LOWEST     ((unsigned int) 0x00FF0000)
+#define EINT1_IRQn                  (SIM_IRQ_EINT1)
+#define NVIC_EnableIRQ(irq)         sim_nvic_enable((irq), 1)
+#define NVIC_DisableIRQ(irq)        sim_nvic_enable((irq), 0)
+#define __disable_irq()             sim_primask(1)
+#define __enable_irq()              sim_primask(0)
+
+// pin config is accepted and ignored
+#define IOCON_COMMON_MODE_INACTIVE  (0x00)
+#define IOCON_COMMON_MODE_PULLDOWN  (0x08)
+#define IOCON_COMMON_MODE_PULLUP    (0x10)
+#define IOCON_COMMON_MODE_REPEATER  (0x18)
+#define IOCON_PIO1_8                (sim_iocon)
+#define IOCON_PIO1_9                (sim_iocon)
+#define IOCON_PIO1_10               (sim_iocon)
+#define IOCON_PIO1_11               (sim_iocon)
+
+// chb_tx and chb_write spin on chb_task(). sleep until the next interrupt
+// instead so that simulated time moves on.
+#define CHB_TASK_HOOK()             sim_wfi()
+
+#endif
@@ -0,0 +1,1233 @@
+/**************************************************************************/
+/*! 
+    @file     radio.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    AT86RF212 model and shared channel for the Chibi simulator
+
+    Register level model of the parts of the AT86RF212 that Chibi uses:
+    the SPI command set, register file, frame buffer (with RX_SAFE_MODE
+    protection), the state machine including the 110 usec PLL settling
+    from TRX_OFF, and the extended operating modes. TX_ARET does CSMA-CA
+    with random backoff, CCA, ACK wait and frame retries and reports the
+    TRAC status. RX_AACK filters on the PAN ID and short address and
+    sends the ACK after the 12 symbol turnaround. RX_START and TRX_END
+    are raised on the IRQ line.
+
+    The data rate comes from TRX_CTRL_2 (OQPSK 100/250 kbit/s, BPSK
+    20/40 kbit/s). A frame takes (6 + PHR) byte times on the air.
+
+    All radios share one channel. Every link can lose a percentage of
+    the frames sent over it (100 = out of range, not even heard by the
+    CCA) and delay them. Frames that overlap at a receiver are corrupted
+    unless collisions are turned off. The FCS is computed and checked,
+    so a corrupted frame fails the FCS like it would on the air.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "projectconfig.h"
+#include "drivers/rf/chibi/chb.h"
+#include "drivers/rf/chibi/chb_drvr.h"
+#include "drivers/rf/chibi/chb_spi.h"
+
+#define SHR_PHR_LEN     6       // preamble, SFD and PHR in byte times
+#define SHR_LEN         5
+#define BACKOFF_SYM     20      // aUnitBackoffPeriod
+#define TURNAROUND_SYM  12      // aTurnaroundTime
+#define CCA_SYM         8
+#define ACK_LEN         5       // FCF, seq, FCS
+#define TX_START_US     16
+
+#define FCF_TYPE_MASK   0x07
+#define FCF_TYPE_ACK    0x02
+#define FCF_PENDING     (1 << 4)
+
+// a frame on the air
+struct sim_tx
+{
+    sim_tx_t *next;             // list of frames still referenced
+    sim_node_t *src;
+    uint8_t channel;
+    uint8_t len;                // PHR (incl. FCS)
+    uint8_t psdu[CHB_MAX_FRAME_LENGTH];
+    sim_time_t start;
+    sim_time_t end;
+    bool aborted;               // sender was forced off half way
+    bool heard[SIM_MAX_NODES];  // made it to the node (no loss)
+    bool corrupt[SIM_MAX_NODES];// overlapped another frame at the node
+    int refs;
+};
+
+typedef struct
+{
+    uint8_t loss;               // percent. 100 = out of range
+    uint8_t ed;
+    sim_time_t delay;
+} sim_link_t;
+
+static sim_link_t links[SIM_MAX_NODES][SIM_MAX_NODES];
+static bool collisions;
+static sim_tx_t *tx_list;
+
+static void radio_goto(sim_node_t *n, uint8_t cmd);
+static void radio_csma_start(sim_node_t *n);
+
+/**************************************************************************/
+/*!
+    802.15.4 FCS (CRC-16 ITU-T, LSB first). Run over a frame including its
+    FCS the result is 0.
+*/
+/**************************************************************************/
+static uint16_t radio_crc(uint8_t *data, uint8_t len)
+{
+    uint16_t crc = 0;
+    uint8_t i;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (i=0; i<8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+/**************************************************************************/
+/*!
+    Modulation as set in TRX_CTRL_2. OQPSK has 2 symbols per byte, BPSK 8.
+*/
+/**************************************************************************/
+static sim_time_t radio_sym_ns(sim_radio_t *r)
+{
+    bool oqpsk = r->reg[TRX_CTRL_2] & (1 << 3);
+    bool sub_mode = r->reg[TRX_CTRL_2] & (1 << 2);
+
+    if (oqpsk)
+    {
+        return sub_mode ? SIM_US(16) : SIM_US(40);
+    }
+    return sub_mode ? SIM_US(25) : SIM_US(50);
+}
+
+static unsigned radio_sym_per_byte(sim_radio_t *r)
+{
+    return (r->reg[TRX_CTRL_2] & (1 << 3)) ? 2 : 8;
+}
+
+static sim_time_t radio_byte_ns(sim_radio_t *r)
+{
+    return radio_sym_ns(r) * radio_sym_per_byte(r);
+}
+
+static uint8_t radio_channel(sim_radio_t *r)
+{
+    return r->reg[PHY_CC_CCA] & 0x1f;
+}
+
+static bool radio_busy(uint8_t state)
+{
+    return (state == BUSY_RX) || (state == BUSY_TX) || (state == BUSY_RX_AACK) ||
+           (state == BUSY_TX_ARET) || (state == TRANS_IN_PROG);
+}
+
+/**************************************************************************/
+/*!
+    Raise interrupt sources (the enabled ones end up in IRQ_STATUS)
+*/
+/**************************************************************************/
+static void radio_irq(sim_node_t *n, uint8_t mask)
+{
+    n->radio.irq_status |= mask & n->radio.reg[IRQ_MASK];
+    sim_irq_update(n);
+}
+
+/**************************************************************************/
+/*!
+    Frame bookkeeping. A frame is freed once the sender and every
+    receiver are done with it.
+*/
+/**************************************************************************/
+static void tx_put(sim_tx_t *tx)
+{
+    sim_tx_t **p;
+
+    if (--tx->refs > 0)
+    {
+        return;
+    }
+    for (p = &tx_list; *p; p = &(*p)->next)
+    {
+        if (*p == tx)
+        {
+            *p = tx->next;
+            break;
+        }
+    }
+    free(tx);
+}
+
+/**************************************************************************/
+/*!
+    Stop whatever the radio is doing (FORCE_TRX_OFF, reset, sleep)
+*/
+/**************************************************************************/
+static void radio_abort(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+
+    r->gen++;
+    if (r->tx)
+    {
+        r->tx->aborted = true;
+        r->tx = NULL;
+    }
+    r->rx = NULL;
+    r->wait_ack = false;
+    r->pending_cmd = CMD_NOP;
+}
+
+/**************************************************************************/
+/*!
+    Power on / reset values of the registers that matter
+*/
+/**************************************************************************/
+static void radio_defaults(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+
+    radio_abort(n);
+    memset(r->reg, 0, sizeof(r->reg));
+    r->reg[TRX_CTRL_1] = 0x22;          // TX_AUTO_CRC_ON
+    r->reg[PHY_TX_PWR] = 0x60;
+    r->reg[PHY_CC_CCA] = 0x21;
+    r->reg[CCA_THRES] = 0xC7;
+    r->reg[TRX_CTRL_2] = 0x24;
+    r->reg[PART_NUM] = CHB_AT86RF212_PART_NUM;
+    r->reg[VERSION_NUM] = CHB_AT86RF212_VER_NUM;
+    r->reg[MAN_ID_0] = 0x1F;
+    memset(&r->reg[SHORT_ADDR_0], 0xFF, 4);
+    r->reg[XAH_CTRL_0] = (CHB_MAX_FRAME_RETRIES << CHB_MAX_FRAME_RETRIES_POS) |
+                         (CHB_MAX_CSMA_RETRIES << CHB_MAX_CSMA_RETIRES_POS);
+    r->reg[CSMA_SEED_1] = 0x42;
+    r->reg[CSMA_BE] = (CHB_MAX_BE << 4) | CHB_MIN_BE;
+
+    if (r->state == SLEEP)
+    {
+        r->on_since = sim_now();
+    }
+    r->state = TRX_OFF;
+    r->cmd = CMD_NOP;
+    r->trac = TRAC_SUCCESS;
+    r->irq_status = 0;
+    r->fb_protected = false;
+    r->fb_len = 0;
+    sim_irq_update(n);
+}
+
+void radio_reset(sim_node_t *n)
+{
+    radio_defaults(n);
+}
+
+/**************************************************************************/
+/*!
+    Apply a state change that came in while the radio was busy
+*/
+/**************************************************************************/
+static void radio_resume(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+    uint8_t cmd = r->pending_cmd;
+
+    if (cmd != CMD_NOP)
+    {
+        r->pending_cmd = CMD_NOP;
+        radio_goto(n, cmd);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Put a frame on the air and schedule its arrival at every node in
+    range. len is the PHR, psdu includes the FCS.
+*/
+/**************************************************************************/
+static sim_tx_t *medium_tx(sim_node_t *src, uint8_t *psdu, uint8_t len);
+
+static void medium_rx_start(sim_node_t *n, void *arg, uint32_t gen);
+static void medium_rx_end(sim_node_t *n, void *arg, uint32_t gen);
+
+static sim_tx_t *medium_tx(sim_node_t *src, uint8_t *psdu, uint8_t len)
+{
+    sim_radio_t *r = &src->radio;
+    sim_tx_t *tx = calloc(1, sizeof(sim_tx_t));
+    sim_link_t *link;
+    sim_node_t *m;
+    int i;
+
+    tx->src = src;
+    tx->channel = radio_channel(r);
+    tx->len = len;
+    memcpy(tx->psdu, psdu, len);
+    tx->start = sim_now();
+    tx->end = tx->start + (SHR_PHR_LEN + len) * radio_byte_ns(r);
+    tx->refs = 1;
+    tx->next = tx_list;
+    tx_list = tx;
+
+    for (i=0; (m = sim_node_get(i)) != NULL; i++)
+    {
+        link = &links[src->id][i];
+        if ((m == src) || (link->loss >= 100))
+        {
+            continue;
+        }
+        tx->heard[i] = (sim_rand() % 100) >= link->loss;
+        tx->refs += 2;
+        sim_at(tx->start + link->delay, medium_rx_start, m, tx, 0);
+        sim_at(tx->end + link->delay, medium_rx_end, m, tx, 0);
+    }
+    return tx;
+}
+
+/**************************************************************************/
+/*!
+    TX_ARET
+*/
+/**************************************************************************/
+static void radio_aret_done(sim_node_t *n, uint8_t trac)
+{
+    sim_radio_t *r = &n->radio;
+
+    r->trac = trac;
+    r->state = TX_ARET_ON;
+    radio_irq(n, CHB_IRQ_TRX_END_MASK);
+    radio_resume(n);
+}
+
+static void radio_ack_timeout(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+
+    if ((gen != r->gen) || !r->wait_ack)
+    {
+        return;
+    }
+    r->wait_ack = false;
+    if (r->retries < (r->reg[XAH_CTRL_0] >> CHB_MAX_FRAME_RETRIES_POS))
+    {
+        r->retries++;
+        radio_csma_start(n);
+    }
+    else
+    {
+        radio_aret_done(n, TRAC_NO_ACK);
+    }
+}
+
+static void radio_aret_sent(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    sim_tx_t *tx = arg;
+    unsigned spb = radio_sym_per_byte(r);
+
+    tx_put(tx);
+    if ((gen != r->gen) || (r->tx != tx))
+    {
+        return;
+    }
+    r->tx = NULL;
+
+    if (r->fb[0] & (1 << CHB_ACK_REQ_POS))
+    {
+        // macAckWaitDuration
+        r->wait_ack = true;
+        r->ack_seq = r->fb[2];
+        sim_at(sim_now() + (BACKOFF_SYM + TURNAROUND_SYM + (SHR_LEN + 6) * spb) * radio_sym_ns(r),
+               radio_ack_timeout, n, NULL, r->gen);
+    }
+    else
+    {
+        radio_aret_done(n, TRAC_SUCCESS);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Send the frame buffer. The FCS is added if TX_AUTO_CRC_ON is set,
+    otherwise whatever is in the buffer goes out.
+*/
+/**************************************************************************/
+static sim_tx_t *radio_send(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+    uint8_t len = r->fb_len & 0x7f;
+    uint16_t fcs;
+
+    if (len < 2)
+    {
+        len = 2;
+    }
+    if (r->reg[TRX_CTRL_1] & (1 << CHB_AUTO_CRC_POS))
+    {
+        fcs = radio_crc(r->fb, len - 2);
+        r->fb[len - 2] = fcs & 0xFF;
+        r->fb[len - 1] = fcs >> 8;
+    }
+    r->fb_protected = false;
+    r->stats.tx_frames++;
+    r->tx = medium_tx(n, r->fb, len);
+    return r->tx;
+}
+
+static void radio_aret_tx(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+
+    if (gen != r->gen)
+    {
+        return;
+    }
+    radio_send(n);
+    sim_at(r->tx->end, radio_aret_sent, n, r->tx, r->gen);
+}
+
+static void radio_cca(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+
+    if (gen != r->gen)
+    {
+        return;
+    }
+
+    // busy if anything was heard during the 8 symbols
+    if (r->air_cnt || (r->air_quiet + CCA_SYM * radio_sym_ns(r) > sim_now()))
+    {
+        r->stats.cca_busy++;
+        if (++r->nb > ((r->reg[XAH_CTRL_0] >> CHB_MAX_CSMA_RETIRES_POS) & 0x7))
+        {
+            radio_aret_done(n, TRAC_CHANNEL_ACCESS_FAIL);
+            return;
+        }
+        if (r->be < (r->reg[CSMA_BE] >> 4))
+        {
+            r->be++;
+        }
+        sim_at(sim_now() + ((sim_rand() % (1 << r->be)) * BACKOFF_SYM + CCA_SYM) * radio_sym_ns(r),
+               radio_cca, n, NULL, r->gen);
+        return;
+    }
+    radio_aret_tx(n, NULL, gen);
+}
+
+static void radio_csma_start(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+
+    // MAX_CSMA_RETRIES = 7: straight out without CSMA-CA, after the PLL_ON
+    // to BUSY_TX delay
+    if (((r->reg[XAH_CTRL_0] >> CHB_MAX_CSMA_RETIRES_POS) & 0x7) == 7)
+    {
+        sim_at(sim_now() + SIM_US(TX_START_US), radio_aret_tx, n, NULL, r->gen);
+        return;
+    }
+
+    r->nb = 0;
+    r->be = r->reg[CSMA_BE] & 0x0f;
+    sim_at(sim_now() + ((sim_rand() % (1 << r->be)) * BACKOFF_SYM + CCA_SYM) * radio_sym_ns(r),
+           radio_cca, n, NULL, r->gen);
+}
+
+/**************************************************************************/
+/*!
+    Basic mode TX (TX_START in PLL_ON)
+*/
+/**************************************************************************/
+static void radio_basic_sent(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    sim_tx_t *tx = arg;
+
+    tx_put(tx);
+    if ((gen != r->gen) || (r->tx != tx))
+    {
+        return;
+    }
+    r->tx = NULL;
+    r->state = PLL_ON;
+    radio_irq(n, CHB_IRQ_TRX_END_MASK);
+    radio_resume(n);
+}
+
+/**************************************************************************/
+/*!
+    RX_AACK: the ACK goes out after the turnaround time
+*/
+/**************************************************************************/
+static void radio_ack_sent(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    sim_tx_t *tx = arg;
+
+    tx_put(tx);
+    if ((gen != r->gen) || (r->tx != tx))
+    {
+        return;
+    }
+    r->tx = NULL;
+    r->state = RX_AACK_ON;
+    radio_resume(n);
+}
+
+static void radio_ack_tx(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    uint8_t ack[ACK_LEN];
+    uint16_t fcs;
+
+    if (gen != r->gen)
+    {
+        return;
+    }
+    ack[0] = FCF_TYPE_ACK;
+    ack[1] = 0;
+    ack[2] = (uint8_t)(uintptr_t)arg;
+    fcs = radio_crc(ack, 3);
+    ack[3] = fcs & 0xFF;
+    ack[4] = fcs >> 8;
+
+    r->stats.tx_acks++;
+    r->tx = medium_tx(n, ack, ACK_LEN);
+    sim_at(r->tx->end, radio_ack_sent, n, r->tx, r->gen);
+}
+
+/**************************************************************************/
+/*!
+    RX_AACK frame filter: data, command and beacon frames of an accepted
+    frame version, addressed to our short address (or broadcast) on our
+    PAN (or the broadcast PAN)
+*/
+/**************************************************************************/
+static bool radio_filter(sim_radio_t *r, uint8_t *psdu, uint8_t len)
+{
+    uint8_t type = psdu[0] & FCF_TYPE_MASK;
+    uint8_t ver = (psdu[1] >> 4) & 0x3;
+    uint8_t fvn = r->reg[CSMA_SEED_1] >> CHB_FVN_POS;
+    uint16_t pan, dest;
+
+    if ((len < ACK_LEN) || (type == FCF_TYPE_ACK) || (type > 3) || ((fvn < 3) && (ver > fvn)))
+    {
+        return false;
+    }
+
+    // only short destination addresses are modelled
+    if (((psdu[1] >> 2) & 0x3) != 2)
+    {
+        return false;
+    }
+    pan = psdu[3] | (psdu[4] << 8);
+    dest = psdu[5] | (psdu[6] << 8);
+    if ((pan != 0xFFFF) && (pan != (r->reg[PAN_ID_0] | (r->reg[PAN_ID_1] << 8))))
+    {
+        return false;
+    }
+    return (dest == 0xFFFF) || (dest == (r->reg[SHORT_ADDR_0] | (r->reg[SHORT_ADDR_1] << 8)));
+}
+
+/**************************************************************************/
+/*!
+    A frame we were locked on to has ended
+*/
+/**************************************************************************/
+static void radio_rx_done(sim_node_t *n, sim_tx_t *tx)
+{
+    sim_radio_t *r = &n->radio;
+    uint16_t dest;
+    bool ok;
+
+    r->rx = NULL;
+    r->fb_len = tx->len;
+    memcpy(r->fb, tx->psdu, tx->len);
+    if (tx->corrupt[n->id] || tx->aborted)
+    {
+        r->fb[sim_rand() % tx->len] ^= 1 << (sim_rand() % 8);
+        if (tx->corrupt[n->id])
+        {
+            r->stats.rx_collided++;
+        }
+    }
+    ok = (radio_crc(r->fb, r->fb_len) == 0);
+    if (ok)
+    {
+        r->stats.rx_ok++;
+    }
+    else
+    {
+        r->stats.rx_bad_fcs++;
+    }
+    r->crc = ok;
+    r->ed = links[tx->src->id][n->id].ed;
+    r->lqi = ok ? 0xFF : 0x30;
+
+    if (r->state == BUSY_RX)
+    {
+        r->state = RX_ON;
+    }
+    else
+    {
+        if (!ok || !radio_filter(r, r->fb, r->fb_len))
+        {
+            r->state = RX_AACK_ON;
+            radio_resume(n);
+            return;
+        }
+
+        // ACK unicast frames that ask for it
+        dest = r->fb[5] | (r->fb[6] << 8);
+        if ((r->fb[0] & (1 << CHB_ACK_REQ_POS)) && (dest != 0xFFFF))
+        {
+            sim_at(sim_now() + TURNAROUND_SYM * radio_sym_ns(r), radio_ack_tx, n, (void *)(uintptr_t)r->fb[2], r->gen);
+        }
+        else
+        {
+            r->state = RX_AACK_ON;
+        }
+    }
+
+    if (r->reg[TRX_CTRL_2] & (1 << CHB_RX_SAFE_MODE_POS))
+    {
+        r->fb_protected = true;
+    }
+    radio_irq(n, CHB_IRQ_TRX_END_MASK);
+    if (!radio_busy(r->state))
+    {
+        radio_resume(n);
+    }
+}
+
+static void radio_rx_start_irq(sim_node_t *n, void *arg, uint32_t gen)
+{
+    if ((gen == n->radio.gen) && (n->radio.rx == arg))
+    {
+        radio_irq(n, CHB_IRQ_RX_START_MASK);
+    }
+}
+
+/**************************************************************************/
+/*!
+    A frame becomes audible at node n
+*/
+/**************************************************************************/
+static void medium_rx_start(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    sim_tx_t *tx = arg;
+    int i;
+
+    if (tx->channel != radio_channel(r))
+    {
+        return;
+    }
+
+    // overlapping frames ruin each other
+    if (collisions)
+    {
+        for (i=0; i<r->air_cnt; i++)
+        {
+            r->air[i]->corrupt[n->id] = true;
+            tx->corrupt[n->id] = true;
+        }
+    }
+    if (r->air_cnt < SIM_AIR_MAX)
+    {
+        r->air[r->air_cnt++] = tx;
+    }
+
+    if (!tx->heard[n->id])
+    {
+        return;
+    }
+    if (((r->state != RX_ON) && (r->state != RX_AACK_ON)) || r->fb_protected || !n->rst)
+    {
+        // the ACK we're waiting for is picked up by TX_ARET
+        if (!r->wait_ack)
+        {
+            r->stats.rx_missed++;
+        }
+        return;
+    }
+
+    // lock on. RX_START comes after the SHR and PHR
+    r->rx = tx;
+    r->state = (r->state == RX_ON) ? BUSY_RX : BUSY_RX_AACK;
+    sim_at(sim_now() + SHR_PHR_LEN * radio_byte_ns(r), radio_rx_start_irq, n, tx, r->gen);
+}
+
+/**************************************************************************/
+/*!
+    A frame has ended at node n
+*/
+/**************************************************************************/
+static void medium_rx_end(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+    sim_tx_t *tx = arg;
+    int i;
+
+    for (i=0; i<r->air_cnt; i++)
+    {
+        if (r->air[i] == tx)
+        {
+            r->air[i] = r->air[--r->air_cnt];
+            if (r->air_cnt == 0)
+            {
+                r->air_quiet = sim_now();
+            }
+            break;
+        }
+    }
+
+    if (r->wait_ack && tx->heard[n->id] && !tx->corrupt[n->id] && (tx->channel == radio_channel(r)) &&
+        (tx->len == ACK_LEN) && ((tx->psdu[0] & FCF_TYPE_MASK) == FCF_TYPE_ACK) &&
+        (tx->psdu[2] == r->ack_seq) && (radio_crc(tx->psdu, tx->len) == 0))
+    {
+        r->wait_ack = false;
+        r->gen++;
+        radio_aret_done(n, (tx->psdu[0] & FCF_PENDING) ? TRAC_SUCCESS_DATA_PENDING : TRAC_SUCCESS);
+    }
+    else if (r->rx == tx)
+    {
+        radio_rx_done(n, tx);
+    }
+    tx_put(tx);
+}
+
+/**************************************************************************/
+/*!
+    State changes
+*/
+/**************************************************************************/
+static void radio_settled(sim_node_t *n, void *arg, uint32_t gen)
+{
+    sim_radio_t *r = &n->radio;
+
+    if (gen != r->gen)
+    {
+        return;
+    }
+    r->state = (uint8_t)(uintptr_t)arg;
+    radio_resume(n);
+}
+
+static void radio_goto(sim_node_t *n, uint8_t cmd)
+{
+    sim_radio_t *r = &n->radio;
+
+    switch (cmd)
+    {
+    case CMD_TX_START:
+        if (r->state == TX_ARET_ON)
+        {
+            r->state = BUSY_TX_ARET;
+            r->retries = 0;
+            radio_csma_start(n);
+        }
+        else if (r->state == PLL_ON)
+        {
+            r->state = BUSY_TX;
+            radio_send(n);
+            sim_at(r->tx->end, radio_basic_sent, n, r->tx, r->gen);
+        }
+        break;
+
+    case CMD_TRX_OFF:
+        r->gen++;
+        r->state = TRX_OFF;
+        r->fb_protected = false;
+        break;
+
+    case CMD_PLL_ON:
+    case CMD_RX_ON:
+    case CMD_RX_AACK_ON:
+    case CMD_TX_ARET_ON:
+        // the command values are the states they lead to
+        r->gen++;
+        if ((cmd == CMD_PLL_ON) || (cmd == CMD_TX_ARET_ON))
+        {
+            r->fb_protected = false;
+        }
+        if (r->state == TRX_OFF)
+        {
+            r->state = TRANS_IN_PROG;
+            sim_at(sim_now() + SIM_US(TIME_TRX_OFF_PLL_ON), radio_settled, n, (void *)(uintptr_t)cmd, r->gen);
+        }
+        else
+        {
+            r->state = cmd;
+        }
+        break;
+    }
+}
+
+static void radio_cmd(sim_node_t *n, uint8_t cmd)
+{
+    sim_radio_t *r = &n->radio;
+
+    switch (cmd)
+    {
+    case CMD_NOP:
+        return;
+
+    case CMD_FORCE_TRX_OFF:
+        radio_abort(n);
+        r->state = TRX_OFF;
+        r->fb_protected = false;
+        return;
+
+    case CMD_FORCE_PLL_ON:
+        if ((r->state != TRX_OFF) && (r->state != TRANS_IN_PROG))
+        {
+            radio_abort(n);
+            r->state = PLL_ON;
+            r->fb_protected = false;
+        }
+        return;
+    }
+
+    // state changes wait for the frame to be done. TX_START is ignored
+    if (radio_busy(r->state))
+    {
+        if (cmd != CMD_TX_START)
+        {
+            r->pending_cmd = cmd;
+        }
+        return;
+    }
+    radio_goto(n, cmd);
+}
+
+/**************************************************************************/
+/*!
+    Live RSSI (3dB steps above the sensitivity, 0..28) of what's on the
+    channel, the strongest frame if several overlap. Only valid in the
+    receive states, like on the real part.
+*/
+/**************************************************************************/
+static uint8_t radio_rssi(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+    uint8_t rssi = sim_rand() & 0x1, val;
+    int i;
+
+    if ((r->state != RX_ON) && (r->state != RX_AACK_ON) &&
+        (r->state != BUSY_RX) && (r->state != BUSY_RX_AACK))
+    {
+        return 0;
+    }
+    for (i=0; i<r->air_cnt; i++)
+    {
+        val = links[r->air[i]->src->id][n->id].ed / 3;
+        if (val > rssi)
+        {
+            rssi = (val > 28) ? 28 : val;
+        }
+    }
+    return rssi;
+}
+
+/**************************************************************************/
+/*!
+    Register access
+*/
+/**************************************************************************/
+static uint8_t radio_reg_read(sim_node_t *n, uint8_t addr)
+{
+    sim_radio_t *r = &n->radio;
+    uint8_t val;
+
+    switch (addr)
+    {
+    case TRX_STATUS:
+        return r->state;
+    case TRX_STATE:
+        return (r->trac << CHB_TRAC_STATUS_POS) | r->cmd;
+    case PHY_RSSI:
+        return (r->crc << 7) | radio_rssi(n);
+    case PHY_ED_LEVEL:
+        return r->ed;
+    case IRQ_STATUS:
+        val = r->irq_status;
+        r->irq_status = 0;
+        sim_irq_update(n);
+        return val;
+    default:
+        return r->reg[addr];
+    }
+}
+
+static void radio_reg_write(sim_node_t *n, uint8_t addr, uint8_t val)
+{
+    sim_radio_t *r = &n->radio;
+
+    switch (addr)
+    {
+    case TRX_STATUS:
+    case PHY_RSSI:
+    case PHY_ED_LEVEL:
+    case IRQ_STATUS:
+    case PART_NUM:
+    case VERSION_NUM:
+    case MAN_ID_0:
+    case MAN_ID_1:
+        break;
+    case TRX_STATE:
+        r->cmd = val & 0x1f;
+        radio_cmd(n, r->cmd);
+        break;
+    case IRQ_MASK:
+        r->reg[addr] = val;
+        sim_irq_update(n);
+        break;
+    default:
+        r->reg[addr] = val;
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    SRAM access. The frame buffer starts at 0, the AES engine isn't
+    modelled (it always reports done).
+*/
+/**************************************************************************/
+static uint8_t radio_sram_read(sim_radio_t *r, uint8_t addr)
+{
+    if (addr < sizeof(r->fb))
+    {
+        return r->fb[addr];
+    }
+    return (addr == CHB_AES_STATUS) ? CHB_AES_DONE : 0;
+}
+
+static void radio_sram_write(sim_radio_t *r, uint8_t addr, uint8_t val)
+{
+    if (addr < sizeof(r->fb))
+    {
+        r->fb[addr] = val;
+    }
+}
+
+/**************************************************************************/
+/*!
+    One byte of an SPI transaction. The first byte is the command.
+*/
+/**************************************************************************/
+static uint8_t radio_spi(sim_node_t *n, uint8_t out)
+{
+    sim_radio_t *r = &n->radio;
+    unsigned idx = r->spi_idx++;
+    unsigned k;
+
+    // nothing answers while the radio is asleep, in reset or not selected
+    if (!n->rst || n->ssel || (r->state == SLEEP))
+    {
+        return 0;
+    }
+    if (idx == 0)
+    {
+        r->spi_cmd = out;
+        return 0;
+    }
+
+    if ((r->spi_cmd & 0xC0) == CHB_SPI_CMD_RR)
+    {
+        return (idx == 1) ? radio_reg_read(n, r->spi_cmd & 0x3f) : 0;
+    }
+    if ((r->spi_cmd & 0xC0) == CHB_SPI_CMD_RW)
+    {
+        if (idx == 1)
+        {
+            radio_reg_write(n, r->spi_cmd & 0x3f, out);
+        }
+        return 0;
+    }
+
+    switch (r->spi_cmd & 0xE0)
+    {
+    case CHB_SPI_CMD_FR:
+        // PHR, PSDU, LQI
+        r->spi_fb_read = true;
+        k = idx - 1;
+        if (k == 0)
+        {
+            return r->fb_len;
+        }
+        if (k <= r->fb_len)
+        {
+            return r->fb[k - 1];
+        }
+        return (k == r->fb_len + 1U) ? r->lqi : 0;
+
+    case CHB_SPI_CMD_FW:
+        if (idx == 1)
+        {
+            r->fb_len = out;
+        }
+        else if (idx - 2 < sizeof(r->fb))
+        {
+            r->fb[idx - 2] = out;
+        }
+        return 0;
+
+    case CHB_SPI_CMD_SR:
+        if (idx == 1)
+        {
+            r->spi_addr = out;
+            return 0;
+        }
+        return radio_sram_read(r, r->spi_addr++);
+
+    case CHB_SPI_CMD_SW:
+        if (idx == 1)
+        {
+            r->spi_addr = out;
+        }
+        else
+        {
+            radio_sram_write(r, r->spi_addr++, out);
+        }
+        return 0;
+    }
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    SSEL, RST and SLP_TR
+*/
+/**************************************************************************/
+static void radio_wake(sim_node_t *n, void *arg, uint32_t gen)
+{
+    if ((gen == n->radio.gen) && (n->radio.state == SLEEP))
+    {
+        n->radio.state = TRX_OFF;
+    }
+}
+
+void radio_pin(sim_node_t *n, int pin, bool val)
+{
+    sim_radio_t *r = &n->radio;
+
+    switch (pin)
+    {
+    case SIM_PIN_SSEL:
+        if (!val)
+        {
+            r->spi_idx = 0;
+            r->spi_fb_read = false;
+        }
+        else if (r->spi_fb_read)
+        {
+            // RX_SAFE_MODE: the frame has been read
+            r->fb_protected = false;
+        }
+        break;
+
+    case SIM_PIN_RST:
+        radio_defaults(n);
+        break;
+
+    case SIM_PIN_SLPTR:
+        if (val && (r->state == TRX_OFF))
+        {
+            radio_abort(n);
+            r->state = SLEEP;
+            r->stats.on_time += sim_now() - r->on_since;
+        }
+        else if (!val && (r->state == SLEEP))
+        {
+            r->on_since = sim_now();
+            sim_at(sim_now() + SIM_US(TIME_SLEEP_TO_TRX_OFF), radio_wake, n, NULL, r->gen);
+        }
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Time the radio has spent awake (out of SLEEP), counted from when it
+    was woken up, so the SLEEP to TRX_OFF transition is included
+*/
+/**************************************************************************/
+sim_time_t radio_on_time(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+
+    if (r->state == SLEEP)
+    {
+        return r->stats.on_time;
+    }
+    return r->stats.on_time + sim_now() - r->on_since;
+}
+
+/**************************************************************************/
+/*!
+    Data rate the radio is set up for, in bit/s
+*/
+/**************************************************************************/
+uint32_t radio_bit_rate(sim_node_t *n)
+{
+    return 8000000000ULL / radio_byte_ns(&n->radio);
+}
+
+/**************************************************************************/
+/*!
+    SPI driver (takes the place of chb_spi.c)
+*/
+/**************************************************************************/
+void chb_spi_init()
+{
+}
+
+U8 chb_xfer_byte(U8 data)
+{
+    sim_node_t *n = sim_node();
+    U8 val;
+
+    sim_cost(SIM_SPI_XFER_NS);
+    val = radio_spi(n, data);
+    sim_irq_poll();
+    return val;
+}
+
+void chb_xfer_block(U8 *out, U8 *in, U8 len)
+{
+    sim_node_t *n = sim_node();
+    U8 i, val;
+
+    for (i=0; i<len; i++)
+    {
+        sim_cost(SIM_SPI_BYTE_NS);
+        val = radio_spi(n, out ? out[i] : 0xFF);
+        if (in)
+        {
+            in[i] = val;
+        }
+    }
+    sim_irq_poll();
+}
+
+void chb_write_block(U8 *data, U8 len)
+{
+    sim_node_t *n = sim_node();
+    U8 i;
+
+    for (i=0; i<len; i++)
+    {
+        sim_cost(SIM_SPI_BYTE_NS);
+        radio_spi(n, data ? data[i] : 0);
+    }
+    sim_irq_poll();
+}
+
+void chb_read_block(U8 *data, U8 len)
+{
+    sim_node_t *n = sim_node();
+    U8 i, val;
+
+    for (i=0; i<len; i++)
+    {
+        sim_cost(SIM_SPI_BYTE_NS);
+        val = radio_spi(n, 0);
+        if (data)
+        {
+            data[i] = val;
+        }
+    }
+    sim_irq_poll();
+}
+
+/**************************************************************************/
+/*!
+    The shared channel
+*/
+/**************************************************************************/
+void medium_reset()
+{
+    sim_tx_t *tx;
+    int a, b;
+
+    while ((tx = tx_list) != NULL)
+    {
+        tx_list = tx->next;
+        free(tx);
+    }
+    for (a=0; a<SIM_MAX_NODES; a++)
+    {
+        for (b=0; b<SIM_MAX_NODES; b++)
+        {
+            links[a][b].loss = 0;
+            links[a][b].ed = 60;
+            links[a][b].delay = 0;
+        }
+    }
+    collisions = true;
+}
+
+/**************************************************************************/
+/*!
+    Set up the link between nodes a and b (both ways). loss_pct is the
+    share of frames that don't make it, 100 puts the nodes out of range
+    of each other.
+*/
+/**************************************************************************/
+void sim_link(int a, int b, int loss_pct, uint32_t delay_us)
+{
+    links[a][b].loss = links[b][a].loss = loss_pct;
+    links[a][b].delay = links[b][a].delay = SIM_US(delay_us);
+}
+
+/**************************************************************************/
+/*!
+    With collisions off, overlapping frames are both received intact
+*/
+/**************************************************************************/
+void sim_collisions(bool enb)
+{
+    collisions = enb;
+}
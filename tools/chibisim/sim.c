@@ -0,0 +1,796 @@
+/**************************************************************************/
+/*! 
+    @file     sim.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Scheduler and core/peripheral hooks for the Chibi simulator
+
+    Every node is a coroutine with its own stack. The scheduler always
+    resumes whichever node is furthest behind, unless an event (a frame
+    arriving, a radio timer) is due first, and lets it run at most
+    SIM_LOOKAHEAD past the next node or up to the next event. This keeps
+    everything that can affect a node's radio in time order without
+    having to stop at every instruction.
+
+    The Chibi stack keeps its state in static variables. Its objects are
+    linked with their .data and .bss renamed to chibi_data and chibi_bss
+    (see the Makefile), and those two sections are swapped out whenever
+    a different node is resumed.
+
+    Interrupts are taken at the hooks, with the same rules as the NVIC:
+    nothing while PRIMASK is set, the GPIO interrupt (radio IRQ) can
+    preempt PendSV, and PendSV only runs from thread mode.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "projectconfig.h"
+#include "core/gpio/gpio.h"
+#include "core/pmu/pmu.h"
+#include "core/systick/systick.h"
+#include "core/timer16/timer16.h"
+#include "core/timer32/timer32.h"
+#include "drivers/storage/eeprom/eeprom.h"
+#include "drivers/rf/chibi/chb_drvr.h"
+#include "drivers/rf/chibi/chb_spi.h"
+
+// event queue entry
+typedef struct
+{
+    sim_time_t t;
+    uint64_t seq;               // keeps events at the same time in order
+    sim_event_fn_t fn;
+    sim_node_t *node;
+    void *arg;
+    uint32_t gen;
+} sim_event_t;
+
+// the stack's RAM (see the Makefile). weak in case a section ends up empty
+extern uint8_t __start_chibi_data[] __attribute__((weak));
+extern uint8_t __stop_chibi_data[] __attribute__((weak));
+extern uint8_t __start_chibi_bss[] __attribute__((weak));
+extern uint8_t __stop_chibi_bss[] __attribute__((weak));
+#define DATA_SZ     ((size_t)(__stop_chibi_data - __start_chibi_data))
+#define BSS_SZ      ((size_t)(__stop_chibi_bss - __start_chibi_bss))
+
+// only defined when the driver runs its bottom half from PendSV
+extern void PendSV_Handler(void) __attribute__((weak));
+
+volatile uint32_t sim_iocon;
+
+static sim_node_t *nodes[SIM_MAX_NODES];
+static int node_cnt;
+static sim_node_t *cur;             // node that is running, NULL in the scheduler
+static sim_node_t *loaded;          // node whose RAM is in the chibi sections
+static ucontext_t sched_ctx;
+static sim_time_t clock_now;        // time of the event being processed
+static bool stop;
+static uint8_t *data_init;          // initial .data of the stack
+static uint64_t rand_state;
+
+static sim_event_t *heap;
+static int heap_cnt, heap_cap;
+static uint64_t heap_seq;
+
+/**************************************************************************/
+/*!
+    Event queue (binary heap ordered by time, then by insertion)
+*/
+/**************************************************************************/
+static bool sim_ev_before(sim_event_t *a, sim_event_t *b)
+{
+    return (a->t < b->t) || ((a->t == b->t) && (a->seq < b->seq));
+}
+
+void sim_at(sim_time_t t, sim_event_fn_t fn, sim_node_t *node, void *arg, uint32_t gen)
+{
+    sim_event_t ev = { t, heap_seq++, fn, node, arg, gen };
+    int i;
+
+    if (heap_cnt == heap_cap)
+    {
+        heap_cap = heap_cap ? heap_cap * 2 : 256;
+        heap = realloc(heap, heap_cap * sizeof(sim_event_t));
+    }
+
+    i = heap_cnt++;
+    while ((i > 0) && sim_ev_before(&ev, &heap[(i - 1) / 2]))
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = ev;
+
+    // the running node mustn't get past an event it just created
+    if (cur && (t < cur->bound))
+    {
+        cur->bound = t;
+    }
+}
+
+static sim_event_t sim_ev_pop()
+{
+    sim_event_t top = heap[0], last = heap[--heap_cnt];
+    int i = 0, c;
+
+    while ((c = 2 * i + 1) < heap_cnt)
+    {
+        if ((c + 1 < heap_cnt) && sim_ev_before(&heap[c + 1], &heap[c]))
+        {
+            c++;
+        }
+        if (!sim_ev_before(&heap[c], &last))
+        {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**************************************************************************/
+/*!
+    xorshift64*, so that runs can be repeated with the same seed
+*/
+/**************************************************************************/
+uint32_t sim_rand()
+{
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return (uint32_t)((rand_state * 2685821657736338717ULL) >> 32);
+}
+
+/**************************************************************************/
+/*!
+    Remove all nodes, events and links and start again at time 0
+*/
+/**************************************************************************/
+void sim_reset(uint64_t seed)
+{
+    int i;
+
+    // the first time round the sections still hold the initial values
+    if (!data_init)
+    {
+        data_init = malloc(DATA_SZ + 1);
+        memcpy(data_init, __start_chibi_data, DATA_SZ);
+    }
+
+    for (i=0; i<node_cnt; i++)
+    {
+        free(nodes[i]->stack);
+        free(nodes[i]->data_save);
+        free(nodes[i]->bss_save);
+        free(nodes[i]);
+    }
+    node_cnt = 0;
+    loaded = NULL;
+    heap_cnt = 0;
+    clock_now = 0;
+    stop = false;
+    rand_state = seed ? seed : 1;
+    medium_reset();
+}
+
+static void sim_entry()
+{
+    cur->fn(cur->arg);
+    cur->done = true;
+    swapcontext(&cur->ctx, &sched_ctx);
+}
+
+/**************************************************************************/
+/*!
+    Add a node. fn is its main() and runs on the node's own stack. The
+    short address is put in the node's EEPROM, where chb_init() picks it
+    up. Returns NULL when SIM_MAX_NODES are already in use.
+*/
+/**************************************************************************/
+sim_node_t *sim_node_add(uint16_t short_addr, sim_main_t fn, void *arg)
+{
+    sim_node_t *n;
+    int i;
+
+    if (node_cnt == SIM_MAX_NODES)
+    {
+        return NULL;
+    }
+
+    n = calloc(1, sizeof(sim_node_t));
+    n->id = node_cnt;
+    n->fn = fn;
+    n->arg = arg;
+    n->stack = malloc(SIM_STACK_SZ);
+    n->data_save = malloc(DATA_SZ + 1);
+    n->bss_save = calloc(1, BSS_SZ + 1);
+    memcpy(n->data_save, data_init, DATA_SZ);
+
+    // blank eeprom, then the addresses
+    memset(n->eeprom, 0xFF, sizeof(n->eeprom));
+    n->eeprom[CFG_EEPROM_CHIBI_SHORTADDR] = short_addr & 0xFF;
+    n->eeprom[CFG_EEPROM_CHIBI_SHORTADDR + 1] = short_addr >> 8;
+    for (i=0; i<8; i++)
+    {
+        n->eeprom[CFG_EEPROM_CHIBI_IEEEADDR + i] = (i < 2) ? (short_addr >> (8 * i)) : 0;
+    }
+
+    // gpioInit() has enabled the EINT interrupts in the NVIC
+    n->nvic_eint1 = true;
+    n->ssel = n->rst = true;
+    radio_reset(n);
+
+    getcontext(&n->ctx);
+    n->ctx.uc_stack.ss_sp = n->stack;
+    n->ctx.uc_stack.ss_size = SIM_STACK_SZ;
+    n->ctx.uc_link = NULL;
+    makecontext(&n->ctx, sim_entry, 0);
+
+    nodes[node_cnt++] = n;
+    return n;
+}
+
+sim_node_t *sim_node_get(int id)
+{
+    return ((id >= 0) && (id < node_cnt)) ? nodes[id] : NULL;
+}
+
+/**************************************************************************/
+/*!
+    The node that is running, or NULL outside of the nodes
+*/
+/**************************************************************************/
+sim_node_t *sim_node()
+{
+    return cur;
+}
+
+sim_time_t sim_now()
+{
+    return cur ? cur->now : clock_now;
+}
+
+/**************************************************************************/
+/*!
+    Make sim_run() return once the running node yields
+*/
+/**************************************************************************/
+void sim_stop()
+{
+    stop = true;
+}
+
+/**************************************************************************/
+/*!
+    Switch the chibi sections over to node n
+*/
+/**************************************************************************/
+static void sim_load(sim_node_t *n)
+{
+    if (loaded == n)
+    {
+        return;
+    }
+    if (loaded)
+    {
+        memcpy(loaded->data_save, __start_chibi_data, DATA_SZ);
+        memcpy(loaded->bss_save, __start_chibi_bss, BSS_SZ);
+    }
+    memcpy(__start_chibi_data, n->data_save, DATA_SZ);
+    memcpy(__start_chibi_bss, n->bss_save, BSS_SZ);
+    loaded = n;
+}
+
+/**************************************************************************/
+/*!
+    Run the simulation until the given time, until every node has
+    returned from its main() or until sim_stop() is called. Returns the
+    time reached.
+*/
+/**************************************************************************/
+sim_time_t sim_run(sim_time_t until)
+{
+    sim_node_t *n, *first;
+    sim_time_t t, t_first, t_second, t_ev;
+    sim_event_t ev;
+    int i;
+
+    while (!stop)
+    {
+        // the node that is furthest behind, and how far the next one is
+        first = NULL;
+        t_first = t_second = SIM_NEVER;
+        for (i=0; i<node_cnt; i++)
+        {
+            n = nodes[i];
+            if (n->done)
+            {
+                continue;
+            }
+            t = n->sleeping ? n->wake : n->now;
+            if (t < t_first)
+            {
+                t_second = t_first;
+                t_first = t;
+                first = n;
+            }
+            else if (t < t_second)
+            {
+                t_second = t;
+            }
+        }
+
+        t_ev = heap_cnt ? heap[0].t : SIM_NEVER;
+        if ((t_ev == SIM_NEVER) && !first)
+        {
+            break;
+        }
+
+        // events go first, so that a node never sees the radio in the past
+        if (t_ev <= t_first)
+        {
+            if (t_ev > until)
+            {
+                break;
+            }
+            ev = sim_ev_pop();
+            clock_now = ev.t;
+            ev.fn(ev.node, ev.arg, ev.gen);
+            continue;
+        }
+
+        if (t_first > until)
+        {
+            break;
+        }
+        if (first->sleeping)
+        {
+            first->sleeping = false;
+            first->now = first->wake;
+        }
+        first->bound = t_ev;
+        if ((t_second != SIM_NEVER) && (t_second + SIM_LOOKAHEAD < first->bound))
+        {
+            first->bound = t_second + SIM_LOOKAHEAD;
+        }
+
+        sim_load(first);
+        cur = first;
+        swapcontext(&sched_ctx, &first->ctx);
+        cur = NULL;
+        if (first->now > clock_now)
+        {
+            clock_now = first->now;
+        }
+    }
+
+    if (clock_now < until && !stop && (until != SIM_NEVER))
+    {
+        clock_now = until;
+    }
+    stop = false;
+    return clock_now;
+}
+
+/**************************************************************************/
+/*!
+    Hand control back to the scheduler
+*/
+/**************************************************************************/
+static void sim_yield()
+{
+    swapcontext(&cur->ctx, &sched_ctx);
+}
+
+/**************************************************************************/
+/*!
+    Advance the running node's clock. Returns once everything that was
+    due before the new time has happened.
+*/
+/**************************************************************************/
+void sim_cost(sim_time_t ns)
+{
+    cur->now += ns;
+    while ((cur->now > cur->bound) || stop)
+    {
+        sim_yield();
+    }
+}
+
+/**************************************************************************/
+/*!
+    True if node n has an interrupt it can take right now
+*/
+/**************************************************************************/
+static bool sim_irq_ready(sim_node_t *n)
+{
+    if (n->icsr & SCB_ICSR_PENDSVSET)
+    {
+        n->icsr &= ~SCB_ICSR_PENDSVSET;
+        n->pendsv = true;
+    }
+    if (n->primask)
+    {
+        return false;
+    }
+    return (n->gpio_pending && n->nvic_eint1 && (n->exc < SIM_EXC_GPIO)) ||
+           (n->pendsv && (n->exc == SIM_EXC_THREAD));
+}
+
+/**************************************************************************/
+/*!
+    Take the running node's pending interrupts, highest priority first
+*/
+/**************************************************************************/
+void sim_irq_poll()
+{
+    sim_node_t *n = cur;
+    uint8_t exc;
+
+    while (sim_irq_ready(n))
+    {
+        exc = n->exc;
+        sim_cost(SIM_ISR_ENTRY_NS);
+        if (n->gpio_pending && n->nvic_eint1 && (n->exc < SIM_EXC_GPIO))
+        {
+            // like GPIO_IRQHandler: the pin's interrupt is cleared after
+            // the handler, so an edge during the handler is lost
+            n->exc = SIM_EXC_GPIO;
+            chb_ISR_Handler();
+            n->gpio_pending = false;
+        }
+        else
+        {
+            n->pendsv = false;
+            n->exc = SIM_EXC_PENDSV;
+            if (PendSV_Handler)
+            {
+                PendSV_Handler();
+            }
+        }
+        n->exc = exc;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Called by the radio model when its IRQ status or mask changes.
+    Latches the edge on P1.8 if the pin is set up to trigger on it and
+    wakes the node if it's sleeping.
+*/
+/**************************************************************************/
+void sim_irq_update(sim_node_t *n)
+{
+    sim_radio_t *r = &n->radio;
+    bool line = (r->irq_status & r->reg[IRQ_MASK]) != 0;
+
+    if (line == n->irq_line)
+    {
+        return;
+    }
+    n->irq_line = line;
+
+    if (n->int_en && ((line && n->int_rise) || (!line && n->int_fall)))
+    {
+        n->gpio_pending = true;
+        if (n->sleeping && sim_irq_ready(n))
+        {
+            n->sleeping = false;
+            if (clock_now > n->now)
+            {
+                n->now = clock_now;
+            }
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Idle until the time given or, if wfi is set, until an interrupt has
+    been taken. Other nodes and the radio carry on in the meantime.
+*/
+/**************************************************************************/
+static void sim_idle(sim_time_t until, bool wfi)
+{
+    sim_node_t *n = cur;
+
+    for (;;)
+    {
+        if (sim_irq_ready(n))
+        {
+            sim_irq_poll();
+            if (wfi)
+            {
+                return;
+            }
+        }
+        if (n->now >= until)
+        {
+            return;
+        }
+        n->wake = until;
+        n->sleeping = true;
+        sim_yield();
+    }
+}
+
+/**************************************************************************/
+/*!
+    Sleep until the next interrupt. The systick wakes the part up every
+    millisecond, so this returns at the next tick at the latest.
+*/
+/**************************************************************************/
+void sim_wfi()
+{
+    sim_idle((cur->now / SIM_MS(CFG_SYSTICK_DELAY_IN_MS) + 1) * SIM_MS(CFG_SYSTICK_DELAY_IN_MS), true);
+}
+
+/**************************************************************************/
+/*!
+    Let time pass (interrupts are serviced)
+*/
+/**************************************************************************/
+void sim_sleep_until(sim_time_t t)
+{
+    sim_idle(t, false);
+}
+
+/**************************************************************************/
+/*!
+    Busy wait. Interrupts that come in are taken and the wait ends at the
+    same time as it would have without them (or straight after).
+*/
+/**************************************************************************/
+void sim_delay_us(uint32_t usec)
+{
+    sim_time_t end = cur->now + SIM_US(usec);
+    sim_time_t t;
+
+    while (cur->now < end)
+    {
+        t = (cur->bound < end) ? cur->bound + 1 : end;
+        if (t <= cur->now)
+        {
+            t = cur->now + 1;
+        }
+        sim_cost(t - cur->now);
+        sim_irq_poll();
+    }
+}
+
+/**************************************************************************/
+/*!
+    Cortex-M3 core
+*/
+/**************************************************************************/
+volatile uint32_t *sim_icsr()
+{
+    return &cur->icsr;
+}
+
+volatile uint32_t *sim_shpr3()
+{
+    return &cur->shpr3;
+}
+
+void sim_nvic_enable(int irq, bool enb)
+{
+    if (irq == SIM_IRQ_EINT1)
+    {
+        cur->nvic_eint1 = enb;
+        sim_irq_poll();
+    }
+}
+
+void sim_primask(bool set)
+{
+    cur->primask = set;
+    if (!set)
+    {
+        sim_irq_poll();
+    }
+}
+
+/**************************************************************************/
+/*!
+    GPIO. Only the pins wired to the radio do anything.
+*/
+/**************************************************************************/
+void gpioInit()
+{
+}
+
+void gpioSetDir(uint32_t portNum, uint32_t bitPos, gpioDirection_t dir)
+{
+}
+
+void gpioSetPullup(volatile uint32_t *ioconRegister, gpioPullupMode_t mode)
+{
+}
+
+uint32_t gpioGetValue(uint32_t portNum, uint32_t bitPos)
+{
+    sim_node_t *n = cur;
+
+    sim_cost(SIM_GPIO_NS);
+    if ((portNum == CHB_SSPORT) && (bitPos == CHB_SSPIN))
+    {
+        return n->ssel;
+    }
+    if ((portNum == CHB_RSTPORT) && (bitPos == CHB_RSTPIN))
+    {
+        return n->rst;
+    }
+    if ((portNum == CHB_SLPTRPORT) && (bitPos == CHB_SLPTRPIN))
+    {
+        return n->slp_tr;
+    }
+    if ((portNum == CHB_EINTPORT) && (bitPos == CHB_EINTPIN))
+    {
+        return n->irq_line;
+    }
+    return 0;
+}
+
+void gpioSetValue(uint32_t portNum, uint32_t bitPos, uint32_t bitVal)
+{
+    sim_node_t *n = cur;
+    bool val = (bitVal != 0);
+
+    sim_cost(SIM_GPIO_NS);
+    if ((portNum == CHB_SSPORT) && (bitPos == CHB_SSPIN) && (val != n->ssel))
+    {
+        n->ssel = val;
+        radio_pin(n, SIM_PIN_SSEL, val);
+    }
+    else if ((portNum == CHB_RSTPORT) && (bitPos == CHB_RSTPIN) && (val != n->rst))
+    {
+        n->rst = val;
+        radio_pin(n, SIM_PIN_RST, val);
+    }
+    else if ((portNum == CHB_SLPTRPORT) && (bitPos == CHB_SLPTRPIN) && (val != n->slp_tr))
+    {
+        n->slp_tr = val;
+        radio_pin(n, SIM_PIN_SLPTR, val);
+    }
+    sim_irq_poll();
+}
+
+void gpioSetInterrupt(uint32_t portNum, uint32_t bitPos, gpioInterruptSense_t sense, gpioInterruptEdge_t edge, gpioInterruptEvent_t event)
+{
+    if ((portNum != CHB_EINTPORT) || (bitPos != CHB_EINTPIN))
+    {
+        return;
+    }
+    if (sense != gpioInterruptSense_Edge)
+    {
+        printf("chibisim: only edge triggered interrupts are simulated\n");
+        exit(1);
+    }
+    cur->int_rise = (edge == gpioInterruptEdge_Double) || (event == gpioInterruptEvent_ActiveHigh);
+    cur->int_fall = (edge == gpioInterruptEdge_Double) || (event == gpioInterruptEvent_ActiveLow);
+}
+
+void gpioIntEnable(uint32_t portNum, uint32_t bitPos)
+{
+    if ((portNum == CHB_EINTPORT) && (bitPos == CHB_EINTPIN))
+    {
+        cur->int_en = true;
+    }
+}
+
+void gpioIntDisable(uint32_t portNum, uint32_t bitPos)
+{
+    if ((portNum == CHB_EINTPORT) && (bitPos == CHB_EINTPIN))
+    {
+        cur->int_en = false;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Timers. The systick and timer32 follow the node's clock.
+*/
+/**************************************************************************/
+uint32_t systickGetTicks()
+{
+    sim_cost(SIM_GPIO_NS);
+    sim_irq_poll();
+    return (uint32_t)((cur->now - cur->tick_lost) / SIM_MS(CFG_SYSTICK_DELAY_IN_MS));
+}
+
+void timer16Init(uint8_t timerNum, uint16_t timerInterval)
+{
+}
+
+void timer16Enable(uint8_t timerNum)
+{
+}
+
+void timer16DelayUS(uint8_t timerNum, uint16_t delayInUs)
+{
+    sim_delay_us(delayInUs);
+}
+
+void timer32InitFreeRunning(uint8_t timerNum, uint32_t prescale)
+{
+}
+
+uint32_t timer32GetTimerValue(uint8_t timerNum)
+{
+    return (uint32_t)(cur->now / SIM_US(1));
+}
+
+/**************************************************************************/
+/*!
+    Power management
+*/
+/**************************************************************************/
+void pmuSleep()
+{
+    sim_wfi();
+}
+
+void pmuDeepSleepMs(uint32_t sleepCtrl, uint32_t wakeupMs)
+{
+    sim_time_t start = cur->now;
+
+    chb_sleep(true);
+    sim_sleep_until(cur->now + SIM_MS(wakeupMs));
+    cur->tick_lost += cur->now - start;
+    chb_sleep(false);
+}
+
+/**************************************************************************/
+/*!
+    EEPROM
+*/
+/**************************************************************************/
+void eepromWriteU8(uint16_t addr, uint8_t value)
+{
+    cur->eeprom[addr & 0xFF] = value;
+}
+
+void eepromReadBuffer(uint16_t addr, uint8_t *buffer, uint32_t bufferLength)
+{
+    uint32_t i;
+
+    for (i=0; i<bufferLength; i++)
+    {
+        buffer[i] = cur->eeprom[(addr + i) & 0xFF];
+    }
+}
@@ -0,0 +1,226 @@
+/**************************************************************************/
+/*! 
+    @file     sim.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Host-side simulator for the Chibi stack
+
+    Any number of nodes run the unmodified Chibi sources in one process,
+    each with its own copy of the stack's RAM, its own AT86RF212 model
+    (radio.c) and its own virtual clock. A discrete event scheduler keeps
+    the nodes in step so that everything that happens on the shared
+    channel is seen in the right order.
+
+    Simulated time only moves in the hooks: SPI transfers, delays, the
+    systick and sleeping until the next interrupt. Code in between runs
+    in zero time, so the numbers are those of the radio and the SPI link
+    rather than the CPU.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ucontext.h>
+
+// simulated time in nanoseconds
+typedef uint64_t sim_time_t;
+
+#define SIM_US(x)           ((sim_time_t)(x) * 1000ULL)
+#define SIM_MS(x)           ((sim_time_t)(x) * 1000000ULL)
+#define SIM_NEVER           (~(sim_time_t)0)
+
+#define SIM_MAX_NODES       16
+#define SIM_AIR_MAX         SIM_MAX_NODES
+#define SIM_STACK_SZ        (256 * 1024)
+
+// how far a node may run ahead of the others. nothing a node does reaches
+// another node sooner than this (a transmission always starts with a CCA
+// or an ACK turnaround, both much longer)
+#define SIM_LOOKAHEAD       SIM_US(16)
+
+// cost of the hooks
+#define SIM_SPI_BYTE_NS     1000        // 8 MHz SCK
+#define SIM_SPI_XFER_NS     1250        // single byte incl. waiting on the SSP
+#define SIM_GPIO_NS         30
+#define SIM_ISR_ENTRY_NS    200
+
+#define SIM_IRQ_EINT1       1
+
+// radio pins
+enum
+{
+    SIM_PIN_SSEL = 0,           // P0.2
+    SIM_PIN_RST,                // P1.9
+    SIM_PIN_SLPTR               // P1.10
+};
+
+// exception priority the node is running at
+enum
+{
+    SIM_EXC_THREAD = 0,
+    SIM_EXC_PENDSV,
+    SIM_EXC_GPIO
+};
+
+typedef struct sim_node sim_node_t;
+typedef struct sim_tx sim_tx_t;
+typedef void (*sim_main_t)(void *arg);
+typedef void (*sim_event_fn_t)(sim_node_t *node, void *arg, uint32_t gen);
+
+// counters kept by the radio model
+typedef struct
+{
+    uint32_t tx_frames;         // frames put on the air (incl. retries)
+    uint32_t tx_acks;           // ACKs sent by RX_AACK
+    uint32_t cca_busy;          // CCAs that found the channel busy
+    uint32_t rx_ok;             // frames received with a good FCS
+    uint32_t rx_bad_fcs;        // frames received with a bad FCS
+    uint32_t rx_missed;         // frames that arrived while the radio couldn't take them
+    uint32_t rx_collided;       // frames corrupted by another frame
+    sim_time_t on_time;         // time spent out of SLEEP (see radio_on_time)
+} sim_radio_stats_t;
+
+// AT86RF212 model (radio.c)
+typedef struct
+{
+    uint8_t reg[0x40];
+    uint8_t fb[128];            // frame buffer (PSDU)
+    uint8_t fb_len;             // PHR
+    uint8_t lqi;
+    uint8_t state;
+    uint8_t trac;
+    uint8_t cmd;                // last value written to TRX_CMD
+    uint8_t pending_cmd;        // state change held off while busy
+    uint8_t irq_status;
+    uint8_t ed;
+    bool crc;
+    bool fb_protected;          // RX_SAFE_MODE: frame not read yet
+    uint32_t gen;               // bumped to cancel outstanding timers
+
+    // spi transaction
+    uint8_t spi_cmd;
+    uint8_t spi_addr;
+    uint16_t spi_idx;
+    bool spi_fb_read;
+
+    // TX_ARET
+    uint8_t nb;
+    uint8_t be;
+    uint8_t retries;
+    bool wait_ack;
+    uint8_t ack_seq;
+    sim_tx_t *tx;               // own frame on the air
+
+    // receiving
+    sim_tx_t *rx;
+    sim_tx_t *air[SIM_AIR_MAX]; // frames currently audible
+    uint8_t air_cnt;
+    sim_time_t air_quiet;       // when the channel last went quiet
+    sim_time_t on_since;        // woken up (SLP_TR low) at
+
+    sim_radio_stats_t stats;
+} sim_radio_t;
+
+struct sim_node
+{
+    int id;
+    ucontext_t ctx;
+    void *stack;
+    sim_main_t fn;
+    void *arg;
+
+    sim_time_t now;             // the node's own clock
+    sim_time_t bound;           // it has to yield once it gets past this
+    sim_time_t wake;            // sleeping until (unless interrupted)
+    sim_time_t tick_lost;       // the systick stops in deep sleep
+    bool sleeping;
+    bool done;
+
+    // cortex-m3
+    bool primask;
+    uint8_t exc;
+    bool pendsv;
+    bool nvic_eint1;
+    uint32_t icsr;
+    uint32_t shpr3;
+
+    // pins. the radio's IRQ line goes to the edge triggered P1.8
+    bool ssel, rst, slp_tr;
+    bool irq_line;
+    bool int_en, int_rise, int_fall;
+    bool gpio_pending;
+
+    uint8_t eeprom[256];
+    uint8_t *data_save;         // the stack's RAM while another node runs
+    uint8_t *bss_save;
+
+    sim_radio_t radio;
+};
+
+// scheduler (sim.c)
+void sim_reset(uint64_t seed);
+sim_node_t *sim_node_add(uint16_t short_addr, sim_main_t fn, void *arg);
+sim_time_t sim_run(sim_time_t until);
+void sim_stop(void);
+sim_node_t *sim_node(void);
+sim_node_t *sim_node_get(int id);
+sim_time_t sim_now(void);
+uint32_t sim_rand(void);
+void sim_at(sim_time_t t, sim_event_fn_t fn, sim_node_t *node, void *arg, uint32_t gen);
+
+// for code running on a node
+void sim_cost(sim_time_t ns);
+void sim_delay_us(uint32_t usec);
+void sim_sleep_until(sim_time_t t);
+void sim_wfi(void);
+void sim_irq_poll(void);
+void sim_irq_update(sim_node_t *node);
+
+// core hooks used by projectconfig.h
+extern volatile uint32_t sim_iocon;
+volatile uint32_t *sim_icsr(void);
+volatile uint32_t *sim_shpr3(void);
+void sim_nvic_enable(int irq, bool enb);
+void sim_primask(bool set);
+
+// radio and channel model (radio.c)
+void radio_reset(sim_node_t *node);
+void radio_pin(sim_node_t *node, int pin, bool val);
+sim_time_t radio_on_time(sim_node_t *node);
+uint32_t radio_bit_rate(sim_node_t *node);
+void medium_reset(void);
+void sim_link(int a, int b, int loss_pct, uint32_t delay_us);
+void sim_collisions(bool enb);
+
+#endif
@@ -40,8 +40,6 @@
 #include "drivers/rf/chibi/chb.h"
 #include "drivers/rf/chibi/chb_drvr.h"
 
-static chb_rx_data_t rx_data;
-
 /**************************************************************************/
 /*! 
     Converts the ED (Energy Detection) value to dBm using the following
@@ -74,7 +72,7 @@ int edToDBM(uint32_t ed)
     --------------------------------------------------
     CFG_CHIBI             -> Enabled
     CFG_CHIBI_PROMISCUOUS -> 0
-    CFG_CHIBI_BUFFERSIZE  -> 128
+    CFG_CHIBI_BUFFERSIZE  -> 256
 */
 /**************************************************************************/
 int main(void)
@@ -90,24 +88,26 @@ int main(void)
     #error "CFG_CHIBI_PROMISCUOUS must be set to 0 in projectconfig.h for this example"
   #endif
 
-  // Get a reference to the Chibi peripheral control block
-  chb_pcb_t *pcb = chb_get_pcb();
+  chb_frame_t *frame;
 
   while(1)
   {
-    // Check for incoming messages 
-    while (pcb->data_rcv) 
+    // Service the radio (only needed when CFG_CHIBI_DEFERIRQ is 2)
+    chb_task();
+
+    // Check for incoming messages.  The frame stays in the receive
+    // buffer until it is released, and carries its own ED and LQI values
+    while ((frame = chb_read_frame()) != NULL)
     { 
       // Enable LED to indicate message reception 
       gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_ON); 
-      // get the length of the data
-      rx_data.len = chb_read(&rx_data);
       // make sure the length is nonzero
-      if (rx_data.len)
+      if (frame->len)
       {
-        int dbm = edToDBM(pcb->ed);
-        printf("Message received from node %02X: %s, len=%d, dBm=%d.%s", rx_data.src_addr, rx_data.data, rx_data.len, dbm, CFG_PRINTF_NEWLINE);
+        int dbm = edToDBM(frame->ed);
+        printf("Message received from node %02X: %s, len=%d, dBm=%d, lqi=%d.%s", frame->src_addr, frame->data, frame->len, dbm, frame->lqi, CFG_PRINTF_NEWLINE);
       }
+      chb_release_frame(frame);
       // Disable LED
       gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_OFF); 
     }
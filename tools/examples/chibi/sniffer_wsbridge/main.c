@@ -43,12 +43,18 @@
   #include <stdlib.h>
   #include "drivers/rf/chibi/chb.h"
   #include "drivers/rf/chibi/chb_drvr.h"
+  #include "drivers/rf/chibi/chb_sniff.h"
   #include "core/uart/uart.h"
-  static chb_rx_data_t rx_data;
+  static U8 rec[CHB_SNIFF_REC_MAX];
 #endif
 
+// Channels to capture on.  With SNIFF_FIRST_CHANNEL != SNIFF_LAST_CHANNEL
+// the sniffer scans the range, staying SNIFF_DWELL_MS on each channel
+#define SNIFF_FIRST_CHANNEL   (CFG_CHIBI_CHANNEL)
+#define SNIFF_LAST_CHANNEL    (CFG_CHIBI_CHANNEL)
+#define SNIFF_DWELL_MS        (500)
+
 #ifdef CFG_PRINTF_USBCDC
-  volatile unsigned int lastTick;
   #include "core/usbcdc/usb.h"
   #include "core/usbcdc/usbcore.h"
   #include "core/usbcdc/usbhw.h"
@@ -59,7 +65,10 @@
 /**************************************************************************/
 /*! 
     Use Chibi as a wireless sniffer and write all captured frames
-    to UART or USB CDC for wsbridge to handle (see "tools/wsbridge")
+    to UART or USB CDC for wsbridge to handle (see "tools/wsbridge").
+    Every frame is sent as a SLIP framed record with a microsecond
+    timestamp, the channel, ED/RSSI, LQI and CRC status (see
+    drivers/rf/chibi/chb_sniff.h)
   
     projectconfig.h settings:
     --------------------------------------------------
@@ -85,60 +94,44 @@ int main(void)
   #endif
 
   #if defined CFG_CHIBI && CFG_CHIBI_PROMISCUOUS != 0
-    // Get a reference to the Chibi peripheral control block
-    chb_pcb_t *pcb = chb_get_pcb();
-    
-    // Wait for incoming frames and transmit the raw data over uart
+    chb_frame_t *frm;
+    U16 len;
+
+    // Start on the first channel of the scan
+    chb_sniff_init(SNIFF_FIRST_CHANNEL, SNIFF_LAST_CHANNEL, SNIFF_DWELL_MS);
+
+    // Wait for incoming frames and send a record for each one to the PC
     while(1)
     {
-      // Check for incoming messages 
-      while (pcb->data_rcv) 
+      // Service the radio (only needed when CFG_CHIBI_DEFERIRQ is 2)
+      chb_task();
+
+      // Check for incoming frames
+      while ((frm = chb_read_frame()) != NULL)
       { 
-        // get the length of the data
-        rx_data.len = chb_read(&rx_data);
-        // make sure the length is nonzero
-        if (rx_data.len)
-        {
-          // Enable LED to indicate message reception 
-          gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_ON); 
-
-          
-          // Send raw data the to PC for processing using wsbridge
-          uint8_t i;
-          for (i=0; i<rx_data.len; i++)
-          {
-            #ifdef CFG_PRINTF_UART
-              uartSendByte(rx_data.data[i]);
-            #endif
-            #ifdef CFG_PRINTF_USBCDC
-               // ToDo: This really needs to be refactored!
-              if (USB_Configuration) 
-              {
-                cdcBufferWrite(rx_data.data[i]);
-                // Check if we can flush the buffer now or if we need to wait
-                unsigned int currentTick = systickGetTicks();
-                if (currentTick != lastTick)
-                {
-                  uint8_t frame[64];
-                  uint32_t bytesRead = 0;
-                  while (cdcBufferDataPending())
-                  {
-                    // Read 64 byte chunks until end of data
-                    bytesRead = cdcBufferReadLen(frame, 64);
-                    // debug_printf("%d,", bytesRead);
-                    USB_WriteEP (CDC_DEP_IN, frame, bytesRead);
-                    systickDelay(1);
-                  }
-                  lastTick = currentTick;
-                }
-              }  
-            #endif
-          }
-
-          // Disable LED
-          gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_OFF); 
-        }
+        // Enable LED to indicate message reception 
+        gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_ON); 
+
+        // Build the record and hand the slot back to the radio
+        len = chb_sniff_record(frm, rec);
+        chb_release_frame(frm);
+
+        // Send the record to the PC for processing using wsbridge
+        #ifdef CFG_PRINTF_UART
+          uartSend(rec, len);
+        #endif
+        #ifdef CFG_PRINTF_USBCDC
+          // Queued and sent in the background by the USB ISR
+          CDC_WrInBuf(rec, len);
+          CDC_BulkInStart();
+        #endif
+
+        // Disable LED
+        gpioSetValue (CFG_LED_PORT, CFG_LED_PIN, CFG_LED_OFF); 
       }
+
+      // Move on to the next channel when scanning
+      chb_sniff_task();
     }
   #endif
 
@@ -53,7 +53,7 @@
     --------------------------------------------------
     CFG_CHIBI             -> Enabled
     CFG_CHIBI_PROMISCUOUS -> 0
-    CFG_CHIBI_BUFFERSIZE  -> 128
+    CFG_CHIBI_BUFFERSIZE  -> 256
 */
 /**************************************************************************/
 int main(void)
@@ -0,0 +1,217 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2010, microBuilder SARL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the
+ * names of its contributors may be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Measures the report rate and latency of the ROM based USB HID firmware
+ * (core/usbhid-rom) through Linux hidraw.
+ *
+ * Every report is counted and its sequence number checked for gaps.  At
+ * regular intervals an echo request is sent in the OUT report; the time
+ * until the matching echo report arrives is the end-to-end round trip
+ * (host -> device -> host), including one poll interval of the IN
+ * endpoint.  The per-report queue age reported by the firmware gives the
+ * time events spent waiting on the device.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#define REPORT_MAX      64
+#define HEADER_SIZE     12
+#define TYPE_STATUS     0
+#define TYPE_ECHO       1
+#define ECHO_PERIOD_MS  50
+
+typedef struct
+{
+  uint32_t count;
+  double   min;
+  double   max;
+  double   sum;
+} stat_t;
+
+static double nowMs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void statAdd(stat_t *s, double v)
+{
+  if (s->count == 0 || v < s->min) s->min = v;
+  if (s->count == 0 || v > s->max) s->max = v;
+  s->sum += v;
+  s->count++;
+}
+
+static void statPrint(const char *name, const stat_t *s, const char *unit)
+{
+  if (s->count == 0)
+  {
+    printf("%-22s n/a\n", name);
+    return;
+  }
+  printf("%-22s min %.3f  avg %.3f  max %.3f %s (%u samples)\n",
+         name, s->min, s->sum / s->count, s->max, unit, s->count);
+}
+
+int main(int argc, char *argv[])
+{
+  struct hidraw_devinfo info;
+  struct pollfd pfd;
+  uint8_t buf[REPORT_MAX];
+  uint8_t out[1 + 4];
+  uint8_t echoId = 0, lastSeq = 0;
+  double start, end, echoSent = 0, nextEcho;
+  uint32_t reports = 0, missed = 0, dropped = 0, merged = 0;
+  uint32_t statusReports = 0, echoReports = 0, eventReports = 0;
+  stat_t rtt = { 0 }, age = { 0 };
+  int fd, n, seconds = 10, haveSeq = 0, reportSize = 0;
+
+  // Check for required arguments
+  if (argc < 2)
+  {
+    printf("syntax: hidtest </dev/hidrawN> [seconds]\n");
+    return 1;
+  }
+  if (argc > 2)
+  {
+    seconds = atoi(argv[2]);
+  }
+
+  if ((fd = open(argv[1], O_RDWR)) < 0)
+  {
+    printf("error: could not open [%s]: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  if (ioctl(fd, HIDIOCGRAWINFO, &info) == 0)
+  {
+    printf("device %04x:%04x\n", info.vendor & 0xFFFF, info.product & 0xFFFF);
+  }
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  start = nowMs();
+  end = start + seconds * 1000.0;
+  nextEcho = start;
+
+  while (nowMs() < end)
+  {
+    // Lost echo (e.g. device reset): try again
+    if (echoSent && nowMs() - echoSent > 1000)
+    {
+      echoSent = 0;
+    }
+
+    // Send an echo request if none is outstanding
+    if (!echoSent && nowMs() >= nextEcho)
+    {
+      if (++echoId == 0) echoId = 1;
+      memset(out, 0, sizeof out);
+      out[0] = 0;                   // Report ID (none)
+      out[2] = echoId;
+      echoSent = nowMs();
+      if (write(fd, out, sizeof out) < 0)
+      {
+        printf("error: write failed: %s\n", strerror(errno));
+        return 1;
+      }
+    }
+
+    if (poll(&pfd, 1, 10) <= 0)
+    {
+      continue;
+    }
+    n = read(fd, buf, sizeof buf);
+    if (n < 0)
+    {
+      printf("error: read failed: %s\n", strerror(errno));
+      return 1;
+    }
+    if (n < HEADER_SIZE)
+    {
+      continue;
+    }
+
+    reports++;
+    reportSize = n;
+    if (haveSeq && buf[1] != (uint8_t)(lastSeq + 1))
+    {
+      missed += (uint8_t)(buf[1] - lastSeq - 1);
+    }
+    lastSeq = buf[1];
+    haveSeq = 1;
+    dropped += buf[3];
+    if (buf[2] > 1) merged += buf[2] - 1;
+
+    switch (buf[0])
+    {
+      case TYPE_STATUS:
+        statusReports++;
+        break;
+      case TYPE_ECHO:
+        echoReports++;
+        if (echoSent && buf[HEADER_SIZE] == echoId)
+        {
+          statAdd(&rtt, nowMs() - echoSent);
+          echoSent = 0;
+          nextEcho = nowMs() + ECHO_PERIOD_MS;
+        }
+        break;
+      default:
+        eventReports++;
+        statAdd(&age, buf[8] | (buf[9] << 8));
+        break;
+    }
+  }
+
+  printf("report size            %d bytes\n", reportSize);
+  printf("reports                %u (%.1f/s)\n", reports, reports * 1000.0 / (nowMs() - start));
+  printf("  status/echo/event    %u/%u/%u\n", statusReports, echoReports, eventReports);
+  printf("missed (seq gaps)      %u\n", missed);
+  printf("dropped on device      %u\n", dropped);
+  printf("coalesced on device    %u\n", merged);
+  statPrint("round trip", &rtt, "ms");
+  statPrint("event queue age", &age, "ticks");
+
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,387 @@
+/**************************************************************************/
+/*! 
+    @file     main.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @section DESCRIPTION
+
+    Validation and benchmark code for Chibi frame security, which runs
+    AES-128 on the AES engine of the AT86RF212.  A plain software AES-128
+    is included as the baseline.
+
+    Both AES implementations are first checked against the FIPS-197 test
+    vector.  chb_sec_protect is then checked against a software CCM* built
+    on the software AES for a range of payload sizes, and chb_sec_unprotect
+    must recover the payload and reject frames with a flipped bit.  Finally
+    a single block and a full frame are timed with both.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "sysinit.h"
+#include "drivers/rf/chibi/chb.h"
+#include "drivers/rf/chibi/chb_drvr.h"
+#include "tools/validation/validation.h"
+
+#define BENCH_REPEAT  (16)
+
+static const uint8_t fipsKey[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                     0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+static const uint8_t fipsPlain[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                       0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+static const uint8_t fipsCipher[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+static const uint8_t sbox[256] =
+{
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t roundKeys[176];
+
+/**************************************************************************/
+/*! 
+    Software AES-128 key expansion (FIPS-197 section 5.2)
+*/
+/**************************************************************************/
+static void swAesSetKey(const uint8_t *key)
+{
+  uint8_t i, t[4], rcon = 0x01;
+
+  memcpy(roundKeys, key, 16);
+  for (i = 16; i < 176; i += 4)
+  {
+    memcpy(t, &roundKeys[i - 4], 4);
+    if ((i % 16) == 0)
+    {
+      uint8_t t0 = t[0];
+      t[0] = sbox[t[1]] ^ rcon;
+      t[1] = sbox[t[2]];
+      t[2] = sbox[t[3]];
+      t[3] = sbox[t0];
+      rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0);
+    }
+    roundKeys[i + 0] = roundKeys[i - 16] ^ t[0];
+    roundKeys[i + 1] = roundKeys[i - 15] ^ t[1];
+    roundKeys[i + 2] = roundKeys[i - 14] ^ t[2];
+    roundKeys[i + 3] = roundKeys[i - 13] ^ t[3];
+  }
+}
+
+static uint8_t xtime(uint8_t x)
+{
+  return (x << 1) ^ ((x & 0x80) ? 0x1b : 0);
+}
+
+/**************************************************************************/
+/*! 
+    Software AES-128 encryption of one block (in and out can overlap)
+*/
+/**************************************************************************/
+static void swAesEncrypt(const uint8_t *in, uint8_t *out)
+{
+  uint8_t s[16], t[16], r, c, a0, a1, a2, a3, x;
+
+  for (c = 0; c < 16; c++) s[c] = in[c] ^ roundKeys[c];
+
+  for (r = 1; r <= 10; r++)
+  {
+    // SubBytes and ShiftRows
+    for (c = 0; c < 16; c++) t[c] = sbox[s[(c + 4 * (c & 3)) & 15]];
+
+    // MixColumns, skipped in the last round
+    if (r < 10)
+    {
+      for (c = 0; c < 16; c += 4)
+      {
+        a0 = t[c]; a1 = t[c + 1]; a2 = t[c + 2]; a3 = t[c + 3];
+        x = a0 ^ a1 ^ a2 ^ a3;
+        t[c]     = a0 ^ x ^ xtime(a0 ^ a1);
+        t[c + 1] = a1 ^ x ^ xtime(a1 ^ a2);
+        t[c + 2] = a2 ^ x ^ xtime(a2 ^ a3);
+        t[c + 3] = a3 ^ x ^ xtime(a3 ^ a0);
+      }
+    }
+
+    for (c = 0; c < 16; c++) s[c] = t[c] ^ roundKeys[16 * r + c];
+  }
+  memcpy(out, s, 16);
+}
+
+/**************************************************************************/
+/*! 
+    CCM* flags/nonce/value block, laid out the same way as in chb.c
+*/
+/**************************************************************************/
+static void swCcmBlock(uint8_t *blk, uint8_t flags, const uint8_t *mhr, uint32_t cnt, uint16_t val)
+{
+  memset(blk, 0, 16);
+  blk[0] = flags;
+  blk[5] = mhr[4];
+  blk[6] = mhr[3];
+  blk[7] = mhr[8];
+  blk[8] = mhr[7];
+  blk[9] = cnt >> 24;
+  blk[10] = cnt >> 16;
+  blk[11] = cnt >> 8;
+  blk[12] = cnt;
+  blk[13] = CHB_SEC_LEVEL;
+  blk[14] = val >> 8;
+  blk[15] = val;
+}
+
+/**************************************************************************/
+/*! 
+    Software CCM* (MIC-32 + encryption) of a payload, producing the same
+    aux header + ciphertext + MIC as chb_sec_protect
+*/
+/**************************************************************************/
+static uint8_t swCcmProtect(const uint8_t *mhr, const uint8_t *data, uint8_t len, uint32_t cnt, uint8_t *out)
+{
+  uint8_t blk[16], x[16], mic[CHB_MIC_LEN], i, j, n;
+  uint8_t *m = out + CHB_AUX_HDR_SZ;
+
+  out[0] = CHB_SEC_LEVEL;
+  out[1] = cnt;
+  out[2] = cnt >> 8;
+  out[3] = cnt >> 16;
+  out[4] = cnt >> 24;
+
+  // CBC-MAC over B0, the header block and the payload
+  swCcmBlock(blk, 0x49, mhr, cnt, len);
+  swAesEncrypt(blk, x);
+  blk[0] = 0;
+  blk[1] = CHB_HDR_SZ + CHB_AUX_HDR_SZ;
+  memcpy(&blk[2], mhr, CHB_HDR_SZ);
+  memcpy(&blk[2 + CHB_HDR_SZ], out, CHB_AUX_HDR_SZ);
+  for (j = 0; j < 16; j++) x[j] ^= blk[j];
+  swAesEncrypt(x, x);
+  for (i = 0; i < len; i += 16)
+  {
+    n = ((len - i) > 16) ? 16 : (len - i);
+    for (j = 0; j < n; j++) x[j] ^= data[i + j];
+    swAesEncrypt(x, x);
+  }
+  memcpy(mic, x, CHB_MIC_LEN);
+
+  // counter mode
+  swCcmBlock(blk, 0x01, mhr, cnt, 0);
+  swAesEncrypt(blk, x);
+  for (j = 0; j < CHB_MIC_LEN; j++) m[len + j] = mic[j] ^ x[j];
+  for (i = 0; i < len; i += 16)
+  {
+    swCcmBlock(blk, 0x01, mhr, cnt, i / 16 + 1);
+    swAesEncrypt(blk, x);
+    n = ((len - i) > 16) ? 16 : (len - i);
+    for (j = 0; j < n; j++) m[i + j] = data[i + j] ^ x[j];
+  }
+
+  return len + CHB_AUX_HDR_SZ + CHB_MIC_LEN;
+}
+
+/**************************************************************************/
+/*! 
+    Fill in a typical MAC header (ack request, security enabled)
+*/
+/**************************************************************************/
+static void makeMhr(uint8_t *mhr)
+{
+  mhr[0] = CHB_FCF_BYTE_0 | (1 << CHB_ACK_REQ_POS) | (1 << CHB_SEC_EN_POS);
+  mhr[1] = CHB_FCF_BYTE_1;
+  mhr[2] = 0x5a;
+  mhr[3] = CFG_CHIBI_PANID & 0xff;
+  mhr[4] = CFG_CHIBI_PANID >> 8;
+  mhr[5] = 0x02;
+  mhr[6] = 0x00;
+  mhr[7] = 0x01;
+  mhr[8] = 0x00;
+}
+
+static void fail(const char *what, uint32_t len)
+{
+  validationFail("%s (len %u)", what, (unsigned int)len);
+}
+
+/**************************************************************************/
+/*! 
+    Checks both AES implementations and chb_sec_protect/unprotect
+*/
+/**************************************************************************/
+static void validate(void)
+{
+  uint8_t mhr[CHB_HDR_SZ], data[CHB_MAX_PAYLOAD];
+  uint8_t hw[CHB_MAX_PAYLOAD + CHB_AUX_HDR_SZ + CHB_MIC_LEN];
+  uint8_t sw[CHB_MAX_PAYLOAD + CHB_AUX_HDR_SZ + CHB_MIC_LEN];
+  uint8_t blk[16], len, secLen, i;
+  uint32_t cnt;
+
+  swAesSetKey(fipsKey);
+  swAesEncrypt(fipsPlain, blk);
+  if (memcmp(blk, fipsCipher, 16)) fail("software AES", 16);
+
+  chb_aes_set_key((uint8_t *)fipsKey);
+  chb_aes_encrypt(CHB_AES_MODE_ECB, (uint8_t *)fipsPlain, blk);
+  if (memcmp(blk, fipsCipher, 16)) fail("AT86RF212 AES", 16);
+
+  chb_set_key((uint8_t *)fipsKey);
+  makeMhr(mhr);
+  for (i = 0; i < sizeof(data); i++) data[i] = i * 7;
+
+  for (len = 0; len <= CHB_MAX_PAYLOAD; len++)
+  {
+    secLen = chb_sec_protect(mhr, data, len, hw);
+    cnt = hw[1] | (hw[2] << 8) | ((uint32_t)hw[3] << 16) | ((uint32_t)hw[4] << 24);
+    if ((swCcmProtect(mhr, data, len, cnt, sw) != secLen) || memcmp(hw, sw, secLen))
+    {
+      fail("chb_sec_protect", len);
+      continue;
+    }
+
+    if (!chb_sec_unprotect(mhr, hw, &secLen) || (secLen != len) ||
+        memcmp(&hw[CHB_AUX_HDR_SZ], data, len))
+    {
+      fail("chb_sec_unprotect", len);
+    }
+
+    // any change to the header or the secured payload must be caught
+    memcpy(hw, sw, len + CHB_AUX_HDR_SZ + CHB_MIC_LEN);
+    hw[CHB_AUX_HDR_SZ + len / 2] ^= 0x01;
+    secLen = len + CHB_AUX_HDR_SZ + CHB_MIC_LEN;
+    if (chb_sec_unprotect(mhr, hw, &secLen)) fail("tampered payload accepted", len);
+
+    memcpy(hw, sw, len + CHB_AUX_HDR_SZ + CHB_MIC_LEN);
+    mhr[7] ^= 0x01;
+    secLen = len + CHB_AUX_HDR_SZ + CHB_MIC_LEN;
+    if (chb_sec_unprotect(mhr, hw, &secLen)) fail("tampered header accepted", len);
+    mhr[7] ^= 0x01;
+  }
+}
+
+/**************************************************************************/
+/*! 
+    Times one block and one full frame (CHB_MAX_PAYLOAD bytes) with the
+    radio's AES engine and the software AES
+*/
+/**************************************************************************/
+static void benchmark(void)
+{
+  uint8_t mhr[CHB_HDR_SZ], data[CHB_MAX_PAYLOAD], blk[16];
+  uint8_t out[CHB_MAX_PAYLOAD + CHB_AUX_HDR_SZ + CHB_MIC_LEN];
+  uint32_t r, tHwBlk, tSwBlk, tHwFrm, tSwFrm, tHwOpen;
+  uint8_t len;
+
+  makeMhr(mhr);
+  memset(data, 0x55, sizeof(data));
+  memcpy(blk, fipsPlain, 16);
+
+  {
+    BENCH_START;
+    for (r = 0; r < BENCH_REPEAT; r++) chb_aes_encrypt(CHB_AES_MODE_ECB, blk, blk);
+    tHwBlk = BENCH_STOP / BENCH_REPEAT;
+  }
+  {
+    BENCH_START;
+    for (r = 0; r < BENCH_REPEAT; r++) swAesEncrypt(blk, blk);
+    tSwBlk = BENCH_STOP / BENCH_REPEAT;
+  }
+  {
+    BENCH_START;
+    for (r = 0; r < BENCH_REPEAT; r++) chb_sec_protect(mhr, data, CHB_MAX_PAYLOAD, out);
+    tHwFrm = BENCH_STOP / BENCH_REPEAT;
+  }
+  {
+    BENCH_START;
+    for (r = 0; r < BENCH_REPEAT; r++)
+    {
+      len = sizeof(out);
+      chb_sec_unprotect(mhr, out, &len);
+    }
+    tHwOpen = BENCH_STOP / BENCH_REPEAT;
+  }
+  {
+    BENCH_START;
+    for (r = 0; r < BENCH_REPEAT; r++) swCcmProtect(mhr, data, CHB_MAX_PAYLOAD, r, out);
+    tSwFrm = BENCH_STOP / BENCH_REPEAT;
+  }
+
+  // cycles at 72MHz -> usec, and the payload rate the crypto alone allows
+  printf("                      cycles     usec  payload kbit/s%s", CFG_PRINTF_NEWLINE);
+  printf("AES block (hw)      %8u %8u%s", (unsigned int)tHwBlk, (unsigned int)(tHwBlk / 72), CFG_PRINTF_NEWLINE);
+  printf("AES block (sw)      %8u %8u%s", (unsigned int)tSwBlk, (unsigned int)(tSwBlk / 72), CFG_PRINTF_NEWLINE);
+  printf("protect frame (hw)  %8u %8u %8u%s", (unsigned int)tHwFrm, (unsigned int)(tHwFrm / 72),
+         (unsigned int)(CHB_MAX_PAYLOAD * 8 * 72000 / tHwFrm), CFG_PRINTF_NEWLINE);
+  printf("unprotect frame (hw)%8u %8u %8u%s", (unsigned int)tHwOpen, (unsigned int)(tHwOpen / 72),
+         (unsigned int)(CHB_MAX_PAYLOAD * 8 * 72000 / tHwOpen), CFG_PRINTF_NEWLINE);
+  printf("protect frame (sw)  %8u %8u %8u%s", (unsigned int)tSwFrm, (unsigned int)(tSwFrm / 72),
+         (unsigned int)(CHB_MAX_PAYLOAD * 8 * 72000 / tSwFrm), CFG_PRINTF_NEWLINE);
+}
+
+/**************************************************************************/
+/*! 
+    Main program entry point.  After reset, normal code execution will
+    begin here.
+*/
+/**************************************************************************/
+int main(void)
+{
+  // Configure cpu and mandatory peripherals (includes chb_init)
+  systemInit();
+
+  printf("Validating AES and CCM* (0..%u byte payloads)%s", CHB_MAX_PAYLOAD, CFG_PRINTF_NEWLINE);
+  validate();
+  validationReport();
+
+  benchmark();
+
+  while (1)
+  {
+  }
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+/**************************************************************************/
+/*! 
+    @file     main.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @section DESCRIPTION
+
+    Checks on a real board how the AT86RF212 IRQ line behaves and that
+    the GPIO interrupt set up by chb_drvr.c catches it.  The radio is
+    made to raise PLL_LOCK with its interrupt held off in the NVIC, and
+    the pin level and the GPIO interrupt latch are read at each step.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdio.h>
+
+#include "projectconfig.h"
+#include "sysinit.h"
+#include "core/gpio/gpio.h"
+#include "core/systick/systick.h"
+#include "drivers/rf/chibi/chb.h"
+#include "drivers/rf/chibi/chb_drvr.h"
+#include "tools/validation/validation.h"
+
+/**************************************************************************/
+/*! 
+    Prints one step and counts it as an error if it isn't what an
+    active high IRQ line caught on its rising edge would give
+*/
+/**************************************************************************/
+static void check(const char *step, uint32_t value, uint32_t expected)
+{
+  if (value != expected) validationErrors++;
+  printf("%-36s %u (expected %u)%s%s", step, (unsigned int)value, (unsigned int)expected,
+         value != expected ? "  FAIL" : "", CFG_PRINTF_NEWLINE);
+}
+
+/**************************************************************************/
+/*! 
+    Main program entry point.  After reset, normal code execution will
+    begin here.
+*/
+/**************************************************************************/
+int main(void)
+{
+  uint8_t mask, status;
+
+  // Configure cpu and mandatory peripherals (includes chb_init)
+  systemInit();
+
+  // Keep the driver's ISR out of the way so the latch can be read here
+  NVIC_DisableIRQ(CHB_EINTIRQ);
+  mask = chb_reg_read(IRQ_MASK);
+  chb_reg_write(IRQ_MASK, mask | CHB_IRQ_PLL_LOCK_MASK);
+
+  // TRX_OFF with nothing pending
+  chb_reg_read_mod_write(TRX_STATE, CMD_FORCE_TRX_OFF, 0x1F);
+  while ((chb_reg_read(TRX_STATUS) & 0x1F) != TRX_OFF);
+  chb_reg_read(IRQ_STATUS);
+  gpioIntClear(CHB_EINTPORT, CHB_EINTPIN);
+  check("IRQ pin, idle", gpioGetValue(CHB_EINTPORT, CHB_EINTPIN), 0);
+
+  // PLL_ON raises PLL_LOCK within ~200us
+  chb_reg_read_mod_write(TRX_STATE, CMD_PLL_ON, 0x1F);
+  systickDelay(2);
+  check("IRQ pin, PLL_LOCK pending", gpioGetValue(CHB_EINTPORT, CHB_EINTPIN), 1);
+  check("GPIO interrupt latched (line up)", gpioIntStatus(CHB_EINTPORT, CHB_EINTPIN), 1);
+  gpioIntClear(CHB_EINTPORT, CHB_EINTPIN);
+
+  // Reading IRQ_STATUS releases the line
+  status = chb_reg_read(IRQ_STATUS);
+  check("IRQ_STATUS has PLL_LOCK", (status & CHB_IRQ_PLL_LOCK_MASK) ? 1 : 0, 1);
+  check("IRQ pin, after IRQ_STATUS read", gpioGetValue(CHB_EINTPORT, CHB_EINTPIN), 0);
+  check("GPIO interrupt latched (line down)", gpioIntStatus(CHB_EINTPORT, CHB_EINTPIN), 0);
+
+  // Put the radio back the way chb_init left it
+  chb_reg_write(IRQ_MASK, mask);
+  chb_set_state(RX_STATE);
+  gpioIntClear(CHB_EINTPORT, CHB_EINTPIN);
+  NVIC_EnableIRQ(CHB_EINTIRQ);
+
+  validationReport();
+
+  while (1)
+  {
+  }
+
+  return 0;
+}
@@ -0,0 +1,318 @@
+/**************************************************************************/
+/*! 
+    @file     main.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @section DESCRIPTION
+
+    Validation and benchmark code for the string/memory routines in
+    core/libc/string.c.  Every routine is checked against a simple
+    bytewise reference implementation for all sizes from 1 up to
+    LIBC_MAXSIZE, and for every source/destination alignment combination.
+    The routines are then timed for a range of sizes and alignments.
+
+    The same file can be built for the LPC1343 (cycles are measured with
+    the DWT cycle counter, see CPU_RESET_CYCLECOUNTER) or on a PC for a
+    quick functional check (see readme.txt).
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tools/validation/validation.h"
+
+#ifdef VALIDATION_HOST
+  // The host has plenty of RAM, so test the full range
+  #define LIBC_MAXSIZE        (4096)
+  #define LIBC_REPEAT         (20000)
+#else
+  #include "sysinit.h"
+  // Two buffers of LIBC_MAXSIZE must fit in the 8KB of SRAM
+  #define LIBC_MAXSIZE        (1024)
+  #define LIBC_REPEAT         (1)
+#endif
+
+// Guard bytes on each side of the destination to catch overruns
+#define LIBC_GUARD            (8)
+#define LIBC_GUARDVALUE       (0xA5)
+
+static uint8_t srcBuffer[LIBC_MAXSIZE + 2 * LIBC_GUARD];
+static uint8_t dstBuffer[LIBC_MAXSIZE + 2 * LIBC_GUARD];
+
+// Sizes used for the timing runs
+static const uint32_t benchSizes[] = { 1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 64, 
+                                       127, 128, 256, 512, 1024, 2048, 4096 };
+
+// Keeps the compiler from discarding memcmp calls in the timing loop
+static volatile int benchResult;
+
+/**************************************************************************/
+/*! 
+    Reports a mismatch against the reference implementation
+*/
+/**************************************************************************/
+static void fail(const char *func, uint32_t size, uint32_t srcAlign, uint32_t dstAlign)
+{
+  validationFail("%s size %u src+%u dst+%u", func, (unsigned int)size,
+                 (unsigned int)srcAlign, (unsigned int)dstAlign);
+}
+
+/**************************************************************************/
+/*! 
+    Fills the source buffer with a non-repeating, non-zero pattern and the
+    destination buffer with the guard value
+*/
+/**************************************************************************/
+static void fillBuffers(void)
+{
+  uint32_t i;
+  for (i = 0; i < sizeof(srcBuffer); i++)
+  {
+    // Never zero, so the buffer can also be used as a string
+    srcBuffer[i] = (uint8_t)((((i * 7) + (i >> 8)) % 255) + 1);
+    dstBuffer[i] = LIBC_GUARDVALUE;
+  }
+}
+
+/**************************************************************************/
+/*! 
+    Returns 1 if dst[0..size-1] matches src and the bytes around it
+    still hold the guard value
+*/
+/**************************************************************************/
+static int checkCopy(const uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+  uint32_t i;
+  for (i = 0; i < size; i++)
+  {
+    if (dst[i] != src[i]) return 0;
+  }
+  for (i = 1; i <= 4; i++)
+  {
+    if (dst[-(int32_t)i] != LIBC_GUARDVALUE) return 0;
+    if (dst[size + i - 1] != LIBC_GUARDVALUE) return 0;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*! 
+    Returns the sign of an int (memcmp/strcmp only guarantee the sign)
+*/
+/**************************************************************************/
+static int sign(int value)
+{
+  return (value > 0) - (value < 0);
+}
+
+/**************************************************************************/
+/*! 
+    Checks memcpy, memmove, memset, memcmp, strlen and strcmp for every
+    size from 1 to LIBC_MAXSIZE and every alignment combination
+*/
+/**************************************************************************/
+static void validate(void)
+{
+  uint32_t size, sa, da, i;
+  uint8_t *src, *dst;
+
+  for (size = 1; size <= LIBC_MAXSIZE; size++)
+  {
+    for (sa = 0; sa < 4; sa++)
+    {
+      for (da = 0; da < 4; da++)
+      {
+        src = srcBuffer + LIBC_GUARD + sa;
+        dst = dstBuffer + LIBC_GUARD + da;
+
+        // Fill size + 4 might exceed the buffer for the largest sizes
+        if (size + sa + 4 > LIBC_MAXSIZE + LIBC_GUARD) continue;
+
+        // memcpy
+        fillBuffers();
+        memcpy(dst, src, size);
+        if (!checkCopy(dst, src, size)) fail("memcpy", size, sa, da);
+
+        // memmove (non-overlapping)
+        fillBuffers();
+        memmove(dst, src, size);
+        if (!checkCopy(dst, src, size)) fail("memmove", size, sa, da);
+
+        // memcmp (equal, then a difference at the first, middle and last byte)
+        if (memcmp(dst, src, size) != 0) fail("memcmp", size, sa, da);
+        for (i = 0; i < 3; i++)
+        {
+          uint32_t pos = (i == 0) ? 0 : (i == 1) ? size / 2 : size - 1;
+          uint8_t saved = dst[pos];
+          dst[pos] = saved + 1;
+          if (sign(memcmp(dst, src, size)) != sign((int)dst[pos] - (int)src[pos]))
+            fail("memcmp", size, sa, da);
+          if (sign(memcmp(src, dst, size)) != sign((int)src[pos] - (int)dst[pos]))
+            fail("memcmp", size, sa, da);
+          dst[pos] = saved;
+        }
+
+        // memset
+        fillBuffers();
+        memset(dst, 0x5A + da, size);
+        for (i = 0; i < size; i++)
+        {
+          if (dst[i] != (uint8_t)(0x5A + da)) break;
+        }
+        if ((i != size) || (dst[-1] != LIBC_GUARDVALUE) || (dst[size] != LIBC_GUARDVALUE))
+          fail("memset", size, sa, da);
+
+        // strlen/strcmp (src string is size - 1 chars long)
+        fillBuffers();
+        memcpy(dst, src, size);
+        dst[size - 1] = 0;
+        if (strlen((char *)dst) != size - 1) fail("strlen", size, sa, da);
+        src[size - 1] = 0;
+        if (strcmp((char *)dst, (char *)src) != 0) fail("strcmp", size, sa, da);
+        if (size > 1)
+        {
+          // Incrementing 0xFF terminates dst early, which is also valid
+          uint32_t pos = size - 2;
+          dst[pos]++;
+          if (sign(strcmp((char *)dst, (char *)src)) != sign((int)dst[pos] - (int)src[pos]))
+            fail("strcmp", size, sa, da);
+          if (sign(strcmp((char *)src, (char *)dst)) != sign((int)src[pos] - (int)dst[pos]))
+            fail("strcmp", size, sa, da);
+        }
+      }
+
+      // Overlapping memmove, shifting a block up and down by 1..7 bytes
+      for (da = 1; da < 8; da++)
+      {
+        uint8_t *base = dstBuffer + LIBC_GUARD + sa;
+        if (size + da + sa > LIBC_MAXSIZE) continue;
+
+        fillBuffers();
+        memcpy(base, srcBuffer, size + da);
+        memmove(base + da, base, size);
+        for (i = 0; i < size; i++)
+        {
+          if (base[da + i] != srcBuffer[i]) { fail("memmove up", size, sa, da); break; }
+        }
+
+        fillBuffers();
+        memcpy(base, srcBuffer, size + da);
+        memmove(base, base + da, size);
+        for (i = 0; i < size; i++)
+        {
+          if (base[i] != srcBuffer[da + i]) { fail("memmove down", size, sa, da); break; }
+        }
+      }
+    }
+  }
+}
+
+/**************************************************************************/
+/*! 
+    Times memcpy, memmove, memset and memcmp for the sizes in benchSizes
+    with every source/destination alignment combination
+*/
+/**************************************************************************/
+static void benchmark(void)
+{
+  uint32_t n, sa, da, r;
+  uint32_t tCpy, tMove, tSet, tCmp;
+
+  printf("size  src dst  memcpy memmove memset memcmp (%s)%s", BENCH_UNIT, CFG_PRINTF_NEWLINE);
+
+  for (n = 0; n < sizeof(benchSizes) / sizeof(benchSizes[0]); n++)
+  {
+    uint32_t size = benchSizes[n];
+    if (size + 4 > LIBC_MAXSIZE + LIBC_GUARD) break;
+
+    for (sa = 0; sa < 4; sa++)
+    {
+      for (da = 0; da < 4; da++)
+      {
+        uint8_t *src = srcBuffer + LIBC_GUARD + sa;
+        uint8_t *dst = dstBuffer + LIBC_GUARD + da;
+
+        fillBuffers();
+
+        BENCH_START;
+        for (r = 0; r < LIBC_REPEAT; r++) memcpy(dst, src, size);
+        tCpy = BENCH_STOP / LIBC_REPEAT;
+
+        BENCH_START;
+        for (r = 0; r < LIBC_REPEAT; r++) memmove(dst, src, size);
+        tMove = BENCH_STOP / LIBC_REPEAT;
+
+        BENCH_START;
+        for (r = 0; r < LIBC_REPEAT; r++) benchResult = memcmp(dst, src, size);
+        tCmp = BENCH_STOP / LIBC_REPEAT;
+
+        BENCH_START;
+        for (r = 0; r < LIBC_REPEAT; r++) memset(dst, r, size);
+        tSet = BENCH_STOP / LIBC_REPEAT;
+
+        printf("%4u  %u   %u   %6u %7u %6u %6u%s", (unsigned int)size,
+               (unsigned int)sa, (unsigned int)da, (unsigned int)tCpy,
+               (unsigned int)tMove, (unsigned int)tSet, (unsigned int)tCmp,
+               CFG_PRINTF_NEWLINE);
+      }
+    }
+  }
+}
+
+/**************************************************************************/
+/*! 
+    Main program entry point.  After reset, normal code execution will
+    begin here.
+*/
+/**************************************************************************/
+int main(void)
+{
+  #ifndef VALIDATION_HOST
+    // Configure cpu and mandatory peripherals
+    systemInit();
+  #endif
+
+  printf("Validating string.c (1..%u bytes)%s", LIBC_MAXSIZE, CFG_PRINTF_NEWLINE);
+  validate();
+  validationReport();
+
+  benchmark();
+
+  #ifndef VALIDATION_HOST
+    while (1)
+    {
+    }
+  #endif
+
+  return validationErrors ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/**************************************************************************/
+/*! 
+    @file     main.c
+    @author   K. Townsend (microBuilder.eu)
+
+    @section DESCRIPTION
+
+    Validation and benchmark code for the block transfer functions in
+    core/ssp/ssp.c.  SSP0 is put in loopback mode, so everything sent
+    comes straight back and no device needs to be connected.  Every
+    function is checked for all sizes from 1 up to SSPTEST_MAXSIZE, then
+    timed against a byte at a time reference loop (the way ssp.c used to
+    work, waiting for BSY after every frame) at several SPI clock rates.
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "projectconfig.h"
+#include "sysinit.h"
+#include "core/ssp/ssp.h"
+#include "tools/validation/validation.h"
+
+#define SSPTEST_MAXSIZE       (512)
+
+// Guard bytes on each side of the receive buffer to catch overruns
+#define SSPTEST_GUARD         (8)
+#define SSPTEST_GUARDVALUE    (0xA5)
+
+static uint8_t  txBuffer[SSPTEST_MAXSIZE];
+static uint8_t  rxBuffer[SSPTEST_MAXSIZE + 2 * SSPTEST_GUARD];
+static uint16_t tx16Buffer[SSPTEST_MAXSIZE / 2];
+static uint16_t rx16Buffer[SSPTEST_MAXSIZE / 2];
+
+// Sizes used for the timing runs
+static const uint32_t benchSizes[] = { 1, 2, 4, 8, 16, 64, 128, 512 };
+
+// SCR values used for the timing runs (SPI clock = 36MHz / (SCR + 1))
+static const uint32_t benchClocks[] = { 8, 4, 0 };
+
+// Counted by SSP_IRQHandler
+extern volatile uint32_t interruptOverRunStat;
+
+/**************************************************************************/
+/*! 
+    Reports a failed check
+*/
+/**************************************************************************/
+static void fail(const char *func, uint32_t size)
+{
+  validationFail("%s size %u", func, (unsigned int)size);
+}
+
+/**************************************************************************/
+/*! 
+    Fills the transmit buffers with a non-repeating pattern and the
+    receive buffers with the guard value
+*/
+/**************************************************************************/
+static void fillBuffers(void)
+{
+  uint32_t i;
+  for (i = 0; i < SSPTEST_MAXSIZE; i++)
+  {
+    txBuffer[i] = (uint8_t)((i * 7) + (i >> 8) + 1);
+  }
+  for (i = 0; i < SSPTEST_MAXSIZE / 2; i++)
+  {
+    tx16Buffer[i] = (uint16_t)((i * 0x0B3D) ^ 0x5AA5);
+    rx16Buffer[i] = 0;
+  }
+  memset(rxBuffer, SSPTEST_GUARDVALUE, sizeof(rxBuffer));
+}
+
+/**************************************************************************/
+/*! 
+    Returns 1 if the bus is idle with nothing left in the receive FIFO
+    and no overrun was seen, which must be the case after every call
+*/
+/**************************************************************************/
+static int checkIdle(void)
+{
+  if (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY | SSP_SSP0SR_RNE_NOTEMPTY)) return 0;
+  if (interruptOverRunStat) return 0;
+  return 1;
+}
+
+/**************************************************************************/
+/*! 
+    Returns 1 if rx[0..size-1] matches expected (or is all expected[0] if
+    same is set) and the bytes around it still hold the guard value
+*/
+/**************************************************************************/
+static int checkReceived(const uint8_t *rx, const uint8_t *expected, uint32_t size, int same)
+{
+  uint32_t i;
+  for (i = 0; i < size; i++)
+  {
+    if (rx[i] != (same ? expected[0] : expected[i])) return 0;
+  }
+  for (i = 1; i <= SSPTEST_GUARD; i++)
+  {
+    if (rx[-(int32_t)i] != SSPTEST_GUARDVALUE) return 0;
+    if (rx[size + i - 1] != SSPTEST_GUARDVALUE) return 0;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*! 
+    Checks sspTransfer, sspSend, sspReceive, sspDrain, sspFill and
+    sspTransfer16 for every size from 1 to SSPTEST_MAXSIZE
+*/
+/**************************************************************************/
+static void validate(void)
+{
+  uint8_t *rx = rxBuffer + SSPTEST_GUARD;
+  uint8_t ff = 0xFF, fill = 0x3C;
+  uint32_t size, i;
+
+  for (size = 1; size <= SSPTEST_MAXSIZE; size++)
+  {
+    fillBuffers();
+    sspTransfer(0, txBuffer, rx, size);
+    if (!checkIdle() || !checkReceived(rx, txBuffer, size, 0)) fail("sspTransfer", size);
+
+    // In place, as used by w25q16bv_TransferByte
+    memcpy(rx, txBuffer, size);
+    sspTransfer(0, rx, rx, size);
+    if (!checkIdle() || !checkReceived(rx, txBuffer, size, 0)) fail("sspTransfer (in place)", size);
+
+    fillBuffers();
+    sspTransfer(0, NULL, rx, size);
+    if (!checkIdle() || !checkReceived(rx, &ff, size, 1)) fail("sspTransfer (no tx)", size);
+
+    sspTransfer(0, txBuffer, NULL, size);
+    if (!checkIdle()) fail("sspTransfer (no rx)", size);
+
+    sspSend(0, txBuffer, size);
+    if (!checkIdle()) fail("sspSend", size);
+
+    fillBuffers();
+    sspReceive(0, rx, size);
+    if (!checkIdle() || !checkReceived(rx, &ff, size, 1)) fail("sspReceive", size);
+
+    fillBuffers();
+    sspDrain(0, rx, size, fill);
+    if (!checkIdle() || !checkReceived(rx, &fill, size, 1)) fail("sspDrain", size);
+
+    sspDrain(0, NULL, size, fill);
+    if (!checkIdle()) fail("sspDrain (discard)", size);
+
+    sspFill(0, fill, size);
+    if (!checkIdle()) fail("sspFill", size);
+  }
+
+  sspSetDataSize(0, 16);
+  for (size = 1; size <= SSPTEST_MAXSIZE / 2; size++)
+  {
+    fillBuffers();
+    sspTransfer16(0, tx16Buffer, rx16Buffer, size);
+    if (!checkIdle()) fail("sspTransfer16", size);
+    for (i = 0; i < SSPTEST_MAXSIZE / 2; i++)
+    {
+      if (rx16Buffer[i] != (i < size ? tx16Buffer[i] : 0))
+      {
+        fail("sspTransfer16", size);
+        break;
+      }
+    }
+
+    sspFill(0, 0xF800, size);
+    if (!checkIdle()) fail("sspFill (16-bit)", size);
+  }
+  sspSetDataSize(0, 8);
+}
+
+/**************************************************************************/
+/*! 
+    Reference: one byte at a time, waiting for each frame to complete
+    before sending the next one
+*/
+/**************************************************************************/
+static void bytewiseTransfer(const uint8_t *txBuf, uint8_t *rxBuf, uint32_t length)
+{
+  uint32_t i;
+
+  for (i = 0; i < length; i++)
+  {
+    while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_NOTFULL | SSP_SSP0SR_BSY_BUSY)) != SSP_SSP0SR_TNF_NOTFULL);
+    SSP_SSP0DR = txBuf[i];
+    while ((SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY | SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY);
+    rxBuf[i] = SSP_SSP0DR;
+  }
+}
+
+/**************************************************************************/
+/*! 
+    Times each function for a range of sizes and SPI clock rates.  The
+    16-bit columns move the same number of bytes (size / 2 frames).
+*/
+/**************************************************************************/
+static void benchmark(void)
+{
+  uint8_t *rx = rxBuffer + SSPTEST_GUARD;
+  uint32_t c, s, size, frames;
+  uint32_t tRef, tXfer, tFill, tXfer16;
+
+  for (c = 0; c < sizeof(benchClocks) / sizeof(benchClocks[0]); c++)
+  {
+    SSP_SSP0CR0 = (SSP_SSP0CR0 & ~SSP_SSP0CR0_SCR_MASK) | (benchClocks[c] << 8);
+    printf("%sSPI clock %u kHz (cycles, cycles/byte)%s", CFG_PRINTF_NEWLINE,
+           (unsigned int)(CFG_CPU_CCLK / 2 / (benchClocks[c] + 1) / 1000), CFG_PRINTF_NEWLINE);
+    printf("size   bytewise     sspTransfer  sspFill      sspTransfer16%s", CFG_PRINTF_NEWLINE);
+
+    for (s = 0; s < sizeof(benchSizes) / sizeof(benchSizes[0]); s++)
+    {
+      size = benchSizes[s];
+      frames = size / 2;
+
+      BENCH_START;
+      bytewiseTransfer(txBuffer, rx, size);
+      tRef = BENCH_STOP;
+
+      BENCH_START;
+      sspTransfer(0, txBuffer, rx, size);
+      tXfer = BENCH_STOP;
+
+      BENCH_START;
+      sspFill(0, 0xFF, size);
+      tFill = BENCH_STOP;
+
+      tXfer16 = 0;
+      if (frames)
+      {
+        sspSetDataSize(0, 16);
+        BENCH_START;
+        sspTransfer16(0, tx16Buffer, rx16Buffer, frames);
+        tXfer16 = BENCH_STOP;
+        sspSetDataSize(0, 8);
+      }
+
+      printf("%4u  %6u %4u  %6u %4u  %6u %4u  %6u %4u%s", (unsigned int)size,
+             (unsigned int)tRef, (unsigned int)(tRef / size),
+             (unsigned int)tXfer, (unsigned int)(tXfer / size),
+             (unsigned int)tFill, (unsigned int)(tFill / size),
+             (unsigned int)tXfer16, (unsigned int)(tXfer16 / size),
+             CFG_PRINTF_NEWLINE);
+    }
+  }
+
+  // Back to the sspInit default (4MHz)
+  SSP_SSP0CR0 = (SSP_SSP0CR0 & ~SSP_SSP0CR0_SCR_MASK) | SSP_SSP0CR0_SCR_8;
+}
+
+/**************************************************************************/
+/*! 
+    Main program entry point.  After reset, normal code execution will
+    begin here.
+*/
+/**************************************************************************/
+int main(void)
+{
+  // Configure cpu and mandatory peripherals
+  systemInit();
+
+  sspInit(0, sspClockPolarity_Low, sspClockPhase_RisingEdge);
+  SSP_SSP0CR1 |= SSP_SSP0CR1_LBM_INVERTED;    // Loopback, nothing leaves the chip
+
+  printf("Validating ssp.c (1..%u bytes)%s", SSPTEST_MAXSIZE, CFG_PRINTF_NEWLINE);
+  validate();
+  validationReport();
+
+  benchmark();
+
+  SSP_SSP0CR1 &= ~SSP_SSP0CR1_LBM_MASK;
+
+  while (1)
+  {
+  }
+
+  return validationErrors ? 1 : 0;
+}
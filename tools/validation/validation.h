@@ -0,0 +1,103 @@
+/**************************************************************************/
+/*! 
+    @file     validation.h
+    @author   K. Townsend (microBuilder.eu)
+
+    @brief    Timing and pass/fail reporting shared by the validation
+              programs in tools/validation (see readme.txt)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2012, microBuilder SARL
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#ifndef _VALIDATION_H_
+#define _VALIDATION_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef VALIDATION_HOST
+  #include <stdint.h>
+  #include <time.h>
+  #define CFG_PRINTF_NEWLINE  "\n"
+#else
+  #include "projectconfig.h"
+  #include "core/cpu/cpu.h"
+#endif
+
+/**************************************************************************/
+/*! 
+    BENCH_START restarts the clock and BENCH_STOP reads the time since
+    then, in BENCH_UNIT: CPU cycles from the DWT cycle counter on the
+    target, or nanoseconds on a PC (divide by a repeat count there, as
+    clock() is coarse)
+*/
+/**************************************************************************/
+#ifdef VALIDATION_HOST
+  static clock_t validationStart;
+  #define BENCH_START   (validationStart = clock())
+  #define BENCH_STOP    ((uint32_t)(((clock() - validationStart) * 1000000000ULL) / CLOCKS_PER_SEC))
+  #define BENCH_UNIT    "ns"
+#else
+  #define BENCH_START   CPU_RESET_CYCLECOUNTER
+  #define BENCH_STOP    ((uint32_t)DWT_CYCCNT)
+  #define BENCH_UNIT    "cycles"
+#endif
+
+static uint32_t validationErrors = 0;
+
+/**************************************************************************/
+/*! 
+    Counts a failed check and prints "FAIL: " followed by the message
+*/
+/**************************************************************************/
+static inline void validationFail(const char *format, ...)
+{
+  va_list ap;
+
+  validationErrors++;
+  printf("FAIL: ");
+  va_start(ap, format);
+  vprintf(format, ap);
+  va_end(ap);
+  printf("%s", CFG_PRINTF_NEWLINE);
+}
+
+/**************************************************************************/
+/*! 
+    Prints the number of failed checks so far and returns it
+*/
+/**************************************************************************/
+static inline uint32_t validationReport(void)
+{
+  printf("%u error(s)%s", (unsigned int)validationErrors, CFG_PRINTF_NEWLINE);
+  return validationErrors;
+}
+
+#endif
@@ -38,10 +38,35 @@
     When the sniffer firmware is loaded into the Freakduino, then the Freakduino
     will be in promiscuous mode and will just dump any frames it sees. This
     program takes the frame dump and sends it into Wireshark for analysis. The
-    global header is already set up to inform wireshark that the link layer for
+    section header is already set up to inform wireshark that the link layer for
     all frames will be in IEEE 802.15.4 format. After that, it is up to the user
     to choose any higher layer protocols to decode above 802.15.4 via the
     wireshark "enable protocols" menu. 
+
+    The sniffer sends one SLIP framed record per frame (see
+    drivers/rf/chibi/chb_sniff.h) with a microsecond timestamp taken on the
+    device, so the capture timing isn't skewed by the serial link. The
+    first record is lined up with the PC clock and later ones are placed
+    relative to it using the device timestamps.
+
+    The output is pcapng with nanosecond timestamps. Every channel the
+    sniffer reports gets its own interface, so a channel scan shows up as
+    several interfaces. RSSI, LQI and ED go into the packet comment, a bad
+    CRC sets the CRC error bit of the packet flags and frames the sniffer
+    had to drop are reported in the drop count of the next packet.
+
+    The serial port is read in large non-blocking chunks and each frame is
+    written with a single writev(), so the bridge keeps up with the radio
+    even when printing is off and the link is busy.
+
+    Usage: wsbridge [options] <portname>
+           wsbridge [options] -r <recording>
+
+        -w <file>   write the capture to a file instead of the wireshark pipe
+        -s <file>   save the raw serial stream to a file (for -r)
+        -r <file>   replay a raw serial stream saved with -s as fast as
+                    possible and report the throughput (ex. -w /dev/null)
+        -v          print every frame
 */
 /**************************************************************************/
 #include <stddef.h>
@@ -52,38 +77,94 @@
 #include <time.h>
 #include <stdint.h>
 #include <signal.h>
+#include <poll.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <termios.h>
 
-#define PORTBUFSIZE     32
-#define BUFSIZE         1024
-#define PACKET_FCS      2
-#define DEBUG           1
+#define PORTBUFSIZE     4096
+#define REPLAYBUFSIZE   65536
+#define RECBUFSIZE      160
 #define PIPENAME        "/tmp/wireshark"
 #define BAUDRATE        B115200
 
-enum FSM
-{
-    START_CAPTURE,
-    PACKET_CAPTURE
-};
-
-static int FD_pipe = -1;
+// SLIP framing
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+// sniffer record (see drivers/rf/chibi/chb_sniff.h)
+#define REC_FRAME       0x01
+#define REC_TYPE        0
+#define REC_HDR_LEN     1
+#define REC_TIMESTAMP   2
+#define REC_CHANNEL     6
+#define REC_ED          7
+#define REC_RSSI        8
+#define REC_LQI         9
+#define REC_FLAGS       10
+#define REC_DROPPED     11
+#define REC_LEN         12
+#define REC_MIN_HDR     13
+#define REC_FLAG_CRC_OK (1<<0)
+
+// pcapng
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER       0x1A2B3C4D
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_SHB_USERAPPL     4
+#define PCAPNG_IF_NAME          2
+#define PCAPNG_IF_TSRESOL       9
+#define PCAPNG_EPB_FLAGS        2
+#define PCAPNG_EPB_DROPCOUNT    4
+#define PCAPNG_FLAG_INBOUND     (1<<0)
+#define PCAPNG_FLAG_CRC_ERR     (1<<24)
+#define PCAPNG_OPTBUFSIZE       128
+#define LINKTYPE_IEEE802_15_4   195     // with FCS
+
+#define PAD4(x)         (((x) + 3) & ~3)
+
+static int FD_out = -1;
 static int FD_com = -1;
-static uint8_t port_buf[PORTBUFSIZE];
-static uint8_t circ_buf[BUFSIZE];
-static uint16_t rd_idx = 0;
-static uint16_t wr_idx = 0;
-static uint8_t len;
-static uint8_t state = START_CAPTURE;
-static uint8_t file_write = 0;
+static int FD_save = -1;
+static int verbose = 0;
+static volatile sig_atomic_t quit = 0;
+
+// record being assembled from the SLIP stream
+static uint8_t rec_buf[RECBUFSIZE];
+static uint16_t rec_len = 0;
+static uint8_t rec_esc = 0;
+static uint8_t rec_overrun = 0;
+
+// device timestamp extended to 64 bits, and the PC time it lines up with
+static int ts_valid = 0;
+static uint32_t ts_last;
+static int64_t ts_dev;
+static uint64_t ts_base;
+
+// pcapng interface id for each channel, -1 until the first frame on it
+static int if_id[256];
+static int if_cnt = 0;
+
+// stats
+static uint64_t stat_bytes = 0;
+static uint32_t stat_frames = 0;
+static uint32_t stat_bad = 0;
+static uint32_t stat_crc = 0;
+static uint32_t stat_dropped = 0;
 
 /**************************************************************************/
 /*!
     Open the serial port that we'll be communicating with the Freakduino (sniffer)
-    through.
+    through. The port is put in raw mode so that no bytes get translated, and
+    is non-blocking since it's read from a poll() loop.
 */
 /**************************************************************************/
 static int serial_open(char *portname)
@@ -91,7 +172,7 @@ static int serial_open(char *portname)
     int FD_com; // file descriptor for the serial port
     struct termios term;
 
-    FD_com = open(portname, O_RDONLY | O_NOCTTY | O_NDELAY);
+    FD_com = open(portname, O_RDONLY | O_NOCTTY | O_NONBLOCK);
     
     if(FD_com == -1) // if open is unsucessful
     {
@@ -99,6 +180,9 @@ static int serial_open(char *portname)
     }
     else
     {
+        tcgetattr(FD_com, &term);
+        cfmakeraw(&term);
+
         // set speed of port
         cfsetspeed(&term, BAUDRATE);
 
@@ -119,9 +203,9 @@ static int serial_open(char *portname)
     Create the named pipe that we will be communicating with wireshark through.
 */
 /**************************************************************************/
-static void named_pipe_create(char *name)
+static int named_pipe_create(char *name)
 {
-    int rv = 0;
+    int rv = 0, fd;
     rv = mkfifo(name, 0666);
     if ((rv == -1) && (errno != EEXIST)) 
     {
@@ -129,150 +213,326 @@ static void named_pipe_create(char *name)
         exit(1);
     }
 
-    FD_pipe = open(name, O_WRONLY);
+    fd = open(name, O_WRONLY);
 
-    if (FD_pipe == -1) 
+    if (fd == -1) 
     {
         perror("Error connecting to named pipe");
         exit(1);
     }
+    return fd;
 }
 
 /**************************************************************************/
 /*!
-    Write data to the pipe
+    Write one block to the output in a single call. A pipe write of up to
+    PIPE_BUF bytes is atomic, so wireshark never sees part of a block.
 */
 /**************************************************************************/
-size_t data_write(const void *ptr, size_t size)
+static void data_writev(struct iovec *iov, int cnt)
 {
-    ssize_t bytes = 0;
-    if (FD_pipe != -1) 
+    if (FD_out == -1)
     {
-        bytes = write(FD_pipe, ptr, size);
+        return;
+    }
+
+    if (writev(FD_out, iov, cnt) == -1)
+    {
+        perror("Error writing capture");
+        quit = 1;
     }
 }
 
 /**************************************************************************/
 /*!
-    Write the global header to wireshark. This is only done once at the
-    beginning of the capture. 
+    Append a pcapng option to buf, padded to 32 bits. Returns the new end.
 */
 /**************************************************************************/
-static void write_global_hdr()
+static uint8_t *opt_add(uint8_t *buf, uint16_t code, const void *val, uint16_t len)
 {
-    uint32_t magic_number = 0xa1b2c3d4; /* magic number */
-    uint16_t version_major = 2; /* major version number */
-    uint16_t version_minor = 4; /* minor version number */
-    int32_t thiszone = 0;       /* GMT to local correction */
-    uint32_t sigfigs = 0;       /* accuracy of timestamps */
-    uint32_t snaplen = 65535;   /* max length of captured packets, in octets */
-    uint32_t network = 195;     /* data link type (DLT) - IEEE 802.15.4 */
-
-    data_write(&magic_number, sizeof(magic_number));
-    data_write(&version_major, sizeof(version_major));
-    data_write(&version_minor, sizeof(version_minor));
-    data_write(&thiszone, sizeof(thiszone));
-    data_write(&sigfigs, sizeof(sigfigs));
-    data_write(&snaplen, sizeof(snaplen));
-    data_write(&network, sizeof(network));
+    memcpy(buf, &code, 2);
+    memcpy(buf + 2, &len, 2);
+    memcpy(buf + 4, val, len);
+    memset(buf + 4 + len, 0, PAD4(len) - len);
+    return buf + 4 + PAD4(len);
 }
 
 /**************************************************************************/
 /*!
-    Write the frame header into wireshark. This is required for the libpcap
-    format and informs wireshark that a new frame is coming.
+    Write a pcapng block: the type and length, the fixed body, the options
+    and the trailing length.
 */
 /**************************************************************************/
-static void write_frame_hdr(uint8_t len)
+static void write_block(uint32_t type, void *body, uint32_t body_len,
+                        void *data, uint32_t data_len, uint8_t *opts, uint32_t opts_len)
 {
-    uint32_t ts_sec;    /* timestamp seconds */
-    uint32_t ts_usec;   /* timestamp microseconds */
-    uint32_t incl_len;  /* number of octets of packet saved in file */
-    uint32_t orig_len;  /* actual length of packet */
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
-    ts_sec      = tv.tv_sec;
-    ts_usec     = tv.tv_usec;
-    incl_len    = len;
-    orig_len    = len + PACKET_FCS;
-
-    data_write(&ts_sec, sizeof(ts_sec));
-    data_write(&ts_usec, sizeof(ts_usec));
-    data_write(&incl_len, sizeof(incl_len));
-    data_write(&orig_len, sizeof(orig_len));
+    static const uint8_t pad[4] = {0};
+    uint32_t hdr[2], len;
+    struct iovec iov[6];
+
+    len = 12 + body_len + PAD4(data_len) + opts_len;
+    hdr[0] = type;
+    hdr[1] = len;
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = body;
+    iov[1].iov_len = body_len;
+    iov[2].iov_base = data;
+    iov[2].iov_len = data_len;
+    iov[3].iov_base = (void *)pad;
+    iov[3].iov_len = PAD4(data_len) - data_len;
+    iov[4].iov_base = opts;
+    iov[4].iov_len = opts_len;
+    iov[5].iov_base = &len;
+    iov[5].iov_len = sizeof(len);
+    data_writev(iov, 6);
 }
 
 /**************************************************************************/
 /*!
-    Write one frame into wireshark (via the pipe).
+    Write the section header to wireshark. This is only done once at the
+    beginning of the capture. 
 */
 /**************************************************************************/
-static void write_frame(uint8_t frame_len)
+static void write_section_hdr()
 {
-    uint8_t i;
-
-    // actual frame length for wireshark should not include FCS
-    frame_len -= PACKET_FCS;
-
-    // write header to inform WS that new frame has arrived
-    write_frame_hdr(frame_len);
+    uint8_t opts[PCAPNG_OPTBUFSIZE], *p = opts;
+    struct
+    {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int64_t section_len;
+    } __attribute__((packed)) shb = { PCAPNG_BYTE_ORDER, 1, 0, -1 };
+
+    p = opt_add(p, PCAPNG_SHB_USERAPPL, "wsbridge", 8);
+    p = opt_add(p, PCAPNG_OPT_END, NULL, 0);
+    write_block(PCAPNG_SHB, &shb, sizeof(shb), NULL, 0, opts, p - opts);
+}
 
-    // bump rd_idx. we don't want to write the length byte
-    rd_idx = (rd_idx + 1) % BUFSIZE;
+/**************************************************************************/
+/*!
+    Get the interface for a channel, describing it to wireshark the first
+    time the channel is seen.
+*/
+/**************************************************************************/
+static uint32_t channel_if(uint8_t channel)
+{
+    uint8_t opts[PCAPNG_OPTBUFSIZE], *p = opts;
+    uint8_t tsresol = 9;    // nanoseconds
+    char name[16];
+    struct
+    {
+        uint16_t linktype;
+        uint16_t reserved;
+        uint32_t snaplen;
+    } idb = { LINKTYPE_IEEE802_15_4, 0, 0 };
 
-    // write frame into wireshark
-    for (i=0; i<frame_len; i++)
+    if (if_id[channel] == -1)
     {
-        data_write(&circ_buf[rd_idx], 1);
-        rd_idx = (rd_idx + 1) % BUFSIZE;
+        snprintf(name, sizeof(name), "chibi-ch%d", channel);
+        p = opt_add(p, PCAPNG_IF_NAME, name, strlen(name));
+        p = opt_add(p, PCAPNG_IF_TSRESOL, &tsresol, 1);
+        p = opt_add(p, PCAPNG_OPT_END, NULL, 0);
+        write_block(PCAPNG_IDB, &idb, sizeof(idb), NULL, 0, opts, p - opts);
+        if_id[channel] = if_cnt++;
     }
-
-    // bump rd_idx. we're not using the trailing FCS value
-    rd_idx = (rd_idx + 1) % BUFSIZE;
+    return if_id[channel];
 }
 
 /**************************************************************************/
 /*!
-    Calculate total number of bytes in buffer.
+    Turn the 32-bit microsecond device timestamp into PC time in ns. The
+    first record is lined up with the PC clock. After that the device clock
+    is followed, so the spacing between frames is exact.
 */
 /**************************************************************************/
-static uint16_t calc_bytes_in_buf()
+static uint64_t frame_time(uint32_t ts)
 {
-    if (rd_idx > wr_idx)
+    struct timespec now;
+
+    if (!ts_valid)
     {
-        // read index is greater than write. we must have wrapped around
-        return (BUFSIZE - (rd_idx - wr_idx));
+        clock_gettime(CLOCK_REALTIME, &now);
+        ts_base = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        ts_dev = 0;
+        ts_valid = 1;
     }
     else
     {
-        return (wr_idx - rd_idx);
+        // the difference handles the 32-bit wrap around. it's signed since
+        // frames are stamped with their start but sent in the order they
+        // ended, which differ when frames overlap (collisions)
+        ts_dev += (int32_t)(ts - ts_last);
     }
+    ts_last = ts;
+    return ts_base + ts_dev * 1000;
 }
 
 /**************************************************************************/
 /*!
-    Deal with any received signals. This includes ctrl-C to stop the program.
+    Handle one complete (SLIP decoded) record from the sniffer and write
+    the frame into wireshark as an enhanced packet block. The frame is
+    passed on with its FCS so that wireshark can check it too.
 */
 /**************************************************************************/
-static void sig_int(int signo)
+static void write_record(uint8_t *rec, uint16_t len)
 {
-    (void) signo;
-    if (FD_pipe != -1) 
+    uint8_t opts[PCAPNG_OPTBUFSIZE], *p = opts;
+    uint8_t hdr_len, frame_len;
+    uint32_t ts, flags;
+    uint64_t t, dropped;
+    char comment[64];
+    int n;
+    struct
+    {
+        uint32_t if_id;
+        uint32_t ts_high;
+        uint32_t ts_low;
+        uint32_t cap_len;
+        uint32_t orig_len;
+    } epb;
+
+    // make sure the record is complete before trusting the length fields.
+    // anything else is line noise or a record that lost bytes
+    if ((len < REC_MIN_HDR) || (rec[REC_TYPE] != REC_FRAME))
     {
-        printf("\nClosing pipe.\n");
-        close(FD_pipe);
+        stat_bad++;
+        return;
     }
+    hdr_len = rec[REC_HDR_LEN];
+    frame_len = rec[REC_LEN];
+    if ((hdr_len < REC_MIN_HDR) || (len != hdr_len + frame_len))
+    {
+        stat_bad++;
+        return;
+    }
+
+    ts = rec[REC_TIMESTAMP] | (rec[REC_TIMESTAMP+1] << 8) |
+         (rec[REC_TIMESTAMP+2] << 16) | ((uint32_t)rec[REC_TIMESTAMP+3] << 24);
+    t = frame_time(ts);
 
-    if (FD_com != -1)
+    stat_frames++;
+    stat_dropped += rec[REC_DROPPED];
+    flags = PCAPNG_FLAG_INBOUND;
+    if (!(rec[REC_FLAGS] & REC_FLAG_CRC_OK))
     {
-        printf("\nClosing serial port.\n");
-        close(FD_com);
+        flags |= PCAPNG_FLAG_CRC_ERR;
+        stat_crc++;
     }
 
-    printf("\nSignal captured and devices shut down.\n");
+    n = snprintf(comment, sizeof(comment), "ch %d rssi %d dBm lqi %d ed %d",
+                 rec[REC_CHANNEL], (int8_t)rec[REC_RSSI], rec[REC_LQI], rec[REC_ED]);
+    p = opt_add(p, PCAPNG_OPT_COMMENT, comment, n);
+    p = opt_add(p, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+    if (rec[REC_DROPPED])
+    {
+        dropped = rec[REC_DROPPED];
+        p = opt_add(p, PCAPNG_EPB_DROPCOUNT, &dropped, sizeof(dropped));
+    }
+    p = opt_add(p, PCAPNG_OPT_END, NULL, 0);
+
+    epb.if_id = channel_if(rec[REC_CHANNEL]);
+    epb.ts_high = t >> 32;
+    epb.ts_low = t & 0xffffffff;
+    epb.cap_len = frame_len;
+    epb.orig_len = frame_len;
+    write_block(PCAPNG_EPB, &epb, sizeof(epb), &rec[hdr_len], frame_len, opts, p - opts);
+
+    if (verbose)
+    {
+        uint8_t i;
 
-    exit(0);
+        printf("%10u us  %s  %s\n", ts, comment,
+               (rec[REC_FLAGS] & REC_FLAG_CRC_OK) ? "crc ok" : "CRC BAD");
+        for (i=0; i<frame_len; i++)
+        {
+            printf("%02X ", rec[hdr_len + i]);
+        }
+        printf("\n");
+    }
+}
+
+/**************************************************************************/
+/*!
+    Feed a chunk from the serial port into the SLIP decoder. Bytes are
+    collected until the END marker, then the record is handled. A record
+    that is too long (END lost) is dropped and the decoder picks up again
+    at the next END.
+*/
+/**************************************************************************/
+static void slip_rx(const uint8_t *buf, int len)
+{
+    uint8_t c;
+    int i;
+
+    stat_bytes += len;
+    for (i=0; i<len; i++)
+    {
+        c = buf[i];
+        if (c == SLIP_END)
+        {
+            if (rec_overrun)
+            {
+                stat_bad++;
+            }
+            else if (rec_len)
+            {
+                write_record(rec_buf, rec_len);
+            }
+            rec_len = 0;
+            rec_esc = 0;
+            rec_overrun = 0;
+            continue;
+        }
+
+        if (c == SLIP_ESC)
+        {
+            rec_esc = 1;
+            continue;
+        }
+
+        if (rec_esc)
+        {
+            c = (c == SLIP_ESC_END) ? SLIP_END : (c == SLIP_ESC_ESC) ? SLIP_ESC : c;
+            rec_esc = 0;
+        }
+
+        if (rec_len < RECBUFSIZE)
+        {
+            rec_buf[rec_len++] = c;
+        }
+        else
+        {
+            rec_overrun = 1;
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Print what has been captured so far
+*/
+/**************************************************************************/
+static void print_stats()
+{
+    printf("%llu bytes, %u frames (%u with a bad CRC), %u bad records, "
+           "%u dropped by the sniffer, %d channels\n",
+           (unsigned long long)stat_bytes, stat_frames, stat_crc, stat_bad,
+           stat_dropped, if_cnt);
+}
+
+/**************************************************************************/
+/*!
+    Deal with any received signals. This includes ctrl-C to stop the program.
+    The main loop notices the flag and shuts everything down.
+*/
+/**************************************************************************/
+static void sig_int(int signo)
+{
+    (void) signo;
+    quit = 1;
 }
 
 /**************************************************************************/
@@ -282,138 +542,184 @@ static void sig_int(int signo)
 /**************************************************************************/
 static void signal_init(void)
 {
-    signal(SIGINT, sig_int);
-    signal(SIGHUP, sig_int);
-    signal(SIGTERM, sig_int);
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_int;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
 }
 
 /**************************************************************************/
 /*!
-    Here's the meat of the code.
+    Replay a raw serial stream saved with -s as fast as possible and report
+    how long it took.
 */
 /**************************************************************************/
-int main(int argc, char *argv[])
+static void replay(int fd)
 {
+    static uint8_t buf[REPLAYBUFSIZE];
+    struct timespec start, end;
+    double secs;
     int nbytes;
-    uint8_t i;
 
-    // capture any signals that will terminate program
-    signal_init();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!quit && ((nbytes = read(fd, buf, sizeof(buf))) > 0))
+    {
+        slip_rx(buf, nbytes);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    print_stats();
+    printf("replayed in %.3f s: %.0f frames/s, %.2f MB/s (the serial link carries %.3f MB/s)\n",
+           secs, stat_frames / secs, stat_bytes / secs / 1e6, 11520 / 1e6);
+}
+
+/**************************************************************************/
+/*!
+    Read the serial port until told to stop. poll() waits for data, then
+    everything the driver has buffered is taken in one read.
+*/
+/**************************************************************************/
+static void capture(int fd)
+{
+    static uint8_t buf[PORTBUFSIZE];
+    struct pollfd pfd;
+    int nbytes;
 
-    // make sure the COM port is specified
-    if (argc == 2) 
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (!quit)
     {
-        // open the COM port
-        if ((FD_com = serial_open(argv[1])) == -1)
+        if (poll(&pfd, 1, 1000) <= 0)
         {
-            printf("Serial port not opened.\n");
-            return 0;
+            continue;
         }
-        else
+
+        while ((nbytes = read(fd, buf, sizeof(buf))) > 0)
+        {
+            if (FD_save != -1)
+            {
+                if (write(FD_save, buf, nbytes) != nbytes)
+                {
+                    perror("Error saving the serial stream");
+                    FD_save = -1;
+                }
+            }
+            slip_rx(buf, nbytes);
+        }
+
+        if ((nbytes == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+        {
+            printf("Serial port closed.\n");
+            break;
+        }
+
+        if (verbose)
         {
-            printf("Serial port connected. Waiting for wireshark connection.\n");
-            printf("Open wireshark and connect to local interface: %s\n", PIPENAME);
+            fflush(stdout);
         }
     }
-    else
+}
+
+/**************************************************************************/
+/*!
+    Here's the meat of the code.
+*/
+/**************************************************************************/
+int main(int argc, char *argv[])
+{
+    char *outfile = NULL, *savefile = NULL, *replayfile = NULL;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "w:s:r:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w': outfile = optarg; break;
+            case 's': savefile = optarg; break;
+            case 'r': replayfile = optarg; break;
+            case 'v': verbose = 1; break;
+            default: optind = argc + 1; break;
+        }
+    }
+
+    if ((replayfile && (optind != argc)) || (!replayfile && (optind != argc - 1)))
     {
-        printf("Usage: wsbridge <portname>.\n");
+        printf("Usage: wsbridge [-w <file>] [-s <file>] [-v] <portname>\n");
+        printf("       wsbridge [-w <file>] [-v] -r <recording>\n");
         return 0;
     }
 
+    for (i=0; i<256; i++)
+    {
+        if_id[i] = -1;
+    }
 
-    // create and open pipe for wireshark
-    named_pipe_create(PIPENAME);
+    // capture any signals that will terminate program
+    signal_init();
 
-    // wait for wireshark to connect to pipe. Once wireshark
-    // connects, then the global header will be written to it.
-    if (FD_pipe != -1)
+    // open the COM port or the recording
+    if (replayfile)
     {
-        write_global_hdr();
-        printf("Client connected to pipe.\n");
+        if ((FD_com = open(replayfile, O_RDONLY)) == -1)
+        {
+            printf("Unable to open %s.\n", replayfile);
+            return 0;
+        }
+    }
+    else if ((FD_com = serial_open(argv[optind])) == -1)
+    {
+        printf("Serial port not opened.\n");
+        return 0;
     }
 
-    for (;;) 
+    if (savefile && ((FD_save = open(savefile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1))
     {
-        uint16_t bytes_in_buf;
-        uint8_t frame_len, byte_ctr;
+        printf("Unable to create %s.\n", savefile);
+        return 0;
+    }
 
-        // wait for data to come in on the serial port
-        if ((nbytes = read(FD_com, port_buf, PORTBUFSIZE)) > 0)
+    if (outfile)
+    {
+        if ((FD_out = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
         {
-            // write data to circular buffer. loop through all received bytes
-            for (i=0; i<nbytes; i++)
-            {
-                switch (state)
-                {
-                    case START_CAPTURE:
-                        // new frame starting
-                        len = port_buf[i];
-                        byte_ctr = 0;
-
-                        printf("Len = %02X.\n", len);
-
-                        circ_buf[wr_idx] = len;
-                        wr_idx = (wr_idx + 1) % BUFSIZE;
-                        state = PACKET_CAPTURE;
-                        break;
-
-
-                    case PACKET_CAPTURE:
-                        // continue capturing bytes until end of frame
-
-                        // write data to circular buffer and increment index
-                        circ_buf[wr_idx] = port_buf[i];
-                        
-                        printf("%02X ", circ_buf[wr_idx]);
-
-                        wr_idx = (wr_idx + 1) % BUFSIZE;
-
-                        // track number of received bytes. when received bytes
-                        // equals frame length, then restart state machine and 
-                        // write bytes to wireshark
-                        byte_ctr++;
-                        if (byte_ctr == (len - 1))
-                        {
-                            state = START_CAPTURE;
-                            file_write = 1;
-                            printf("\n");
-                        }
-                        break;
-                }
-                fflush(stdout);
-            }
-
-            // at least one frame has been written. loop through circular buffer 
-            // and write out all completed frames
-            while (file_write)
-            {
-                // capture frame length and check buffer to see if one or more frames 
-                // are available.
-                frame_len = circ_buf[rd_idx];
-                bytes_in_buf = calc_bytes_in_buf();
-            
-                if (bytes_in_buf > frame_len)
-                {
-                    // if more than one frame is available, then write one frame to 
-                    // wireshark and then see if any more are available.
-                    write_frame(frame_len);
-                }
-                else if (bytes_in_buf == frame_len)
-                {
-                    // only one frame is available. write to wireshark and then quit
-                    // the loop
-                    write_frame(frame_len);
-                    file_write = 0;
-                }
-                else
-                {
-                    // less than one frame is available. quit the loop and collect more 
-                    // bytes. we normally should not get here.
-                    file_write = 0;
-                }
-            }
+            printf("Unable to create %s.\n", outfile);
+            return 0;
         }
     }
-}
+    else
+    {
+        // create and open pipe for wireshark. this waits for wireshark to
+        // connect to the pipe
+        printf("Waiting for wireshark connection.\n");
+        printf("Open wireshark and connect to local interface: %s\n", PIPENAME);
+        FD_out = named_pipe_create(PIPENAME);
+        printf("Client connected to pipe.\n");
+    }
 
+    // the section header is only written once at the start
+    write_section_hdr();
+
+    if (replayfile)
+    {
+        replay(FD_com);
+    }
+    else
+    {
+        capture(FD_com);
+        print_stats();
+    }
+
+    close(FD_out);
+    close(FD_com);
+    if (FD_save != -1)
+    {
+        close(FD_save);
+    }
+    return 0;
+}
@@ -10,25 +10,42 @@ namespace wsbridge
         static NamedPipeServerStream wspipe;
         static BinaryWriter ws;
         static SerialPort p;
-        const uint BUFSIZE = 1024;
-        static byte[] b = new byte[BUFSIZE];
-        static uint wr_idx = 0;
-        static uint rd_idx = 0;
-        static byte len;
-        static FSM state;
-        static bool file_write = false;
+        const int RECBUFSIZE = 160;
+        static byte[] rec = new byte[RECBUFSIZE];
+        static int rec_len = 0;
+        static bool rec_esc = false;
+        static bool rec_overrun = false;
         static long start_time_in_ticks;
-        static byte byte_ctr;
         static String port;
 
-        enum FSM
-        {
-            START_CAPTURE,
-            PACKET_CAPTURE
-        }
+        // device timestamp extended to 64 bits. the first record is lined up with
+        // the time the capture started and later ones follow the device clock
+        static bool ts_valid = false;
+        static uint ts_last;
+        static long ts_dev;
+        static long ts_base;
+
+        // SLIP framing
+        const byte SLIP_END = 0xC0;
+        const byte SLIP_ESC = 0xDB;
+        const byte SLIP_ESC_END = 0xDC;
+        const byte SLIP_ESC_ESC = 0xDD;
+
+        // sniffer record (see drivers/rf/chibi/chb_sniff.h)
+        const byte REC_FRAME = 0x01;
+        const int REC_TYPE = 0;
+        const int REC_HDR_LEN = 1;
+        const int REC_TIMESTAMP = 2;
+        const int REC_CHANNEL = 6;
+        const int REC_ED = 7;
+        const int REC_RSSI = 8;
+        const int REC_LQI = 9;
+        const int REC_FLAGS = 10;
+        const int REC_DROPPED = 11;
+        const int REC_LEN = 12;
+        const int REC_MIN_HDR = 13;
+        const byte REC_FLAG_CRC_OK = 0x01;
 
-        const int PACKET_FCS = 2;
-        const int PACKET_LEN = 1;
         const bool DEBUG_PRINT = true;
 
         static void Main(string[] args)
@@ -91,7 +108,6 @@ namespace wsbridge
 
             // add serial data capture
             p.DataReceived += new SerialDataReceivedEventHandler(serialPort_DataReceived);
-            state = FSM.START_CAPTURE;
             
             // keep track of time started. this will be used for timestamps
             start_time_in_ticks = DateTime.Now.Ticks; 
@@ -105,100 +121,73 @@ namespace wsbridge
             }
         }
 
-        // serial port handler. this gets executed whenever data is available on the serial port
+        // serial port handler. this gets executed whenever data is available on the serial port.
+        // the sniffer sends one SLIP framed record per frame. bytes are collected until the 
+        // END marker and then the record is written into wireshark
         static void serialPort_DataReceived(object sender, System.IO.Ports.SerialDataReceivedEventArgs e)
         {
-            uint frame_len, bytes_in_buf;
+            byte c;
 
             // loop until serial port buffer is empty
             while (p.BytesToRead != 0)
             {
-                switch (state)
-                {
-                    case FSM.START_CAPTURE:
-                        // starting a new frame. the first byte will indicate the length
-                        len = (byte)p.ReadByte();
-                        b[wr_idx] = len;
-                        byte_ctr = 0;
-
-                        if (DEBUG_PRINT)
-                        {
-                            Console.WriteLine();
-                            Console.Write(String.Format("{0,2:X}", b[wr_idx]) + ' ');
-                        }
-
-                        // increment the buffer index and wrap back to 0 if it reaches the max size
-                        // (standard circular buffer behavior)
-                        wr_idx = (wr_idx + 1) % BUFSIZE;
-                        state = FSM.PACKET_CAPTURE;
-                        break;
-
-                    case FSM.PACKET_CAPTURE:
-                        // capture bytes until the total length of the frame
-                        b[wr_idx] = (byte)p.ReadByte();
-
-                        if (DEBUG_PRINT)
-                        {
-                            Console.Write(String.Format("{0,2:X}", b[wr_idx]) + ' ');
-                        }
+                c = (byte)p.ReadByte();
 
-                        wr_idx = (wr_idx + 1) % BUFSIZE;
-                        byte_ctr++;
-
-                        // we've captured all bytes in frame. tell the next section we're ready to write
-                        // the frame into wireshark
-                        if (byte_ctr == (len - 1))
-                        {
-                            state = FSM.START_CAPTURE;
-                            file_write = true;
-                        }
-                        break;
+                if (c == SLIP_END)
+                {
+                    if ((rec_len > 0) && !rec_overrun)
+                    {
+                        write_record();
+                    }
+                    rec_len = 0;
+                    rec_esc = false;
+                    rec_overrun = false;
+                    continue;
                 }
-            }
 
-            // at least one frame has been captured. write it into wireshark
-            while (file_write == true)
-            {
-                frame_len = b[rd_idx];
-                bytes_in_buf = calc_bytes_in_buf();
+                if (c == SLIP_ESC)
+                {
+                    rec_esc = true;
+                    continue;
+                }
 
-                // compare the frame lengto the number of bytes in the buffer. if the bytes in buffer are
-                // greater than the frame length, then we have more than one frame. loop through until 
-                // all complete frames have been written to wireshark
-                if (bytes_in_buf > frame_len)
+                if (rec_esc)
                 {
-                    // more than one frame in buffer. don't indicate we're finished yet in case we have 
-                    // other frames we can send out.
-                    write_frame(frame_len);
+                    if (c == SLIP_ESC_END) c = SLIP_END;
+                    else if (c == SLIP_ESC_ESC) c = SLIP_ESC;
+                    rec_esc = false;
                 }
-                else if (bytes_in_buf == frame_len)
+
+                if (rec_len < RECBUFSIZE)
                 {
-                    // only one frame in buffer. indicate we're finished after we write this frame out.
-                    write_frame(frame_len);
-                    file_write = false;
+                    rec[rec_len++] = c;
                 }
                 else
                 {
-                    // what?! no frames in buffer? we shouldn't reach here. 
-                    file_write = false;
+                    // no END seen for too long. drop everything up to the next one
+                    rec_overrun = true;
                 }
             }
         }
 
-        // return the number of bytes in the buffer
-        static uint calc_bytes_in_buf()
+        // turn the 32-bit microsecond device timestamp into capture time (in usec). the
+        // difference is signed since frames are stamped with their start but sent in the
+        // order they ended, which differ when frames overlap (collisions)
+        static long frame_time(uint ts)
         {
-            if (rd_idx > wr_idx)
+            if (!ts_valid)
             {
-                // since we're using a circular buffer, its possible for the write index to be less
-                // than the read index if a wraparound occurred. handle this case here.
-                return (BUFSIZE - (rd_idx - wr_idx));
+                // each tick is 100 nsec
+                ts_base = (DateTime.Now.Ticks - start_time_in_ticks) / 10;
+                ts_dev = 0;
+                ts_valid = true;
             }
             else
             {
-                // normal way to calculate bytes in the buffer
-                return (wr_idx - rd_idx);
+                ts_dev += (int)(ts - ts_last);
             }
+            ts_last = ts;
+            return ts_base + ts_dev;
         }
 
         // this is the global header that starts any packet capture file. this will tell wireshark what 
@@ -250,45 +239,62 @@ namespace wsbridge
             }
        }
 
-        // this writes a frame into wireshark. it calculates the timestamp and length and uses that 
-        // for the frame header. it then writes captured bytes into wireshark
-        static void write_frame(uint frame_len)
+        // this writes the frame from a complete record into wireshark. the timestamp comes
+        // from the device so it isn't skewed by the serial link. the FCS is passed on so 
+        // that wireshark can flag the frames with a bad CRC
+        static void write_record()
         {
-            uint incl_len, orig_len;
-            long sec, usec;
-
-            // generating timestamp. its kind of cheesy but there isn't a unix timestamp mechanism in win. 
-            // just counting ticks from when program was started. each tick is 100 nsec. 
-            long diff_in_ticks = DateTime.Now.Ticks - start_time_in_ticks;  // get difference in ticks
-            sec = diff_in_ticks / TimeSpan.TicksPerSecond;                  // get seconds
-            diff_in_ticks -= (sec * TimeSpan.TicksPerSecond);               // subtract off seconds from total
-            usec = diff_in_ticks / 10;                                      // get usec
-
-            // calculate frame length. we won't be feeding frame checksum (FCS) into wireshark. 
-            incl_len = (uint)frame_len - PACKET_FCS;
-            orig_len = frame_len;
+            int hdr_len, frame_len;
+            uint ts;
+            long usec;
 
-            // increment over the length byte. we won't feed that into wireshark either. it doesn't seem to like it. 
-            rd_idx = (rd_idx + 1) % BUFSIZE;
+            // make sure the record is complete before trusting the length fields
+            if ((rec_len < REC_MIN_HDR) || (rec[REC_TYPE] != REC_FRAME))
+            {
+                return;
+            }
+            hdr_len = rec[REC_HDR_LEN];
+            frame_len = rec[REC_LEN];
+            if ((hdr_len < REC_MIN_HDR) || (rec_len != hdr_len + frame_len))
+            {
+                Console.WriteLine("Bad record (" + rec_len + " bytes). Dropped.");
+                return;
+            }
 
-            // write frame header first
-            write_frm_hdr(sec, usec, incl_len, orig_len);
+            ts = (uint)(rec[REC_TIMESTAMP] | (rec[REC_TIMESTAMP + 1] << 8) |
+                        (rec[REC_TIMESTAMP + 2] << 16) | (rec[REC_TIMESTAMP + 3] << 24));
 
-            // loop through entire length and write data into wireshark
-            for (int i = 0; i < incl_len; i++)
+            if (DEBUG_PRINT)
             {
-                try
+                Console.Write(String.Format("{0,10} us  ch {1,2}  rssi {2,4} dBm  ed {3,2}  lqi {4,3}  {5}",
+                    ts, rec[REC_CHANNEL], (sbyte)rec[REC_RSSI], rec[REC_ED], rec[REC_LQI],
+                    ((rec[REC_FLAGS] & REC_FLAG_CRC_OK) != 0) ? "crc ok " : "CRC BAD"));
+                if (rec[REC_DROPPED] != 0)
                 {
-                    ws.Write(b[rd_idx]);
+                    Console.Write("  (" + rec[REC_DROPPED] + " dropped before)");
                 }
-                catch
+                Console.WriteLine();
+                for (int i = 0; i < frame_len; i++)
                 {
-                    Console.WriteLine("Pipe has been closed.");
-                    close();
+                    Console.Write(String.Format("{0,2:X}", rec[hdr_len + i]) + ' ');
                 }
-                rd_idx = (rd_idx + 1) % BUFSIZE;
+                Console.WriteLine();
+            }
+
+            usec = frame_time(ts);
+
+            // write frame header first
+            write_frm_hdr(usec / 1000000, usec % 1000000, (uint)frame_len, (uint)frame_len);
+
+            try
+            {
+                ws.Write(rec, hdr_len, frame_len);
+            }
+            catch
+            {
+                Console.WriteLine("Pipe has been closed.");
+                close();
             }
-            rd_idx = (rd_idx + 1) % BUFSIZE;
         }
 
         // Received some type of termination. Close everything and wrap up.